@@ -0,0 +1,268 @@
+/****************************************************************
+ *
+ * checkpoint.c: binary checkpoints of the optimizer state
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2014
+ * 	Institute for Theoretical and Applied Physics
+ * 	University of Stuttgart, D-70550 Stuttgart, Germany
+ *	http://potfit.sourceforge.net/
+ *
+ ****************************************************************
+ *
+ *   This file is part of potfit.
+ *
+ *   potfit is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   potfit is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+
+#include "potfit.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "utils.h"
+
+#define CKPT_MAGIC "potfitck"
+#define CKPT_VERSION 1
+
+/****************************************************************
+ *
+ *  A checkpoint file consists of a header with the global state
+ *  (parameter vector, RNG state and number of force calls)
+ *  followed by the payload of the optimizer which wrote it.
+ *  It is written to a temporary file which replaces the old
+ *  checkpoint only when complete, so a crash during writing
+ *  always leaves a usable file behind. With checkpoint_interval
+ *  > 0 at most one checkpoint is written per interval.
+ *
+ ****************************************************************/
+
+static int ckpt_stage = 0;	/* stage of a pending restart */
+static int ckpt_write = 0;	/* direction of checkpoint_data */
+static long ckpt_offset = 0;	/* start of the optimizer payload */
+static char ckpt_tmpfile[260];
+static time_t ckpt_last = 0;	/* time of the last checkpoint */
+
+/****************************************************************
+ *
+ *  checkpoint_data: read or write a block of the checkpoint
+ *
+ ****************************************************************/
+
+void checkpoint_data(FILE *ckpt, void *data, size_t size, size_t count)
+{
+  if (ckpt_write) {
+    if (fwrite(data, size, count, ckpt) != count)
+      error(1, "Could not write checkpoint file %s\n", ckpt_tmpfile);
+  } else {
+    if (fread(data, size, count, ckpt) != count)
+      error(1, "Checkpoint file %s is truncated\n", checkpointfile);
+  }
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  header_data: global state, identical for all optimizers
+ *
+ ****************************************************************/
+
+static void header_data(FILE *ckpt, int *stage)
+{
+  char  magic[8];
+  int   version = CKPT_VERSION;
+  int   len = opt_pot.len, idxlen = opt_pot.idxlen, m = mdim;
+  int   nd_have;
+  double nd_val;
+#ifndef APOT
+  int   ncols = opt_pot.ncols;
+#endif /* !APOT */
+
+  memcpy(magic, CKPT_MAGIC, 8);
+  get_normdist_state(&nd_have, &nd_val);
+
+  checkpoint_data(ckpt, magic, sizeof(char), 8);
+  if (0 != memcmp(magic, CKPT_MAGIC, 8))
+    error(1, "%s is not a potfit checkpoint file\n", checkpointfile);
+  checkpoint_data(ckpt, &version, sizeof(int), 1);
+  if (CKPT_VERSION != version)
+    error(1, "Checkpoint file %s has unsupported version %d\n", checkpointfile, version);
+  checkpoint_data(ckpt, stage, sizeof(int), 1);
+  checkpoint_data(ckpt, &len, sizeof(int), 1);
+  checkpoint_data(ckpt, &idxlen, sizeof(int), 1);
+  checkpoint_data(ckpt, &m, sizeof(int), 1);
+  if (len != opt_pot.len || idxlen != opt_pot.idxlen || m != mdim)
+    error(1, "Checkpoint file %s does not match the current potential and configuration\n",
+      checkpointfile);
+  checkpoint_data(ckpt, &fcalls, sizeof(int), 1);
+  checkpoint_data(ckpt, &dsfmt, sizeof(dsfmt_t), 1);
+  checkpoint_data(ckpt, &nd_have, sizeof(int), 1);
+  checkpoint_data(ckpt, &nd_val, sizeof(double), 1);
+  checkpoint_data(ckpt, opt_pot.table, sizeof(double), len);
+#ifndef APOT
+  /* the sampling points may have been moved by rescaling */
+  checkpoint_data(ckpt, &ncols, sizeof(int), 1);
+  if (ncols != opt_pot.ncols)
+    error(1, "Checkpoint file %s does not match the current potential\n", checkpointfile);
+  checkpoint_data(ckpt, opt_pot.begin, sizeof(double), ncols);
+  checkpoint_data(ckpt, opt_pot.end, sizeof(double), ncols);
+  checkpoint_data(ckpt, opt_pot.step, sizeof(double), ncols);
+  checkpoint_data(ckpt, opt_pot.invstep, sizeof(double), ncols);
+  checkpoint_data(ckpt, opt_pot.xcoord, sizeof(double), len);
+#endif /* !APOT */
+
+  if (!ckpt_write)
+    set_normdist_state(nd_have, nd_val);
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  read_checkpoint: restore the global state on restart,
+ *	the optimizer payload is read later by checkpoint_resume
+ *
+ ****************************************************************/
+
+void read_checkpoint()
+{
+  FILE *ckpt;
+
+  ckpt = fopen(checkpointfile, "rb");
+  if (NULL == ckpt)
+    error(1, "Could not open checkpoint file %s\n", checkpointfile);
+
+  ckpt_write = 0;
+  header_data(ckpt, &ckpt_stage);
+#ifdef EVO
+  if (CKPT_ANNEAL == ckpt_stage)
+#else
+  if (CKPT_EVO == ckpt_stage)
+#endif /* EVO */
+    error(1, "Checkpoint file %s was written by a different optimizer\n", checkpointfile);
+  if (ckpt_stage < CKPT_ANNEAL || ckpt_stage > CKPT_POWELL)
+    error(1, "Checkpoint file %s has an invalid optimizer stage\n", checkpointfile);
+  ckpt_offset = ftell(ckpt);
+  fclose(ckpt);
+
+  printf("Restarting from checkpoint file %s after %d force calculations.\n", checkpointfile,
+    fcalls);
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  checkpoint_pending: is a restart at the given stage pending?
+ *
+ ****************************************************************/
+
+int checkpoint_pending(int stage)
+{
+  return (stage == ckpt_stage);
+}
+
+/****************************************************************
+ *
+ *  checkpoint_due: should the optimizer write a checkpoint now?
+ *
+ ****************************************************************/
+
+int checkpoint_due(void)
+{
+  time_t now;
+
+  if ('\0' == *checkpointfile)
+    return 0;
+
+  now = time(NULL);
+  if (checkpoint_interval > 0 && difftime(now, ckpt_last) < checkpoint_interval)
+    return 0;
+  ckpt_last = now;
+
+  return 1;
+}
+
+/****************************************************************
+ *
+ *  checkpoint_resume: open the pending checkpoint for the given
+ *	stage at its payload, NULL if there is nothing to resume
+ *
+ ****************************************************************/
+
+FILE *checkpoint_resume(int stage)
+{
+  FILE *ckpt;
+
+  if (stage != ckpt_stage)
+    return NULL;
+
+  ckpt = fopen(checkpointfile, "rb");
+  if (NULL == ckpt || 0 != fseek(ckpt, ckpt_offset, SEEK_SET))
+    error(1, "Could not open checkpoint file %s\n", checkpointfile);
+
+  /* a checkpoint is only consumed once */
+  ckpt_stage = 0;
+  ckpt_write = 0;
+
+  return ckpt;
+}
+
+/****************************************************************
+ *
+ *  checkpoint_begin: start a new checkpoint and write the header
+ *
+ ****************************************************************/
+
+FILE *checkpoint_begin(int stage)
+{
+  FILE *ckpt;
+
+  sprintf(ckpt_tmpfile, "%s.tmp", checkpointfile);
+  ckpt = fopen(ckpt_tmpfile, "wb");
+  if (NULL == ckpt)
+    error(1, "Could not open checkpoint file %s for writing\n", ckpt_tmpfile);
+
+  ckpt_write = 1;
+  header_data(ckpt, &stage);
+
+  return ckpt;
+}
+
+/****************************************************************
+ *
+ *  checkpoint_end: finish the checkpoint and replace the old one
+ *
+ ****************************************************************/
+
+void checkpoint_end(FILE *ckpt)
+{
+  if (ckpt_write) {
+    /* the data has to be on disk before the rename replaces the old file */
+    if (0 != fflush(ckpt) || 0 != fsync(fileno(ckpt)) || 0 != fclose(ckpt))
+      error(1, "Could not write checkpoint file %s\n", ckpt_tmpfile);
+    if (0 != rename(ckpt_tmpfile, checkpointfile))
+      error(1, "Could not rename %s to %s\n", ckpt_tmpfile, checkpointfile);
+  } else {
+    fclose(ckpt);
+  }
+  ckpt_write = 0;
+
+  return;
+}
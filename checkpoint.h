@@ -0,0 +1,47 @@
+/****************************************************************
+ *
+ * checkpoint.h: header file for checkpointing the optimizer state
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2014
+ * 	Institute for Theoretical and Applied Physics
+ * 	University of Stuttgart, D-70550 Stuttgart, Germany
+ *	http://potfit.sourceforge.net/
+ *
+ ****************************************************************
+ *
+ *   This file is part of potfit.
+ *
+ *   potfit is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   potfit is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/* optimizer stages stored in a checkpoint file */
+#define CKPT_ANNEAL 1
+#define CKPT_EVO 2
+#define CKPT_POWELL 3
+
+void  read_checkpoint();
+int   checkpoint_pending(int);
+int   checkpoint_due(void);
+FILE *checkpoint_begin(int);
+FILE *checkpoint_resume(int);
+void  checkpoint_data(FILE *, void *, size_t, size_t);
+void  checkpoint_end(FILE *);
+
+#endif /* CHECKPOINT_H */
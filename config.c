@@ -28,11 +28,927 @@
  *
  ****************************************************************/
 
+/* fopencookie() is needed for in-process decompression */
+#if defined ZLIB || defined ZSTD
+#define _GNU_SOURCE
+#endif /* ZLIB || ZSTD */
+
 #include "potfit.h"
 
+#include <ctype.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef ZLIB
+#include <zlib.h>
+#endif /* ZLIB */
+
+#ifdef ZSTD
+#include <zstd.h>
+#endif /* ZSTD */
+
 #include "config.h"
+#include "potential.h"
 #include "utils.h"
 
+/* buffer size for reading the config file */
+#define CONFIG_BUFSIZE (1 << 20)
+
+/* is the config file read from an external decompressor? */
+static int config_pipe = 0;
+
+#ifdef ZLIB
+
+/****************************************************************
+ *
+ *  stdio wrapper around a gzip stream
+ *
+ ****************************************************************/
+
+static ssize_t gz_read(void *cookie, char *buf, size_t size)
+{
+  int   n = gzread((gzFile) cookie, buf, (unsigned int)size);
+
+  return (n < 0) ? -1 : n;
+}
+
+static int gz_close(void *cookie)
+{
+  return (Z_OK == gzclose((gzFile) cookie)) ? 0 : EOF;
+}
+
+static FILE *open_gzip(char *filename)
+{
+  cookie_io_functions_t io = { gz_read, NULL, NULL, gz_close };
+  gzFile gz;
+  FILE *infile;
+
+  gz = gzopen(filename, "rb");
+  if (NULL == gz)
+    error(1, "Could not open file %s\n", filename);
+  gzbuffer(gz, CONFIG_BUFSIZE);
+  infile = fopencookie(gz, "r", io);
+  if (NULL == infile)
+    error(1, "Could not open gzip stream for %s\n", filename);
+
+  return infile;
+}
+
+#endif /* ZLIB */
+
+#ifdef ZSTD
+
+/****************************************************************
+ *
+ *  stdio wrapper around a zstd stream
+ *
+ ****************************************************************/
+
+typedef struct {
+  FILE *file;			/* compressed file */
+  ZSTD_DStream *stream;		/* decompression context */
+  ZSTD_inBuffer in;		/* compressed input buffer */
+  size_t insize;		/* allocated size of the input buffer */
+  size_t last;			/* last return value of the decoder, 0 at the end of a frame */
+  char *filename;		/* for the error message */
+} zstd_cookie_t;
+
+static ssize_t zstd_read(void *cookie, char *buf, size_t size)
+{
+  zstd_cookie_t *zc = (zstd_cookie_t *) cookie;
+  ZSTD_outBuffer out = { buf, size, 0 };
+  size_t ret;
+
+  while (0 == out.pos) {
+    if (zc->in.pos == zc->in.size) {
+      zc->in.size = fread((void *)zc->in.src, 1, zc->insize, zc->file);
+      zc->in.pos = 0;
+      if (0 == zc->in.size && 0 == zc->last)
+	break;
+    }
+    /* at the end of the file the decoder may still flush some output */
+    ret = ZSTD_decompressStream(zc->stream, &out, &zc->in);
+    if (ZSTD_isError(ret))
+      return -1;
+    if (0 == zc->in.size && 0 == out.pos && 0 != ret)
+      error(1, "The zstd compressed file %s is truncated\n", zc->filename);
+    zc->last = ret;
+  }
+
+  return (ssize_t) out.pos;
+}
+
+static int zstd_close(void *cookie)
+{
+  zstd_cookie_t *zc = (zstd_cookie_t *) cookie;
+  int   ret = fclose(zc->file);
+
+  ZSTD_freeDStream(zc->stream);
+  free((void *)zc->in.src);
+  free(zc);
+
+  return ret;
+}
+
+static FILE *open_zstd(char *filename)
+{
+  cookie_io_functions_t io = { zstd_read, NULL, NULL, zstd_close };
+  zstd_cookie_t *zc;
+  FILE *infile;
+
+  zc = (zstd_cookie_t *) malloc(sizeof(zstd_cookie_t));
+  if (NULL == zc)
+    error(1, "Cannot allocate memory for zstd stream");
+  zc->file = fopen(filename, "rb");
+  if (NULL == zc->file)
+    error(1, "Could not open file %s\n", filename);
+  zc->stream = ZSTD_createDStream();
+  zc->insize = ZSTD_DStreamInSize();
+  zc->in.src = malloc(zc->insize);
+  zc->in.size = 0;
+  zc->in.pos = 0;
+  zc->last = 0;
+  zc->filename = filename;
+  if (NULL == zc->stream || NULL == zc->in.src)
+    error(1, "Cannot allocate memory for zstd stream");
+  ZSTD_initDStream(zc->stream);
+  infile = fopencookie(zc, "r", io);
+  if (NULL == infile)
+    error(1, "Could not open zstd stream for %s\n", filename);
+
+  return infile;
+}
+
+#endif /* ZSTD */
+
+#if !defined ZLIB || !defined ZSTD
+
+/****************************************************************
+ *
+ *  open_pipe: decompress with an external program
+ *
+ ****************************************************************/
+
+static FILE *open_pipe(const char *command, char *filename)
+{
+  char  buffer[1024];
+  FILE *infile;
+
+  if (NULL != strchr(filename, '\''))
+    error(1, "Cannot decompress %s, the file name contains a quote\n", filename);
+  snprintf(buffer, sizeof(buffer), "%s '%s'", command, filename);
+  infile = popen(buffer, "r");
+  if (NULL == infile)
+    error(1, "Could not run \"%s\"\n", buffer);
+  config_pipe = 1;
+
+  return infile;
+}
+
+#endif /* !ZLIB || !ZSTD */
+
+/****************************************************************
+ *
+ *  open_config: open the config file, gzip and zstd compressed
+ *	files are detected by their magic bytes and decompressed
+ *	while reading
+ *
+ ****************************************************************/
+
+static FILE *open_config(char *filename)
+{
+  FILE *infile;
+  unsigned char magic[4] = { 0, 0, 0, 0 };
+
+  infile = fopen(filename, "r");
+  if (NULL == infile)
+    error(1, "Could not open file %s\n", filename);
+  if (0 == fread(magic, 1, 4, infile))
+    error(1, "The config file %s is empty\n", filename);
+
+  config_pipe = 0;
+
+  if (0x1f == magic[0] && 0x8b == magic[1]) {
+    fclose(infile);
+#ifdef ZLIB
+    infile = open_gzip(filename);
+#else
+    infile = open_pipe("gzip -dc", filename);
+#endif /* ZLIB */
+  } else if (0x28 == magic[0] && 0xb5 == magic[1] && 0x2f == magic[2] && 0xfd == magic[3]) {
+    fclose(infile);
+#ifdef ZSTD
+    infile = open_zstd(filename);
+#else
+    infile = open_pipe("zstd -dc", filename);
+#endif /* ZSTD */
+  } else
+    rewind(infile);
+
+  return infile;
+}
+
+/****************************************************************
+ *
+ *  close_config: close the config file or decompressor pipe
+ *
+ ****************************************************************/
+
+static void close_config(FILE *infile, char *filename)
+{
+  if (config_pipe) {
+    if (0 != pclose(infile))
+      error(1, "Decompression of %s failed\n", filename);
+  } else if (0 != fclose(infile))
+    error(1, "Error while reading %s\n", filename);
+}
+
+/****************************************************************
+ *
+ *  The config file is read in three steps:
+ *
+ *  1. The whole file is mapped into memory (compressed files are
+ *     decompressed into a buffer) and the headers are read one
+ *     configuration after the other. The atom lines of a tagged
+ *     configuration end at the next "#N" line and are only skipped
+ *     here, configurations in the old format are read right away.
+ *  2. Several threads read the atom lines and build the neighbor
+ *     and angle tables, one configuration at a time. They do not
+ *     touch shared state, errors and diagnostics are kept with the
+ *     configuration.
+ *  3. The results are merged in the order of the configurations,
+ *     so the tables and the first error are the same as if the
+ *     file was read serially. The messages about the atoms follow
+ *     the warnings about the headers.
+ *
+ ****************************************************************/
+
+#define MAX_READ_THREADS 16	/* threads for the atoms and neighbor tables */
+
+typedef struct {
+  char *text;			/* first atom line */
+  char *end;			/* end of the configuration in the buffer */
+  int   line;			/* line number before the first atom */
+  int   tag_format;		/* configuration in the tagged format */
+  int   parsed;			/* atoms already read in the first step */
+  vector box_x, box_y, box_z;	/* box vectors */
+  vector tbox_x, tbox_y, tbox_z;	/* transformed box vectors */
+#ifdef CONTRIB
+  int   have_contrib_box;	/* box of contributing atoms */
+  vector cbox_o, cbox_a, cbox_b, cbox_c;
+  int   n_spheres;		/* number of spheres of contributing atoms */
+#endif /* CONTRIB */
+  double *mindist;		/* minimal distances in this configuration */
+  int   have_small_box;		/* additional periodic images needed */
+  int   sh_dist;		/* short distance flag */
+  FILE *log;			/* diagnostic messages for stderr */
+  char *log_buf;
+  size_t log_len;
+  long  error_pos, slot_pos;	/* length of the log at the errors */
+  char  error[255];		/* fatal error */
+  char  slot_error[255];	/* distance outside of a potential table */
+  char  slot_msg[255];		/* message for the slot error */
+} conf_read_t;
+
+static conf_read_t *conf_read = NULL;
+static int conf_next = 0;	/* next configuration for a thread */
+static pthread_mutex_t conf_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************
+ *
+ *  map_config: the config file in memory, terminated by '\0'
+ *
+ ****************************************************************/
+
+static char *map_config(char *filename, size_t *len, int *mapped)
+{
+  char *buf;
+  size_t size = CONFIG_BUFSIZE, n;
+  struct stat st;
+  FILE *infile;
+
+  infile = open_config(filename);
+  *mapped = 0;
+  *len = 0;
+
+  if (fileno(infile) >= 0 && 0 == fstat(fileno(infile), &st) && S_ISREG(st.st_mode)) {
+    /* the zero filled rest of the last page terminates the mapping */
+    if (0 != st.st_size % sysconf(_SC_PAGESIZE)) {
+      buf = (char *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(infile), 0);
+      if (MAP_FAILED != buf) {
+	close_config(infile, filename);
+	*mapped = 1;
+	*len = (size_t)st.st_size;
+	return buf;
+      }
+    }
+    size = (size_t)st.st_size + 2;
+  }
+
+  buf = (char *)malloc(size);
+  while (NULL != buf && (n = fread(buf + *len, 1, size - *len - 1, infile)) > 0) {
+    *len += n;
+    if (*len == size - 1) {
+      size *= 2;
+      buf = (char *)realloc(buf, size);
+    }
+  }
+  if (NULL == buf)
+    error(1, "Cannot allocate memory for the config file %s", filename);
+  buf[*len] = '\0';
+  close_config(infile, filename);
+
+  return buf;
+}
+
+/****************************************************************
+ *
+ *  mem_gets: fgets() for the config file in memory
+ *
+ ****************************************************************/
+
+static char *mem_gets(char *buffer, int len, char **pos, char *end)
+{
+  char *eol;
+  size_t n;
+
+  if (*pos >= end)
+    return NULL;
+  eol = (char *)memchr(*pos, '\n', end - *pos);
+  n = (NULL == eol) ? (size_t)(end - *pos) : (size_t)(eol - *pos + 1);
+  if (n > (size_t)len - 1)
+    n = len - 1;
+  memcpy(buffer, *pos, n);
+  buffer[n] = '\0';
+  *pos += n;
+
+  return buffer;
+}
+
+/****************************************************************
+ *
+ *  mem_scan: read n numbers like fscanf("%lf ... %lf\n"),
+ *	returns the number of values read
+ *
+ ****************************************************************/
+
+static int mem_scan(char **pos, double *val, int n)
+{
+  char *end;
+  int   i;
+
+  for (i = 0; i < n; i++) {
+    val[i] = parse_double(*pos, &end);
+    if (end == *pos)
+      return i;
+    *pos = end;
+  }
+  while (isspace((unsigned char)**pos))
+    (*pos)++;
+
+  return n;
+}
+
+/****************************************************************
+ *
+ *  next_config: start of the next "#N" line
+ *
+ ****************************************************************/
+
+static char *next_config(char *pos, char *end)
+{
+  char *p = pos;
+
+  while (p < end && NULL != (p = (char *)memchr(p, '#', end - p))) {
+    if ((p == pos || '\n' == p[-1]) && 'N' == p[1])
+      return p;
+    p++;
+  }
+
+  return end;
+}
+
+/****************************************************************
+ *
+ *  read_atom: parse one atom line (type, position and force)
+ *	blank lines are skipped, like fscanf() did before
+ *
+ ****************************************************************/
+
+static int read_atom(char **pos, char *end, atom_t *atom)
+{
+  char *ptr = *pos, *eol, *next;
+  double val[6];
+  int   i;
+
+  for (;;) {
+    if (ptr >= end)
+      return 0;
+    eol = (char *)memchr(ptr, '\n', end - ptr);
+    if (NULL == eol)
+      eol = end;
+    while (ptr < eol && isspace((unsigned char)*ptr))
+      ptr++;
+    if (ptr < eol)
+      break;
+    ptr = eol + 1;
+  }
+
+  /* all values have to be on this line */
+  atom->type = (int)strtol(ptr, &next, 10);
+  if (next == ptr || next > eol)
+    return 0;
+  for (i = 0; i < 6; i++) {
+    ptr = next;
+    val[i] = parse_double(ptr, &next);
+    if (next == ptr || next > eol)
+      return 0;
+  }
+
+  atom->pos.x = val[0];
+  atom->pos.y = val[1];
+  atom->pos.z = val[2];
+  atom->force.x = val[3];
+  atom->force.y = val[4];
+  atom->force.z = val[5];
+  *pos = (eol < end) ? eol + 1 : end;
+
+  return 1;
+}
+
+/****************************************************************
+ *
+ *  conf_log, conf_error: diagnostics and errors of a configuration,
+ *	they are reported when the configurations are merged
+ *
+ ****************************************************************/
+
+static FILE *conf_log(conf_read_t *rec)
+{
+  if (NULL == rec->log) {
+    rec->log = open_memstream(&rec->log_buf, &rec->log_len);
+    if (NULL == rec->log)
+      rec->log = stderr;
+  }
+
+  return rec->log;
+}
+
+static void conf_error(conf_read_t *rec, const char *msg, ...)
+{
+  va_list ap;
+
+  va_start(ap, msg);
+  vsnprintf(rec->error, sizeof(rec->error), msg, ap);
+  va_end(ap);
+  rec->error_pos = (NULL == rec->log) ? 0 : ftell(rec->log);
+}
+
+/****************************************************************
+ *
+ *  read_atoms: read the atom lines of configuration c
+ *
+ ****************************************************************/
+
+static int read_atoms(int c)
+{
+  atom_t *atom;
+  char *pos;
+  conf_read_t *rec = conf_read + c;
+  int   i;
+
+  pos = rec->text;
+  for (i = 0; i < inconf[c]; i++) {
+    atom = atoms + cnfstart[c] + i;
+    if (0 == read_atom(&pos, rec->end, atom)) {
+      conf_error(rec, "Corrupt configuration file on line %d\n", rec->line + i + 1);
+      return 0;
+    }
+    if (global_cell_scale != 1.0) {
+      atom->pos.x *= global_cell_scale;
+      atom->pos.y *= global_cell_scale;
+      atom->pos.z *= global_cell_scale;
+    }
+    if (atom->type >= ntypes || atom->type < 0) {
+      conf_error(rec, "Corrupt configuration file on line %d: Incorrect atom type (%d)\n",
+	rec->line + i + 1, atom->type);
+      return 0;
+    }
+    atom->absforce = sqrt(dsquare(atom->force.x) + dsquare(atom->force.y) + dsquare(atom->force.z));
+    atom->conf = c;
+    na_type[c][atom->type] += 1;
+  }
+
+  /* skip whitespace up to the next configuration */
+  while (pos < rec->end && isspace((unsigned char)*pos))
+    pos++;
+  if (!rec->tag_format)
+    rec->end = pos;
+  else if (pos < rec->end) {
+    conf_error(rec, "Corrupt configuration file on line %d: More atoms than given in the #N line\n",
+      rec->line + inconf[c] + 1);
+    return 0;
+  }
+  rec->parsed = 1;
+
+  return 1;
+}
+
+/****************************************************************
+ *
+ *  neigh_slot: index and shift of a neighbor distance in the
+ *	potential table col, stored in slot n of the neighbor,
+ *	returns 0 if the distance is before the beginning of the table
+ *
+ ****************************************************************/
+
+static int neigh_slot(conf_read_t *rec, neigh_t *neigh, int n, int col)
+{
+  int   slot, klo, khi;
+  double r = neigh->r, rr, istep, shift, step;
+
+  neigh->col[n] = col;
+  if (format == 0 || format == 3) {
+    rr = r - calc_pot.begin[col];
+    if (rr < 0) {
+      /* only reported if no short distance was found before */
+      snprintf(rec->slot_msg, sizeof(rec->slot_msg),
+	"The distance %f is smaller than the beginning\nof the potential #%d (r_begin=%f).\n", r, col,
+	calc_pot.begin[col]);
+      snprintf(rec->slot_error, sizeof(rec->slot_error), "%s",
+	(0 == n) ? "Short distance!" : "short distance in config.c!");
+      rec->slot_pos = (NULL == rec->log) ? 0 : ftell(rec->log);
+      return 0;
+    }
+    istep = calc_pot.invstep[col];
+    slot = (int)(rr * istep);
+    shift = (rr - slot * calc_pot.step[col]) * istep;
+    slot += calc_pot.first[col];
+    step = calc_pot.step[col];
+  } else {			/* format == 4 ! */
+    klo = calc_pot.first[col];
+    khi = calc_pot.last[col];
+    /* bisection */
+    while (khi - klo > 1) {
+      slot = (khi + klo) >> 1;
+      if (calc_pot.xcoord[slot] > r)
+	khi = slot;
+      else
+	klo = slot;
+    }
+    slot = klo;
+    step = calc_pot.xcoord[khi] - calc_pot.xcoord[klo];
+    shift = (r - calc_pot.xcoord[klo]) / step;
+  }
+  /* independent of format - we should be left of last index */
+  if (slot >= calc_pot.last[col]) {
+    slot--;
+    shift += 1.0;
+  }
+  neigh->shift[n] = shift;
+  neigh->slot[n] = slot;
+  neigh->step[n] = step;
+
+  return 1;
+}
+
+#ifdef THREEBODY
+
+/****************************************************************
+ *
+ *  build_angles: angular part of configuration c
+ *	For TERSOFF we create a full neighbor list,
+ *	for all other potentials only a half list
+ *
+ ****************************************************************/
+
+static int build_angles(int c)
+{
+  int   i, j, k, ijk, nnn, col;
+  double ccos;
+#ifdef MEAM
+  int   slot = 0;
+  double istep, shift = 0.0, step = 0.0;
+#endif /* MEAM */
+  conf_read_t *rec = conf_read + c;
+
+  for (i = cnfstart[c]; i < cnfstart[c] + inconf[c]; i++) {
+    nnn = atoms[i].num_neigh;
+    ijk = 0;
+    /* at most one angle per pair of neighbors is stored */
+#ifdef TERSOFF
+    atoms[i].angle_part = (angle_t *) malloc(MAX(nnn * (nnn - 1), 1) * sizeof(angle_t));
+#else
+    atoms[i].angle_part = (angle_t *) malloc(MAX(nnn * (nnn - 1) / 2, 1) * sizeof(angle_t));
+#endif /* TERSOFF */
+    if (NULL == atoms[i].angle_part) {
+      conf_error(rec, "Cannot allocate memory for angular part");
+      return 0;
+    }
+#ifdef TERSOFF
+    for (j = 0; j < nnn; j++) {
+#else
+    for (j = 0; j < nnn - 1; j++) {
+#endif /* TERSOFF */
+      atoms[i].neigh[j].ijk_start = ijk;
+#ifdef TERSOFF
+      for (k = 0; k < nnn; k++) {
+	if (j == k)
+	  continue;
+#else
+      for (k = j + 1; k < nnn; k++) {
+#endif /* TERSOFF */
+	/* only store the angles inside the threebody cutoffs */
+#ifdef MEAM
+	if (atoms[i].neigh[j].r >= calc_pot.end[atoms[i].neigh[j].col[2]]
+	  || atoms[i].neigh[k].r >= calc_pot.end[atoms[i].neigh[k].col[2]])
+	  continue;
+#elif defined STIWEB
+	if (!stiweb_angle(atoms[i].type, atoms[i].neigh + j, atoms[i].neigh + k))
+	  continue;
+#elif defined TERSOFF
+	if (!tersoff_angle(atoms[i].neigh + j, atoms[i].neigh + k))
+	  continue;
+#endif /* MEAM */
+	init_angle(atoms[i].angle_part + ijk);
+	atoms[i].angle_part[ijk].j = j;
+	atoms[i].angle_part[ijk].k = k;
+	ccos =
+	  atoms[i].neigh[j].dist_r.x * atoms[i].neigh[k].dist_r.x +
+	  atoms[i].neigh[j].dist_r.y * atoms[i].neigh[k].dist_r.y +
+	  atoms[i].neigh[j].dist_r.z * atoms[i].neigh[k].dist_r.z;
+
+	atoms[i].angle_part[ijk].cos = ccos;
+
+	col = 2 * paircol + 2 * ntypes + atoms[i].type;
+	if (0 == format || 3 == format) {
+	  if ((fabs(ccos) - 1.0) > 1e-10) {
+	    fprintf(conf_log(rec), "%.20f %f %d %d %d\n", ccos, calc_pot.begin[col], col,
+	      atoms[i].neigh[j].type, atoms[i].neigh[k].type);
+	    conf_error(rec, "cos out of range, it is strange!");
+	    return 0;
+	  }
+#ifdef MEAM
+	  istep = calc_pot.invstep[col];
+	  slot = (int)((ccos + 1) * istep);
+	  shift = ((ccos + 1) - slot * calc_pot.step[col]) * istep;
+	  slot += calc_pot.first[col];
+	  step = calc_pot.step[col];
+
+	  /* Don't want lower bound spline knot to be final knot or upper
+	     bound knot will cause trouble since it goes beyond the array */
+	  if (slot >= calc_pot.last[col]) {
+	    slot--;
+	    shift += 1.0;
+	  }
+#endif /* !MEAM */
+	}
+#ifdef MEAM
+	atoms[i].angle_part[ijk].shift = shift;
+	atoms[i].angle_part[ijk].slot = slot;
+	atoms[i].angle_part[ijk].step = step;
+#endif /* MEAM */
+	ijk++;
+      }				/* third loop over atoms */
+    }				/* second loop over atoms */
+    atoms[i].num_angles = ijk;
+    /* shrink the angular table to the stored angles */
+    atoms[i].angle_part = (angle_t *) realloc(atoms[i].angle_part, MAX(ijk, 1) * sizeof(angle_t));
+  }				/* first loop over atoms */
+
+  return 1;
+}
+
+#endif /* THREEBODY */
+
+/****************************************************************
+ *
+ *  build_neighbors: neighbor tables of configuration c
+ *
+ ****************************************************************/
+
+static int build_neighbors(int c)
+{
+  int   i, j, k, ix, iy, iz, first, last;
+  int   type1, type2, col;
+  int   max_neigh;		/* allocated size of the current neighbor table */
+  int   cell_scale[3];
+  double r;
+  vector d, dd, iheight;
+  vector bx, by, bz;
+  conf_read_t *rec = conf_read + c;
+
+  first = cnfstart[c];
+  last = first + inconf[c];
+  bx = rec->box_x;
+  by = rec->box_y;
+  bz = rec->box_z;
+
+  /* check cell size */
+  /* inverse height in direction */
+  iheight.x = sqrt(SPROD(rec->tbox_x, rec->tbox_x));
+  iheight.y = sqrt(SPROD(rec->tbox_y, rec->tbox_y));
+  iheight.z = sqrt(SPROD(rec->tbox_z, rec->tbox_z));
+
+  if ((ceil(rcutmax * iheight.x) > 30000)
+    || (ceil(rcutmax * iheight.y) > 30000)
+    || (ceil(rcutmax * iheight.z) > 30000)) {
+    conf_error(rec, "Very bizarre small cell size - aborting");
+    return 0;
+  }
+
+  cell_scale[0] = (int)ceil(rcutmax * iheight.x);
+  cell_scale[1] = (int)ceil(rcutmax * iheight.y);
+  cell_scale[2] = (int)ceil(rcutmax * iheight.z);
+
+  if (cell_scale[0] > 1 || cell_scale[1] > 1 || cell_scale[2] > 1)
+    rec->have_small_box = 1;
+
+#ifdef DEBUG
+  fprintf(conf_log(rec), "\nChecking cell size for configuration %d:\n", c);
+  fprintf(conf_log(rec), "Box dimensions:\n");
+  fprintf(conf_log(rec), "     %10.6f %10.6f %10.6f\n", bx.x, bx.y, bx.z);
+  fprintf(conf_log(rec), "     %10.6f %10.6f %10.6f\n", by.x, by.y, by.z);
+  fprintf(conf_log(rec), "     %10.6f %10.6f %10.6f\n", bz.x, bz.y, bz.z);
+  fprintf(conf_log(rec), "Box normals:\n");
+  fprintf(conf_log(rec), "     %10.6f %10.6f %10.6f\n", rec->tbox_x.x, rec->tbox_x.y, rec->tbox_x.z);
+  fprintf(conf_log(rec), "     %10.6f %10.6f %10.6f\n", rec->tbox_y.x, rec->tbox_y.y, rec->tbox_y.z);
+  fprintf(conf_log(rec), "     %10.6f %10.6f %10.6f\n", rec->tbox_z.x, rec->tbox_z.y, rec->tbox_z.z);
+  fprintf(conf_log(rec), "Box heights:\n");
+  fprintf(conf_log(rec), "     %10.6f %10.6f %10.6f\n", 1.0 / iheight.x, 1.0 / iheight.y,
+    1.0 / iheight.z);
+  fprintf(conf_log(rec), "Potential range:  %f\n", rcutmax);
+  fprintf(conf_log(rec), "Periodic images needed: %d %d %d\n\n",
+    2 * cell_scale[0] + 1, 2 * cell_scale[1] + 1, 2 * cell_scale[2] + 1);
+#endif /* DEBUG */
+
+  /* compute the neighbor table */
+  for (i = first; i < last; i++) {
+    atoms[i].num_neigh = 0;
+    max_neigh = 0;
+    /* loop over all atoms for threebody interactions */
+#ifdef THREEBODY
+    for (j = first; j < last; j++) {
+#else
+    for (j = i; j < last; j++) {
+#endif /* THREEBODY */
+      d.x = atoms[j].pos.x - atoms[i].pos.x;
+      d.y = atoms[j].pos.y - atoms[i].pos.y;
+      d.z = atoms[j].pos.z - atoms[i].pos.z;
+      for (ix = -cell_scale[0]; ix <= cell_scale[0]; ix++) {
+	for (iy = -cell_scale[1]; iy <= cell_scale[1]; iy++) {
+	  for (iz = -cell_scale[2]; iz <= cell_scale[2]; iz++) {
+	    if ((i == j) && (ix == 0) && (iy == 0) && (iz == 0))
+	      continue;
+	    dd.x = d.x + ix * bx.x + iy * by.x + iz * bz.x;
+	    dd.y = d.y + ix * bx.y + iy * by.y + iz * bz.y;
+	    dd.z = d.z + ix * bx.z + iy * by.z + iz * bz.z;
+	    r = sqrt(SPROD(dd, dd));
+	    type1 = atoms[i].type;
+	    type2 = atoms[j].type;
+	    if (r <= rcut[type1 * ntypes + type2]) {
+	      if (r <= rmin[type1 * ntypes + type2]) {
+		rec->sh_dist = c;
+		fprintf(conf_log(rec), "Configuration %d: Distance %f\n", c, r);
+		fprintf(conf_log(rec), "atom %d (type %d) at pos: %f %f %f\n",
+		  i - first, type1, atoms[i].pos.x, atoms[i].pos.y, atoms[i].pos.z);
+		fprintf(conf_log(rec), "atom %d (type %d) at pos: %f %f %f\n", j - first, type2, dd.x,
+		  dd.y, dd.z);
+	      }
+	      /* grow the neighbor table geometrically */
+	      if (atoms[i].num_neigh == max_neigh) {
+		max_neigh = MAX(2 * max_neigh, 16);
+		atoms[i].neigh = (neigh_t *)realloc(atoms[i].neigh, max_neigh * sizeof(neigh_t));
+		if (NULL == atoms[i].neigh) {
+		  conf_error(rec, "Cannot allocate memory for neighbor table");
+		  return 0;
+		}
+	      }
+	      dd.x /= r;
+	      dd.y /= r;
+	      dd.z /= r;
+	      k = atoms[i].num_neigh++;
+	      init_neigh(atoms[i].neigh + k);
+	      atoms[i].neigh[k].type = type2;
+	      atoms[i].neigh[k].nr = j;
+	      atoms[i].neigh[k].r = r;
+	      atoms[i].neigh[k].r2 = r * r;
+	      atoms[i].neigh[k].inv_r = 1.0 / r;
+	      atoms[i].neigh[k].dist_r = dd;
+	      atoms[i].neigh[k].dist.x = dd.x * r;
+	      atoms[i].neigh[k].dist.y = dd.y * r;
+	      atoms[i].neigh[k].dist.z = dd.z * r;
+#ifdef ADP
+	      atoms[i].neigh[k].sqrdist.xx = dd.x * dd.x * r * r;
+	      atoms[i].neigh[k].sqrdist.yy = dd.y * dd.y * r * r;
+	      atoms[i].neigh[k].sqrdist.zz = dd.z * dd.z * r * r;
+	      atoms[i].neigh[k].sqrdist.yz = dd.y * dd.z * r * r;
+	      atoms[i].neigh[k].sqrdist.zx = dd.z * dd.x * r * r;
+	      atoms[i].neigh[k].sqrdist.xy = dd.x * dd.y * r * r;
+#endif /* ADP */
+
+	      col = (type1 <= type2) ? type1 * ntypes + type2 - ((type1 * (type1 + 1)) / 2)
+		: type2 * ntypes + type1 - ((type2 * (type2 + 1)) / 2);
+	      atoms[i].neigh[k].col[0] = col;
+	      rec->mindist[col] = MIN(rec->mindist[col], r);
+
+	      /* pre-compute index and shift into potential table,
+	         the first distance outside of a table ends this */
+	      if (!rec->sh_dist && '\0' == rec->slot_error[0])
+		(void)(neigh_slot(rec, atoms[i].neigh + k, 0, col)
+#if defined EAM || defined ADP || defined MEAM
+		  /* transfer function */
+		  && (!embedding || neigh_slot(rec, atoms[i].neigh + k, 1, paircol + type2))
+#ifdef TBEAM
+		  /* transfer function - d band */
+		  && neigh_slot(rec, atoms[i].neigh + k, 2, paircol + 2 * ntypes + type2)
+#endif /* TBEAM */
+#endif /* EAM || ADP || MEAM */
+#ifdef MEAM
+		  /* f(r_ij) */
+		  && neigh_slot(rec, atoms[i].neigh + k, 2, paircol + 2 * ntypes + col)
+#endif /* MEAM */
+#ifdef ADP
+		  /* dipole and quadrupole part */
+		  && neigh_slot(rec, atoms[i].neigh + k, 2, paircol + 2 * ntypes + col)
+		  && neigh_slot(rec, atoms[i].neigh + k, 3, 2 * paircol + 2 * ntypes + col)
+#endif /* ADP */
+#ifdef STIWEB
+		  /* exp. function */
+		  && neigh_slot(rec, atoms[i].neigh + k, 1, paircol + col)
+#endif /* STIWEB */
+		  );
+	    }			/* r < r_cut */
+	  }			/* loop over images in z direction */
+	}			/* loop over images in y direction */
+      }				/* loop over images in x direction */
+    }				/* second loop over atoms (neighbors) */
+
+    /* shrink the neighbor table to its final size */
+    atoms[i].neigh = (neigh_t *)realloc(atoms[i].neigh, MAX(atoms[i].num_neigh, 1) * sizeof(neigh_t));
+  }				/* first loop over atoms */
+
+#ifdef THREEBODY
+  return build_angles(c);
+#else
+  return 1;
+#endif /* THREEBODY */
+}
+
+/****************************************************************
+ *
+ *  read_worker: read the atoms and build the neighbor tables of
+ *	the configurations, until none is left
+ *
+ ****************************************************************/
+
+static void *read_worker(void *arg)
+{
+  int   c;
+
+  for (;;) {
+    pthread_mutex_lock(&conf_mutex);
+    c = conf_next++;
+    pthread_mutex_unlock(&conf_mutex);
+    if (c >= nconf)
+      break;
+    if (conf_read[c].parsed || read_atoms(c))
+      (void)build_neighbors(c);
+    if (NULL != conf_read[c].log && stderr != conf_read[c].log)
+      fclose(conf_read[c].log);
+  }
+
+  return arg;
+}
+
+/****************************************************************
+ *
+ *  read_parallel: run read_worker() on several threads
+ *
+ ****************************************************************/
+
+static void read_parallel(void)
+{
+  int   i, nthreads;
+  int   started[MAX_READ_THREADS];
+  pthread_t thread[MAX_READ_THREADS];
+
+  nthreads = MIN(MAX_READ_THREADS, (int)sysconf(_SC_NPROCESSORS_ONLN));
+  nthreads = MIN(nthreads, nconf);
+
+  conf_next = 0;
+  /* the calling thread is one of the workers */
+  for (i = 1; i < nthreads; i++)
+    started[i] = (0 == pthread_create(&thread[i], NULL, read_worker, NULL));
+  read_worker(NULL);
+  for (i = 1; i < nthreads; i++)
+    if (started[i])
+      pthread_join(thread[i], NULL);
+}
+
 /****************************************************************
  *
  *  read the configurations
@@ -41,14 +957,14 @@
 
 void read_config(char *filename)
 {
-  atom_t *atom;
   char  msg[255], buffer[1024];
   char *res, *ptr;
   char *tmp, *res_tmp;
+  char *buf = NULL, *bufend = NULL, *pos = NULL;
   int   count;
-  int   i, j, k, ix, iy, iz;
-  int   type1, type2, col, slot, klo, khi;
-  int   cell_scale[3];
+  int   i, j, k;
+  int   col;
+  int   mapped = 0;
   int   fixed_elements = 0;
   int   h_stress = 0, h_eng = 0, h_boxx = 0, h_boxy = 0, h_boxz = 0, use_force;
   int   have_small_box = 0;
@@ -58,25 +974,17 @@ void read_config(char *filename)
   int   line = 0;
   int   max_type = 0;
   int   sh_dist = 0;		/* short distance flag */
+  int   cached = 0;		/* configurations restored from cache */
   int   str_len;
   int   tag_format = 0;
   int   w_force = 0, w_stress = 0;
-#ifdef APOT
-  int   index;
-#endif /* APOT */
-  FILE *infile;
-  fpos_t filepos;
-  double r, rr, istep, shift, step;
+  size_t len;
+  double val[6];
   double *mindist;
 #ifdef STRESS
   sym_tens *stresses;
 #endif /* STRESS */
-  vector d, dd, iheight;
-#ifdef THREEBODY
-  int   ijk;
-  int   nnn;
-  double ccos;
-#endif /* THREEBODY */
+  conf_read_t *rec;
 
   /* initialize elements array */
   elements = (char **)malloc(ntypes * sizeof(char *));
@@ -107,17 +1015,31 @@ void read_config(char *filename)
 
   nconf = 0;
 
-  /* open file */
-  infile = fopen(filename, "r");
-  if (NULL == infile)
-    error(1, "Could not open file %s\n", filename);
+  /* the angular tables only keep the angles inside the threebody cutoffs */
+#ifdef STIWEB
+  init_stiweb_angles();
+#endif /* STIWEB */
+#ifdef TERSOFF
+  init_tersoff_angles();
+#endif /* TERSOFF */
+
+  /* try to restore the configurations from the cache file */
+  if ('\0' != config_cache[0])
+    cached = read_config_cache(filename, mindist, &w_force, &w_stress, &max_type, &have_small_box);
 
-  printf("Reading the config file >> %s << and calculating neighbor lists ... ", filename);
-  fflush(stdout);
+  if (!cached) {
+    /* read the whole file into memory */
+    buf = map_config(filename, &len, &mapped);
+    pos = buf;
+    bufend = buf + len;
 
-  /* read configurations until the end of the file */
-  do {
-    res = fgets(buffer, 1024, infile);
+    printf("Reading the config file >> %s << and calculating neighbor lists ... ", filename);
+    fflush(stdout);
+  }
+
+  /* read the headers of the configurations until the end of the file */
+  while (!cached && pos < bufend) {
+    res = mem_gets(buffer, 1024, &pos, bufend);
     line++;
     if (NULL == res)
       error(1, "Unexpected end of file in %s", filename);
@@ -152,10 +1074,8 @@ void read_config(char *filename)
     atoms = (atom_t *)realloc(atoms, (natoms + count) * sizeof(atom_t));
     if (NULL == atoms)
       error(1, "Cannot allocate memory for atoms");
-    for (i = 0; i < count; i++) {
-      atoms[natoms + i].neigh = (neigh_t *)malloc(sizeof(neigh_t));
-      reg_for_free(atoms[natoms + i].neigh, "test neigh");
-    }
+    for (i = 0; i < count; i++)
+      atoms[natoms + i].neigh = NULL;
     coheng = (double *)realloc(coheng, (nconf + 1) * sizeof(double));
     if (NULL == coheng)
       error(1, "Cannot allocate memory for cohesive energy");
@@ -193,6 +1113,16 @@ void read_config(char *filename)
     reg_for_free(na_type[nconf], "na_type[%d]", nconf);
     if (NULL == na_type[nconf])
       error(1, "Cannot allocate memory for na_type");
+    conf_read = (conf_read_t *) realloc(conf_read, (nconf + 1) * sizeof(conf_read_t));
+    if (NULL == conf_read)
+      error(1, "Cannot allocate memory for reading the configurations");
+    rec = conf_read + nconf;
+    memset(rec, 0, sizeof(conf_read_t));
+    rec->mindist = (double *)malloc(ntypes * ntypes * sizeof(double));
+    if (NULL == rec->mindist)
+      error(1, "Cannot allocate memory for minimal distance.");
+    for (i = 0; i < ntypes * ntypes; i++)
+      rec->mindist[i] = mindist[i];
 
     for (i = natoms; i < natoms + count; i++)
       init_atom(atoms + i);
@@ -213,7 +1143,9 @@ void read_config(char *filename)
 
     if (tag_format) {
       do {
-	res = fgets(buffer, 1024, infile);
+	res = mem_gets(buffer, 1024, &pos, bufend);
+	if (NULL == res)
+	  error(1, "Unexpected end of file in %s", filename);
 	if ((ptr = strchr(res, '\n')) != NULL)
 	  *ptr = '\0';
 	line++;
@@ -350,7 +1282,6 @@ void read_config(char *filename)
 
 	/* chemical elements */
 	else if (res[1] == 'C') {
-	  fgetpos(infile, &filepos);
 	  if (!have_elements) {
 	    i = 0;
 	    for (j = 0; j < ntypes; j++) {
@@ -419,7 +1350,6 @@ void read_config(char *filename)
 		break;
 	    }
 	  }
-	  fsetpos(infile, &filepos);
 	}
 #ifdef STRESS
 	/* read stress */
@@ -450,13 +1380,21 @@ void read_config(char *filename)
 #endif /* STRESS */
     } else {
       /* read the box vectors */
-      if (3 != fscanf(infile, "%lf %lf %lf\n", &box_x.x, &box_x.y, &box_x.z)) {
+      if (3 != mem_scan(&pos, val, 3))
 	error(1, "Not enough items in box vector on line %d\n", line);
-      } else if (3 != fscanf(infile, "%lf %lf %lf\n", &box_y.x, &box_y.y, &box_y.z)) {
+      box_x.x = val[0];
+      box_x.y = val[1];
+      box_x.z = val[2];
+      if (3 != mem_scan(&pos, val, 3))
 	error(1, "Not enough items in box vector on line %d\n", line);
-      } else if (3 != fscanf(infile, "%lf %lf %lf\n", &box_z.x, &box_z.y, &box_z.z)) {
+      box_y.x = val[0];
+      box_y.y = val[1];
+      box_y.z = val[2];
+      if (3 != mem_scan(&pos, val, 3))
 	error(1, "Not enough items in box vector on line %d\n", line);
-      }
+      box_z.x = val[0];
+      box_z.y = val[1];
+      box_z.z = val[2];
       line += 3;
       if (global_cell_scale != 1.0) {
 	box_x.x *= global_cell_scale;
@@ -471,15 +1409,20 @@ void read_config(char *filename)
       }
 
       /* read cohesive energy */
-      if (1 != fscanf(infile, "%lf\n", &(coheng[nconf])))
+      if (1 != mem_scan(&pos, coheng + nconf, 1))
 	error(1, "Configuration file without cohesive energy -- old format!");
       line++;
 
 #ifdef STRESS
       /* read stress tensor */
-      if (6 != fscanf(infile, "%lf %lf %lf %lf %lf %lf\n", &(stresses->xx),
-	  &(stresses->yy), &(stresses->zz), &(stresses->xy), &(stresses->yz), &(stresses->zx)))
+      if (6 != mem_scan(&pos, val, 6))
 	error(1, "No stresses given -- old format");
+      stresses->xx = val[0];
+      stresses->yy = val[1];
+      stresses->zz = val[2];
+      stresses->xy = val[3];
+      stresses->yz = val[4];
+      stresses->zx = val[5];
       usestress[nconf] = 1;
       line++;
 #endif /* STRESS */
@@ -494,514 +1437,122 @@ void read_config(char *filename)
 
     volume[nconf] = make_box();
 
-    /* read the atoms */
-    for (i = 0; i < count; i++) {
-      atom = atoms + natoms + i;
-      if (7 > fscanf(infile, "%d %lf %lf %lf %lf %lf %lf\n", &(atom->type),
-	  &(atom->pos.x), &(atom->pos.y), &(atom->pos.z), &(atom->force.x), &(atom->force.y),
-	  &(atom->force.z)))
-	error(1, "Corrupt configuration file on line %d\n", line + 1);
-      line++;
-      if (global_cell_scale != 1.0) {
-	atom->pos.x *= global_cell_scale;
-	atom->pos.y *= global_cell_scale;
-	atom->pos.z *= global_cell_scale;
-      }
-      if (atom->type >= ntypes || atom->type < 0)
-	error(1, "Corrupt configuration file on line %d: Incorrect atom type (%d)\n", line, atom->type);
-      atom->absforce = sqrt(dsquare(atom->force.x) + dsquare(atom->force.y) + dsquare(atom->force.z));
-      atom->conf = nconf;
+#ifdef COULOMB
+    /* the reciprocal part of the Ewald sum needs the box vectors */
+    boxes = (vector *)realloc(boxes, 3 * (nconf + 1) * sizeof(vector));
+    if (NULL == boxes)
+      error(1, "Cannot allocate memory for box vectors");
+    boxes[3 * nconf + 0] = box_x;
+    boxes[3 * nconf + 1] = box_y;
+    boxes[3 * nconf + 2] = box_z;
+#endif /* COULOMB */
+
+    /* the box of this configuration for the neighbor tables */
+    rec->box_x = box_x;
+    rec->box_y = box_y;
+    rec->box_z = box_z;
+    rec->tbox_x = tbox_x;
+    rec->tbox_y = tbox_y;
+    rec->tbox_z = tbox_z;
 #ifdef CONTRIB
-      if (have_contrib_box || n_spheres != 0)
-	atom->contrib = does_contribute(atom->pos);
-      else
-	atom->contrib = 1;
-#endif
-      na_type[nconf][atom->type] += 1;
-      max_type = MAX(max_type, atom->type);
-    }
-
-    /* check cell size */
-    /* inverse height in direction */
-    iheight.x = sqrt(SPROD(tbox_x, tbox_x));
-    iheight.y = sqrt(SPROD(tbox_y, tbox_y));
-    iheight.z = sqrt(SPROD(tbox_z, tbox_z));
-
-    if ((ceil(rcutmax * iheight.x) > 30000)
-      || (ceil(rcutmax * iheight.y) > 30000)
-      || (ceil(rcutmax * iheight.z) > 30000))
-      error(1, "Very bizarre small cell size - aborting");
-
-    cell_scale[0] = (int)ceil(rcutmax * iheight.x);
-    cell_scale[1] = (int)ceil(rcutmax * iheight.y);
-    cell_scale[2] = (int)ceil(rcutmax * iheight.z);
-
-    if (cell_scale[0] > 1 || cell_scale[1] > 1 || cell_scale[2] > 1)
-      have_small_box = 1;
-
-#ifdef DEBUG
-    fprintf(stderr, "\nChecking cell size for configuration %d:\n", nconf);
-    fprintf(stderr, "Box dimensions:\n");
-    fprintf(stderr, "     %10.6f %10.6f %10.6f\n", box_x.x, box_x.y, box_x.z);
-    fprintf(stderr, "     %10.6f %10.6f %10.6f\n", box_y.x, box_y.y, box_y.z);
-    fprintf(stderr, "     %10.6f %10.6f %10.6f\n", box_z.x, box_z.y, box_z.z);
-    fprintf(stderr, "Box normals:\n");
-    fprintf(stderr, "     %10.6f %10.6f %10.6f\n", tbox_x.x, tbox_x.y, tbox_x.z);
-    fprintf(stderr, "     %10.6f %10.6f %10.6f\n", tbox_y.x, tbox_y.y, tbox_y.z);
-    fprintf(stderr, "     %10.6f %10.6f %10.6f\n", tbox_z.x, tbox_z.y, tbox_z.z);
-    fprintf(stderr, "Box heights:\n");
-    fprintf(stderr, "     %10.6f %10.6f %10.6f\n", 1.0 / iheight.x, 1.0 / iheight.y, 1.0 / iheight.z);
-    fprintf(stderr, "Potential range:  %f\n", rcutmax);
-    fprintf(stderr, "Periodic images needed: %d %d %d\n\n",
-      2 * cell_scale[0] + 1, 2 * cell_scale[1] + 1, 2 * cell_scale[2] + 1);
-#endif /* DEBUG */
-
-    /* compute the neighbor table */
-    for (i = natoms; i < natoms + count; i++) {
-      atoms[i].num_neigh = 0;
-      /* loop over all atoms for threebody interactions */
-#ifdef THREEBODY
-      for (j = natoms; j < natoms + count; j++) {
-#else
-      for (j = i; j < natoms + count; j++) {
-#endif /* THREEBODY */
-	d.x = atoms[j].pos.x - atoms[i].pos.x;
-	d.y = atoms[j].pos.y - atoms[i].pos.y;
-	d.z = atoms[j].pos.z - atoms[i].pos.z;
-	for (ix = -cell_scale[0]; ix <= cell_scale[0]; ix++) {
-	  for (iy = -cell_scale[1]; iy <= cell_scale[1]; iy++) {
-	    for (iz = -cell_scale[2]; iz <= cell_scale[2]; iz++) {
-	      if ((i == j) && (ix == 0) && (iy == 0) && (iz == 0))
-		continue;
-	      dd.x = d.x + ix * box_x.x + iy * box_y.x + iz * box_z.x;
-	      dd.y = d.y + ix * box_x.y + iy * box_y.y + iz * box_z.y;
-	      dd.z = d.z + ix * box_x.z + iy * box_y.z + iz * box_z.z;
-	      r = sqrt(SPROD(dd, dd));
-	      type1 = atoms[i].type;
-	      type2 = atoms[j].type;
-	      if (r <= rcut[type1 * ntypes + type2]) {
-		if (r <= rmin[type1 * ntypes + type2]) {
-		  sh_dist = nconf;
-		  fprintf(stderr, "Configuration %d: Distance %f\n", nconf, r);
-		  fprintf(stderr, "atom %d (type %d) at pos: %f %f %f\n",
-		    i - natoms, type1, atoms[i].pos.x, atoms[i].pos.y, atoms[i].pos.z);
-		  fprintf(stderr, "atom %d (type %d) at pos: %f %f %f\n", j - natoms, type2, dd.x, dd.y,
-		    dd.z);
-		}
-		atoms[i].neigh =
-		  (neigh_t *)realloc(atoms[i].neigh, (atoms[i].num_neigh + 1) * sizeof(neigh_t));
-		dd.x /= r;
-		dd.y /= r;
-		dd.z /= r;
-		k = atoms[i].num_neigh++;
-		init_neigh(atoms[i].neigh + k);
-		atoms[i].neigh[k].type = type2;
-		atoms[i].neigh[k].nr = j;
-		atoms[i].neigh[k].r = r;
-		atoms[i].neigh[k].r2 = r * r;
-		atoms[i].neigh[k].inv_r = 1.0 / r;
-		atoms[i].neigh[k].dist_r = dd;
-		atoms[i].neigh[k].dist.x = dd.x * r;
-		atoms[i].neigh[k].dist.y = dd.y * r;
-		atoms[i].neigh[k].dist.z = dd.z * r;
-#ifdef ADP
-		atoms[i].neigh[k].sqrdist.xx = dd.x * dd.x * r * r;
-		atoms[i].neigh[k].sqrdist.yy = dd.y * dd.y * r * r;
-		atoms[i].neigh[k].sqrdist.zz = dd.z * dd.z * r * r;
-		atoms[i].neigh[k].sqrdist.yz = dd.y * dd.z * r * r;
-		atoms[i].neigh[k].sqrdist.zx = dd.z * dd.x * r * r;
-		atoms[i].neigh[k].sqrdist.xy = dd.x * dd.y * r * r;
-#endif /* ADP */
-
-		col = (type1 <= type2) ? type1 * ntypes + type2 - ((type1 * (type1 + 1)) / 2)
-		  : type2 * ntypes + type1 - ((type2 * (type2 + 1)) / 2);
-		atoms[i].neigh[k].col[0] = col;
-		mindist[col] = MIN(mindist[col], r);
-
-		/* pre-compute index and shift into potential table */
-
-		/* pair potential */
-		if (!sh_dist) {
-		  if (format == 0 || format == 3) {
-		    rr = r - calc_pot.begin[col];
-		    if (rr < 0) {
-		      fprintf(stderr, "The distance %f is smaller than the beginning\n", r);
-		      fprintf(stderr, "of the potential #%d (r_begin=%f).\n", col, calc_pot.begin[col]);
-		      fflush(stdout);
-		      error(1, "Short distance!");
-		    }
-		    istep = calc_pot.invstep[col];
-		    slot = (int)(rr * istep);
-		    shift = (rr - slot * calc_pot.step[col]) * istep;
-		    slot += calc_pot.first[col];
-		    step = calc_pot.step[col];
-		  } else {	/* format == 4 ! */
-		    klo = calc_pot.first[col];
-		    khi = calc_pot.last[col];
-		    /* bisection */
-		    while (khi - klo > 1) {
-		      slot = (khi + klo) >> 1;
-		      if (calc_pot.xcoord[slot] > r)
-			khi = slot;
-		      else
-			klo = slot;
-		    }
-		    slot = klo;
-		    step = calc_pot.xcoord[khi] - calc_pot.xcoord[klo];
-		    shift = (r - calc_pot.xcoord[klo]) / step;
-
-		  }
-		  /* independent of format - we should be left of last index */
-		  if (slot >= calc_pot.last[col]) {
-		    slot--;
-		    shift += 1.0;
-		  }
-		  atoms[i].neigh[k].shift[0] = shift;
-		  atoms[i].neigh[k].slot[0] = slot;
-		  atoms[i].neigh[k].step[0] = step;
-
-#if defined EAM || defined ADP || defined MEAM
-		  /* transfer function */
-		  col = paircol + type2;
-		  atoms[i].neigh[k].col[1] = col;
-		  if (format == 0 || format == 3) {
-		    rr = r - calc_pot.begin[col];
-		    if (rr < 0) {
-		      fprintf(stderr, "The distance %f is smaller than the beginning\n", r);
-		      fprintf(stderr, "of the potential #%d (r_begin=%f).\n", col, calc_pot.begin[col]);
-		      fflush(stdout);
-		      error(1, "short distance in config.c!");
-		    }
-		    istep = calc_pot.invstep[col];
-		    slot = (int)(rr * istep);
-		    shift = (rr - slot * calc_pot.step[col]) * istep;
-		    slot += calc_pot.first[col];
-		    step = calc_pot.step[col];
-		  } else {	/* format == 4 ! */
-		    klo = calc_pot.first[col];
-		    khi = calc_pot.last[col];
-		    /* bisection */
-		    while (khi - klo > 1) {
-		      slot = (khi + klo) >> 1;
-		      if (calc_pot.xcoord[slot] > r)
-			khi = slot;
-		      else
-			klo = slot;
-		    }
-		    slot = klo;
-		    step = calc_pot.xcoord[khi] - calc_pot.xcoord[klo];
-		    shift = (r - calc_pot.xcoord[klo]) / step;
-
-		  }
-		  /* Check if we are at the last index */
-		  if (slot >= calc_pot.last[col]) {
-		    slot--;
-		    shift += 1.0;
-		  }
-		  atoms[i].neigh[k].shift[1] = shift;
-		  atoms[i].neigh[k].slot[1] = slot;
-		  atoms[i].neigh[k].step[1] = step;
-
-#ifdef TBEAM
-		  /* transfer function - d band */
-		  col = paircol + 2 * ntypes + type2;
-		  atoms[i].neigh[k].col[2] = col;
-		  if (format == 0 || format == 3) {
-		    rr = r - calc_pot.begin[col];
-		    if (rr < 0) {
-		      fprintf(stderr, "The distance %f is smaller than the beginning\n", r);
-		      fprintf(stderr, "of the potential #%d (r_begin=%f).\n", col, calc_pot.begin[col]);
-		      fflush(stdout);
-		      error(1, "short distance in config.c!");
-		    }
-		    istep = calc_pot.invstep[col];
-		    slot = (int)(rr * istep);
-		    shift = (rr - slot * calc_pot.step[col]) * istep;
-		    slot += calc_pot.first[col];
-		    step = calc_pot.step[col];
-		  } else {	/* format == 4 ! */
-		    klo = calc_pot.first[col];
-		    khi = calc_pot.last[col];
-		    /* bisection */
-		    while (khi - klo > 1) {
-		      slot = (khi + klo) >> 1;
-		      if (calc_pot.xcoord[slot] > r)
-			khi = slot;
-		      else
-			klo = slot;
-		    }
-		    slot = klo;
-		    step = calc_pot.xcoord[khi] - calc_pot.xcoord[klo];
-		    shift = (r - calc_pot.xcoord[klo]) / step;
-
-		  }
-		  /* Check if we are at the last index */
-		  if (slot >= calc_pot.last[col]) {
-		    slot--;
-		    shift += 1.0;
-		  }
-		  atoms[i].neigh[k].shift[2] = shift;
-		  atoms[i].neigh[k].slot[2] = slot;
-		  atoms[i].neigh[k].step[2] = step;
-#endif /* TBEAM */
-
-#endif /* EAM || ADP || MEAM */
-
-#ifdef MEAM
-		  /* Store slots and stuff for f(r_ij) */
-		  col = paircol + 2 * ntypes + atoms[i].neigh[k].col[0];
-		  atoms[i].neigh[k].col[2] = col;
-		  if (0 == format || 3 == format) {
-		    rr = r - calc_pot.begin[col];
-		    if (rr < 0) {
-		      fprintf(stderr, "The distance %f is smaller than the beginning\n", r);
-		      fprintf(stderr, "of the potential #%d (r_begin=%f).\n", col, calc_pot.begin[col]);
-		      fflush(stdout);
-		      error(1, "short distance in config.c!");
-		    }
-		    istep = calc_pot.invstep[col];
-		    slot = (int)(rr * istep);
-		    shift = (rr - slot * calc_pot.step[col]) * istep;
-		    slot += calc_pot.first[col];
-		    step = calc_pot.step[col];
-		  } else {	/* format == 4 ! */
-		    klo = calc_pot.first[col];
-		    khi = calc_pot.last[col];
-		    /* bisection */
-		    while (khi - klo > 1) {
-		      slot = (khi + klo) >> 1;
-		      if (calc_pot.xcoord[slot] > r)
-			khi = slot;
-		      else
-			klo = slot;
-		    }
-		    slot = klo;
-		    step = calc_pot.xcoord[khi] - calc_pot.xcoord[klo];
-		    shift = (r - calc_pot.xcoord[klo]) / step;
-
-		  }
-		  /* Check if we are at the last index */
-		  if (slot >= calc_pot.last[col]) {
-		    slot--;
-		    shift += 1.0;
-		  }
-		  atoms[i].neigh[k].shift[2] = shift;
-		  atoms[i].neigh[k].slot[2] = slot;
-		  atoms[i].neigh[k].step[2] = step;
-#endif /* MEAM */
-
-#ifdef ADP
-		  /* dipole part */
-		  col = paircol + 2 * ntypes + atoms[i].neigh[k].col[0];
-		  atoms[i].neigh[k].col[2] = col;
-		  if (format == 0 || format == 3) {
-		    rr = r - calc_pot.begin[col];
-		    if (rr < 0) {
-		      fprintf(stderr, "The distance %f is smaller than the beginning\n", r);
-		      fprintf(stderr, "of the potential #%d (r_begin=%f).\n", col, calc_pot.begin[col]);
-		      fflush(stdout);
-		      error(1, "short distance in config.c!");
-		    }
-		    istep = calc_pot.invstep[col];
-		    slot = (int)(rr * istep);
-		    shift = (rr - slot * calc_pot.step[col]) * istep;
-		    slot += calc_pot.first[col];
-		    step = calc_pot.step[col];
-		  } else {	/* format == 4 ! */
-		    klo = calc_pot.first[col];
-		    khi = calc_pot.last[col];
-		    /* bisection */
-		    while (khi - klo > 1) {
-		      slot = (khi + klo) >> 1;
-		      if (calc_pot.xcoord[slot] > r)
-			khi = slot;
-		      else
-			klo = slot;
-		    }
-		    slot = klo;
-		    step = calc_pot.xcoord[khi] - calc_pot.xcoord[klo];
-		    shift = (r - calc_pot.xcoord[klo]) / step;
-
-		  }
-		  /* Check if we are at the last index */
-		  if (slot >= calc_pot.last[col]) {
-		    slot--;
-		    shift += 1.0;
-		  }
-		  atoms[i].neigh[k].shift[2] = shift;
-		  atoms[i].neigh[k].slot[2] = slot;
-		  atoms[i].neigh[k].step[2] = step;
-
-		  /* quadrupole part */
-		  col = 2 * paircol + 2 * ntypes + atoms[i].neigh[k].col[0];
-		  atoms[i].neigh[k].col[3] = col;
-		  if (format == 0 || format == 3) {
-		    rr = r - calc_pot.begin[col];
-		    if (rr < 0) {
-		      fprintf(stderr, "The distance %f is smaller than the beginning\n", r);
-		      fprintf(stderr, "of the potential #%d (r_begin=%f).\n", col, calc_pot.begin[col]);
-		      fflush(stdout);
-		      error(1, "short distance in config.c!");
-		    }
-		    istep = calc_pot.invstep[col];
-		    slot = (int)(rr * istep);
-		    shift = (rr - slot * calc_pot.step[col]) * istep;
-		    slot += calc_pot.first[col];
-		    step = calc_pot.step[col];
-		  } else {	/* format == 4 ! */
-		    klo = calc_pot.first[col];
-		    khi = calc_pot.last[col];
-		    /* bisection */
-		    while (khi - klo > 1) {
-		      slot = (khi + klo) >> 1;
-		      if (calc_pot.xcoord[slot] > r)
-			khi = slot;
-		      else
-			klo = slot;
-		    }
-		    slot = klo;
-		    step = calc_pot.xcoord[khi] - calc_pot.xcoord[klo];
-		    shift = (r - calc_pot.xcoord[klo]) / step;
-
-		  }
-		  /* Check if we are at the last index */
-		  if (slot >= calc_pot.last[col]) {
-		    slot--;
-		    shift += 1.0;
-		  }
-		  atoms[i].neigh[k].shift[3] = shift;
-		  atoms[i].neigh[k].slot[3] = slot;
-		  atoms[i].neigh[k].step[3] = step;
-#endif /* ADP */
-
-#ifdef STIWEB
-		  /* Store slots and stuff for exp. function */
-		  col = paircol + atoms[i].neigh[k].col[0];
-		  atoms[i].neigh[k].col[1] = col;
-		  if (0 == format || 3 == format) {
-		    rr = r - calc_pot.begin[col];
-		    if (rr < 0) {
-		      fprintf(stderr, "The distance %f is smaller than the beginning\n", r);
-		      fprintf(stderr, "of the potential #%d (r_begin=%f).\n", col, calc_pot.begin[col]);
-		      fflush(stdout);
-		      error(1, "short distance in config.c!");
-		    }
-		    istep = calc_pot.invstep[col];
-		    slot = (int)(rr * istep);
-		    shift = (rr - slot * calc_pot.step[col]) * istep;
-		    slot += calc_pot.first[col];
-		    step = calc_pot.step[col];
-		  } else {	/* format == 4 ! */
-		    klo = calc_pot.first[col];
-		    khi = calc_pot.last[col];
-		    /* bisection */
-		    while (khi - klo > 1) {
-		      slot = (khi + klo) >> 1;
-		      if (calc_pot.xcoord[slot] > r)
-			khi = slot;
-		      else
-			klo = slot;
-		    }
-		    slot = klo;
-		    step = calc_pot.xcoord[khi] - calc_pot.xcoord[klo];
-		    shift = (r - calc_pot.xcoord[klo]) / step;
+    rec->have_contrib_box = have_contrib_box;
+    rec->cbox_o = cbox_o;
+    rec->cbox_a = cbox_a;
+    rec->cbox_b = cbox_b;
+    rec->cbox_c = cbox_c;
+    rec->n_spheres = n_spheres;
+#endif /* CONTRIB */
+    rec->text = pos;
+    rec->line = line;
+    rec->tag_format = tag_format;
 
-		  }
-		  /* Check if we are at the last index */
-		  if (slot >= calc_pot.last[col]) {
-		    slot--;
-		    shift += 1.0;
-		  }
-		  atoms[i].neigh[k].shift[1] = shift;
-		  atoms[i].neigh[k].slot[1] = slot;
-		  atoms[i].neigh[k].step[1] = step;
-#endif /* STIWEB */
+    if (tag_format) {
+      /* the atoms are read later, they end at the next configuration */
+      rec->end = next_config(pos, bufend);
+    } else {
+      /* the end of the atoms is only known after reading them */
+      rec->end = bufend;
+      if (0 == read_atoms(nconf))
+	error(1, "%s", rec->error);
+    }
+    pos = rec->end;
+    line += count;
 
-		}		/* !sh_dist */
-	      }			/* r < r_cut */
-	    }			/* loop over images in z direction */
-	  }			/* loop over images in y direction */
-	}			/* loop over images in x direction */
-      }				/* second loop over atoms (neighbors) */
+    /* increment natoms and configuration number */
+    natoms += count;
+    nconf++;
 
-      reg_for_free(atoms[i].neigh, "neighbor table atom %d", i);
-    }				/* first loop over atoms */
+  }
 
-    /* compute the angular part */
-    /* For TERSOFF we create a full neighbor list, for all other potentials only a half list */
+  if (!cached) {
+    /* read the atoms and compute the neighbor tables in parallel */
+    read_parallel();
+
+    /* collect the results in the order of the configurations */
+    for (i = 0; i < nconf; i++) {
+      rec = conf_read + i;
+      if ('\0' != rec->slot_error[0] && 0 == sh_dist) {
+	fwrite(rec->log_buf, 1, rec->slot_pos, stderr);
+	fputs(rec->slot_msg, stderr);
+	fflush(stdout);
+	error(1, "%s", rec->slot_error);
+      }
+      if ('\0' != rec->error[0]) {
+	fwrite(rec->log_buf, 1, rec->error_pos, stderr);
+	fflush(stdout);
+	error(1, "%s", rec->error);
+      }
+      if (NULL != rec->log_buf) {
+	fwrite(rec->log_buf, 1, rec->log_len, stderr);
+	free(rec->log_buf);
+      }
+      if (rec->sh_dist)
+	sh_dist = rec->sh_dist;
+      for (j = 0; j < ntypes * ntypes; j++)
+	mindist[j] = MIN(mindist[j], rec->mindist[j]);
+      free(rec->mindist);
+      if (rec->have_small_box)
+	have_small_box = 1;
+      for (j = 0; j < ntypes; j++)
+	if (na_type[i][j] > 0)
+	  max_type = MAX(max_type, j);
+#ifdef CONTRIB
+      have_contrib_box = rec->have_contrib_box;
+      cbox_o = rec->cbox_o;
+      cbox_a = rec->cbox_a;
+      cbox_b = rec->cbox_b;
+      cbox_c = rec->cbox_c;
+      n_spheres = rec->n_spheres;
+#endif /* CONTRIB */
+      for (j = cnfstart[i]; j < cnfstart[i] + inconf[i]; j++) {
+#ifdef CONTRIB
+	if (have_contrib_box || n_spheres != 0)
+	  atoms[j].contrib = does_contribute(atoms[j].pos);
+	else
+	  atoms[j].contrib = 1;
+#endif /* CONTRIB */
+	reg_for_free(atoms[j].neigh, "neighbor table atom %d", j);
+      }
 #ifdef THREEBODY
-    for (i = natoms; i < natoms + count; i++) {
-      nnn = atoms[i].num_neigh;
-      ijk = 0;
-      atoms[i].angle_part = (angle_t *) malloc(sizeof(angle_t));
-#ifdef TERSOFF
-      for (j = 0; j < nnn; j++) {
-#else
-      for (j = 0; j < nnn - 1; j++) {
-#endif /* TERSOFF */
-	atoms[i].neigh[j].ijk_start = ijk;
-#ifdef TERSOFF
-	for (k = 0; k < nnn; k++) {
-	  if (j == k)
-	    continue;
-#else
-	for (k = j + 1; k < nnn; k++) {
-#endif /* TERSOFF */
-	  atoms[i].angle_part = (angle_t *) realloc(atoms[i].angle_part, (ijk + 1) * sizeof(angle_t));
-	  init_angle(atoms[i].angle_part + ijk);
-	  ccos =
-	    atoms[i].neigh[j].dist_r.x * atoms[i].neigh[k].dist_r.x +
-	    atoms[i].neigh[j].dist_r.y * atoms[i].neigh[k].dist_r.y +
-	    atoms[i].neigh[j].dist_r.z * atoms[i].neigh[k].dist_r.z;
-
-	  atoms[i].angle_part[ijk].cos = ccos;
-
-	  col = 2 * paircol + 2 * ntypes + atoms[i].type;
-	  if (0 == format || 3 == format) {
-	    if ((fabs(ccos) - 1.0) > 1e-10) {
-	      printf("%.20f %f %d %d %d\n", ccos, calc_pot.begin[col], col, type1, type2);
-	      fflush(stdout);
-	      error(1, "cos out of range, it is strange!");
-	    }
-#ifdef MEAM
-	    istep = calc_pot.invstep[col];
-	    slot = (int)((ccos + 1) * istep);
-	    shift = ((ccos + 1) - slot * calc_pot.step[col]) * istep;
-	    slot += calc_pot.first[col];
-	    step = calc_pot.step[col];
-
-	    /* Don't want lower bound spline knot to be final knot or upper
-	       bound knot will cause trouble since it goes beyond the array */
-	    if (slot >= calc_pot.last[col]) {
-	      slot--;
-	      shift += 1.0;
-	    }
-#endif /* !MEAM */
-	  }
-#ifdef MEAM
-	  atoms[i].angle_part[ijk].shift = shift;
-	  atoms[i].angle_part[ijk].slot = slot;
-	  atoms[i].angle_part[ijk].step = step;
-#endif /* MEAM */
-	  ijk++;
-	}			/* third loop over atoms */
-      }				/* second loop over atoms */
-      atoms[i].num_angles = ijk;
-      reg_for_free(atoms[i].angle_part, "angular part atom %d", i);
-    }				/* first loop over atoms */
+      for (j = cnfstart[i]; j < cnfstart[i] + inconf[i]; j++)
+	reg_for_free(atoms[j].angle_part, "angular part atom %d", j);
 #endif /* THREEBODY */
+    }
+    free(conf_read);
+    conf_read = NULL;
 
-    /* increment natoms and configuration number */
-    natoms += count;
-    nconf++;
-
-  } while (!feof(infile));
+    if (mapped)
+      munmap(buf, len);
+    else
+      free(buf);
 
-  /* close config file */
-  fclose(infile);
+    /* the calculation of the neighbor lists is now complete */
+    printf("done\n");
 
-  /* the calculation of the neighbor lists is now complete */
-  printf("done\n");
+    /* store the neighbor lists for the next run */
+    if ('\0' != config_cache[0] && !sh_dist)
+      write_config_cache(filename, mindist, w_force, w_stress, max_type, have_small_box);
+  }
 
   /* calculate the total number of the atom types */
   na_type = (int **)realloc(na_type, (nconf + 1) * sizeof(int *));
@@ -1045,6 +1596,9 @@ void read_config(char *filename)
   reg_for_free(coheng, "coheng");
   reg_for_free(conf_weight, "conf_weight");
   reg_for_free(volume, "volume");
+#ifdef COULOMB
+  reg_for_free(boxes, "boxes");
+#endif /* COULOMB */
 #ifdef STRESS
   reg_for_free(stress, "stress");
 #endif /* STRESS */
@@ -1164,7 +1718,6 @@ void read_config(char *filename)
 
     for (k = 0; k < paircol; k++) {
       for (i = 0; i < natoms; i++) {
-	type1 = atoms[i].type;
 	for (j = 0; j < atoms[i].num_neigh; j++) {
 	  col = atoms[i].neigh[j].col[0];
 	  if (col == k) {
@@ -1214,10 +1767,12 @@ void read_config(char *filename)
 
   /* transfer functions */
 #if defined EAM || defined ADP || defined MEAM
-  for (i = paircol; i < paircol + ntypes; i++) {
-    apot_table.begin[i] = min * 0.95;
-    opt_pot.begin[i] = min * 0.95;
-    calc_pot.begin[i] = min * 0.95;
+  if (embedding) {
+    for (i = paircol; i < paircol + ntypes; i++) {
+      apot_table.begin[i] = min * 0.95;
+      opt_pot.begin[i] = min * 0.95;
+      calc_pot.begin[i] = min * 0.95;
+    }
   }
 #ifdef TBEAM
   for (i = paircol + 2 * ntypes; i < paircol + 3 * ntypes; i++) {
@@ -1265,14 +1820,7 @@ void read_config(char *filename)
 #endif /* MEAM */
 
   /* recalculate step, invstep and xcoord for new tables */
-  for (i = 0; i < calc_pot.ncols; i++) {
-    calc_pot.step[i] = (calc_pot.end[i] - calc_pot.begin[i]) / (APOT_STEPS - 1);
-    calc_pot.invstep[i] = 1.0 / calc_pot.step[i];
-    for (j = 0; j < APOT_STEPS; j++) {
-      index = i * APOT_STEPS + (i + 1) * 2 + j;
-      calc_pot.xcoord[index] = calc_pot.begin[i] + j * calc_pot.step[i];
-    }
-  }
+  init_apot_sampling();
 
   update_slots();
 #endif /* APOT */
@@ -1409,15 +1957,17 @@ void update_slots(void)
       }
 #if defined EAM || defined ADP || defined MEAM
       /* update slots for eam transfer functions, slot 1 */
-      col = atoms[i].neigh[j].col[1];
-      if (r < calc_pot.end[col]) {
-	rr = r - calc_pot.begin[col];
-	atoms[i].neigh[j].slot[1] = (int)(rr * calc_pot.invstep[col]);
-	atoms[i].neigh[j].step[1] = calc_pot.step[col];
-	atoms[i].neigh[j].shift[1] =
-	  (rr - atoms[i].neigh[j].slot[1] * calc_pot.step[col]) * calc_pot.invstep[col];
-	/* move slot to the right potential */
-	atoms[i].neigh[j].slot[1] += calc_pot.first[col];
+      if (embedding) {
+	col = atoms[i].neigh[j].col[1];
+	if (r < calc_pot.end[col]) {
+	  rr = r - calc_pot.begin[col];
+	  atoms[i].neigh[j].slot[1] = (int)(rr * calc_pot.invstep[col]);
+	  atoms[i].neigh[j].step[1] = calc_pot.step[col];
+	  atoms[i].neigh[j].shift[1] =
+	    (rr - atoms[i].neigh[j].slot[1] * calc_pot.step[col]) * calc_pot.invstep[col];
+	  /* move slot to the right potential */
+	  atoms[i].neigh[j].slot[1] += calc_pot.first[col];
+	}
       }
 #ifdef TBEAM
       /* update slots for tbeam transfer functions, s-band, slot 2 */
@@ -38,6 +38,10 @@
 void  read_config(char *);
 double make_box(void);
 
+/* config_cache.c */
+int   read_config_cache(char *, double *, int *, int *, int *, int *);
+void  write_config_cache(char *, double *, int, int, int, int);
+
 #ifdef CONTRIB
 int   does_contribute(vector);
 #endif /* CONTRIB */
@@ -0,0 +1,451 @@
+/****************************************************************
+ *
+ * config_cache.c: binary cache of configurations and neighbor lists
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2014
+ * 	Institute for Theoretical and Applied Physics
+ * 	University of Stuttgart, D-70550 Stuttgart, Germany
+ *	http://potfit.sourceforge.net/
+ *
+ ****************************************************************
+ *
+ *   This file is part of potfit.
+ *
+ *   potfit is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   potfit is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#include "potfit.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "utils.h"
+
+#define CACHE_MAGIC "potfitcc"
+#define CACHE_VERSION 2
+
+/****************************************************************
+ *
+ *  The cache holds everything read_config() derives from the
+ *  config file before the global post-processing: the atoms with
+ *  their neighbor and angle tables, the per-configuration data and
+ *  the minimal distances. All sections are 8-byte aligned and
+ *  neighbors/angles are stored packed in atom order, so the file
+ *  can be mapped and copied in a few large blocks.
+ *
+ *  The cache is only valid for the same config file contents,
+ *  cutoff radii, potential grid and compile options. These are
+ *  condensed into a 64-bit key stored in the header.
+ *
+ ****************************************************************/
+
+typedef struct {
+  char  magic[8];
+  int   version;
+  int   sizes[3];		/* sizeof atom_t, neigh_t, angle_t */
+  uint64_t key;
+  int   ntypes;
+  int   nconf;
+  int   natoms;
+  int   nneigh;			/* total number of neighbors */
+  int   nangles;		/* total number of angles */
+  int   w_force;
+  int   w_stress;
+  int   max_type;
+  int   have_small_box;
+  int   have_elements;
+} cache_header_t;
+
+/* options which change the layout or contents of the neighbor tables */
+static const char *cache_options = "options:"
+#ifdef APOT
+  " apot"
+#endif /* APOT */
+#ifdef STRESS
+  " stress"
+#endif /* STRESS */
+#ifdef EAM
+  " eam"
+#endif /* EAM */
+#ifdef TBEAM
+  " tbeam"
+#endif /* TBEAM */
+#ifdef ADP
+  " adp"
+#endif /* ADP */
+#ifdef MEAM
+  " meam"
+#endif /* MEAM */
+#ifdef STIWEB
+  " stiweb"
+#endif /* STIWEB */
+#ifdef TERSOFF
+  " tersoff"
+#endif /* TERSOFF */
+#ifdef COULOMB
+  " coulomb"
+#endif /* COULOMB */
+#ifdef DIPOLE
+  " dipole"
+#endif /* DIPOLE */
+#ifdef CONTRIB
+  " contrib"
+#endif /* CONTRIB */
+  ;
+
+static uint64_t cache_key = 0;
+static int have_cache_key = 0;
+
+/****************************************************************
+ *
+ *  fnv_hash: 64-bit FNV-1a hash, continued from hash
+ *
+ ****************************************************************/
+
+static uint64_t fnv_hash(uint64_t hash, const void *data, size_t len)
+{
+  const unsigned char *p = (const unsigned char *)data;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+/****************************************************************
+ *
+ *  get_cache_key: hash of config file, cutoffs and potential grid
+ *
+ ****************************************************************/
+
+static uint64_t get_cache_key(char *filename)
+{
+  FILE *infile;
+  char  buffer[65536];
+  size_t len;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  if (have_cache_key)
+    return cache_key;
+
+  infile = fopen(filename, "rb");
+  if (NULL == infile)
+    error(1, "Could not open file %s\n", filename);
+  while ((len = fread(buffer, 1, sizeof(buffer), infile)) > 0)
+    hash = fnv_hash(hash, buffer, len);
+  fclose(infile);
+
+  hash = fnv_hash(hash, cache_options, strlen(cache_options));
+  hash = fnv_hash(hash, &force_kernel, sizeof(int));
+  hash = fnv_hash(hash, &ntypes, sizeof(int));
+  hash = fnv_hash(hash, &global_cell_scale, sizeof(double));
+  hash = fnv_hash(hash, rcut, ntypes * ntypes * sizeof(double));
+  hash = fnv_hash(hash, rmin, ntypes * ntypes * sizeof(double));
+  hash = fnv_hash(hash, &format, sizeof(int));
+  hash = fnv_hash(hash, &calc_pot.ncols, sizeof(int));
+  hash = fnv_hash(hash, &calc_pot.len, sizeof(int));
+  hash = fnv_hash(hash, calc_pot.begin, calc_pot.ncols * sizeof(double));
+  hash = fnv_hash(hash, calc_pot.step, calc_pot.ncols * sizeof(double));
+  hash = fnv_hash(hash, calc_pot.invstep, calc_pot.ncols * sizeof(double));
+  hash = fnv_hash(hash, calc_pot.first, calc_pot.ncols * sizeof(int));
+  hash = fnv_hash(hash, calc_pot.last, calc_pot.ncols * sizeof(int));
+  hash = fnv_hash(hash, calc_pot.xcoord, calc_pot.len * sizeof(double));
+#ifdef STIWEB
+  hash = fnv_hash(hash, apot_table.sw.cut_3, paircol * sizeof(double));
+  hash = fnv_hash(hash, apot_table.sw.skip_3, ntypes * ntypes * ntypes * sizeof(int));
+#endif /* STIWEB */
+#ifdef TERSOFF
+  hash = fnv_hash(hash, apot_table.tersoff.cut_3, paircol * sizeof(double));
+#endif /* TERSOFF */
+
+  cache_key = hash;
+  have_cache_key = 1;
+
+  return cache_key;
+}
+
+/****************************************************************
+ *
+ *  section helpers, every section is padded to 8 bytes
+ *
+ ****************************************************************/
+
+static size_t padded(size_t len)
+{
+  return (len + 7) & ~((size_t) 7);
+}
+
+static void write_data(FILE *outfile, const void *data, size_t len)
+{
+  if (len > 0 && fwrite(data, 1, len, outfile) != len)
+    error(1, "Could not write config cache %s\n", config_cache);
+}
+
+static void write_padding(FILE *outfile, size_t len)
+{
+  static const char zero[8] = { 0 };
+
+  write_data(outfile, zero, padded(len) - len);
+}
+
+static void write_section(FILE *outfile, const void *data, size_t len)
+{
+  write_data(outfile, data, len);
+  write_padding(outfile, len);
+}
+
+static void read_section(const char *map, size_t *pos, size_t size, void *data, size_t len)
+{
+  if (*pos + padded(len) > size)
+    error(1, "Config cache %s is truncated\n", config_cache);
+  if (len > 0)
+    memcpy(data, map + *pos, len);
+  *pos += padded(len);
+}
+
+/****************************************************************
+ *
+ *  write_config_cache: store the result of the config parser
+ *
+ ****************************************************************/
+
+void write_config_cache(char *filename, double *mindist, int w_force, int w_stress, int max_type,
+  int have_small_box)
+{
+  FILE *outfile;
+  char  tmpfile[260];
+  int   i;
+  cache_header_t header;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, 8);
+  header.version = CACHE_VERSION;
+  header.sizes[0] = sizeof(atom_t);
+  header.sizes[1] = sizeof(neigh_t);
+#ifdef THREEBODY
+  header.sizes[2] = sizeof(angle_t);
+#endif /* THREEBODY */
+  header.key = get_cache_key(filename);
+  header.ntypes = ntypes;
+  header.nconf = nconf;
+  header.natoms = natoms;
+  for (i = 0; i < natoms; i++) {
+    header.nneigh += atoms[i].num_neigh;
+#ifdef THREEBODY
+    header.nangles += atoms[i].num_angles;
+#endif /* THREEBODY */
+  }
+  header.w_force = w_force;
+  header.w_stress = w_stress;
+  header.max_type = max_type;
+  header.have_small_box = have_small_box;
+  header.have_elements = have_elements;
+
+  snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", config_cache);
+  outfile = fopen(tmpfile, "wb");
+  if (NULL == outfile) {
+    warning("Could not open config cache %s for writing\n", tmpfile);
+    return;
+  }
+
+  write_section(outfile, &header, sizeof(header));
+  for (i = 0; i < ntypes; i++)
+    write_section(outfile, elements[i], 3 * sizeof(char));
+  write_section(outfile, mindist, ntypes * ntypes * sizeof(double));
+  write_section(outfile, coheng, nconf * sizeof(double));
+  write_section(outfile, conf_weight, nconf * sizeof(double));
+  write_section(outfile, volume, nconf * sizeof(double));
+#ifdef COULOMB
+  write_section(outfile, boxes, 3 * nconf * sizeof(vector));
+#endif /* COULOMB */
+#ifdef STRESS
+  write_section(outfile, stress, nconf * sizeof(sym_tens));
+  write_section(outfile, usestress, nconf * sizeof(int));
+#endif /* STRESS */
+  write_section(outfile, inconf, nconf * sizeof(int));
+  write_section(outfile, cnfstart, nconf * sizeof(int));
+  write_section(outfile, useforce, nconf * sizeof(int));
+  for (i = 0; i < nconf; i++)
+    write_data(outfile, na_type[i], ntypes * sizeof(int));
+  write_padding(outfile, nconf * ntypes * sizeof(int));
+  write_section(outfile, atoms, natoms * sizeof(atom_t));
+
+  /* neighbor and angle tables of all atoms are packed into one section each */
+  for (i = 0; i < natoms; i++)
+    write_data(outfile, atoms[i].neigh, atoms[i].num_neigh * sizeof(neigh_t));
+  write_padding(outfile, header.nneigh * sizeof(neigh_t));
+#ifdef THREEBODY
+  for (i = 0; i < natoms; i++)
+    write_data(outfile, atoms[i].angle_part, atoms[i].num_angles * sizeof(angle_t));
+  write_padding(outfile, header.nangles * sizeof(angle_t));
+#endif /* THREEBODY */
+
+  /* the data has to be on disk before the rename replaces the old file */
+  if (0 != fflush(outfile) || 0 != fsync(fileno(outfile)) || 0 != fclose(outfile))
+    error(1, "Could not write config cache %s\n", tmpfile);
+  if (0 != rename(tmpfile, config_cache))
+    error(1, "Could not rename %s to %s\n", tmpfile, config_cache);
+
+  printf("Neighbor lists written to config cache >> %s <<\n", config_cache);
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  read_config_cache: restore the parser results from the cache,
+ *	returns 0 if there is no matching cache file
+ *
+ ****************************************************************/
+
+int read_config_cache(char *filename, double *mindist, int *w_force, int *w_stress, int *max_type,
+  int *have_small_box)
+{
+  int   fd, i;
+  size_t pos = 0, size;
+  struct stat st;
+  const char *map;
+  cache_header_t header;
+  neigh_t *neigh;
+#ifdef THREEBODY
+  angle_t *angle;
+#endif /* THREEBODY */
+
+  fd = open(config_cache, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  if (0 != fstat(fd, &st) || (size_t) st.st_size < sizeof(header)) {
+    close(fd);
+    return 0;
+  }
+  size = (size_t) st.st_size;
+  map = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == map)
+    return 0;
+
+  /* check if the cache belongs to this run */
+  read_section(map, &pos, size, &header, sizeof(header));
+  if (0 != memcmp(header.magic, CACHE_MAGIC, 8) || CACHE_VERSION != header.version
+    || header.sizes[0] != sizeof(atom_t) || header.sizes[1] != sizeof(neigh_t)
+#ifdef THREEBODY
+    || header.sizes[2] != sizeof(angle_t)
+#endif /* THREEBODY */
+    || header.ntypes != ntypes || header.key != get_cache_key(filename)) {
+    munmap((void *)map, size);
+    printf("Config cache >> %s << does not match and will be rebuilt.\n", config_cache);
+    return 0;
+  }
+
+  printf("Reading the config file >> %s << from cache >> %s << ... ", filename, config_cache);
+  fflush(stdout);
+
+  nconf = header.nconf;
+  natoms = header.natoms;
+  *w_force = header.w_force;
+  *w_stress = header.w_stress;
+  *max_type = header.max_type;
+  *have_small_box = header.have_small_box;
+  have_elements = header.have_elements;
+
+  atoms = (atom_t *)malloc(natoms * sizeof(atom_t));
+  coheng = (double *)malloc(nconf * sizeof(double));
+  conf_weight = (double *)malloc(nconf * sizeof(double));
+  volume = (double *)malloc(nconf * sizeof(double));
+  inconf = (int *)malloc(nconf * sizeof(int));
+  cnfstart = (int *)malloc(nconf * sizeof(int));
+  useforce = (int *)malloc(nconf * sizeof(int));
+  na_type = (int **)malloc(nconf * sizeof(int *));
+  if (NULL == atoms || NULL == coheng || NULL == conf_weight || NULL == volume || NULL == inconf
+    || NULL == cnfstart || NULL == useforce || NULL == na_type)
+    error(1, "Cannot allocate memory for configurations");
+#ifdef COULOMB
+  boxes = (vector *)malloc(3 * nconf * sizeof(vector));
+  if (NULL == boxes)
+    error(1, "Cannot allocate memory for box vectors");
+#endif /* COULOMB */
+#ifdef STRESS
+  stress = (sym_tens *)malloc(nconf * sizeof(sym_tens));
+  usestress = (int *)malloc(nconf * sizeof(int));
+  if (NULL == stress || NULL == usestress)
+    error(1, "Cannot allocate memory for stress");
+#endif /* STRESS */
+
+  for (i = 0; i < ntypes; i++)
+    read_section(map, &pos, size, elements[i], 3 * sizeof(char));
+  read_section(map, &pos, size, mindist, ntypes * ntypes * sizeof(double));
+  read_section(map, &pos, size, coheng, nconf * sizeof(double));
+  read_section(map, &pos, size, conf_weight, nconf * sizeof(double));
+  read_section(map, &pos, size, volume, nconf * sizeof(double));
+#ifdef COULOMB
+  read_section(map, &pos, size, boxes, 3 * nconf * sizeof(vector));
+#endif /* COULOMB */
+#ifdef STRESS
+  read_section(map, &pos, size, stress, nconf * sizeof(sym_tens));
+  read_section(map, &pos, size, usestress, nconf * sizeof(int));
+#endif /* STRESS */
+  read_section(map, &pos, size, inconf, nconf * sizeof(int));
+  read_section(map, &pos, size, cnfstart, nconf * sizeof(int));
+  read_section(map, &pos, size, useforce, nconf * sizeof(int));
+
+  /* atom counts per type, one block for all configurations */
+  na_type[0] = (int *)malloc(nconf * ntypes * sizeof(int));
+  if (NULL == na_type[0])
+    error(1, "Cannot allocate memory for na_type");
+  reg_for_free(na_type[0], "na_type block");
+  read_section(map, &pos, size, na_type[0], nconf * ntypes * sizeof(int));
+  for (i = 1; i < nconf; i++)
+    na_type[i] = na_type[0] + i * ntypes;
+
+  read_section(map, &pos, size, atoms, natoms * sizeof(atom_t));
+
+  /* the neighbor tables stay packed, the atoms point into the block */
+  neigh = (neigh_t *)malloc(MAX(header.nneigh, 1) * sizeof(neigh_t));
+  if (NULL == neigh)
+    error(1, "Cannot allocate memory for neighbor tables");
+  reg_for_free(neigh, "neighbor tables");
+  read_section(map, &pos, size, neigh, header.nneigh * sizeof(neigh_t));
+  for (i = 0; i < natoms; i++) {
+    atoms[i].neigh = neigh;
+    neigh += atoms[i].num_neigh;
+  }
+
+#ifdef THREEBODY
+  angle = (angle_t *) malloc(MAX(header.nangles, 1) * sizeof(angle_t));
+  if (NULL == angle)
+    error(1, "Cannot allocate memory for angular parts");
+  reg_for_free(angle, "angular parts");
+  read_section(map, &pos, size, angle, header.nangles * sizeof(angle_t));
+  for (i = 0; i < natoms; i++) {
+    atoms[i].angle_part = angle;
+    angle += atoms[i].num_angles;
+  }
+#endif /* THREEBODY */
+
+  munmap((void *)map, size);
+
+  printf("done\n");
+
+  return 1;
+}
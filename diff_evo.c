@@ -33,7 +33,9 @@
 
 #ifdef EVO
 
+#include "checkpoint.h"
 #include "optimize.h"
+#include "potential.h"
 #include "utils.h"
 
 #define D (ndimtot+2)
@@ -181,6 +183,35 @@ void opposite_check(double **P, double *costP, int init)
 
 #endif /* APOT */
 
+/****************************************************************
+ *
+ *  read or write the population from/to a checkpoint
+ *
+ ****************************************************************/
+
+#ifdef APOT
+static void evo_checkpoint(FILE *ckpt, int *count, double *min, double *crit, double *best,
+  double *cost, double **x1, double *jumprate, int *jsteps)
+#else
+static void evo_checkpoint(FILE *ckpt, int *count, double *min, double *crit, double *best,
+  double *cost, double **x1)
+#endif /* APOT */
+{
+  int   i;
+
+  checkpoint_data(ckpt, count, sizeof(int), 1);
+  checkpoint_data(ckpt, min, sizeof(double), 1);
+  checkpoint_data(ckpt, crit, sizeof(double), 1);
+  checkpoint_data(ckpt, best, sizeof(double), D);
+  checkpoint_data(ckpt, cost, sizeof(double), NP);
+  for (i = 0; i < NP; i++)
+    checkpoint_data(ckpt, x1[i], sizeof(double), D);
+#ifdef APOT
+  checkpoint_data(ckpt, jumprate, sizeof(double), 1);
+  checkpoint_data(ckpt, jsteps, sizeof(int), 1);
+#endif /* APOT */
+}
+
 /****************************************************************
  *
  *  differential evolution
@@ -216,8 +247,10 @@ void diff_evo(double *xi)
   double **x1;			/* current population */
   double **x2;			/* next generation */
   FILE *ff;			/* exit flagfile */
+  FILE *ckpt;			/* checkpoint file */
 
-  if (evo_threshold == 0.0)
+  /* a restart in the powell stage skips the evolution */
+  if (evo_threshold == 0.0 || checkpoint_pending(CKPT_POWELL))
     return;
 
   /* vector for force calculation */
@@ -244,24 +277,35 @@ void diff_evo(double *xi)
     }
   }
 
-  printf("Initializing population ... ");
-  fflush(stdout);
+  ckpt = checkpoint_resume(CKPT_EVO);
+  if (NULL != ckpt) {
+#ifdef APOT
+    evo_checkpoint(ckpt, &count, &min, &crit, best, cost, x1, &jumprate, &jsteps);
+#else
+    evo_checkpoint(ckpt, &count, &min, &crit, best, cost, x1);
+#endif /* APOT */
+    checkpoint_end(ckpt);
+    printf("Resuming population from checkpoint\n");
+  } else {
+    printf("Initializing population ... ");
+    fflush(stdout);
 
-  init_population(x1, xi, cost);
-  for (i = 0; i < NP; i++) {
-    if (cost[i] < min) {
-      min = cost[i];
-      for (j = 0; j < D; j++)
-	best[j] = x1[i][j];
+    init_population(x1, xi, cost);
+    for (i = 0; i < NP; i++) {
+      if (cost[i] < min) {
+	min = cost[i];
+	for (j = 0; j < D; j++)
+	  best[j] = x1[i][j];
+      }
+      if (cost[i] > max)
+	max = cost[i];
     }
-    if (cost[i] > max)
-      max = cost[i];
+    printf("done\n");
+
+    crit = max - min;
   }
   for (i = 0; i < NP; i++)
     avg += cost[i];
-  printf("done\n");
-
-  crit = max - min;
 
   printf("Loops\t\tOptimum\t\tAverage error sum\t\tMax-Min\n");
   printf("%5d\t\t%15f\t%20f\t\t%.2e\n", count, min, avg / (NP), crit);
@@ -344,10 +388,10 @@ void diff_evo(double *xi)
 	  for (j = 0; j < ndim; j++)
 #ifdef APOT
 	    apot_table.values[apot_table.idxpot[j]][apot_table.idxparam[j]] = trial[idx[j]];
-	  write_pot_table(&apot_table, tempfile);
+	  write_pot_temp(&apot_table, 0);
 #else
 	    xi[idx[j]] = trial[idx[j]];
-	  write_pot_table(&opt_pot, tempfile);
+	  write_pot_temp(&opt_pot, 0);
 #endif /* APOT */
 	}
 	min = force;
@@ -398,6 +442,17 @@ void diff_evo(double *xi)
     }
 
     crit = max - min;
+
+    /* save the population for a restart */
+    if (checkpoint_due()) {
+      ckpt = checkpoint_begin(CKPT_EVO);
+#ifdef APOT
+      evo_checkpoint(ckpt, &count, &min, &crit, best, cost, x1, &jumprate, &jsteps);
+#else
+      evo_checkpoint(ckpt, &count, &min, &crit, best, cost, x1);
+#endif /* APOT */
+      checkpoint_end(ckpt);
+    }
   }
 
   printf("Finished differential evolution.\n");
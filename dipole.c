@@ -0,0 +1,537 @@
+/****************************************************************
+ *
+ * dipole.c: self-consistent induced dipoles of a configuration
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2014
+ * 	Institute for Theoretical and Applied Physics
+ * 	University of Stuttgart, D-70550 Stuttgart, Germany
+ *	http://potfit.sourceforge.net/
+ *
+ ****************************************************************
+ *
+ *   This file is part of potfit.
+ *
+ *   potfit is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   potfit is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#include "potfit.h"
+
+#ifdef DIPOLE
+
+#include "dipole.h"
+#include "utils.h"
+
+/****************************************************************
+ *
+ *  The induced dipoles solve the linear system
+ *
+ *	p_i = alpha_i (E_stat_i + sum_j T_ij p_j) + p_sr_i
+ *
+ *  with the dipole field tensor T_ij. Divided by alpha_i it reads
+ *  M p = b with the symmetric matrix M = diag(1/alpha) - T, which
+ *  is solved by conjugate gradients with alpha as (Jacobi)
+ *  preconditioner, starting from the dipoles of the previous force
+ *  calculation. dp_solver 0 selects the old iteration with linear
+ *  mixing instead.
+ *
+ *  Both solvers stop when the rms change of the dipoles in one
+ *  step drops below dp_tol and fall back to the static dipoles
+ *  alpha E_stat + p_sr if they do not converge.
+ *
+ *  T_ij = grad_el(r_ij) (3 r_ij r_ij / r_ij^2 - 1) only depends on
+ *  the geometry and kappa. With dp_tensor_mem > 0 the tensors of
+ *  all neighbor pairs are stored once per configuration and kappa,
+ *  up to dp_tensor_mem MB per process, and the field of the dipoles
+ *  becomes a sparse matrix-vector product. Configurations which do
+ *  not fit are still evaluated from the neighbor lists.
+ *
+ ****************************************************************/
+
+#define DP_MAXIT 50		/* maximum number of iterations */
+
+/* work arrays of the solvers, grown as needed */
+static vector *dp_x = NULL;	/* dipoles */
+static vector *dp_r = NULL;	/* residual */
+static vector *dp_z = NULL;	/* preconditioned residual */
+static vector *dp_d = NULL;	/* search direction */
+static vector *dp_q = NULL;	/* field of the dipoles, M applied to d */
+static int dp_len = 0;		/* allocated size of the work arrays */
+static char *dp_warm = NULL;	/* dipoles of the previous call are usable */
+
+/* dipole field tensor of one neighbor pair */
+typedef struct {
+  int   i, k;			/* atoms of the pair within the configuration */
+  double t[6];			/* xx, yy, zz, xy, yz, zx */
+} dp_tensor_t;
+
+/* stored tensors of the local configurations */
+static dp_tensor_t **dp_tens = NULL;	/* tensors of all pairs */
+static int *dp_ntens = NULL;	/* number of pairs, -1 if not stored, -2 if unknown */
+static double *dp_tens_kappa = NULL;	/* kappa of the stored tensors */
+static size_t dp_tens_mem = 0;	/* memory used by the tensors */
+
+/****************************************************************
+ *
+ *  grow_work: make room for n atoms in the work arrays
+ *
+ ****************************************************************/
+
+static void grow_work(int n)
+{
+  if (n > dp_len) {
+    dp_len = n;
+    dp_x = (vector *)realloc(dp_x, dp_len * sizeof(vector));
+    dp_r = (vector *)realloc(dp_r, dp_len * sizeof(vector));
+    dp_z = (vector *)realloc(dp_z, dp_len * sizeof(vector));
+    dp_d = (vector *)realloc(dp_d, dp_len * sizeof(vector));
+    dp_q = (vector *)realloc(dp_q, dp_len * sizeof(vector));
+    if (NULL == dp_x || NULL == dp_r || NULL == dp_z || NULL == dp_d || NULL == dp_q)
+      error(1, "Cannot allocate memory for the dipole solver");
+  }
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  update_tensors: store the dipole field tensors of configuration h
+ *	if they fit into dp_tensor_mem, recompute them if kappa changed
+ *
+ ****************************************************************/
+
+static void update_tensors(int h, double dp_kappa)
+{
+  int   c = h - firstconf;
+  int   i, j, n;
+  double g;
+  size_t size;
+  atom_t *atom;
+  neigh_t *neigh;
+  dp_tensor_t *tens;
+
+  if (dp_tensor_mem <= 0.0)
+    return;
+
+  if (NULL == dp_ntens) {
+    dp_tens = (dp_tensor_t **)calloc(myconf, sizeof(dp_tensor_t *));
+    dp_ntens = (int *)malloc(myconf * sizeof(int));
+    dp_tens_kappa = (double *)malloc(myconf * sizeof(double));
+    if (NULL == dp_tens || NULL == dp_ntens || NULL == dp_tens_kappa)
+      error(1, "Cannot allocate memory for the dipole tensors");
+    reg_for_free(dp_tens, "dipole tensor list");
+    reg_for_free(dp_ntens, "dipole tensor counts");
+    reg_for_free(dp_tens_kappa, "dipole tensor kappa");
+    for (i = 0; i < myconf; i++)
+      dp_ntens[i] = -2;
+  }
+
+  /* does not fit */
+  if (-1 == dp_ntens[c])
+    return;
+
+  /* first call: count the pairs and reserve the memory */
+  if (-2 == dp_ntens[c]) {
+    n = 0;
+    for (i = 0; i < inconf[h]; i++) {
+      atom = conf_atoms + i + cnfstart[h] - firstatom;
+      for (j = 0; j < atom->num_neigh; j++)
+	if (atom->neigh[j].r < dp_cut)
+	  n++;
+    }
+    size = n * sizeof(dp_tensor_t);
+    if (dp_tens_mem + size > dp_tensor_mem * 1048576.0) {
+      dp_ntens[c] = -1;
+      return;
+    }
+    if (n > 0) {
+      dp_tens[c] = (dp_tensor_t *)malloc(size);
+      if (NULL == dp_tens[c])
+	error(1, "Cannot allocate memory for the dipole tensors");
+      reg_for_free(dp_tens[c], "dipole tensors of configuration %d", h);
+    }
+    dp_tens_mem += size;
+    dp_ntens[c] = n;
+  } else if (dp_tens_kappa[c] == dp_kappa) {
+    return;
+  }
+
+  tens = dp_tens[c];
+  for (i = 0; i < inconf[h]; i++) {
+    atom = conf_atoms + i + cnfstart[h] - firstatom;
+    for (j = 0; j < atom->num_neigh; j++) {
+      neigh = atom->neigh + j;
+      if (neigh->r >= dp_cut)
+	continue;
+      g = neigh->grad_el;
+      tens->i = i;
+      tens->k = neigh->nr - cnfstart[h];
+      tens->t[0] = g * (3 * neigh->dist_r.x * neigh->dist_r.x - 1);
+      tens->t[1] = g * (3 * neigh->dist_r.y * neigh->dist_r.y - 1);
+      tens->t[2] = g * (3 * neigh->dist_r.z * neigh->dist_r.z - 1);
+      tens->t[3] = g * 3 * neigh->dist_r.x * neigh->dist_r.y;
+      tens->t[4] = g * 3 * neigh->dist_r.y * neigh->dist_r.z;
+      tens->t[5] = g * 3 * neigh->dist_r.z * neigh->dist_r.x;
+      tens++;
+    }
+  }
+  dp_tens_kappa[c] = dp_kappa;
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  static_dipoles: fall back to the dipoles of the static field
+ *
+ ****************************************************************/
+
+static void static_dipoles(int h, double *dp_alpha)
+{
+  int   i, type1;
+  atom_t *atom;
+
+  for (i = 0; i < inconf[h]; i++) {	/* atoms */
+    atom = conf_atoms + i + cnfstart[h] - firstatom;
+    type1 = atom->type;
+    if (dp_alpha[type1]) {
+      atom->p_ind.x = dp_alpha[type1] * atom->E_stat.x + atom->p_sr.x;
+      atom->p_ind.y = dp_alpha[type1] * atom->E_stat.y + atom->p_sr.y;
+      atom->p_ind.z = dp_alpha[type1] * atom->E_stat.z + atom->p_sr.z;
+      atom->E_ind.x = atom->E_stat.x;
+      atom->E_ind.y = atom->E_stat.y;
+      atom->E_ind.z = atom->E_stat.z;
+    }
+  }
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  dipole_field: field of the dipoles p at all polarizable atoms
+ *	of configuration h, field_i = sum_j T_ij p_j
+ *
+ ****************************************************************/
+
+static void dipole_field(int h, double *dp_alpha, vector *p, vector *field)
+{
+  int   i, j, k, type1, self;
+  double rp;
+  atom_t *atom;
+  neigh_t *neigh;
+
+  for (i = 0; i < inconf[h]; i++) {
+    field[i].x = 0.0;
+    field[i].y = 0.0;
+    field[i].z = 0.0;
+  }
+
+  /* sparse matrix-vector product with the stored tensors,
+     dipoles of non-polarizable atoms are zero */
+  if (NULL != dp_ntens && dp_ntens[h - firstconf] >= 0) {
+    int   n;
+    dp_tensor_t *t = dp_tens[h - firstconf];
+    for (n = 0; n < dp_ntens[h - firstconf]; n++, t++) {
+      i = t->i;
+      k = t->k;
+      field[i].x += t->t[0] * p[k].x + t->t[3] * p[k].y + t->t[5] * p[k].z;
+      field[i].y += t->t[3] * p[k].x + t->t[1] * p[k].y + t->t[4] * p[k].z;
+      field[i].z += t->t[5] * p[k].x + t->t[4] * p[k].y + t->t[2] * p[k].z;
+      if (i != k) {
+	field[k].x += t->t[0] * p[i].x + t->t[3] * p[i].y + t->t[5] * p[i].z;
+	field[k].y += t->t[3] * p[i].x + t->t[1] * p[i].y + t->t[4] * p[i].z;
+	field[k].z += t->t[5] * p[i].x + t->t[4] * p[i].y + t->t[2] * p[i].z;
+      }
+    }
+    return;
+  }
+
+  for (i = 0; i < inconf[h]; i++) {	/* atoms */
+    atom = conf_atoms + i + cnfstart[h] - firstatom;
+    type1 = atom->type;
+    if (!dp_alpha[type1])
+      continue;
+    for (j = 0; j < atom->num_neigh; j++) {	/* neighbors */
+      neigh = atom->neigh + j;
+      if (neigh->r >= dp_cut || !dp_alpha[neigh->type])
+	continue;
+      k = neigh->nr - cnfstart[h];
+      /* In small cells, an atom might interact with itself */
+      self = (k == i) ? 1 : 0;
+
+      rp = SPROD(p[k], neigh->dist_r);
+      field[i].x += neigh->grad_el * (3 * rp * neigh->dist_r.x - p[k].x);
+      field[i].y += neigh->grad_el * (3 * rp * neigh->dist_r.y - p[k].y);
+      field[i].z += neigh->grad_el * (3 * rp * neigh->dist_r.z - p[k].z);
+
+      if (!self) {
+	rp = SPROD(p[i], neigh->dist_r);
+	field[k].x += neigh->grad_el * (3 * rp * neigh->dist_r.x - p[i].x);
+	field[k].y += neigh->grad_el * (3 * rp * neigh->dist_r.y - p[i].y);
+	field[k].z += neigh->grad_el * (3 * rp * neigh->dist_r.z - p[i].z);
+      }
+    }
+  }
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  dipole_cg: preconditioned conjugate gradients for the dipoles
+ *	of configuration h, returns 0 if the iteration failed
+ *
+ ****************************************************************/
+
+static int dipole_cg(int h, double *dp_alpha, int warm)
+{
+  int   i, type1, dp_it = 0;
+  int   n = inconf[h];
+  double alpha, rz, rz_old, zz, dq, step;
+  atom_t *atom;
+
+  grow_work(n);
+
+
+  /* start from the last solution or from the static dipoles */
+  for (i = 0; i < n; i++) {
+    atom = conf_atoms + i + cnfstart[h] - firstatom;
+    alpha = dp_alpha[atom->type];
+    if (!alpha) {
+      dp_x[i].x = 0.0;
+      dp_x[i].y = 0.0;
+      dp_x[i].z = 0.0;
+    } else if (warm) {
+      dp_x[i] = atom->p_ind;
+    } else {
+      dp_x[i].x = alpha * atom->E_stat.x + atom->p_sr.x;
+      dp_x[i].y = alpha * atom->E_stat.y + atom->p_sr.y;
+      dp_x[i].z = alpha * atom->E_stat.z + atom->p_sr.z;
+    }
+  }
+
+  /* r = b - M x, z = alpha r */
+  dipole_field(h, dp_alpha, dp_x, dp_q);
+  rz = 0.0;
+  zz = 0.0;
+  for (i = 0; i < n; i++) {
+    atom = conf_atoms + i + cnfstart[h] - firstatom;
+    type1 = atom->type;
+    alpha = dp_alpha[type1];
+    if (alpha) {
+      dp_r[i].x = atom->E_stat.x + dp_q[i].x + (atom->p_sr.x - dp_x[i].x) / alpha;
+      dp_r[i].y = atom->E_stat.y + dp_q[i].y + (atom->p_sr.y - dp_x[i].y) / alpha;
+      dp_r[i].z = atom->E_stat.z + dp_q[i].z + (atom->p_sr.z - dp_x[i].z) / alpha;
+    } else {
+      dp_r[i].x = 0.0;
+      dp_r[i].y = 0.0;
+      dp_r[i].z = 0.0;
+    }
+    dp_z[i].x = alpha * dp_r[i].x;
+    dp_z[i].y = alpha * dp_r[i].y;
+    dp_z[i].z = alpha * dp_r[i].z;
+    dp_d[i] = dp_z[i];
+    rz += SPROD(dp_r[i], dp_z[i]);
+    zz += SPROD(dp_z[i], dp_z[i]);
+  }
+
+  /* z is the change of the dipoles in one step of the plain iteration */
+  while (sqrt(zz / (3 * n)) >= dp_tol) {
+    if (++dp_it > DP_MAXIT)
+      return 0;
+
+    /* q = M d */
+    dipole_field(h, dp_alpha, dp_d, dp_q);
+    dq = 0.0;
+    for (i = 0; i < n; i++) {
+      alpha = dp_alpha[conf_atoms[i + cnfstart[h] - firstatom].type];
+      if (alpha) {
+	dp_q[i].x = dp_d[i].x / alpha - dp_q[i].x;
+	dp_q[i].y = dp_d[i].y / alpha - dp_q[i].y;
+	dp_q[i].z = dp_d[i].z / alpha - dp_q[i].z;
+      }
+      dq += SPROD(dp_d[i], dp_q[i]);
+    }
+
+    /* M is not positive definite: polarization catastrophe */
+    if (!(dq > 0.0))
+      return 0;
+
+    step = rz / dq;
+    rz_old = rz;
+    rz = 0.0;
+    zz = 0.0;
+    for (i = 0; i < n; i++) {
+      alpha = dp_alpha[conf_atoms[i + cnfstart[h] - firstatom].type];
+      dp_x[i].x += step * dp_d[i].x;
+      dp_x[i].y += step * dp_d[i].y;
+      dp_x[i].z += step * dp_d[i].z;
+      dp_r[i].x -= step * dp_q[i].x;
+      dp_r[i].y -= step * dp_q[i].y;
+      dp_r[i].z -= step * dp_q[i].z;
+      dp_z[i].x = alpha * dp_r[i].x;
+      dp_z[i].y = alpha * dp_r[i].y;
+      dp_z[i].z = alpha * dp_r[i].z;
+      rz += SPROD(dp_r[i], dp_z[i]);
+      zz += SPROD(dp_z[i], dp_z[i]);
+    }
+
+    for (i = 0; i < n; i++) {
+      dp_d[i].x = dp_z[i].x + rz / rz_old * dp_d[i].x;
+      dp_d[i].y = dp_z[i].y + rz / rz_old * dp_d[i].y;
+      dp_d[i].z = dp_z[i].z + rz / rz_old * dp_d[i].z;
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    atom = conf_atoms + i + cnfstart[h] - firstatom;
+    if (dp_alpha[atom->type])
+      atom->p_ind = dp_x[i];
+  }
+
+  return 1;
+}
+
+/****************************************************************
+ *
+ *  dipole_mixing: fixed-point iteration with linear mixing
+ *
+ ****************************************************************/
+
+static void dipole_mixing(int h, double *dp_alpha)
+{
+  int   i, type1;
+  double dp_sum;
+  int   dp_converged = 0, dp_it = 0;
+  double max_diff = 10;
+  atom_t *atom;
+
+  grow_work(inconf[h]);
+
+  while (dp_converged == 0) {
+    dp_sum = 0;
+    for (i = 0; i < inconf[h]; i++) {	/* atoms */
+      atom = conf_atoms + i + cnfstart[h] - firstatom;
+      type1 = atom->type;
+      if (dp_alpha[type1]) {
+
+	if (dp_it) {
+	  /* note: mixing parameter is different from that on in IMD */
+	  atom->E_tot.x = (1 - dp_mix) * atom->E_ind.x + dp_mix * atom->E_old.x + atom->E_stat.x;
+	  atom->E_tot.y = (1 - dp_mix) * atom->E_ind.y + dp_mix * atom->E_old.y + atom->E_stat.y;
+	  atom->E_tot.z = (1 - dp_mix) * atom->E_ind.z + dp_mix * atom->E_old.z + atom->E_stat.z;
+	} else {
+	  atom->E_tot.x = atom->E_ind.x + atom->E_stat.x;
+	  atom->E_tot.y = atom->E_ind.y + atom->E_stat.y;
+	  atom->E_tot.z = atom->E_ind.z + atom->E_stat.z;
+	}
+
+	atom->p_ind.x = dp_alpha[type1] * atom->E_tot.x + atom->p_sr.x;
+	atom->p_ind.y = dp_alpha[type1] * atom->E_tot.y + atom->p_sr.y;
+	atom->p_ind.z = dp_alpha[type1] * atom->E_tot.z + atom->p_sr.z;
+
+	atom->E_old.x = atom->E_ind.x;
+	atom->E_old.y = atom->E_ind.y;
+	atom->E_old.z = atom->E_ind.z;
+
+	atom->E_ind.x = 0.0;
+	atom->E_ind.y = 0.0;
+	atom->E_ind.z = 0.0;
+      }
+    }
+
+    /* induced field of the new dipoles */
+    for (i = 0; i < inconf[h]; i++) {	/* atoms */
+      atom = conf_atoms + i + cnfstart[h] - firstatom;
+      if (dp_alpha[atom->type]) {
+	dp_x[i] = atom->p_ind;
+      } else {
+	dp_x[i].x = 0.0;
+	dp_x[i].y = 0.0;
+	dp_x[i].z = 0.0;
+      }
+    }
+    dipole_field(h, dp_alpha, dp_x, dp_q);
+    for (i = 0; i < inconf[h]; i++) {	/* atoms */
+      atom = conf_atoms + i + cnfstart[h] - firstatom;
+      if (dp_alpha[atom->type])
+	atom->E_ind = dp_q[i];
+    }
+
+    for (i = 0; i < inconf[h]; i++) {	/* atoms */
+      atom = conf_atoms + i + cnfstart[h] - firstatom;
+      type1 = atom->type;
+      if (dp_alpha[type1]) {
+	dp_sum += dsquare(dp_alpha[type1] * (atom->E_old.x - atom->E_ind.x));
+	dp_sum += dsquare(dp_alpha[type1] * (atom->E_old.y - atom->E_ind.y));
+	dp_sum += dsquare(dp_alpha[type1] * (atom->E_old.z - atom->E_ind.z));
+      }
+    }
+
+    dp_sum /= 3 * inconf[h];
+    dp_sum = sqrt(dp_sum);
+
+    if (dp_it) {
+      if ((dp_sum > max_diff) || (dp_it > DP_MAXIT)) {
+	dp_converged = 1;
+	static_dipoles(h, dp_alpha);
+      }
+    }
+
+    if (dp_sum < dp_tol) {
+      dp_converged = 1;
+    }
+
+    dp_it++;
+  }
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  induce_dipoles: calculate the induced dipoles of configuration h
+ *
+ ****************************************************************/
+
+void induce_dipoles(int h, double *dp_alpha, double dp_kappa)
+{
+  update_tensors(h, dp_kappa);
+
+  if (0 == dp_solver) {
+    dipole_mixing(h, dp_alpha);
+    return;
+  }
+
+  if (NULL == dp_warm) {
+    dp_warm = (char *)calloc(myconf, sizeof(char));
+    if (NULL == dp_warm)
+      error(1, "Cannot allocate memory for the dipole solver");
+    reg_for_free(dp_warm, "dipole warm start flags");
+  }
+
+  if (dipole_cg(h, dp_alpha, dp_warm[h - firstconf])) {
+    dp_warm[h - firstconf] = 1;
+  } else {
+    static_dipoles(h, dp_alpha);
+    dp_warm[h - firstconf] = 0;
+  }
+
+  return;
+}
+
+#endif /* DIPOLE */
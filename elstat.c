@@ -0,0 +1,241 @@
+/****************************************************************
+ *
+ * elstat.c: charge independent lattice sums of the monopole interaction
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2014
+ * 	Institute for Theoretical and Applied Physics
+ * 	University of Stuttgart, D-70550 Stuttgart, Germany
+ *	http://potfit.sourceforge.net/
+ *
+ ****************************************************************
+ *
+ *   This file is part of potfit.
+ *
+ *   potfit is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   potfit is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#include "potfit.h"
+
+#if defined COULOMB && !defined DIPOLE
+
+#include "elstat.h"
+#include "ewald.h"
+#include "functions.h"
+#include "utils.h"
+
+/****************************************************************
+ *
+ *  The monopole energy of a configuration is a sum over type
+ *  pairs, E = sum_ab q_a q_b E_ab, where the lattice sums E_ab
+ *  only depend on the geometry and on kappa. The same holds for
+ *  the stresses and, per atom i, for the forces,
+ *  F_i = q_i sum_b q_b F_ib. The sums are computed once and only
+ *  updated if kappa changes, each force calculation then only
+ *  has to contract them with the current charges instead of
+ *  looping over all neighbors.
+ *
+ ****************************************************************/
+
+static double *sum_energy = NULL;	/* E_ab per configuration */
+static vector *sum_force = NULL;	/* F_ib per atom */
+#ifdef STRESS
+static double *sum_stress = NULL;	/* 6 components of S_ab per configuration */
+#endif /* STRESS */
+static double sum_kappa = 0.0;	/* kappa the sums were computed with */
+static int sum_valid = 0;
+
+/****************************************************************
+ *
+ *  update_elstat_sums: (re)compute the lattice sums for all local
+ *	configurations if kappa has changed
+ *
+ ****************************************************************/
+
+void update_elstat_sums(double dp_kappa)
+{
+  int   i, j, h, c, n, type1, type2, self, nat;
+  int   nt2 = ntypes * ntypes;
+  double fnval, grad;
+  double *energy;
+  vector tmp_force, *force;
+#ifdef STRESS
+  double *stress;
+#endif /* STRESS */
+  atom_t *atom;
+  neigh_t *neigh;
+
+  if (sum_valid && dp_kappa == sum_kappa)
+    return;
+
+  nat = cnfstart[firstconf + myconf - 1] + inconf[firstconf + myconf - 1] - firstatom;
+
+  if (NULL == sum_energy) {
+    sum_energy = (double *)malloc(myconf * nt2 * sizeof(double));
+    sum_force = (vector *)malloc(nat * ntypes * sizeof(vector));
+#ifdef STRESS
+    sum_stress = (double *)malloc(6 * myconf * nt2 * sizeof(double));
+    if (NULL == sum_stress)
+      error(1, "Cannot allocate memory for the electrostatic lattice sums");
+    reg_for_free(sum_stress, "elstat stress sums");
+#endif /* STRESS */
+    if (NULL == sum_energy || NULL == sum_force)
+      error(1, "Cannot allocate memory for the electrostatic lattice sums");
+    reg_for_free(sum_energy, "elstat energy sums");
+    reg_for_free(sum_force, "elstat force sums");
+  }
+
+  for (n = 0; n < myconf * nt2; n++)
+    sum_energy[n] = 0.0;
+  for (n = 0; n < nat * ntypes; n++) {
+    sum_force[n].x = 0.0;
+    sum_force[n].y = 0.0;
+    sum_force[n].z = 0.0;
+  }
+#ifdef STRESS
+  for (n = 0; n < 6 * myconf * nt2; n++)
+    sum_stress[n] = 0.0;
+#endif /* STRESS */
+
+  for (h = firstconf; h < firstconf + myconf; h++) {
+    energy = sum_energy + (h - firstconf) * nt2;
+#ifdef STRESS
+    stress = sum_stress + 6 * (h - firstconf) * nt2;
+#endif /* STRESS */
+    for (i = 0; i < inconf[h]; i++) {
+      atom = conf_atoms + i + cnfstart[h] - firstatom;
+      type1 = atom->type;
+      force = sum_force + (i + cnfstart[h] - firstatom) * ntypes;
+      for (j = 0; j < atom->num_neigh; j++) {
+	neigh = atom->neigh + j;
+	type2 = neigh->type;
+
+	/* updating tail-functions - only necessary with variing kappa */
+	if (!apot_table.sw_kappa)
+	  elstat_shift(neigh->r, dp_kappa, &neigh->fnval_el, &neigh->grad_el, &neigh->ggrad_el);
+
+	if (neigh->r >= dp_cut)
+	  continue;
+
+	/* In small cells, an atom might interact with itself */
+	self = (neigh->nr == i + cnfstart[h]) ? 1 : 0;
+
+	fnval = neigh->fnval_el;
+	grad = neigh->grad_el;
+	if (self) {
+	  fnval *= 0.5;
+	  grad *= 0.5;
+	}
+
+	energy[type1 * ntypes + type2] += fnval;
+
+	tmp_force.x = neigh->dist.x * grad;
+	tmp_force.y = neigh->dist.y * grad;
+	tmp_force.z = neigh->dist.z * grad;
+	force[type2].x += tmp_force.x;
+	force[type2].y += tmp_force.y;
+	force[type2].z += tmp_force.z;
+	/* actio = reactio */
+	c = (neigh->nr - firstatom) * ntypes + type1;
+	sum_force[c].x -= tmp_force.x;
+	sum_force[c].y -= tmp_force.y;
+	sum_force[c].z -= tmp_force.z;
+
+#ifdef STRESS
+	c = 6 * (type1 * ntypes + type2);
+	stress[c + 0] -= neigh->dist.x * tmp_force.x;
+	stress[c + 1] -= neigh->dist.y * tmp_force.y;
+	stress[c + 2] -= neigh->dist.z * tmp_force.z;
+	stress[c + 3] -= neigh->dist.x * tmp_force.y;
+	stress[c + 4] -= neigh->dist.y * tmp_force.z;
+	stress[c + 5] -= neigh->dist.z * tmp_force.x;
+#endif /* STRESS */
+      }
+    }
+
+    /* reciprocal part of the Ewald sum */
+    if (dp_ewald > 0.0) {
+#ifdef STRESS
+      ewald_recip(h, dp_kappa, energy, sum_force + (cnfstart[h] - firstatom) * ntypes, stress);
+#else
+      ewald_recip(h, dp_kappa, energy, sum_force + (cnfstart[h] - firstatom) * ntypes, NULL);
+#endif /* STRESS */
+    }
+  }
+
+  sum_kappa = dp_kappa;
+  sum_valid = 1;
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  elstat_sums: contract the lattice sums of configuration h with
+ *	the charges, add forces and stresses and return the energy
+ *
+ ****************************************************************/
+
+double elstat_sums(int h, double *charge, double *forces, int uf, int us)
+{
+  int   i, a, b, n_i;
+  int   nt2 = ntypes * ntypes;
+  double energy = 0.0, q_i;
+  double *e_ab = sum_energy + (h - firstconf) * nt2;
+  vector tmp_force, *force;
+
+  for (a = 0; a < ntypes; a++)
+    for (b = 0; b < ntypes; b++)
+      energy += charge[a] * charge[b] * e_ab[a * ntypes + b];
+
+  if (uf) {
+    for (i = 0; i < inconf[h]; i++) {
+      force = sum_force + (i + cnfstart[h] - firstatom) * ntypes;
+      q_i = charge[conf_atoms[i + cnfstart[h] - firstatom].type];
+      if (0.0 == q_i)
+	continue;
+      tmp_force.x = 0.0;
+      tmp_force.y = 0.0;
+      tmp_force.z = 0.0;
+      for (b = 0; b < ntypes; b++) {
+	tmp_force.x += charge[b] * force[b].x;
+	tmp_force.y += charge[b] * force[b].y;
+	tmp_force.z += charge[b] * force[b].z;
+      }
+      n_i = 3 * (cnfstart[h] + i);
+      forces[n_i + 0] += q_i * tmp_force.x;
+      forces[n_i + 1] += q_i * tmp_force.y;
+      forces[n_i + 2] += q_i * tmp_force.z;
+    }
+#ifdef STRESS
+    if (us) {
+      double *s_ab = sum_stress + 6 * (h - firstconf) * nt2;
+      int   stresses = stress_p + 6 * h;
+      double qq;
+      for (a = 0; a < ntypes; a++)
+	for (b = 0; b < ntypes; b++) {
+	  qq = charge[a] * charge[b];
+	  for (i = 0; i < 6; i++)
+	    forces[stresses + i] += qq * s_ab[6 * (a * ntypes + b) + i];
+	}
+    }
+#endif /* STRESS */
+  }
+
+  return energy;
+}
+
+#endif /* COULOMB && !DIPOLE */
@@ -30,8 +30,214 @@
 
 #include "potfit.h"
 
+#include <pthread.h>
+#include <unistd.h>
+
 #include "utils.h"
 
+#define MAX_WRITE_THREADS 16	/* threads for formatting large output files */
+#define MIN_WRITE_ATOMS 4096	/* minimal number of atoms per thread */
+
+/* writes the lines of atoms first, ..., last - 1 to outfile */
+typedef void (*line_writer_t) (FILE *, int, int, double *);
+
+typedef struct {
+  line_writer_t write_lines;
+  int   first, last;
+  double *force;
+  char *buf;
+  size_t len;
+} write_chunk_t;
+
+/****************************************************************
+ *
+ *  write_parallel: format the lines of all atoms in chunks on
+ *	several threads and write them to outfile in order
+ *
+ *  Every thread prints its atoms into a memory buffer with the
+ *  same fprintf() calls as the serial version, so the output does
+ *  not depend on the number of threads.
+ *
+ ****************************************************************/
+
+static void *write_chunk(void *arg)
+{
+  write_chunk_t *chunk = (write_chunk_t *) arg;
+  FILE *outfile = open_memstream(&chunk->buf, &chunk->len);
+
+  if (NULL == outfile)
+    return arg;
+  chunk->write_lines(outfile, chunk->first, chunk->last, chunk->force);
+  fclose(outfile);
+
+  return NULL;
+}
+
+static void write_parallel(FILE *outfile, line_writer_t write_lines, double *force)
+{
+  int   i, nthreads;
+  int   started[MAX_WRITE_THREADS];
+  pthread_t thread[MAX_WRITE_THREADS];
+  write_chunk_t chunk[MAX_WRITE_THREADS];
+
+  nthreads = MIN(MAX_WRITE_THREADS, (int)sysconf(_SC_NPROCESSORS_ONLN));
+  nthreads = MIN(nthreads, natoms / MIN_WRITE_ATOMS);
+  if (nthreads < 2) {
+    write_lines(outfile, 0, natoms, force);
+    return;
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    chunk[i].write_lines = write_lines;
+    chunk[i].first = (int)((long)natoms * i / nthreads);
+    chunk[i].last = (int)((long)natoms * (i + 1) / nthreads);
+    chunk[i].force = force;
+    chunk[i].buf = NULL;
+    chunk[i].len = 0;
+    started[i] = (0 == pthread_create(&thread[i], NULL, write_chunk, &chunk[i]));
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    if (started[i])
+      pthread_join(thread[i], NULL);
+    if (NULL == chunk[i].buf) {
+      /* the thread could not be started or had no buffer */
+      write_lines(outfile, chunk[i].first, chunk[i].last, force);
+    } else {
+      if (fwrite(chunk[i].buf, 1, chunk[i].len, outfile) != chunk[i].len)
+	error(1, "Could not write error data\n");
+      free(chunk[i].buf);
+    }
+  }
+}
+
+#if defined EAM || defined ADP || defined MEAM
+#ifndef MPI
+
+/****************************************************************
+ *
+ *  write_rho_lines: local electron density of some atoms
+ *
+ ****************************************************************/
+
+static void write_rho_lines(FILE *outfile, int first, int last, double *force)
+{
+  int   i;
+
+  for (i = first; i < last; i++) {
+#if defined EAM || defined ADP
+    fprintf(outfile, "%d\t%d\t%f\n", i, atoms[i].type, atoms[i].rho);
+#elif defined MEAM
+    fprintf(outfile, "%d\t%d\t%f\t%f\t%f\n", i, atoms[i].type, atoms[i].rho,
+      atoms[i].rho_eam, atoms[i].rho - atoms[i].rho_eam);
+#endif /* EAM || ADP */
+  }
+}
+
+#endif /* !MPI */
+#endif /* EAM || ADP || MEAM */
+
+/****************************************************************
+ *
+ *  force_error: contribution of one force component to the error sum
+ *
+ ****************************************************************/
+
+static double force_error(double *force, int i)
+{
+#ifdef CONTRIB
+  if (0 == atoms[i / 3].contrib)
+    return 0.0;
+#endif /* CONTRIB */
+
+  return conf_weight[atoms[i / 3].conf] * dsquare(force[i]);
+}
+
+/****************************************************************
+ *
+ *  write_force_lines: force deviations of some atoms
+ *
+ ****************************************************************/
+
+static void write_force_lines(FILE *outfile, int first, int last, double *force)
+{
+  int   i;
+  double sqr;
+
+  for (i = 3 * first; i < 3 * last; i++) {
+    sqr = force_error(force, i);
+#ifdef FWEIGHT
+    if (i > 2 && i % 3 == 0 && atoms[i / 3].conf != atoms[i / 3 - 1].conf)
+      fprintf(outfile, "\n\n");
+    if (i == 0)
+      fprintf(outfile, "#conf:atom\ttype\tdf^2\t\tf\t\tf0\t\tdf/f0\t\t|f|\n");
+    fprintf(outfile,
+      "%3d:%6d:%s\t%4s\t%20.18f\t%11.6f\t%11.6f\t%14.8f\t%14.8f\n",
+      atoms[i / 3].conf, i / 3, component[i % 3], elements[atoms[i / 3].type],
+      sqr, force[i] * (FORCE_EPS + atoms[i / 3].absforce) + force_0[i],
+      force_0[i], (force[i] * (FORCE_EPS + atoms[i / 3].absforce)) / force_0[i], atoms[i / 3].absforce);
+#else
+    if (i > 2 && i % 3 == 0 && atoms[i / 3].conf != atoms[i / 3 - 1].conf)
+      fprintf(outfile, "\n\n");
+    if (i == 0)
+      fprintf(outfile, "#conf:atom\ttype\tdf^2\t\tf\t\tf0\t\tdf/f0\n");
+    fprintf(outfile, "%3d:%6d:%s\t%4s\t%e\t%e\t%e\t%e\n", atoms[i / 3].conf,
+      i / 3, component[i % 3], elements[atoms[i / 3].type], sqr,
+      force[i] + force_0[i], force_0[i], force[i] / force_0[i]);
+#endif /* FWEIGHT */
+  }
+}
+
+/****************************************************************
+ *
+ *  write_force_csv: force deviations of some atoms as CSV,
+ *	all numbers are written with full precision
+ *
+ ****************************************************************/
+
+static void write_force_csv(FILE *outfile, int first, int last, double *force)
+{
+  int   i;
+  double f;
+
+  for (i = 3 * first; i < 3 * last; i++) {
+#ifdef FWEIGHT
+    f = force[i] * (FORCE_EPS + atoms[i / 3].absforce) + force_0[i];
+#else
+    f = force[i] + force_0[i];
+#endif /* FWEIGHT */
+    fprintf(outfile, "%d,%d,%s,%s,%.17g,%.17g,%.17g,%.17g\n", atoms[i / 3].conf, i / 3, component[i % 3],
+      elements[atoms[i / 3].type], conf_weight[atoms[i / 3].conf], f, force_0[i], force_error(force, i));
+  }
+}
+
+/****************************************************************
+ *
+ *  open_csv: open <output_prefix><suffix> and write the header
+ *
+ ****************************************************************/
+
+static FILE *open_csv(const char *suffix, const char *header)
+{
+  char  file[255];
+  FILE *outfile;
+
+  snprintf(file, 255, "%s%s", output_prefix, suffix);
+  outfile = fopen(file, "w");
+  if (NULL == outfile)
+    error(1, "Could not open file %s\n", file);
+  fprintf(outfile, "%s\n", header);
+
+  return outfile;
+}
+
+static void close_csv(FILE *outfile, const char *suffix)
+{
+  if (0 != fclose(outfile))
+    error(1, "Could not write file %s%s\n", output_prefix, suffix);
+  printf("CSV data written to \t\t\t%s%s\n", output_prefix, suffix);
+}
+
 void write_errors(double *force, double tot)
 {
   int   i, j;
@@ -52,40 +258,36 @@ void write_errors(double *force, double tot)
 #if defined EAM || defined ADP || defined MEAM
 #ifndef MPI
 /* Not much sense in printing rho when not communicated... */
-  if (write_output_files) {
-    strcpy(file, output_prefix);
-    strcat(file, ".rho_loc");
-    outfile = fopen(file, "w");
-    if (NULL == outfile)
-      error(1, "Could not open file %s\n", file);
-  } else {
-    outfile = stdout;
-    printf("Local electron density rho\n");
-  }
-  for (i = 0; i < ntypes; i++) {
-    totdens[i] = 0.0;
-  }
-  fprintf(outfile, "#    atomtype\trho\n");
+  if (embedding) {
+    if (write_output_files) {
+      strcpy(file, output_prefix);
+      strcat(file, ".rho_loc");
+      outfile = fopen(file, "w");
+      if (NULL == outfile)
+	error(1, "Could not open file %s\n", file);
+    } else {
+      outfile = stdout;
+      printf("Local electron density rho\n");
+    }
+    for (i = 0; i < ntypes; i++) {
+      totdens[i] = 0.0;
+    }
+    fprintf(outfile, "#    atomtype\trho\n");
 #ifdef MEAM
-  fprintf(outfile, "#    atomtype\trho\trho_eam\trho_meam\n");
+    fprintf(outfile, "#    atomtype\trho\trho_eam\trho_meam\n");
 #endif /* MEAM */
-  for (i = 0; i < natoms; i++) {
-#if defined EAM || defined ADP
-    fprintf(outfile, "%d\t%d\t%f\n", i, atoms[i].type, atoms[i].rho);
-#elif defined MEAM
-    fprintf(outfile, "%d\t%d\t%f\t%f\t%f\n", i, atoms[i].type, atoms[i].rho,
-      atoms[i].rho_eam, atoms[i].rho - atoms[i].rho_eam);
-#endif /* EAM || ADP */
-    totdens[atoms[i].type] += atoms[i].rho;
-  }
-  fprintf(outfile, "\n");
-  for (i = 0; i < ntypes; i++) {
-    totdens[i] /= (double)na_type[nconf][i];
-    fprintf(outfile, "Average local electron density at atom sites type %d: %f\n", i, totdens[i]);
-  }
-  if (write_output_files) {
-    printf("Local electron density data written to \t%s\n", file);
-    fclose(outfile);
+    write_parallel(outfile, write_rho_lines, NULL);
+    for (i = 0; i < natoms; i++)
+      totdens[atoms[i].type] += atoms[i].rho;
+    fprintf(outfile, "\n");
+    for (i = 0; i < ntypes; i++) {
+      totdens[i] /= (double)na_type[nconf][i];
+      fprintf(outfile, "Average local electron density at atom sites type %d: %f\n", i, totdens[i]);
+    }
+    if (write_output_files) {
+      printf("Local electron density data written to \t%s\n", file);
+      fclose(outfile);
+    }
   }
 #endif /* !MPI */
 #endif /* EAM || ADP || MEAM */
@@ -118,38 +320,18 @@ void write_errors(double *force, double tot)
   strcpy(component[0], "x");
   strcpy(component[1], "y");
   strcpy(component[2], "z");
-  for (i = 0; i < 3 * natoms; i++) {
-#ifdef CONTRIB
-    if (0 == atoms[i / 3].contrib)
-      sqr = 0.0;
-    else
-#endif /* CONTRIB */
-      sqr = conf_weight[atoms[i / 3].conf] * dsquare(force[i]);
-    f_sum += sqr;
-#ifdef FWEIGHT
-    if (i > 2 && i % 3 == 0 && atoms[i / 3].conf != atoms[i / 3 - 1].conf)
-      fprintf(outfile, "\n\n");
-    if (i == 0)
-      fprintf(outfile, "#conf:atom\ttype\tdf^2\t\tf\t\tf0\t\tdf/f0\t\t|f|\n");
-    fprintf(outfile,
-      "%3d:%6d:%s\t%4s\t%20.18f\t%11.6f\t%11.6f\t%14.8f\t%14.8f\n",
-      atoms[i / 3].conf, i / 3, component[i % 3], elements[atoms[i / 3].type],
-      sqr, force[i] * (FORCE_EPS + atoms[i / 3].absforce) + force_0[i],
-      force_0[i], (force[i] * (FORCE_EPS + atoms[i / 3].absforce)) / force_0[i], atoms[i / 3].absforce);
-#else
-    if (i > 2 && i % 3 == 0 && atoms[i / 3].conf != atoms[i / 3 - 1].conf)
-      fprintf(outfile, "\n\n");
-    if (i == 0)
-      fprintf(outfile, "#conf:atom\ttype\tdf^2\t\tf\t\tf0\t\tdf/f0\n");
-    fprintf(outfile, "%3d:%6d:%s\t%4s\t%e\t%e\t%e\t%e\n", atoms[i / 3].conf,
-      i / 3, component[i % 3], elements[atoms[i / 3].type], sqr,
-      force[i] + force_0[i], force_0[i], force[i] / force_0[i]);
-#endif /* FWEIGHT */
-  }
+  for (i = 0; i < 3 * natoms; i++)
+    f_sum += force_error(force, i);
+  write_parallel(outfile, write_force_lines, force);
   if (write_output_files) {
     printf("Force data written to \t\t\t%s\n", file);
     fclose(outfile);
   }
+  if (write_csv) {
+    outfile = open_csv(".force.csv", "conf,atom,component,element,conf_weight,f,f0,error");
+    write_parallel(outfile, write_force_csv, force);
+    close_csv(outfile, ".force.csv");
+  }
 
   /* write energy deviations */
   if (eweight != 0) {
@@ -189,6 +371,14 @@ void write_errors(double *force, double tot)
       printf("Energy data written to \t\t\t%s\n", file);
       fclose(outfile);
     }
+    if (write_csv) {
+      outfile = open_csv(".energy.csv", "conf,conf_weight,e,e0,error");
+      for (i = 0; i < nconf; i++)
+	fprintf(outfile, "%d,%.17g,%.17g,%.17g,%.17g\n", i, conf_weight[i],
+	  force[energy_p + i] + force_0[energy_p + i], force_0[energy_p + i],
+	  conf_weight[i] * eweight * dsquare(force[energy_p + i]));
+      close_csv(outfile, ".energy.csv");
+    }
   } else {
     printf("Energy data not written (energy weight was 0).\n");
   }
@@ -227,58 +417,68 @@ void write_errors(double *force, double tot)
       printf("Stress data written to \t\t\t%s\n", file);
       fclose(outfile);
     }
+    if (write_csv) {
+      outfile = open_csv(".stress.csv", "conf,component,conf_weight,s,s0,error");
+      for (i = stress_p; i < stress_p + 6 * nconf; i++)
+	fprintf(outfile, "%d,%s,%.17g,%.17g,%.17g,%.17g\n", (i - stress_p) / 6,
+	  component[(i - stress_p) % 6], conf_weight[(i - stress_p) / 6], force[i] + force_0[i],
+	  force_0[i], conf_weight[(i - stress_p) / 6] * sweight * dsquare(force[i]));
+      close_csv(outfile, ".stress.csv");
+    }
   } else {
     printf("Stress data not written (stress weight was 0).\n");
   }
 #endif /* STRESS */
 
 #if ( defined EAM || defined ADP || defined MEAM ) && !defined NOPUNISH
-  /* write EAM punishments */
-  if (write_output_files) {
-    strcpy(file, output_prefix);
-    strcat(file, ".punish");
-    outfile = fopen(file, "w");
-    if (NULL == outfile)
-      error(1, "Could not open file %s\n", file);
-    fprintf(outfile, "Limiting constraints\n");
-    fprintf(outfile, "#conf\tp^2\t\tpunishment\n");
-  } else {
-    outfile = stdout;
-    printf("Punishment Constraints\n");
-  }
-  for (i = limit_p; i < dummy_p; i++) {
-    sqr = dsquare(force[i]);
-    if (write_output_files)
-      fprintf(outfile, "%d\t%f\t%f\n", i - limit_p, sqr, force[i] + force_0[i]);
-    else
-      fprintf(outfile, "%d %f %f %f %f\n", i - limit_p, sqr,
-	force[i] + force_0[i], force_0[i], force[i] / force_0[i]);
-  }
-  if (write_output_files) {
-    fprintf(outfile, "\nDummy Constraints\n");
-    fprintf(outfile, "element\tU^2\t\tU'^2\t\tU\t\tU'\n");
-    for (i = dummy_p; i < dummy_p + ntypes; i++) {
-#ifndef RESCALE
+  if (embedding) {
+    /* write EAM punishments */
+    if (write_output_files) {
+      strcpy(file, output_prefix);
+      strcat(file, ".punish");
+      outfile = fopen(file, "w");
+      if (NULL == outfile)
+	error(1, "Could not open file %s\n", file);
+      fprintf(outfile, "Limiting constraints\n");
+      fprintf(outfile, "#conf\tp^2\t\tpunishment\n");
+    } else {
+      outfile = stdout;
+      printf("Punishment Constraints\n");
+    }
+    for (i = limit_p; i < dummy_p; i++) {
       sqr = dsquare(force[i]);
-      fprintf(outfile, "%s\t%f\t%f\t%f\t%g\n", elements[i - dummy_p], 0.0, sqr, 0.0, force[i]);
+      if (write_output_files)
+	fprintf(outfile, "%d\t%f\t%f\n", i - limit_p, sqr, force[i] + force_0[i]);
+      else
+	fprintf(outfile, "%d %f %f %f %f\n", i - limit_p, sqr,
+	  force[i] + force_0[i], force_0[i], force[i] / force_0[i]);
+    }
+    if (write_output_files) {
+      fprintf(outfile, "\nDummy Constraints\n");
+      fprintf(outfile, "element\tU^2\t\tU'^2\t\tU\t\tU'\n");
+      for (i = dummy_p; i < dummy_p + ntypes; i++) {
+#ifndef RESCALE
+	sqr = dsquare(force[i]);
+	fprintf(outfile, "%s\t%f\t%f\t%f\t%g\n", elements[i - dummy_p], 0.0, sqr, 0.0, force[i]);
 #else
-      sqr = dsquare(force[i + ntypes]);
-      fprintf(outfile, "%s\t%f\t%f\t%f\t%f\n", elements[i - dummy_p], sqr, dsquare(force[i]),
-	force[i + ntypes], force[i]);
+	sqr = dsquare(force[i + ntypes]);
+	fprintf(outfile, "%s\t%f\t%f\t%f\t%f\n", elements[i - dummy_p], sqr, dsquare(force[i]),
+	  force[i + ntypes], force[i]);
 #endif /* !RESCALE */
-    }
+      }
 #ifndef RESCALE
-    fprintf(outfile, "\nNORESCALE: <n>!=1\n");
-    fprintf(outfile, "<n>=%f\n", force[dummy_p + ntypes] / DUMMY_WEIGHT + 1);
-    fprintf(outfile, "Additional punishment of %f added.\n", dsquare(force[dummy_p + ntypes]));
+      fprintf(outfile, "\nNORESCALE: <n>!=1\n");
+      fprintf(outfile, "<n>=%f\n", force[dummy_p + ntypes] / DUMMY_WEIGHT + 1);
+      fprintf(outfile, "Additional punishment of %f added.\n", dsquare(force[dummy_p + ntypes]));
 #endif /* !RESCALE */
-    printf("Punishment constraints data written to \t%s\n", file);
-    fclose(outfile);
-  } else {
-    fprintf(outfile, "Dummy Constraints\n");
-    for (i = dummy_p; i < dummy_p + ntypes; i++) {
-      sqr = dsquare(force[i]);
-      fprintf(outfile, "%s\t%f\t%f\n", elements[i - dummy_p], sqr, force[i]);
+      printf("Punishment constraints data written to \t%s\n", file);
+      fclose(outfile);
+    } else {
+      fprintf(outfile, "Dummy Constraints\n");
+      for (i = dummy_p; i < dummy_p + ntypes; i++) {
+	sqr = dsquare(force[i]);
+	fprintf(outfile, "%s\t%f\t%f\n", elements[i - dummy_p], sqr, force[i]);
+      }
     }
   }
 #endif /* (EAM || ADP || MEAM) && !NOPUNISH */
@@ -0,0 +1,264 @@
+/****************************************************************
+ *
+ * ewald.c: reciprocal space part of the Ewald sum of point charges
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2014
+ * 	Institute for Theoretical and Applied Physics
+ * 	University of Stuttgart, D-70550 Stuttgart, Germany
+ *	http://potfit.sourceforge.net/
+ *
+ ****************************************************************
+ *
+ *   This file is part of potfit.
+ *
+ *   potfit is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   potfit is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#include "potfit.h"
+
+#ifdef COULOMB
+
+#include "ewald.h"
+#include "utils.h"
+
+/****************************************************************
+ *
+ *  With dp_ewald > 0 the monopole interaction is evaluated as a
+ *  full Ewald sum with kappa as splitting parameter: the real
+ *  space part erfc(kappa r)/r is summed over the neighbor list
+ *  without shift, the self energy is subtracted in the force
+ *  routine and the reciprocal part is added here. The k-space
+ *  cutoff follows from dp_ewald = exp(-k_c^2 / (4 kappa^2)).
+ *
+ *  The structure factors are built from per-atom tables of
+ *  exp(i n b_a r_j) along the three reciprocal vectors b_a, so
+ *  only 3 (n_max + 1) sin/cos evaluations per atom are needed.
+ *  They are split by atom type, so the result only has to be
+ *  recomputed when kappa changes, see elstat.c.
+ *
+ ****************************************************************/
+
+/* work arrays, grown as needed */
+static double *ew_cos = NULL;	/* cos(n b_a r_j) for all three directions */
+static double *ew_sin = NULL;	/* sin(n b_a r_j) for all three directions */
+static double *ew_ckr = NULL;	/* cos(k r_j) for the current k */
+static double *ew_skr = NULL;	/* sin(k r_j) for the current k */
+static int *ew_type = NULL;	/* types of the atoms */
+static int ew_table = 0;	/* allocated size of ew_cos and ew_sin */
+static int ew_atoms = 0;	/* allocated size of the per-atom arrays */
+
+/****************************************************************
+ *
+ *  init_ewald: check the Ewald parameters
+ *
+ ****************************************************************/
+
+void init_ewald(void)
+{
+  double kappa = apot_table.dp_kappa[0];
+  double r_cut;
+
+#ifdef DIPOLE
+  error(1, "The Ewald sum (dp_ewald) is only implemented for point charges.\n");
+#endif /* DIPOLE */
+
+  if (dp_ewald >= 1.0)
+    error(1, "The Ewald accuracy dp_ewald has to be smaller than 1.\n");
+  if (kappa <= 0.0)
+    error(1, "The Ewald sum needs a positive dp_kappa.\n");
+
+  /* real space cutoff for the requested accuracy */
+  r_cut = sqrt(-log(dp_ewald)) / kappa;
+  if (dp_cut < r_cut)
+    warning("dp_cut = %f is too short for an Ewald accuracy of %g, use at least %f\n", dp_cut,
+      dp_ewald, r_cut);
+  if (rcutmax < MIN(r_cut, dp_cut))
+    warning("The neighbor lists end at %f, the real space part of the Ewald sum needs %f\n", rcutmax,
+      MIN(r_cut, dp_cut));
+
+  printf("Using Ewald summation with accuracy %g (k_cut = %f for kappa = %f)\n", dp_ewald,
+    2.0 * kappa * sqrt(-log(dp_ewald)), kappa);
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  ewald_recip: reciprocal part of the Ewald sum for configuration h
+ *	per unit charge product, like the lattice sums in elstat.c:
+ *	energy[a * ntypes + b] and virial[6 * (a * ntypes + b) + i]
+ *	are summed over the type pair (a,b), force[j * ntypes + b]
+ *	is the force on atom j of the configuration from all atoms
+ *	of type b; virial may be NULL
+ *
+ ****************************************************************/
+
+void ewald_recip(int h, double dp_kappa, double *energy, vector *force, double *virial)
+{
+  int   i, j, a, b, n1, n2, n3, nat, size;
+  int   nmax[3], off[3];
+  int   count[ntypes];
+  double vol, kcut2, k2, ef, pref, w, e_ab;
+  double c12, s12, c, s, fac;
+  double sum_c[ntypes], sum_s[ntypes];
+  vector bv[3], k, r;
+  vector *box = boxes + 3 * h;
+  atom_t *atom;
+
+  if (dp_kappa <= 0.0)
+    return;
+
+  nat = inconf[h];
+
+  /* reciprocal lattice vectors */
+  bv[0] = vec_prod(box[1], box[2]);
+  bv[1] = vec_prod(box[2], box[0]);
+  bv[2] = vec_prod(box[0], box[1]);
+  vol = SPROD(box[0], bv[0]);
+  for (i = 0; i < 3; i++) {
+    bv[i].x *= 2.0 * M_PI / vol;
+    bv[i].y *= 2.0 * M_PI / vol;
+    bv[i].z *= 2.0 * M_PI / vol;
+  }
+  vol = fabs(vol);
+
+  /* k vectors inside the cutoff sphere satisfy |n_a| <= k_cut |box_a| / 2 pi */
+  kcut2 = -4.0 * dp_kappa * dp_kappa * log(dp_ewald);
+  size = 0;
+  for (i = 0; i < 3; i++) {
+    nmax[i] = (int)(sqrt(kcut2 * SPROD(box[i], box[i])) / (2.0 * M_PI));
+    off[i] = size;
+    size += nmax[i] + 1;
+  }
+
+  /* grow the work arrays */
+  if (size * nat > ew_table) {
+    ew_table = size * nat;
+    ew_cos = (double *)realloc(ew_cos, ew_table * sizeof(double));
+    ew_sin = (double *)realloc(ew_sin, ew_table * sizeof(double));
+    if (NULL == ew_cos || NULL == ew_sin)
+      error(1, "Cannot allocate memory for the Ewald sum");
+  }
+  if (nat > ew_atoms) {
+    ew_atoms = nat;
+    ew_ckr = (double *)realloc(ew_ckr, ew_atoms * sizeof(double));
+    ew_skr = (double *)realloc(ew_skr, ew_atoms * sizeof(double));
+    ew_type = (int *)realloc(ew_type, ew_atoms * sizeof(int));
+    if (NULL == ew_ckr || NULL == ew_skr || NULL == ew_type)
+      error(1, "Cannot allocate memory for the Ewald sum");
+  }
+
+  /* tables of exp(i n b_a r_j) by recursion */
+  for (a = 0; a < ntypes; a++)
+    count[a] = 0;
+  for (j = 0; j < nat; j++) {
+    atom = conf_atoms + cnfstart[h] - firstatom + j;
+    r = atom->pos;
+    ew_type[j] = atom->type;
+    count[atom->type]++;
+    for (i = 0; i < 3; i++) {
+      ew_cos[off[i] * nat + j] = 1.0;
+      ew_sin[off[i] * nat + j] = 0.0;
+      if (nmax[i] > 0) {
+	c = SPROD(bv[i], r);
+	ew_cos[(off[i] + 1) * nat + j] = cos(c);
+	ew_sin[(off[i] + 1) * nat + j] = sin(c);
+      }
+      for (n1 = 2; n1 <= nmax[i]; n1++) {
+	c = ew_cos[(off[i] + n1 - 1) * nat + j];
+	s = ew_sin[(off[i] + n1 - 1) * nat + j];
+	ew_cos[(off[i] + n1) * nat + j] =
+	  c * ew_cos[(off[i] + 1) * nat + j] - s * ew_sin[(off[i] + 1) * nat + j];
+	ew_sin[(off[i] + n1) * nat + j] =
+	  s * ew_cos[(off[i] + 1) * nat + j] + c * ew_sin[(off[i] + 1) * nat + j];
+      }
+    }
+  }
+
+  /* sum over half of k space, k and -k contribute equally */
+  pref = 4.0 * M_PI * dp_eps / vol;
+  for (n1 = 0; n1 <= nmax[0]; n1++) {
+    for (n2 = -nmax[1]; n2 <= nmax[1]; n2++) {
+      for (n3 = -nmax[2]; n3 <= nmax[2]; n3++) {
+	if (0 == n1 && (n2 < 0 || (0 == n2 && n3 <= 0)))
+	  continue;
+	k.x = n1 * bv[0].x + n2 * bv[1].x + n3 * bv[2].x;
+	k.y = n1 * bv[0].y + n2 * bv[1].y + n3 * bv[2].y;
+	k.z = n1 * bv[0].z + n2 * bv[1].z + n3 * bv[2].z;
+	k2 = SPROD(k, k);
+	if (k2 > kcut2)
+	  continue;
+
+	/* partial structure factors S_b(k) = sum_{j of type b} exp(i k r_j) */
+	for (b = 0; b < ntypes; b++) {
+	  sum_c[b] = 0.0;
+	  sum_s[b] = 0.0;
+	}
+	for (j = 0; j < nat; j++) {
+	  /* exp(i (n1 b_1 + n2 b_2) r_j), negative n via complex conjugate */
+	  c = ew_cos[(off[1] + abs(n2)) * nat + j];
+	  s = (n2 < 0) ? -ew_sin[(off[1] - n2) * nat + j] : ew_sin[(off[1] + n2) * nat + j];
+	  c12 = ew_cos[(off[0] + n1) * nat + j] * c - ew_sin[(off[0] + n1) * nat + j] * s;
+	  s12 = ew_sin[(off[0] + n1) * nat + j] * c + ew_cos[(off[0] + n1) * nat + j] * s;
+	  c = ew_cos[(off[2] + abs(n3)) * nat + j];
+	  s = (n3 < 0) ? -ew_sin[(off[2] - n3) * nat + j] : ew_sin[(off[2] + n3) * nat + j];
+	  ew_ckr[j] = c12 * c - s12 * s;
+	  ew_skr[j] = s12 * c + c12 * s;
+	  sum_c[ew_type[j]] += ew_ckr[j];
+	  sum_s[ew_type[j]] += ew_skr[j];
+	}
+
+	ef = pref * exp(-k2 / (4.0 * dp_kappa * dp_kappa)) / k2;
+	w = 2.0 * (1.0 / (4.0 * dp_kappa * dp_kappa) + 1.0 / k2);
+	for (a = 0; a < ntypes; a++)
+	  for (b = 0; b < ntypes; b++) {
+	    e_ab = ef * (sum_c[a] * sum_c[b] + sum_s[a] * sum_s[b]);
+	    energy[a * ntypes + b] += e_ab;
+	    if (NULL != virial) {
+	      virial[6 * (a * ntypes + b) + 0] += e_ab * (1.0 - w * k.x * k.x);
+	      virial[6 * (a * ntypes + b) + 1] += e_ab * (1.0 - w * k.y * k.y);
+	      virial[6 * (a * ntypes + b) + 2] += e_ab * (1.0 - w * k.z * k.z);
+	      virial[6 * (a * ntypes + b) + 3] -= e_ab * w * k.x * k.y;
+	      virial[6 * (a * ntypes + b) + 4] -= e_ab * w * k.y * k.z;
+	      virial[6 * (a * ntypes + b) + 5] -= e_ab * w * k.z * k.x;
+	    }
+	  }
+	for (j = 0; j < nat; j++)
+	  for (b = 0; b < ntypes; b++) {
+	    fac = 2.0 * ef * (ew_skr[j] * sum_c[b] - ew_ckr[j] * sum_s[b]);
+	    force[j * ntypes + b].x += fac * k.x;
+	    force[j * ntypes + b].y += fac * k.y;
+	    force[j * ntypes + b].z += fac * k.z;
+	  }
+      }
+    }
+  }
+
+  /* neutralizing background for configurations which are not neutral */
+  for (a = 0; a < ntypes; a++)
+    for (b = 0; b < ntypes; b++) {
+      e_ab = -M_PI * dp_eps * count[a] * count[b] / (2.0 * vol * dp_kappa * dp_kappa);
+      energy[a * ntypes + b] += e_ab;
+      if (NULL != virial)
+	for (i = 0; i < 3; i++)
+	  virial[6 * (a * ntypes + b) + i] += e_ab;
+    }
+
+  return;
+}
+
+#endif /* COULOMB */
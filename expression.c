@@ -0,0 +1,725 @@
+/****************************************************************
+ *
+ * expression.c: user-defined analytic functions
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2014
+ * 	Institute for Theoretical and Applied Physics
+ * 	University of Stuttgart, D-70550 Stuttgart, Germany
+ *	http://potfit.sourceforge.net/
+ *
+ ****************************************************************
+ *
+ *   This file is part of potfit.
+ *
+ *   potfit is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   potfit is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#include "potfit.h"
+
+#ifdef APOT
+
+#include <ctype.h>
+
+#include "expression.h"
+#include "functions.h"
+#include "utils.h"
+
+/****************************************************************
+ *
+ *  A line of the form
+ *
+ *    function name p_1 p_2 ... p_n = expression
+ *
+ *  in the potential file defines a new analytic function "name"
+ *  with n parameters that can be used like the built-in ones,
+ *  also with the _sc suffix. The expression may contain the
+ *  distance r, the parameters, numbers, pi, the operators
+ *  + - * / ^ (or **) and the functions listed in expr_func.
+ *
+ *  The expression is parsed once into a tree, constant subtrees
+ *  are folded and small integer powers are turned into products.
+ *  The result is stored as bytecode for a stack machine. The batch
+ *  version runs every instruction over a whole column of points,
+ *  so the loops can be vectorized and exp/pow use the vector math
+ *  routines when the potential tables are updated.
+ *
+ ****************************************************************/
+
+#define EXPR_STACK 32		/* maximum stack depth of the bytecode */
+#define EXPR_POWI 16		/* largest integer power done by multiplication */
+#define EXPR_MAX_PAR 16		/* maximum number of parameters */
+
+/* bytecode instructions */
+enum {
+  OP_CONST, OP_R, OP_PAR, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW, OP_POWI, OP_NEG,
+  OP_EXP, OP_LOG, OP_SQRT, OP_SIN, OP_COS, OP_TAN, OP_SINH, OP_COSH, OP_TANH,
+  OP_ATAN, OP_ERF, OP_ERFC, OP_ABS
+};
+
+/* functions that can be used in expressions */
+static const struct {
+  const char *name;
+  int   op;
+  double (*f) (double);
+} expr_func[] = {
+  {"exp", OP_EXP, exp}, {"log", OP_LOG, log}, {"sqrt", OP_SQRT, sqrt},
+  {"sin", OP_SIN, sin}, {"cos", OP_COS, cos}, {"tan", OP_TAN, tan},
+  {"sinh", OP_SINH, sinh}, {"cosh", OP_COSH, cosh}, {"tanh", OP_TANH, tanh},
+  {"atan", OP_ATAN, atan}, {"erf", OP_ERF, erf}, {"erfc", OP_ERFC, erfc},
+  {"abs", OP_ABS, fabs}
+};
+
+#define N_EXPR_FUNC ((int)(sizeof(expr_func) / sizeof(expr_func[0])))
+
+typedef struct expr_node {
+  int   op;
+  int   arg;			/* parameter index or integer exponent */
+  double val;			/* value of constants */
+  struct expr_node *a, *b;	/* operands */
+} expr_node;
+
+typedef struct {
+  int   op;
+  int   arg;
+  double val;
+} expr_instr;
+
+typedef struct {
+  char *def;			/* the definition as read from the file */
+  int   n_par;
+  int   len;			/* number of instructions */
+  int   depth;			/* required stack depth */
+  expr_instr *code;
+} expr_prog;
+
+/* state of the parser */
+typedef struct {
+  const char *s;		/* current position */
+  const char *name;		/* name of the function */
+  int   n_par;
+  char  par[EXPR_MAX_PAR][30];	/* names of the parameters */
+} expr_parser;
+
+static expr_prog expr_list[EXPR_MAX];
+static int n_expr = 0;
+
+/* scratch space for the batch evaluation */
+static double *expr_buf = NULL;
+static int expr_buf_len = 0;
+
+static expr_node *parse_sum(expr_parser *);
+static expr_node *parse_unary(expr_parser *);
+
+/****************************************************************
+ *
+ * evaluate a function for a single distance
+ *
+ ****************************************************************/
+
+static double powi(double x, int n)
+{
+  double y = 1.0;
+  int   m = abs(n);
+
+  while (m) {
+    if (m & 1)
+      y *= x;
+    x *= x;
+    m >>= 1;
+  }
+
+  return (n < 0) ? 1.0 / y : y;
+}
+
+static double expr_eval(const expr_prog *e, double r, const double *p)
+{
+  int   i, sp = -1;
+  double st[EXPR_STACK];
+  const expr_instr *c;
+
+  for (i = 0; i < e->len; i++) {
+    c = e->code + i;
+    switch (c->op) {
+	case OP_CONST:
+	  st[++sp] = c->val;
+	  break;
+	case OP_R:
+	  st[++sp] = r;
+	  break;
+	case OP_PAR:
+	  st[++sp] = p[c->arg];
+	  break;
+	case OP_ADD:
+	  sp--;
+	  st[sp] += st[sp + 1];
+	  break;
+	case OP_SUB:
+	  sp--;
+	  st[sp] -= st[sp + 1];
+	  break;
+	case OP_MUL:
+	  sp--;
+	  st[sp] *= st[sp + 1];
+	  break;
+	case OP_DIV:
+	  sp--;
+	  st[sp] /= st[sp + 1];
+	  break;
+	case OP_POW:
+	  sp--;
+	  st[sp] = pow(st[sp], st[sp + 1]);
+	  break;
+	case OP_POWI:
+	  st[sp] = powi(st[sp], c->arg);
+	  break;
+	case OP_NEG:
+	  st[sp] = -st[sp];
+	  break;
+	case OP_EXP:
+	  st[sp] = exp(st[sp]);
+	  break;
+	case OP_SQRT:
+	  st[sp] = sqrt(st[sp]);
+	  break;
+	default:
+	  /* all other functions of one argument */
+	  st[sp] = expr_func[c->op - OP_EXP].f(st[sp]);
+    }
+  }
+
+  return st[0];
+}
+
+/****************************************************************
+ *
+ * evaluate a function for n distances, instruction by instruction
+ *
+ ****************************************************************/
+
+static void expr_eval_batch(const expr_prog *e, const double *r, int n, const double *p, double *f)
+{
+  int   i, j, sp = -1;
+  double *x, *y;
+  const expr_instr *c;
+
+  if (e->depth * n > expr_buf_len) {
+    expr_buf_len = e->depth * n;
+    expr_buf = (double *)realloc(expr_buf, expr_buf_len * sizeof(double));
+    if (NULL == expr_buf)
+      error(1, "Cannot allocate memory for function evaluation");
+  }
+
+  for (i = 0; i < e->len; i++) {
+    c = e->code + i;
+    /* x is the top of the stack, y the element below */
+    if (c->op == OP_CONST || c->op == OP_R || c->op == OP_PAR)
+      sp++;
+    x = expr_buf + sp * n;
+    y = x - n;
+    switch (c->op) {
+	case OP_CONST:
+	  for (j = 0; j < n; j++)
+	    x[j] = c->val;
+	  break;
+	case OP_R:
+	  for (j = 0; j < n; j++)
+	    x[j] = r[j];
+	  break;
+	case OP_PAR:
+	  for (j = 0; j < n; j++)
+	    x[j] = p[c->arg];
+	  break;
+	case OP_ADD:
+	  for (j = 0; j < n; j++)
+	    y[j] += x[j];
+	  sp--;
+	  break;
+	case OP_SUB:
+	  for (j = 0; j < n; j++)
+	    y[j] -= x[j];
+	  sp--;
+	  break;
+	case OP_MUL:
+	  for (j = 0; j < n; j++)
+	    y[j] *= x[j];
+	  sp--;
+	  break;
+	case OP_DIV:
+	  for (j = 0; j < n; j++)
+	    y[j] /= x[j];
+	  sp--;
+	  break;
+	case OP_POW:
+	  power_m(n, y, y, x);
+	  sp--;
+	  break;
+	case OP_POWI:
+	  for (j = 0; j < n; j++)
+	    x[j] = powi(x[j], c->arg);
+	  break;
+	case OP_NEG:
+	  for (j = 0; j < n; j++)
+	    x[j] = -x[j];
+	  break;
+	case OP_EXP:
+	  exp_m(n, x, x);
+	  break;
+	case OP_SQRT:
+	  for (j = 0; j < n; j++)
+	    x[j] = sqrt(x[j]);
+	  break;
+	default:
+	  for (j = 0; j < n; j++)
+	    x[j] = expr_func[c->op - OP_EXP].f(x[j]);
+    }
+  }
+
+  for (j = 0; j < n; j++)
+    f[j] = expr_buf[j];
+}
+
+/****************************************************************
+ *
+ * one value and one batch function per slot, they are registered
+ * like the built-in functions in functions.c
+ *
+ ****************************************************************/
+
+#define EXPR_FUNCTIONS(k) \
+static void expr_value_ ## k(double r, double *p, double *f) \
+{ \
+  *f = expr_eval(expr_list + k, r, p); \
+} \
+static void expr_batch_ ## k(const double *r, int n, const double *p, double *f) \
+{ \
+  expr_eval_batch(expr_list + k, r, n, p, f); \
+}
+
+EXPR_FUNCTIONS(0)
+EXPR_FUNCTIONS(1)
+EXPR_FUNCTIONS(2)
+EXPR_FUNCTIONS(3)
+EXPR_FUNCTIONS(4)
+EXPR_FUNCTIONS(5)
+EXPR_FUNCTIONS(6)
+EXPR_FUNCTIONS(7)
+EXPR_FUNCTIONS(8)
+EXPR_FUNCTIONS(9)
+EXPR_FUNCTIONS(10)
+EXPR_FUNCTIONS(11)
+EXPR_FUNCTIONS(12)
+EXPR_FUNCTIONS(13)
+EXPR_FUNCTIONS(14)
+EXPR_FUNCTIONS(15)
+
+static fvalue_pointer expr_value[EXPR_MAX] = {
+  expr_value_0, expr_value_1, expr_value_2, expr_value_3, expr_value_4, expr_value_5,
+  expr_value_6, expr_value_7, expr_value_8, expr_value_9, expr_value_10, expr_value_11,
+  expr_value_12, expr_value_13, expr_value_14, expr_value_15
+};
+
+static fvalue_batch_pointer expr_batch[EXPR_MAX] = {
+  expr_batch_0, expr_batch_1, expr_batch_2, expr_batch_3, expr_batch_4, expr_batch_5,
+  expr_batch_6, expr_batch_7, expr_batch_8, expr_batch_9, expr_batch_10, expr_batch_11,
+  expr_batch_12, expr_batch_13, expr_batch_14, expr_batch_15
+};
+
+/****************************************************************
+ *
+ * expression tree with constant folding
+ *
+ ****************************************************************/
+
+static void free_node(expr_node *t)
+{
+  if (NULL == t)
+    return;
+  free_node(t->a);
+  free_node(t->b);
+  free(t);
+}
+
+static expr_node *new_node(int op, expr_node *a, expr_node *b)
+{
+  expr_node *t = (expr_node *)malloc(sizeof(expr_node));
+
+  if (NULL == t)
+    error(1, "Cannot allocate memory for function definition");
+
+  t->op = op;
+  t->arg = 0;
+  t->val = 0.0;
+  t->a = a;
+  t->b = b;
+
+  return t;
+}
+
+static expr_node *new_const(double val)
+{
+  expr_node *t = new_node(OP_CONST, NULL, NULL);
+
+  t->val = val;
+
+  return t;
+}
+
+/* replace a node with constant operands by its value */
+static expr_node *fold(expr_node *t)
+{
+  expr_prog e;
+  expr_instr code[3];
+  double val;
+
+  if (NULL == t->a || OP_CONST != t->a->op || (NULL != t->b && OP_CONST != t->b->op))
+    return t;
+
+  /* evaluate the node with the bytecode interpreter */
+  e.len = 0;
+  code[e.len].op = OP_CONST;
+  code[e.len++].val = t->a->val;
+  if (NULL != t->b) {
+    code[e.len].op = OP_CONST;
+    code[e.len++].val = t->b->val;
+  }
+  code[e.len].op = t->op;
+  code[e.len++].arg = t->arg;
+  e.code = code;
+  val = expr_eval(&e, 0.0, NULL);
+
+  free_node(t);
+
+  return new_const(val);
+}
+
+static expr_node *new_binary(int op, expr_node *a, expr_node *b)
+{
+  int   n;
+  expr_node *t = new_node(op, a, b);
+
+  /* integer powers by multiplication, square roots directly */
+  if (OP_POW == op && OP_CONST == b->op && OP_CONST != a->op) {
+    /* range check first, the cast of large or nan values is undefined */
+    if (fabs(b->val) <= EXPR_POWI && (n = (int)b->val) == b->val) {
+      t->op = OP_POWI;
+      t->arg = n;
+      t->b = NULL;
+      free_node(b);
+    } else if (0.5 == b->val) {
+      t->op = OP_SQRT;
+      t->b = NULL;
+      free_node(b);
+    }
+  }
+
+  return fold(t);
+}
+
+static expr_node *new_unary(int op, expr_node *a)
+{
+  return fold(new_node(op, a, NULL));
+}
+
+/****************************************************************
+ *
+ * recursive descent parser
+ *
+ ****************************************************************/
+
+static void parse_error(expr_parser *ps, const char *msg)
+{
+  error(1, "Cannot parse function %s at \"%s\": %s", ps->name, ps->s, msg);
+}
+
+static void skip_space(expr_parser *ps)
+{
+  while (isspace((unsigned char)*ps->s))
+    ps->s++;
+}
+
+/* read an identifier into buffer, return its length */
+static int read_name(expr_parser *ps, char *buffer, int size)
+{
+  int   n = 0;
+
+  skip_space(ps);
+  if (!isalpha((unsigned char)*ps->s) && '_' != *ps->s)
+    return 0;
+  while (isalnum((unsigned char)*ps->s) || '_' == *ps->s) {
+    if (n < size - 1)
+      buffer[n++] = *ps->s;
+    ps->s++;
+  }
+  buffer[n] = '\0';
+
+  return n;
+}
+
+/* primary: number, r, pi, parameter, function(sum) or (sum) */
+static expr_node *parse_primary(expr_parser *ps)
+{
+  int   i;
+  char  name[30];
+  char *end;
+  double val;
+  expr_node *t;
+
+  skip_space(ps);
+
+  if ('(' == *ps->s) {
+    ps->s++;
+    t = parse_sum(ps);
+    skip_space(ps);
+    if (')' != *ps->s)
+      parse_error(ps, "missing \")\"");
+    ps->s++;
+    return t;
+  }
+
+  if (isdigit((unsigned char)*ps->s) || '.' == *ps->s) {
+    val = strtod(ps->s, &end);
+    if (end == ps->s)
+      parse_error(ps, "invalid number");
+    ps->s = end;
+    return new_const(val);
+  }
+
+  if (0 == read_name(ps, name, 30))
+    parse_error(ps, "unexpected character");
+
+  if (0 == strcmp(name, "r"))
+    return new_node(OP_R, NULL, NULL);
+  if (0 == strcmp(name, "pi"))
+    return new_const(M_PI);
+
+  for (i = 0; i < ps->n_par; i++) {
+    if (0 == strcmp(name, ps->par[i])) {
+      t = new_node(OP_PAR, NULL, NULL);
+      t->arg = i;
+      return t;
+    }
+  }
+
+  for (i = 0; i < N_EXPR_FUNC; i++) {
+    if (0 == strcmp(name, expr_func[i].name)) {
+      skip_space(ps);
+      if ('(' != *ps->s)
+	parse_error(ps, "expected \"(\" after function name");
+      return new_unary(expr_func[i].op, parse_primary(ps));
+    }
+  }
+
+  ps->s -= strlen(name);
+  parse_error(ps, "unknown parameter or function");
+
+  return NULL;
+}
+
+/* power: primary [^ unary], right associative */
+static expr_node *parse_power(expr_parser *ps)
+{
+  expr_node *t = parse_primary(ps);
+
+  skip_space(ps);
+  if ('^' == ps->s[0] || ('*' == ps->s[0] && '*' == ps->s[1])) {
+    ps->s += ('^' == ps->s[0]) ? 1 : 2;
+    t = new_binary(OP_POW, t, parse_unary(ps));
+  }
+
+  return t;
+}
+
+/* unary: [+-] unary | power */
+static expr_node *parse_unary(expr_parser *ps)
+{
+  skip_space(ps);
+  if ('-' == *ps->s) {
+    ps->s++;
+    return new_unary(OP_NEG, parse_unary(ps));
+  }
+  if ('+' == *ps->s) {
+    ps->s++;
+    return parse_unary(ps);
+  }
+
+  return parse_power(ps);
+}
+
+/* product: unary [* or / unary]... */
+static expr_node *parse_product(expr_parser *ps)
+{
+  expr_node *t = parse_unary(ps);
+
+  while (1) {
+    skip_space(ps);
+    if ('*' == ps->s[0] && '*' != ps->s[1]) {
+      ps->s++;
+      t = new_binary(OP_MUL, t, parse_unary(ps));
+    } else if ('/' == ps->s[0]) {
+      ps->s++;
+      t = new_binary(OP_DIV, t, parse_unary(ps));
+    } else
+      return t;
+  }
+}
+
+/* sum: product [+- product]... */
+static expr_node *parse_sum(expr_parser *ps)
+{
+  expr_node *t = parse_product(ps);
+
+  while (1) {
+    skip_space(ps);
+    if ('+' == *ps->s) {
+      ps->s++;
+      t = new_binary(OP_ADD, t, parse_product(ps));
+    } else if ('-' == *ps->s) {
+      ps->s++;
+      t = new_binary(OP_SUB, t, parse_product(ps));
+    } else
+      return t;
+  }
+}
+
+/****************************************************************
+ *
+ * translate the tree into bytecode
+ *
+ ****************************************************************/
+
+static void emit(expr_prog *e, expr_node *t, int depth)
+{
+  if (NULL != t->a)
+    emit(e, t->a, depth);
+  if (NULL != t->b)
+    emit(e, t->b, depth + 1);
+
+  /* leaves push a value */
+  if (NULL == t->a)
+    e->depth = MAX(e->depth, depth + 1);
+
+  e->code[e->len].op = t->op;
+  e->code[e->len].arg = t->arg;
+  e->code[e->len].val = t->val;
+  e->len++;
+}
+
+static int count_nodes(expr_node *t)
+{
+  return (NULL == t) ? 0 : 1 + count_nodes(t->a) + count_nodes(t->b);
+}
+
+/****************************************************************
+ *
+ * define_expression: compile the definition
+ *
+ *   name p_1 ... p_n = expression
+ *
+ * and add it to the function table, returns the number of
+ * bytecode instructions
+ *
+ ****************************************************************/
+
+int define_expression(const char *def)
+{
+  int   i, n;
+  char  name[255], par[30];
+  expr_parser ps;
+  expr_prog *e;
+  expr_node *t;
+
+  if (EXPR_MAX == n_expr)
+    error(1, "Too many user-defined functions, the maximum is %d.", EXPR_MAX);
+
+  /* name of the function */
+  ps.s = def;
+  ps.name = def;
+  ps.n_par = 0;
+  if (0 == read_name(&ps, name, 255))
+    error(1, "Missing name in function definition \"%s\".", def);
+  n = strlen(name);
+  if (n > 3 && 0 == strcmp(name + n - 3, "_sc"))
+    error(1, "The name of function %s must not end with _sc.", name);
+  ps.name = name;
+
+  /* names of the parameters */
+  while (0 != read_name(&ps, par, 30)) {
+    if (0 == strcmp(par, "r") || 0 == strcmp(par, "pi"))
+      error(1, "Function %s: \"%s\" cannot be used as parameter name.", name, par);
+    for (i = 0; i < N_EXPR_FUNC; i++)
+      if (0 == strcmp(par, expr_func[i].name))
+	error(1, "Function %s: \"%s\" cannot be used as parameter name.", name, par);
+    for (i = 0; i < ps.n_par; i++)
+      if (0 == strcmp(par, ps.par[i]))
+	error(1, "Function %s: parameter \"%s\" is defined twice.", name, par);
+    if (EXPR_MAX_PAR == ps.n_par)
+      error(1, "Function %s has too many parameters, the maximum is %d.", name, EXPR_MAX_PAR);
+    strcpy(ps.par[ps.n_par++], par);
+  }
+  skip_space(&ps);
+  if ('=' != *ps.s)
+    parse_error(&ps, "expected \"=\" after the parameter names");
+  ps.s++;
+
+  t = parse_sum(&ps);
+  skip_space(&ps);
+  if ('\0' != *ps.s)
+    parse_error(&ps, "unexpected characters at the end");
+
+  /* store the bytecode */
+  e = expr_list + n_expr;
+  e->n_par = ps.n_par;
+  e->len = 0;
+  e->depth = 0;
+  e->code = (expr_instr *) malloc(count_nodes(t) * sizeof(expr_instr));
+  e->def = (char *)malloc((strlen(def) + 1) * sizeof(char));
+  if (NULL == e->code || NULL == e->def)
+    error(1, "Cannot allocate memory for function %s", name);
+  reg_for_free(e->code, "expression code %d", n_expr);
+  reg_for_free(e->def, "expression definition %d", n_expr);
+  strcpy(e->def, def);
+  emit(e, t, 0);
+  free_node(t);
+
+  if (e->depth > EXPR_STACK)
+    error(1, "Function %s is too deeply nested.", name);
+
+  add_potential(name, e->n_par, expr_value[n_expr]);
+  add_batch_function(name, expr_batch[n_expr]);
+  n_expr++;
+
+  return e->len;
+}
+
+/****************************************************************
+ *
+ * number and definitions of the user-defined functions,
+ * needed for the output and for the other MPI processes
+ *
+ ****************************************************************/
+
+int expression_count(void)
+{
+  return n_expr;
+}
+
+const char *expression_definition(int i)
+{
+  return expr_list[i].def;
+}
+
+#endif /* APOT */
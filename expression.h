@@ -0,0 +1,45 @@
+/****************************************************************
+ *
+ * expression.h: header file for user-defined analytic functions
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2014
+ * 	Institute for Theoretical and Applied Physics
+ * 	University of Stuttgart, D-70550 Stuttgart, Germany
+ *	http://potfit.sourceforge.net/
+ *
+ ****************************************************************
+ *
+ *   This file is part of potfit.
+ *
+ *   potfit is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   potfit is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#ifdef APOT
+
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#define EXPR_MAX 16		/* maximum number of user-defined functions */
+#define EXPR_LEN 1024		/* maximum length of a function definition */
+
+int   define_expression(const char *);
+int   expression_count(void);
+const char *expression_definition(int);
+
+#endif /* EXPRESSION_H */
+
+#endif /* APOT */
@@ -37,6 +37,78 @@
 #include "splines.h"
 #include "utils.h"
 
+/* spline positions and values of u(r) and w(r) of the neighbors of one atom */
+static int *dist_k = NULL;
+static double *dist_b = NULL;
+static double *dist_step = NULL;
+static double *dist_val = NULL;
+static double *dist_grad = NULL;
+static int dist_len = 0;
+
+/****************************************************************
+ *
+ *  adp_distortions: evaluate the dipole function u(r) and the
+ *	quadrupole function w(r) of all neighbors of an atom with
+ *	one spline call, the results are stored in the neighbor
+ *	table for the neighbors within the cutoff
+ *
+ ****************************************************************/
+
+static void adp_distortions(atom_t *atom, double *xi, int uf)
+{
+  int   j, m, col;
+  int   n = 2 * atom->num_neigh;
+  neigh_t *neigh;
+
+  if (n > dist_len) {
+    dist_len = n;
+    dist_k = (int *)realloc(dist_k, dist_len * sizeof(int));
+    dist_b = (double *)realloc(dist_b, dist_len * sizeof(double));
+    dist_step = (double *)realloc(dist_step, dist_len * sizeof(double));
+    dist_val = (double *)realloc(dist_val, dist_len * sizeof(double));
+    dist_grad = (double *)realloc(dist_grad, dist_len * sizeof(double));
+    if (NULL == dist_k || NULL == dist_b || NULL == dist_step || NULL == dist_val
+      || NULL == dist_grad)
+      error(1, "Cannot allocate memory for the dipole and quadrupole functions");
+  }
+
+  /* u(r) goes to the even, w(r) to the odd entries */
+  for (j = 0; j < atom->num_neigh; j++) {
+    neigh = atom->neigh + j;
+    for (m = 0; m < 2; m++) {
+      col = neigh->col[2 + m];
+      if (neigh->r < calc_pot.end[col]) {
+	dist_k[2 * j + m] = neigh->slot[2 + m];
+	dist_b[2 * j + m] = neigh->shift[2 + m];
+	dist_step[2 * j + m] = neigh->step[2 + m];
+      } else {
+	/* outside of the cutoff, any valid table entry will do */
+	dist_k[2 * j + m] = calc_pot.first[col];
+	dist_b[2 * j + m] = 0.0;
+	dist_step[2 * j + m] = 1.0;
+      }
+    }
+  }
+
+  splint_comb_dir_v(&calc_pot, xi, n, dist_k, dist_b, dist_step, dist_val, uf ? dist_grad : NULL);
+
+  for (j = 0; j < atom->num_neigh; j++) {
+    neigh = atom->neigh + j;
+    if (neigh->r < calc_pot.end[neigh->col[2]]) {
+      neigh->u_val = dist_val[2 * j];
+      if (uf)
+	neigh->u_grad = dist_grad[2 * j];
+    }
+    if (neigh->r < calc_pot.end[neigh->col[3]]) {
+      neigh->w_val = dist_val[2 * j + 1];
+      if (uf)
+	neigh->w_grad = dist_grad[2 * j + 1];
+    }
+  }
+
+  return;
+}
+
 /****************************************************************
  *
  *  compute forces using adp potentials with spline interpolation
@@ -86,7 +158,7 @@
  *
  ****************************************************************/
 
-double calc_forces(double *xi_opt, double *forces, int flag)
+double calc_forces_adp(double *xi_opt, double *forces, int flag)
 {
   int   first, col, i = flag;
   double *xi = NULL;
@@ -96,7 +168,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
   double rho_sum_loc = 0.0, rho_sum = 0.0;
 
   /* Temp variables */
-  atom_t *atom;
+  atom_t *atom, *atom_j;
   int   h, j;
   int   n_i, n_j;
   int   self;
@@ -127,9 +199,17 @@ double calc_forces(double *xi_opt, double *forces, int flag)
   double nu;
   double tmp, trace;
   vector tmp_vect;
+  sym_tens tmp_tens;
   sym_tens w_force;
   vector u_force;
 
+  /* dipole and quadrupole distortions and force of atom i,
+     kept in local variables while looping over its neighbors */
+  vector mu_i, force_i;
+  sym_tens lambda_i;
+  double nu_i;
+  int   in_reach;
+
   switch (format) {
       case 0:
 	xi = calc_pot.table;
@@ -180,20 +260,28 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #endif /* MPI */
 
     /* init second derivatives for splines */
-    /* [0, ...,  paircol - 1] = pair potentials */
-    /* [paircol, ..., paircol + ntypes - 1] = transfer function */
-    /* [paircol + ntypes, ..., paircol + 2 * ntypes - 1] = embedding function */
-    /* [paircol + 2 * ntypes, ..., 2 * paircol + 2 * ntypes - 1] = dipole function */
-    /* [2 * paircol + 2 * ntypes, ..., 3 * paircol + 2 * ntypes - 1] = quadrupole function */
-    for (col = 0; col < 3 * paircol + 2 * ntypes; col++) {
-      first = calc_pot.first[col];
-      if (format == 0 || format == 3)
-	spline_ed(calc_pot.step[col], xi + first,
-	  calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
-      else			/* format >= 4 ! */
-	spline_ne(calc_pot.xcoord + first, xi + first,
-	  calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+#ifdef MPI_SHM
+    /* the potential table is shared, one process per node sets it up */
+    if (0 == shm_id) {
+#endif /* MPI_SHM */
+      /* [0, ...,  paircol - 1] = pair potentials */
+      /* [paircol, ..., paircol + ntypes - 1] = transfer function */
+      /* [paircol + ntypes, ..., paircol + 2 * ntypes - 1] = embedding function */
+      /* [paircol + 2 * ntypes, ..., 2 * paircol + 2 * ntypes - 1] = dipole function */
+      /* [2 * paircol + 2 * ntypes, ..., 3 * paircol + 2 * ntypes - 1] = quadrupole function */
+      for (col = 0; col < 3 * paircol + 2 * ntypes; col++) {
+	first = calc_pot.first[col];
+	if (format == 0 || format == 3)
+	  spline_ed(calc_pot.step[col], xi + first,
+	    calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+	else			/* format >= 4 ! */
+	  spline_ne(calc_pot.xcoord + first, xi + first,
+	    calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+      }
+#ifdef MPI_SHM
     }
+    MPI_Barrier(shm_comm);
+#endif /* MPI_SHM */
 
 #ifndef MPI
     myconf = nconf;
@@ -248,9 +336,21 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	for (i = 0; i < inconf[h]; i++) {
 	  atom = conf_atoms + i + cnfstart[h] - firstatom;
 	  n_i = 3 * (cnfstart[h] + i);
+	  mu_i.x = 0.0;
+	  mu_i.y = 0.0;
+	  mu_i.z = 0.0;
+	  lambda_i.xx = 0.0;
+	  lambda_i.yy = 0.0;
+	  lambda_i.zz = 0.0;
+	  lambda_i.yz = 0.0;
+	  lambda_i.zx = 0.0;
+	  lambda_i.xy = 0.0;
+	  /* dipole and quadrupole functions of all neighbors */
+	  adp_distortions(atom, xi, uf);
 	  /* loop over neighbors */
 	  for (j = 0; j < atom->num_neigh; j++) {
 	    neigh = atom->neigh + j;
+	    atom_j = conf_atoms + neigh->nr - firstatom;
 	    /* In small cells, an atom might interact with itself */
 	    self = (neigh->nr == i + cnfstart[h]) ? 1 : 0;
 
@@ -301,14 +401,6 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 
 	    /* dipole distortion part */
 	    if (neigh->r < calc_pot.end[neigh->col[2]]) {
-	      /* fn value and grad are calculated in the same step */
-	      if (uf)
-		neigh->u_val =
-		  splint_comb_dir(&calc_pot, xi, neigh->slot[2], neigh->shift[2], neigh->step[2],
-		  &neigh->u_grad);
-	      else
-		neigh->u_val = splint_dir(&calc_pot, xi, neigh->slot[2], neigh->shift[2], neigh->step[2]);
-
 	      /* avoid double counting if atom is interacting with a copy of itself */
 	      if (self) {
 		neigh->u_val *= 0.5;
@@ -316,27 +408,19 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	      }
 
 	      /* sum up contribution for mu */
-	      tmp = neigh->u_val * neigh->dist.x;
-	      atom->mu.x += tmp;
-	      conf_atoms[neigh->nr - firstatom].mu.x -= tmp;
-	      tmp = neigh->u_val * neigh->dist.y;
-	      atom->mu.y += tmp;
-	      conf_atoms[neigh->nr - firstatom].mu.y -= tmp;
-	      tmp = neigh->u_val * neigh->dist.z;
-	      atom->mu.z += tmp;
-	      conf_atoms[neigh->nr - firstatom].mu.z -= tmp;
+	      tmp_vect.x = neigh->u_val * neigh->dist.x;
+	      tmp_vect.y = neigh->u_val * neigh->dist.y;
+	      tmp_vect.z = neigh->u_val * neigh->dist.z;
+	      mu_i.x += tmp_vect.x;
+	      mu_i.y += tmp_vect.y;
+	      mu_i.z += tmp_vect.z;
+	      atom_j->mu.x -= tmp_vect.x;
+	      atom_j->mu.y -= tmp_vect.y;
+	      atom_j->mu.z -= tmp_vect.z;
 	    }
 
 	    /* quadrupole distortion part */
 	    if (neigh->r < calc_pot.end[neigh->col[3]]) {
-	      /* fn value and grad are calculated in the same step */
-	      if (uf)
-		neigh->w_val =
-		  splint_comb_dir(&calc_pot, xi, neigh->slot[3], neigh->shift[3], neigh->step[3],
-		  &neigh->w_grad);
-	      else
-		neigh->w_val = splint_dir(&calc_pot, xi, neigh->slot[3], neigh->shift[3], neigh->step[3]);
-
 	      /* avoid double counting if atom is interacting with a copy of itself */
 	      if (self) {
 		neigh->w_val *= 0.5;
@@ -344,26 +428,24 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	      }
 
 	      /* sum up contribution for lambda */
-	      /* diagonal elements */
-	      tmp = neigh->w_val * neigh->sqrdist.xx;
-	      atom->lambda.xx += tmp;
-	      conf_atoms[neigh->nr - firstatom].lambda.xx += tmp;
-	      tmp = neigh->w_val * neigh->sqrdist.yy;
-	      atom->lambda.yy += tmp;
-	      conf_atoms[neigh->nr - firstatom].lambda.yy += tmp;
-	      tmp = neigh->w_val * neigh->sqrdist.zz;
-	      atom->lambda.zz += tmp;
-	      conf_atoms[neigh->nr - firstatom].lambda.zz += tmp;
-	      /* offdiagonal elements */
-	      tmp = neigh->w_val * neigh->sqrdist.yz;
-	      atom->lambda.yz += tmp;
-	      conf_atoms[neigh->nr - firstatom].lambda.yz += tmp;
-	      tmp = neigh->w_val * neigh->sqrdist.zx;
-	      atom->lambda.zx += tmp;
-	      conf_atoms[neigh->nr - firstatom].lambda.zx += tmp;
-	      tmp = neigh->w_val * neigh->sqrdist.xy;
-	      atom->lambda.xy += tmp;
-	      conf_atoms[neigh->nr - firstatom].lambda.xy += tmp;
+	      tmp_tens.xx = neigh->w_val * neigh->sqrdist.xx;
+	      tmp_tens.yy = neigh->w_val * neigh->sqrdist.yy;
+	      tmp_tens.zz = neigh->w_val * neigh->sqrdist.zz;
+	      tmp_tens.yz = neigh->w_val * neigh->sqrdist.yz;
+	      tmp_tens.zx = neigh->w_val * neigh->sqrdist.zx;
+	      tmp_tens.xy = neigh->w_val * neigh->sqrdist.xy;
+	      lambda_i.xx += tmp_tens.xx;
+	      lambda_i.yy += tmp_tens.yy;
+	      lambda_i.zz += tmp_tens.zz;
+	      lambda_i.yz += tmp_tens.yz;
+	      lambda_i.zx += tmp_tens.zx;
+	      lambda_i.xy += tmp_tens.xy;
+	      atom_j->lambda.xx += tmp_tens.xx;
+	      atom_j->lambda.yy += tmp_tens.yy;
+	      atom_j->lambda.zz += tmp_tens.zz;
+	      atom_j->lambda.yz += tmp_tens.yz;
+	      atom_j->lambda.zx += tmp_tens.zx;
+	      atom_j->lambda.xy += tmp_tens.xy;
 	    }
 
 	    /* calculate atomic densities */
@@ -374,7 +456,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 		atom->rho += rho_val;
 		/* avoid double counting if atom is interacting with a copy of itself */
 		if (!self) {
-		  conf_atoms[neigh->nr - firstatom].rho += rho_val;
+		  atom_j->rho += rho_val;
 		}
 	      }
 	    } else {
@@ -384,11 +466,22 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	      }
 	      /* cannot use slot/shift to access splines */
 	      if (neigh->r < calc_pot.end[paircol + atom->type])
-		conf_atoms[neigh->nr - firstatom].rho +=
+		atom_j->rho +=
 		  splint(&calc_pot, xi, paircol + atom->type, neigh->r);
 	    }
 	  }			/* loop over neighbors */
 
+	  /* add the sums for atom i to the contributions of the other atoms */
+	  atom->mu.x += mu_i.x;
+	  atom->mu.y += mu_i.y;
+	  atom->mu.z += mu_i.z;
+	  atom->lambda.xx += lambda_i.xx;
+	  atom->lambda.yy += lambda_i.yy;
+	  atom->lambda.zz += lambda_i.zz;
+	  atom->lambda.yz += lambda_i.yz;
+	  atom->lambda.zx += lambda_i.zx;
+	  atom->lambda.xy += lambda_i.xy;
+
 	  col_F = paircol + ntypes + atom->type;	/* column of F */
 #ifdef RESCALE
 	  if (atom->rho > calc_pot.end[col_F]) {
@@ -410,8 +503,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  if (atom->rho < calc_pot.begin[col_F]) {
 #ifdef APOT
 	    /* calculate analytic value explicitly */
-	    apot_table.fvalue[col_F] (atom->rho, xi_opt + apot_table.idxpot[col_F], &temp_eng);
-	    atom->gradF = apot_grad(atom->rho, xi_opt + opt_pot.first[col_F], apot_table.fvalue[col_F]);
+	    apot_value_grad(col_F, atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng, &atom->gradF);
 	    forces[energy_p + h] += temp_eng;
 #else
 	    /* linear extrapolation left */
@@ -421,8 +513,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  } else if (atom->rho > calc_pot.end[col_F]) {
 #ifdef APOT
 	    /* calculate analytic value explicitly */
-	    apot_table.fvalue[col_F] (atom->rho, xi_opt + apot_table.idxpot[col_F], &temp_eng);
-	    atom->gradF = apot_grad(atom->rho, xi_opt + opt_pot.first[col_F], apot_table.fvalue[col_F]);
+	    apot_value_grad(col_F, atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng, &atom->gradF);
 	    forces[energy_p + h] += temp_eng;
 #else
 	    /* and right */
@@ -437,8 +528,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #ifdef APOT
 	    /* calculate small values directly */
 	    if (atom->rho < 0.1) {
-	      apot_table.fvalue[col_F] (atom->rho, xi_opt + apot_table.idxpot[col_F], &temp_eng);
-	      atom->gradF = apot_grad(atom->rho, xi_opt + opt_pot.first[col_F], apot_table.fvalue[col_F]);
+	      apot_value_grad(col_F, atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng, &atom->gradF);
 	      forces[energy_p + h] += temp_eng;
 	    } else
 #endif /* APOT */
@@ -472,12 +562,27 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  for (i = 0; i < inconf[h]; i++) {
 	    atom = conf_atoms + i + cnfstart[h] - firstatom;
 	    n_i = 3 * (cnfstart[h] + i);
+	    col_F = paircol + ntypes + atom->type;	/* column of F */
+	    /* the forces array might alias the atoms, so copy what is needed */
+	    mu_i = atom->mu;
+	    lambda_i = atom->lambda;
+	    nu_i = atom->nu;
+	    force_i.x = 0.0;
+	    force_i.y = 0.0;
+	    force_i.z = 0.0;
 	    for (j = 0; j < atom->num_neigh; j++) {
 	      /* loop over neighbors */
 	      neigh = atom->neigh + j;
+	      atom_j = conf_atoms + neigh->nr - firstatom;
 	      /* In small cells, an atom might interact with itself */
 	      self = (neigh->nr == i + cnfstart[h]) ? 1 : 0;
-	      col_F = paircol + ntypes + atom->type;	/* column of F */
+
+	      /* the EAM, dipole and quadrupole parts are summed up
+	         and written to the force array in one step */
+	      in_reach = 0;
+	      tmp_force.x = 0.0;
+	      tmp_force.y = 0.0;
+	      tmp_force.z = 0.0;
 
 	      /* are we within reach? */
 	      if ((neigh->r < calc_pot.end[neigh->col[1]]) || (neigh->r < calc_pot.end[col_F - ntypes])) {
@@ -489,38 +594,20 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 		  rho_grad_j = (neigh->r < calc_pot.end[col_F - ntypes])
 		    ? splint_grad(&calc_pot, xi, col_F - ntypes, neigh->r) : 0.0;
 		/* now we know everything - calculate forces */
-		eam_force = (rho_grad * atom->gradF + rho_grad_j * conf_atoms[(neigh->nr) - firstatom].gradF);
+		eam_force = (rho_grad * atom->gradF + rho_grad_j * atom_j->gradF);
 		/* avoid double counting if atom is interacting with a
 		   copy of itself */
 		if (self)
 		  eam_force *= 0.5;
-		tmp_force.x = neigh->dist_r.x * eam_force;
-		tmp_force.y = neigh->dist_r.y * eam_force;
-		tmp_force.z = neigh->dist_r.z * eam_force;
-		forces[n_i + 0] += tmp_force.x;
-		forces[n_i + 1] += tmp_force.y;
-		forces[n_i + 2] += tmp_force.z;
-		/* actio = reactio */
-		n_j = 3 * neigh->nr;
-		forces[n_j + 0] -= tmp_force.x;
-		forces[n_j + 1] -= tmp_force.y;
-		forces[n_j + 2] -= tmp_force.z;
-#ifdef STRESS
-		/* and stresses */
-		if (us) {
-		  forces[stresses + 0] -= neigh->dist.x * tmp_force.x;
-		  forces[stresses + 1] -= neigh->dist.y * tmp_force.y;
-		  forces[stresses + 2] -= neigh->dist.z * tmp_force.z;
-		  forces[stresses + 3] -= neigh->dist.x * tmp_force.y;
-		  forces[stresses + 4] -= neigh->dist.y * tmp_force.z;
-		  forces[stresses + 5] -= neigh->dist.z * tmp_force.x;
-		}
-#endif /* STRESS */
+		tmp_force.x += neigh->dist_r.x * eam_force;
+		tmp_force.y += neigh->dist_r.y * eam_force;
+		tmp_force.z += neigh->dist_r.z * eam_force;
+		in_reach = 1;
 	      }			/* within reach */
 	      if (neigh->r < calc_pot.end[neigh->col[2]]) {
-		u_force.x = (atom->mu.x - conf_atoms[(neigh->nr) - firstatom].mu.x);
-		u_force.y = (atom->mu.y - conf_atoms[(neigh->nr) - firstatom].mu.y);
-		u_force.z = (atom->mu.z - conf_atoms[(neigh->nr) - firstatom].mu.z);
+		u_force.x = (mu_i.x - atom_j->mu.x);
+		u_force.y = (mu_i.y - atom_j->mu.y);
+		u_force.z = (mu_i.z - atom_j->mu.z);
 		/* avoid double counting if atom is interacting with a
 		   copy of itself */
 		if (self) {
@@ -529,36 +616,18 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 		  u_force.z *= 0.5;
 		}
 		tmp = SPROD(u_force, neigh->dist) * neigh->u_grad;
-		tmp_force.x = u_force.x * neigh->u_val + tmp * neigh->dist_r.x;
-		tmp_force.y = u_force.y * neigh->u_val + tmp * neigh->dist_r.y;
-		tmp_force.z = u_force.z * neigh->u_val + tmp * neigh->dist_r.z;
-		forces[n_i + 0] += tmp_force.x;
-		forces[n_i + 1] += tmp_force.y;
-		forces[n_i + 2] += tmp_force.z;
-		/* actio = rectio */
-		n_j = 3 * neigh->nr;
-		forces[n_j + 0] -= tmp_force.x;
-		forces[n_j + 1] -= tmp_force.y;
-		forces[n_j + 2] -= tmp_force.z;
-#ifdef STRESS
-		/* and stresses */
-		if (us) {
-		  forces[stresses + 0] -= neigh->dist.x * tmp_force.x;
-		  forces[stresses + 1] -= neigh->dist.y * tmp_force.y;
-		  forces[stresses + 2] -= neigh->dist.z * tmp_force.z;
-		  forces[stresses + 3] -= neigh->dist.x * tmp_force.y;
-		  forces[stresses + 4] -= neigh->dist.y * tmp_force.z;
-		  forces[stresses + 5] -= neigh->dist.z * tmp_force.x;
-		}
-#endif /* STRESS */
+		tmp_force.x += u_force.x * neigh->u_val + tmp * neigh->dist_r.x;
+		tmp_force.y += u_force.y * neigh->u_val + tmp * neigh->dist_r.y;
+		tmp_force.z += u_force.z * neigh->u_val + tmp * neigh->dist_r.z;
+		in_reach = 1;
 	      }
 	      if (neigh->r < calc_pot.end[neigh->col[3]]) {
-		w_force.xx = (atom->lambda.xx + conf_atoms[(neigh->nr) - firstatom].lambda.xx);
-		w_force.yy = (atom->lambda.yy + conf_atoms[(neigh->nr) - firstatom].lambda.yy);
-		w_force.zz = (atom->lambda.zz + conf_atoms[(neigh->nr) - firstatom].lambda.zz);
-		w_force.yz = (atom->lambda.yz + conf_atoms[(neigh->nr) - firstatom].lambda.yz);
-		w_force.zx = (atom->lambda.zx + conf_atoms[(neigh->nr) - firstatom].lambda.zx);
-		w_force.xy = (atom->lambda.xy + conf_atoms[(neigh->nr) - firstatom].lambda.xy);
+		w_force.xx = (lambda_i.xx + atom_j->lambda.xx);
+		w_force.yy = (lambda_i.yy + atom_j->lambda.yy);
+		w_force.zz = (lambda_i.zz + atom_j->lambda.zz);
+		w_force.yz = (lambda_i.yz + atom_j->lambda.yz);
+		w_force.zx = (lambda_i.zx + atom_j->lambda.zx);
+		w_force.xy = (lambda_i.xy + atom_j->lambda.xy);
 		/* avoid double counting if atom is interacting with a
 		   copy of itself */
 		if (self) {
@@ -575,16 +644,20 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 		  w_force.xy * neigh->dist.x + w_force.yy * neigh->dist.y + w_force.yz * neigh->dist.z;
 		tmp_vect.z =
 		  w_force.zx * neigh->dist.x + w_force.yz * neigh->dist.y + w_force.zz * neigh->dist.z;
-		nu = (atom->nu + conf_atoms[(neigh->nr) - firstatom].nu) / 3.0;
+		nu = (nu_i + atom_j->nu) / 3.0;
 		f1 = 2.0 * neigh->w_val;
 		f2 = (SPROD(tmp_vect, neigh->dist) - nu * neigh->r * neigh->r) *
 		  neigh->w_grad - nu * f1 * neigh->r;
-		tmp_force.x = f1 * tmp_vect.x + f2 * neigh->dist_r.x;
-		tmp_force.y = f1 * tmp_vect.y + f2 * neigh->dist_r.y;
-		tmp_force.z = f1 * tmp_vect.z + f2 * neigh->dist_r.z;
-		forces[n_i + 0] += tmp_force.x;
-		forces[n_i + 1] += tmp_force.y;
-		forces[n_i + 2] += tmp_force.z;
+		tmp_force.x += f1 * tmp_vect.x + f2 * neigh->dist_r.x;
+		tmp_force.y += f1 * tmp_vect.y + f2 * neigh->dist_r.y;
+		tmp_force.z += f1 * tmp_vect.z + f2 * neigh->dist_r.z;
+		in_reach = 1;
+	      }
+
+	      if (in_reach) {
+		force_i.x += tmp_force.x;
+		force_i.y += tmp_force.y;
+		force_i.z += tmp_force.z;
 		/* actio = reactio */
 		n_j = 3 * neigh->nr;
 		forces[n_j + 0] -= tmp_force.x;
@@ -604,6 +677,10 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	      }
 	    }			/* loop over neighbors */
 
+	    forces[n_i + 0] += force_i.x;
+	    forces[n_i + 1] += force_i.y;
+	    forces[n_i + 2] += force_i.z;
+
 #ifdef FWEIGHT
 	    /* Weigh by absolute value of force */
 	    forces[n_i + 0] /= FORCE_EPS + atom->absforce;
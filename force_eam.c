@@ -86,7 +86,7 @@
  *
  ****************************************************************/
 
-double calc_forces(double *xi_opt, double *forces, int flag)
+double calc_forces_eam(double *xi_opt, double *forces, int flag)
 {
   int   first, col, i = flag;
   double tmpsum = 0.0, sum = 0.0;
@@ -178,56 +178,64 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 
     /* init second derivatives for splines */
 
-    /* [0, ...,  paircol - 1] = pair potentials */
-    /* [paircol, ..., paircol + ntypes - 1] = transfer function */
-    for (col = 0; col < paircol + ntypes; col++) {
-      first = calc_pot.first[col];
-      if (0 == format || 3 == format)
-	spline_ed(calc_pot.step[col], xi + first,
-	  calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
-      else			/* format >= 4 ! */
-	spline_ne(calc_pot.xcoord + first, xi + first,
-	  calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
-    }
+#ifdef MPI_SHM
+    /* the potential table is shared, one process per node sets it up */
+    if (0 == shm_id) {
+#endif /* MPI_SHM */
+      /* [0, ...,  paircol - 1] = pair potentials */
+      /* [paircol, ..., paircol + ntypes - 1] = transfer function */
+      for (col = 0; col < paircol + ntypes; col++) {
+	first = calc_pot.first[col];
+	if (0 == format || 3 == format)
+	  spline_ed(calc_pot.step[col], xi + first,
+	    calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+	else			/* format >= 4 ! */
+	  spline_ne(calc_pot.xcoord + first, xi + first,
+	    calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+      }
 
-    /* [paircol + ntypes, ..., paircol + 2 * ntypes - 1] = embedding function */
-    for (col = paircol + ntypes; col < paircol + 2 * ntypes; col++) {
-      first = calc_pot.first[col];
-      /* gradient at left boundary matched to square root function,
-         when 0 not in domain(F), else natural spline */
-      if (0 == format || 3 == format)
-	spline_ed(calc_pot.step[col], xi + first, calc_pot.last[col] - first + 1,
-	  *(xi + first - 2), *(xi + first - 1), calc_pot.d2tab + first);
-      else			/* format >= 4 ! */
-	spline_ne(calc_pot.xcoord + first, xi + first, calc_pot.last[col] - first + 1,
-	  *(xi + first - 2), *(xi + first - 1), calc_pot.d2tab + first);
-    }
+      /* [paircol + ntypes, ..., paircol + 2 * ntypes - 1] = embedding function */
+      for (col = paircol + ntypes; col < paircol + 2 * ntypes; col++) {
+	first = calc_pot.first[col];
+	/* gradient at left boundary matched to square root function,
+	   when 0 not in domain(F), else natural spline */
+	if (0 == format || 3 == format)
+	  spline_ed(calc_pot.step[col], xi + first, calc_pot.last[col] - first + 1,
+	    *(xi + first - 2), *(xi + first - 1), calc_pot.d2tab + first);
+	else			/* format >= 4 ! */
+	  spline_ne(calc_pot.xcoord + first, xi + first, calc_pot.last[col] - first + 1,
+	    *(xi + first - 2), *(xi + first - 1), calc_pot.d2tab + first);
+      }
 
 #ifdef TBEAM
-    /* [paircol + 2 * ntypes, ..., paircol + 3 * ntypes - 1] = s-band transfer function */
-    for (col = paircol + 2 * ntypes; col < paircol + 3 * ntypes; col++) {
-      first = calc_pot.first[col];
-      if (0 == format || 3 == format)
-	spline_ed(calc_pot.step[col], xi + first,
-	  calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
-      else			/* format >= 4 ! */
-	spline_ne(calc_pot.xcoord + first, xi + first,
-	  calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
-    }
+      /* [paircol + 2 * ntypes, ..., paircol + 3 * ntypes - 1] = s-band transfer function */
+      for (col = paircol + 2 * ntypes; col < paircol + 3 * ntypes; col++) {
+	first = calc_pot.first[col];
+	if (0 == format || 3 == format)
+	  spline_ed(calc_pot.step[col], xi + first,
+	    calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+	else			/* format >= 4 ! */
+	  spline_ne(calc_pot.xcoord + first, xi + first,
+	    calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+      }
 
-    /* [paircol + 3 * ntypes, ..., paircol + 4 * ntypes - 1] = s-band embedding function */
-    for (col = paircol + 3 * ntypes; col < paircol + 4 * ntypes; col++) {
-      first = calc_pot.first[col];
-      /* gradient at left boundary matched to square root function,
-         when 0 not in domain(F), else natural spline */
-      if (0 == format || 3 == format)
-	spline_ed(calc_pot.step[col], xi + first, calc_pot.last[col] - first + 1,
-	  *(xi + first - 2), *(xi + first - 1), calc_pot.d2tab + first);
-      else			/* format >= 4 ! */
-	spline_ne(calc_pot.xcoord + first, xi + first, calc_pot.last[col] - first + 1,
-	  *(xi + first - 2), *(xi + first - 1), calc_pot.d2tab + first);
-    }
+      /* [paircol + 3 * ntypes, ..., paircol + 4 * ntypes - 1] = s-band embedding function */
+      for (col = paircol + 3 * ntypes; col < paircol + 4 * ntypes; col++) {
+	first = calc_pot.first[col];
+	/* gradient at left boundary matched to square root function,
+	   when 0 not in domain(F), else natural spline */
+	if (0 == format || 3 == format)
+	  spline_ed(calc_pot.step[col], xi + first, calc_pot.last[col] - first + 1,
+	    *(xi + first - 2), *(xi + first - 1), calc_pot.d2tab + first);
+	else			/* format >= 4 ! */
+	  spline_ne(calc_pot.xcoord + first, xi + first, calc_pot.last[col] - first + 1,
+	    *(xi + first - 2), *(xi + first - 1), calc_pot.d2tab + first);
+      }
 #endif /* TBEAM */
+#ifdef MPI_SHM
+    }
+    MPI_Barrier(shm_comm);
+#endif /* MPI_SHM */
 
 #ifndef MPI
     myconf = nconf;
@@ -419,8 +427,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  if (atom->rho < calc_pot.begin[col_F]) {
 #ifdef APOT
 	    /* calculate analytic value explicitly */
-	    apot_table.fvalue[col_F] (atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng);
-	    atom->gradF = apot_grad(atom->rho, xi_opt + opt_pot.first[col_F], apot_table.fvalue[col_F]);
+	    apot_value_grad(col_F, atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng, &atom->gradF);
 	    forces[energy_p + h] += temp_eng;
 #else
 	    /* linear extrapolation left */
@@ -430,8 +437,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  } else if (atom->rho > calc_pot.end[col_F]) {
 #ifdef APOT
 	    /* calculate analytic value explicitly */
-	    apot_table.fvalue[col_F] (atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng);
-	    atom->gradF = apot_grad(atom->rho, xi_opt + opt_pot.first[col_F], apot_table.fvalue[col_F]);
+	    apot_value_grad(col_F, atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng, &atom->gradF);
 	    forces[energy_p + h] += temp_eng;
 #else
 	    /* and right */
@@ -444,8 +450,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #ifdef APOT
 	    /* calculate small values directly */
 	    if (atom->rho < 0.1) {
-	      apot_table.fvalue[col_F] (atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng);
-	      atom->gradF = apot_grad(atom->rho, xi_opt + opt_pot.first[col_F], apot_table.fvalue[col_F]);
+	      apot_value_grad(col_F, atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng, &atom->gradF);
 	      forces[energy_p + h] += temp_eng;
 	    } else
 #endif
@@ -463,9 +468,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  if (atom->rho_s < calc_pot.begin[col_F_s]) {
 #ifdef APOT
 	    /* calculate analytic value explicitly */
-	    apot_table.fvalue[col_F_s] (atom->rho_s, xi_opt + opt_pot.first[col_F_s], &temp_eng);
-	    atom->gradF_s =
-	      apot_grad(atom->rho_s, xi_opt + opt_pot.first[col_F_s], apot_table.fvalue[col_F_s]);
+	    apot_value_grad(col_F_s, atom->rho_s, xi_opt + opt_pot.first[col_F_s], &temp_eng, &atom->gradF_s);
 	    forces[energy_p + h] += temp_eng;
 #else
 	    /* linear extrapolation left */
@@ -475,9 +478,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  } else if (atom->rho_s > calc_pot.end[col_F_s]) {
 #ifdef APOT
 	    /* calculate analytic value explicitly */
-	    apot_table.fvalue[col_F_s] (atom->rho_s, xi_opt + opt_pot.first[col_F_s], &temp_eng);
-	    atom->gradF_s =
-	      apot_grad(atom->rho_s, xi_opt + opt_pot.first[col_F_s], apot_table.fvalue[col_F_s]);
+	    apot_value_grad(col_F_s, atom->rho_s, xi_opt + opt_pot.first[col_F_s], &temp_eng, &atom->gradF_s);
 	    forces[energy_p + h] += temp_eng;
 #else
 	    /* and right */
@@ -492,9 +493,8 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #ifdef APOT
 	    /* calculate small values directly */
 	    if (atom->rho_s < 0.1) {
-	      apot_table.fvalue[col_F_s] (atom->rho_s, xi_opt + opt_pot.first[col_F_s], &temp_eng);
-	      atom->gradF_s =
-		apot_grad(atom->rho_s, xi_opt + opt_pot.first[col_F_s], apot_table.fvalue[col_F_s]);
+	      apot_value_grad(col_F_s, atom->rho_s, xi_opt + opt_pot.first[col_F_s], &temp_eng,
+		&atom->gradF_s);
 	      forces[energy_p + h] += temp_eng;
 	    } else
 #endif
@@ -33,6 +33,8 @@
 
 #if defined COULOMB && !defined EAM
 
+#include "dipole.h"
+#include "elstat.h"
 #include "functions.h"
 #include "potential.h"
 #include "splines.h"
@@ -87,7 +89,7 @@
  *
  ****************************************************************/
 
-double calc_forces(double *xi_opt, double *forces, int flag)
+double calc_forces_elstat(double *xi_opt, double *forces, int flag)
 {
   double tmpsum, sum = 0.0;
   int   first, col, ne, size, i = flag;
@@ -101,6 +103,9 @@ double calc_forces(double *xi_opt, double *forces, int flag)
   double dp_alpha[ntypes];
   double dp_b[apt->number];
   double dp_c[apt->number];
+  static double tail_kappa = 0.0;
+  static int tails_valid = 0;
+  int   update_tails;
 #endif /* DIPOLE */
 
   switch (format) {
@@ -193,33 +198,53 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #endif /* DIPOLE */
 
     /* init second derivatives for splines */
-    for (col = 0; col < paircol; col++) {
-      first = calc_pot.first[col];
-      if (format == 3 || format == 0) {
-	spline_ed(calc_pot.step[col], xi + first,
-	  calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
-      } else {			/* format >= 4 ! */
-	spline_ne(calc_pot.xcoord + first, xi + first,
-	  calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+#ifdef MPI_SHM
+    /* the potential table is shared, one process per node sets it up */
+    if (0 == shm_id) {
+#endif /* MPI_SHM */
+      for (col = 0; col < paircol; col++) {
+	first = calc_pot.first[col];
+	if (format == 3 || format == 0) {
+	  spline_ed(calc_pot.step[col], xi + first,
+	    calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+	} else {			/* format >= 4 ! */
+	  spline_ne(calc_pot.xcoord + first, xi + first,
+	    calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+	}
       }
+#ifdef MPI_SHM
     }
+    MPI_Barrier(shm_comm);
+#endif /* MPI_SHM */
 
 #ifndef MPI
     myconf = nconf;
 #endif /* MPI */
 
+#ifdef DIPOLE
+    /* the tail functions only change with kappa */
+    update_tails = !apt->sw_kappa && (!tails_valid || dp_kappa != tail_kappa);
+    tail_kappa = dp_kappa;
+    tails_valid = 1;
+#else
+    /* the monopole part is contracted from charge independent lattice sums */
+    update_elstat_sums(dp_kappa);
+#endif /* DIPOLE */
+
     /* region containing loop over configurations,
        also OMP-parallelized region */
     {
       int   self;
       vector tmp_force;
-      int   h, j, type1, type2, uf;
+      int   h, j, type1, uf;
 #ifdef STRESS
       int   us, stresses;
 #endif /* STRESS */
       int   n_i, n_j;
-      double fnval, grad, fnval_tail, grad_tail, grad_i, grad_j;
+      double fnval, grad;
 #ifdef DIPOLE
+      int   type2;
+      double fnval_tail, grad_tail, grad_i, grad_j;
       double p_sr_tail;
 #endif /* DIPOLE */
       atom_t *atom;
@@ -274,12 +299,15 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  n_i = 3 * (cnfstart[h] + i);
 	  for (j = 0; j < atom->num_neigh; j++) {	/* neighbors */
 	    neigh = atom->neigh + j;
-	    type2 = neigh->type;
 	    col = neigh->col[0];
 
+#ifdef DIPOLE
+	    type2 = neigh->type;
+
 	    /* updating tail-functions - only necessary with variing kappa */
-	    if (!apt->sw_kappa)
+	    if (update_tails)
 	      elstat_shift(neigh->r, dp_kappa, &neigh->fnval_el, &neigh->grad_el, &neigh->ggrad_el);
+#endif /* DIPOLE */
 
 	    /* In small cells, an atom might interact with itself */
 	    self = (neigh->nr == i + cnfstart[h]) ? 1 : 0;
@@ -329,6 +357,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	      }
 	    }
 
+#ifdef DIPOLE
 	    /* calculate monopole forces */
 	    if (neigh->r < dp_cut && (charge[type1] || charge[type2])) {
 
@@ -377,7 +406,6 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 		}
 #endif /* STRESS */
 	      }
-#ifdef DIPOLE
 	      /* calculate static field-contributions */
 	      atom->E_stat.x += neigh->dist.x * grad_i;
 	      atom->E_stat.y += neigh->dist.y * grad_i;
@@ -402,121 +430,25 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 		conf_atoms[neigh->nr - firstatom].p_sr.y -= charge[type1] * neigh->dist_r.y * p_sr_tail;
 		conf_atoms[neigh->nr - firstatom].p_sr.z -= charge[type1] * neigh->dist_r.z * p_sr_tail;
 	      }
-#endif /* DIPOLE */
 
 	    }
+#endif /* DIPOLE */
 
 	  }			/* loop over neighbours */
 	}			/* end S E C O N D loop over atoms */
 
+#ifndef DIPOLE
+	/* monopole energy, forces and stresses from the lattice sums */
+#ifdef STRESS
+	forces[energy_p + h] += elstat_sums(h, charge, forces, uf, us);
+#else
+	forces[energy_p + h] += elstat_sums(h, charge, forces, uf, 0);
+#endif /* STRESS */
+#endif /* DIPOLE */
+
 #ifdef DIPOLE
 	/* T H I R D loop: calculate whole dipole moment for every atom */
-	double rp, dp_sum;
-	int   dp_converged = 0, dp_it = 0;
-	double max_diff = 10;
-
-	while (dp_converged == 0) {
-	  dp_sum = 0;
-	  for (i = 0; i < inconf[h]; i++) {	/* atoms */
-	    atom = conf_atoms + i + cnfstart[h] - firstatom;
-	    type1 = atom->type;
-	    if (dp_alpha[type1]) {
-
-	      if (dp_it) {
-		/* note: mixing parameter is different from that on in IMD */
-		atom->E_tot.x = (1 - dp_mix) * atom->E_ind.x + dp_mix * atom->E_old.x + atom->E_stat.x;
-		atom->E_tot.y = (1 - dp_mix) * atom->E_ind.y + dp_mix * atom->E_old.y + atom->E_stat.y;
-		atom->E_tot.z = (1 - dp_mix) * atom->E_ind.z + dp_mix * atom->E_old.z + atom->E_stat.z;
-	      } else {
-		atom->E_tot.x = atom->E_ind.x + atom->E_stat.x;
-		atom->E_tot.y = atom->E_ind.y + atom->E_stat.y;
-		atom->E_tot.z = atom->E_ind.z + atom->E_stat.z;
-	      }
-
-	      atom->p_ind.x = dp_alpha[type1] * atom->E_tot.x + atom->p_sr.x;
-	      atom->p_ind.y = dp_alpha[type1] * atom->E_tot.y + atom->p_sr.y;
-	      atom->p_ind.z = dp_alpha[type1] * atom->E_tot.z + atom->p_sr.z;
-
-	      atom->E_old.x = atom->E_ind.x;
-	      atom->E_old.y = atom->E_ind.y;
-	      atom->E_old.z = atom->E_ind.z;
-
-	      atom->E_ind.x = 0.0;
-	      atom->E_ind.y = 0.0;
-	      atom->E_ind.z = 0.0;
-	    }
-	  }
-
-	  for (i = 0; i < inconf[h]; i++) {	/* atoms */
-	    atom = conf_atoms + i + cnfstart[h] - firstatom;
-	    type1 = atom->type;
-	    for (j = 0; j < atom->num_neigh; j++) {	/* neighbors */
-	      neigh = atom->neigh + j;
-	      type2 = neigh->type;
-	      col = neigh->col[0];
-	      /* In small cells, an atom might interact with itself */
-	      self = (neigh->nr == i + cnfstart[h]) ? 1 : 0;
-
-	      if (neigh->r < dp_cut && dp_alpha[type1] && dp_alpha[type2]) {
-
-		rp = SPROD(conf_atoms[neigh->nr - firstatom].p_ind, neigh->dist_r);
-		atom->E_ind.x +=
-		  neigh->grad_el * (3 * rp * neigh->dist_r.x - conf_atoms[neigh->nr - firstatom].p_ind.x);
-		atom->E_ind.y +=
-		  neigh->grad_el * (3 * rp * neigh->dist_r.y - conf_atoms[neigh->nr - firstatom].p_ind.y);
-		atom->E_ind.z +=
-		  neigh->grad_el * (3 * rp * neigh->dist_r.z - conf_atoms[neigh->nr - firstatom].p_ind.z);
-
-		if (!self) {
-		  rp = SPROD(atom->p_ind, neigh->dist_r);
-		  conf_atoms[neigh->nr - firstatom].E_ind.x +=
-		    neigh->grad_el * (3 * rp * neigh->dist_r.x - atom->p_ind.x);
-		  conf_atoms[neigh->nr - firstatom].E_ind.y +=
-		    neigh->grad_el * (3 * rp * neigh->dist_r.y - atom->p_ind.y);
-		  conf_atoms[neigh->nr - firstatom].E_ind.z +=
-		    neigh->grad_el * (3 * rp * neigh->dist_r.z - atom->p_ind.z);
-		}
-	      }
-	    }
-	  }
-
-	  for (i = 0; i < inconf[h]; i++) {	/* atoms */
-	    atom = conf_atoms + i + cnfstart[h] - firstatom;
-	    type1 = atom->type;
-	    if (dp_alpha[type1]) {
-	      dp_sum += dsquare(dp_alpha[type1] * (atom->E_old.x - atom->E_ind.x));
-	      dp_sum += dsquare(dp_alpha[type1] * (atom->E_old.y - atom->E_ind.y));
-	      dp_sum += dsquare(dp_alpha[type1] * (atom->E_old.z - atom->E_ind.z));
-	    }
-	  }
-
-	  dp_sum /= 3 * inconf[h];
-	  dp_sum = sqrt(dp_sum);
-
-	  if (dp_it) {
-	    if ((dp_sum > max_diff) || (dp_it > 50)) {
-	      dp_converged = 1;
-	      for (i = 0; i < inconf[h]; i++) {	/* atoms */
-		atom = conf_atoms + i + cnfstart[h] - firstatom;
-		type1 = atom->type;
-		if (dp_alpha[type1]) {
-		  atom->p_ind.x = dp_alpha[type1] * atom->E_stat.x + atom->p_sr.x;
-		  atom->p_ind.y = dp_alpha[type1] * atom->E_stat.y + atom->p_sr.y;
-		  atom->p_ind.z = dp_alpha[type1] * atom->E_stat.z + atom->p_sr.z;
-		  atom->E_ind.x = atom->E_stat.x;
-		  atom->E_ind.y = atom->E_stat.y;
-		  atom->E_ind.z = atom->E_stat.z;
-		}
-	      }
-	    }
-	  }
-
-	  if (dp_sum < dp_tol) {
-	    dp_converged = 1;
-	  }
-
-	  dp_it++;
-	}			/* end T H I R D loop over atoms */
+	induce_dipoles(h, dp_alpha, dp_kappa);
 
 
 	/* F O U R T H  loop: calculate monopole-dipole and dipole-dipole forces */
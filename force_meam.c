@@ -40,6 +40,10 @@
 #include "splines.h"
 #include "utils.h"
 
+/* angular forces on the neighbors of one atom, summed over all triplets */
+static vector *angle_force = NULL;
+static int angle_force_len = 0;
+
 /****************************************************************
  *
  *  compute forces using eam potentials with spline interpolation
@@ -89,7 +93,7 @@
  *
  ****************************************************************/
 
-double calc_forces(double *xi_opt, double *forces, int flag)
+double calc_forces_meam(double *xi_opt, double *forces, int flag)
 {
   int   first, col, i = flag;
   double *xi = NULL;
@@ -100,8 +104,8 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 
   /* Temp variables */
   atom_t *atom;			/* atom pointer */
-  int   h, j, k;
-  int   n_i, n_j, n_k;
+  int   h, j, ijk;
+  int   n_i, n_j;
   int   uf;
 #ifdef APOT
   double temp_eng;
@@ -126,6 +130,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #endif /* !RESCALE && !APOT */
 
   /* MEAM variables */
+  double g, dg;
   double dV3j, dV3k, V3, vlj, vlk, vv3j, vv3k;
   vector dfj, dfk;
   angle_t *angle;
@@ -182,25 +187,33 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 
     /* First step is to initialize 2nd derivatives for splines */
 
-    /* Pair potential (phi), density (rho), embedding funtion (F)
-       where paircol is number of pair potential columns
-       and ntypes is number of rho columns
-       and ntypes is number of F columns */
-    for (col = 0; col < 2 * paircol + 3 * ntypes; col++) {
-      /* Pointer to first entry */
-      first = calc_pot.first[col];
-
-      /* Initialize 2nd derivatives
-         step = width of spline knots (known as h)
-         xi+first = array with spline values
-         calc_pot.last[col1] - first + 1 = num of spline pts
-         *(xi + first - 2) = value of endpoint gradient (default: 1e30)
-         *(xi + first - 1) = value of other endpoint gradient
-         (default: phi=0.0, rho=0.0, F=1e30)
-         calc_pot.d2tab + first = array to hold 2nd deriv */
-      spline_ed(calc_pot.step[col], xi + first, calc_pot.last[col] - first + 1,
-	*(xi + first - 2), *(xi + first - 1), calc_pot.d2tab + first);
+#ifdef MPI_SHM
+    /* the potential table is shared, one process per node sets it up */
+    if (0 == shm_id) {
+#endif /* MPI_SHM */
+      /* Pair potential (phi), density (rho), embedding funtion (F)
+	 where paircol is number of pair potential columns
+	 and ntypes is number of rho columns
+	 and ntypes is number of F columns */
+      for (col = 0; col < 2 * paircol + 3 * ntypes; col++) {
+	/* Pointer to first entry */
+	first = calc_pot.first[col];
+
+	/* Initialize 2nd derivatives
+	   step = width of spline knots (known as h)
+	   xi+first = array with spline values
+	   calc_pot.last[col1] - first + 1 = num of spline pts
+	   *(xi + first - 2) = value of endpoint gradient (default: 1e30)
+	   *(xi + first - 1) = value of other endpoint gradient
+	   (default: phi=0.0, rho=0.0, F=1e30)
+	   calc_pot.d2tab + first = array to hold 2nd deriv */
+	spline_ed(calc_pot.step[col], xi + first, calc_pot.last[col] - first + 1,
+	  *(xi + first - 2), *(xi + first - 1), calc_pot.d2tab + first);
+      }
+#ifdef MPI_SHM
     }
+    MPI_Barrier(shm_comm);
+#endif /* MPI_SHM */
 
 #ifndef MPI
     myconf = nconf;
@@ -355,32 +368,67 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	     col2 = 2 * paircol + 2 * ntypes + typ1; */
 
 	  /* Loop over every angle formed by neighbors
-	     N(N-1)/2 possible combinations
+	     at most N(N-1)/2 possible combinations
 	     Used in computing angular part g_ijk */
 
-	  /* set angl pointer to angl_part of current atom */
-	  angle = atom->angle_part;
-
-	  for (j = 0; j < atom->num_neigh - 1; j++) {
-
-	    /* Get pointer to neighbor jj */
-	    neigh_j = atom->neigh + j;
-
-	    for (k = j + 1; k < atom->num_neigh; k++) {
-
-	      /* Get pointer to neighbor kk */
-	      neigh_k = atom->neigh + k;
-
-	      /* The cos(theta) should always lie inside -1 ... 1
-	         So store the g and g' without checking bounds */
-	      angle->g = splint_comb_dir(&calc_pot, xi, angle->slot, angle->shift, angle->step, &angle->dg);
-
-	      /* Sum up rho piece for atom i caused by j and k
-	         f_ij * f_ik * m_ijk */
-	      atom->rho += neigh_j->f * neigh_k->f * angle->g;
+	  /* The angular forces are linear in F'(rho_i), so their triplet
+	     parts are summed up per neighbor in the same sweep as rho */
+	  if (uf) {
+	    if (atom->num_neigh > angle_force_len) {
+	      angle_force_len = atom->num_neigh;
+	      angle_force = (vector *)realloc(angle_force, angle_force_len * sizeof(vector));
+	      if (NULL == angle_force)
+		error(1, "Cannot allocate memory for the angular forces");
+	    }
+	    for (j = 0; j < atom->num_neigh; j++) {
+	      angle_force[j].x = 0.0;
+	      angle_force[j].y = 0.0;
+	      angle_force[j].z = 0.0;
+	    }
+	  }
 
-	      /* Increase angl pointer */
-	      angle++;
+	  /* only angles inside the range of f are stored */
+	  for (ijk = 0; ijk < atom->num_angles; ijk++) {
+
+	    /* Get pointers to the angle and to neighbors j and k */
+	    angle = atom->angle_part + ijk;
+	    neigh_j = atom->neigh + angle->j;
+	    neigh_k = atom->neigh + angle->k;
+
+	    /* The cos(theta) should always lie inside -1 ... 1
+	       So compute g and g' without checking bounds */
+	    g = splint_comb_dir(&calc_pot, xi, angle->slot, angle->shift, angle->step, &dg);
+
+	    /* Sum up rho piece for atom i caused by j and k
+	       f_ij * f_ik * m_ijk */
+	    atom->rho += neigh_j->f * neigh_k->f * g;
+
+	    if (uf) {
+	      /* Some tmp variables to clean up force fn below */
+	      dV3j = g * neigh_j->df * neigh_k->f;
+	      dV3k = g * neigh_j->f * neigh_k->df;
+	      V3 = neigh_j->f * neigh_k->f * dg;
+
+	      vlj = V3 * neigh_j->inv_r;
+	      vlk = V3 * neigh_k->inv_r;
+	      vv3j = dV3j - vlj * angle->cos;
+	      vv3k = dV3k - vlk * angle->cos;
+
+	      dfj.x = vv3j * neigh_j->dist_r.x + vlj * neigh_k->dist_r.x;
+	      dfj.y = vv3j * neigh_j->dist_r.y + vlj * neigh_k->dist_r.y;
+	      dfj.z = vv3j * neigh_j->dist_r.z + vlj * neigh_k->dist_r.z;
+
+	      dfk.x = vv3k * neigh_k->dist_r.x + vlk * neigh_j->dist_r.x;
+	      dfk.y = vv3k * neigh_k->dist_r.y + vlk * neigh_j->dist_r.y;
+	      dfk.z = vv3k * neigh_k->dist_r.z + vlk * neigh_j->dist_r.z;
+
+	      /* Triplet forces on atoms j and k, still without F'(rho_i) */
+	      angle_force[angle->j].x += dfj.x;
+	      angle_force[angle->j].y += dfj.y;
+	      angle_force[angle->j].z += dfj.z;
+	      angle_force[angle->k].x += dfk.x;
+	      angle_force[angle->k].y += dfk.y;
+	      angle_force[angle->k].z += dfk.z;
 	    }
 	  }
 
@@ -415,8 +463,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  if (atom->rho < calc_pot.begin[col_F]) {
 #ifdef APOT
 	    /* calculate analytic value explicitly */
-	    apot_table.fvalue[col_F] (atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng);
-	    atom->gradF = apot_grad(atom->rho, xi_opt + opt_pot.first[col_F], apot_table.fvalue[col_F]);
+	    apot_value_grad(col_F, atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng, &atom->gradF);
 	    forces[energy_p + h] += temp_eng;
 #else
 	    /* Linear extrapolate values to left to get F_i(rho)
@@ -431,8 +478,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  } else if (atom->rho > calc_pot.end[col_F]) {
 #ifdef APOT
 	    /* calculate analytic value explicitly */
-	    apot_table.fvalue[col_F] (atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng);
-	    atom->gradF = apot_grad(atom->rho, xi_opt + opt_pot.first[col_F], apot_table.fvalue[col_F]);
+	    apot_value_grad(col_F, atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng, &atom->gradF);
 	    forces[energy_p + h] += temp_eng;
 #else
 	    /* Get value and grad at 1/2 the width from the final spline point */
@@ -447,8 +493,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #ifdef APOT
 	    /* calculate small values directly */
 	    if (atom->rho < 0.1) {
-	      apot_table.fvalue[col_F] (atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng);
-	      atom->gradF = apot_grad(atom->rho, xi_opt + opt_pot.first[col_F], apot_table.fvalue[col_F]);
+	      apot_value_grad(col_F, atom->rho, xi_opt + opt_pot.first[col_F], &temp_eng, &atom->gradF);
 	      forces[energy_p + h] += temp_eng;
 	    } else
 #endif
@@ -511,90 +556,46 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	    /* Compute MEAM Forces */
 	    /********************************/
 
-	    /* Loop over every angle formed by neighbors
-	       N(N-1)/2 possible combinations
-	       Used in computing angular part g_ijk */
-
-	    /* set angle pointer to angl_part of current atom */
-	    angle = atom->angle_part;
-
-	    for (j = 0; j < atom->num_neigh - 1; j++) {
+	    /* The triplet forces were summed up per neighbor together
+	       with rho, only the factor F'(rho_i) is missing */
+	    for (j = 0; j < atom->num_neigh; j++) {
 
 	      /* Get pointer to neighbor j */
 	      neigh_j = atom->neigh + j;
-	      /* Force location for atom j */
-	      n_j = 3 * neigh_j->nr;
-
-	      for (k = j + 1; k < atom->num_neigh; k++) {
 
-		/* Get pointer to neighbor k */
-		neigh_k = atom->neigh + k;
+	      /* Neighbors outside the range of f are in no angle */
+	      if (neigh_j->r >= calc_pot.end[neigh_j->col[2]])
+		continue;
 
-		/* Force location for atom k */
-		n_k = 3 * neigh_k->nr;
-
-		/* Some tmp variables to clean up force fn below */
-		dV3j = angle->g * neigh_j->df * neigh_k->f;
-		dV3k = angle->g * neigh_j->f * neigh_k->df;
-		V3 = neigh_j->f * neigh_k->f * angle->dg;
-
-		vlj = V3 * neigh_j->inv_r;
-		vlk = V3 * neigh_k->inv_r;
-		vv3j = dV3j - vlj * angle->cos;
-		vv3k = dV3k - vlk * angle->cos;
-
-		dfj.x = vv3j * neigh_j->dist_r.x + vlj * neigh_k->dist_r.x;
-		dfj.y = vv3j * neigh_j->dist_r.y + vlj * neigh_k->dist_r.y;
-		dfj.z = vv3j * neigh_j->dist_r.z + vlj * neigh_k->dist_r.z;
-
-		dfk.x = vv3k * neigh_k->dist_r.x + vlk * neigh_j->dist_r.x;
-		dfk.y = vv3k * neigh_k->dist_r.y + vlk * neigh_j->dist_r.y;
-		dfk.z = vv3k * neigh_k->dist_r.z + vlk * neigh_j->dist_r.z;
+	      /* Force location for atom j */
+	      n_j = 3 * neigh_j->nr;
 
-		/* Force on atom i from j and k */
-		forces[n_i + 0] += atom->gradF * (dfj.x + dfk.x);
-		forces[n_i + 1] += atom->gradF * (dfj.y + dfk.y);
-		forces[n_i + 2] += atom->gradF * (dfj.z + dfk.z);
+	      tmp_force.x = atom->gradF * angle_force[j].x;
+	      tmp_force.y = atom->gradF * angle_force[j].y;
+	      tmp_force.z = atom->gradF * angle_force[j].z;
 
-		/* Reaction force on atom j from i and k */
-		forces[n_j + 0] -= atom->gradF * dfj.x;
-		forces[n_j + 1] -= atom->gradF * dfj.y;
-		forces[n_j + 2] -= atom->gradF * dfj.z;
+	      /* Force on atom i from j */
+	      forces[n_i + 0] += tmp_force.x;
+	      forces[n_i + 1] += tmp_force.y;
+	      forces[n_i + 2] += tmp_force.z;
 
-		/* Reaction force on atom k from i and j */
-		forces[n_k + 0] -= atom->gradF * dfk.x;
-		forces[n_k + 1] -= atom->gradF * dfk.y;
-		forces[n_k + 2] -= atom->gradF * dfk.z;
+	      /* Reaction force on atom j from i and the other neighbors */
+	      forces[n_j + 0] -= tmp_force.x;
+	      forces[n_j + 1] -= tmp_force.y;
+	      forces[n_j + 2] -= tmp_force.z;
 
 #ifdef STRESS
-		if (us) {
-		  /* Force from j on atom i */
-		  tmp_force.x = atom->gradF * dfj.x;
-		  tmp_force.y = atom->gradF * dfj.y;
-		  tmp_force.z = atom->gradF * dfj.z;
-		  forces[stresses + 0] -= neigh_j->dist.x * tmp_force.x;
-		  forces[stresses + 1] -= neigh_j->dist.y * tmp_force.y;
-		  forces[stresses + 2] -= neigh_j->dist.z * tmp_force.z;
-		  forces[stresses + 3] -= neigh_j->dist.x * tmp_force.y;
-		  forces[stresses + 4] -= neigh_j->dist.y * tmp_force.z;
-		  forces[stresses + 5] -= neigh_j->dist.z * tmp_force.x;
-
-		  /* Force from k on atom i */
-		  tmp_force.x = atom->gradF * dfk.x;
-		  tmp_force.y = atom->gradF * dfk.y;
-		  tmp_force.z = atom->gradF * dfk.z;
-		  forces[stresses + 0] -= neigh_k->dist.x * tmp_force.x;
-		  forces[stresses + 1] -= neigh_k->dist.y * tmp_force.y;
-		  forces[stresses + 2] -= neigh_k->dist.z * tmp_force.z;
-		  forces[stresses + 3] -= neigh_k->dist.x * tmp_force.y;
-		  forces[stresses + 4] -= neigh_k->dist.y * tmp_force.z;
-		  forces[stresses + 5] -= neigh_k->dist.z * tmp_force.x;
-		}
+	      if (us) {
+		/* Force from j on atom i */
+		forces[stresses + 0] -= neigh_j->dist.x * tmp_force.x;
+		forces[stresses + 1] -= neigh_j->dist.y * tmp_force.y;
+		forces[stresses + 2] -= neigh_j->dist.z * tmp_force.z;
+		forces[stresses + 3] -= neigh_j->dist.x * tmp_force.y;
+		forces[stresses + 4] -= neigh_j->dist.y * tmp_force.z;
+		forces[stresses + 5] -= neigh_j->dist.z * tmp_force.x;
+	      }
 #endif // STRESS
-		/* Increase n_angl pointer */
-		angle++;
-	      }			/* End inner loop over angles (neighbor atom k) */
-	    }			/* End outer loop over angles (neighbor atom j) */
+	    }			/* End loop over neighbors */
 	  }			/* uf */
 	}			/* END OF SECOND LOOP OVER ATOM i */
 
@@ -30,13 +30,252 @@
 
 #include "potfit.h"
 
-#ifdef PAIR
+#if defined PAIR || defined PAIR_KERNEL
 
 #include "functions.h"
 #include "potential.h"
 #include "splines.h"
 #include "utils.h"
 
+#ifdef APOT
+
+/* data for evaluating the analytic potentials directly */
+static int direct_init = 0;	/* has the neighbor data been collected? */
+static int use_direct = 0;	/* evaluate directly instead of using tables */
+static int direct_need_grad = 0;	/* do we need the gradients at all? */
+static int *direct_idx = NULL;	/* index of the distance of every local neighbor */
+static int *direct_first = NULL;	/* first distance of every column */
+static int *direct_num = NULL;	/* number of distances of every column */
+static double *direct_r = NULL;	/* sorted distinct neighbor distances */
+static double *direct_val = NULL;	/* potential values at these distances */
+static double *direct_grad = NULL;	/* potential gradients at these distances */
+static double *direct_tmp = NULL;	/* scratch space */
+
+/****************************************************************
+ *
+ *  compare two doubles for qsort and bsearch
+ *
+ ****************************************************************/
+
+static int compare_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/****************************************************************
+ *
+ *  collect the distinct neighbor distances of the local atoms for
+ *  every column and decide if the potentials are evaluated there
+ *
+ *  Tabulating costs one function call per sampling point, the direct
+ *  evaluation one call per distance, or three for functions without
+ *  analytic derivative (value and central difference). All processes
+ *  have to take the same decision, the one with the most work counts.
+ *
+ ****************************************************************/
+
+static void init_direct(void)
+{
+  int   h, i, j, col, total = 0, num = 0, max = 0, points = 0;
+  int   cost[2];
+  int  *pos;
+  double *r;
+  atom_t *atom;
+  neigh_t *neigh;
+
+  direct_init = 1;
+
+  if (0 == apot_direct)
+    return;
+
+  direct_first = (int *)malloc(paircol * sizeof(int));
+  direct_num = (int *)malloc(paircol * sizeof(int));
+  pos = (int *)malloc(paircol * sizeof(int));
+  if (NULL == direct_first || NULL == direct_num || NULL == pos)
+    error(1, "Cannot allocate memory for direct potential evaluation");
+  reg_for_free(direct_first, "direct_first");
+  reg_for_free(direct_num, "direct_num");
+
+  for (col = 0; col < paircol; col++)
+    direct_num[col] = 0;
+
+  /* count the neighbors inside the cutoff of every column */
+  for (h = firstconf; h < firstconf + myconf; h++) {
+    if (conf_uf[h - firstconf])
+      direct_need_grad = 1;
+    for (i = 0; i < inconf[h]; i++) {
+      atom = conf_atoms + i + cnfstart[h] - firstatom;
+      total += atom->num_neigh;
+      for (j = 0; j < atom->num_neigh; j++) {
+	neigh = atom->neigh + j;
+	if (neigh->r < calc_pot.end[neigh->col[0]])
+	  direct_num[neigh->col[0]]++;
+      }
+    }
+  }
+
+  for (col = 0; col < paircol; col++) {
+    direct_first[col] = num;
+    pos[col] = num;
+    num += direct_num[col];
+  }
+
+  direct_idx = (int *)malloc((total + 1) * sizeof(int));
+  direct_r = (double *)malloc((num + 1) * sizeof(double));
+  direct_val = (double *)malloc((num + 1) * sizeof(double));
+  direct_grad = (double *)malloc((num + 1) * sizeof(double));
+  if (NULL == direct_idx || NULL == direct_r || NULL == direct_val || NULL == direct_grad)
+    error(1, "Cannot allocate memory for direct potential evaluation");
+  reg_for_free(direct_idx, "direct_idx");
+  reg_for_free(direct_r, "direct_r");
+  reg_for_free(direct_val, "direct_val");
+  reg_for_free(direct_grad, "direct_grad");
+
+  /* collect all distances and keep the distinct ones */
+  for (h = firstconf; h < firstconf + myconf; h++) {
+    for (i = 0; i < inconf[h]; i++) {
+      atom = conf_atoms + i + cnfstart[h] - firstatom;
+      for (j = 0; j < atom->num_neigh; j++) {
+	neigh = atom->neigh + j;
+	if (neigh->r < calc_pot.end[neigh->col[0]])
+	  direct_r[pos[neigh->col[0]]++] = neigh->r;
+      }
+    }
+  }
+
+  num = 0;
+  for (col = 0; col < paircol; col++) {
+    r = direct_r + direct_first[col];
+    qsort(r, direct_num[col], sizeof(double), compare_double);
+    for (i = 0, j = 0; i < direct_num[col]; i++)
+      if (0 == j || r[i] != r[j - 1])
+	r[j++] = r[i];
+    direct_num[col] = j;
+    num += j;
+    max = MAX(max, j);
+  }
+
+  /* find the distance of every neighbor */
+  total = 0;
+  for (h = firstconf; h < firstconf + myconf; h++) {
+    for (i = 0; i < inconf[h]; i++) {
+      atom = conf_atoms + i + cnfstart[h] - firstatom;
+      for (j = 0; j < atom->num_neigh; j++) {
+	neigh = atom->neigh + j;
+	col = neigh->col[0];
+	if (neigh->r < calc_pot.end[col]) {
+	  r = (double *)bsearch(&neigh->r, direct_r + direct_first[col], direct_num[col], sizeof(double),
+	    compare_double);
+	  direct_idx[total++] = r - direct_r;
+	} else
+	  direct_idx[total++] = -1;
+      }
+    }
+  }
+
+  free(pos);
+
+  direct_tmp = (double *)malloc((3 * max + 1) * sizeof(double));
+  if (NULL == direct_tmp)
+    error(1, "Cannot allocate memory for direct potential evaluation");
+  reg_for_free(direct_tmp, "direct_tmp");
+
+  /* number of sampling points of the pair potentials */
+  for (col = 0; col < paircol; col++)
+    points += calc_pot.last[col] - calc_pot.first[col] + 1;
+
+  /* function calls of the direct evaluation */
+  cost[0] = 0;
+  for (col = 0; col < paircol; col++)
+    cost[0] += (direct_need_grad && NULL == apot_table.fgrad[col] ? 3 : 1) * direct_num[col];
+  cost[1] = num;
+#ifdef MPI
+  MPI_Allreduce(MPI_IN_PLACE, cost, 2, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+#endif /* MPI */
+
+  if (1 == apot_direct || (cost[0] < points))
+    use_direct = 1;
+
+  if (0 == myid && use_direct)
+    printf("Evaluating the analytic pair potentials directly at %d distances.\n", cost[1]);
+  else if (0 == myid)
+    printf("Using tabulated pair potentials, there are %d distinct distances.\n", cost[1]);
+}
+
+/****************************************************************
+ *
+ *  evaluate the potential in column col at n distances
+ *
+ ****************************************************************/
+
+static void direct_column(int col, double *xi_opt, const double *r, int n, double *f)
+{
+  int   i;
+  double *p = xi_opt + opt_pot.first[col];
+
+  if (NULL != apot_table.fbatch[col])
+    apot_table.fbatch[col] (r, n, p, f);
+  else
+    for (i = 0; i < n; i++)
+      apot_table.fvalue[col] (r[i], p, f + i);
+
+  if (smooth_pot[col])
+    cutoff_batch(r, n, apot_table.end[col], p[apot_table.n_par[col] - 1], f);
+}
+
+/****************************************************************
+ *
+ *  evaluate all pair potentials and their gradients directly
+ *
+ ****************************************************************/
+
+static void eval_direct(double *xi_opt)
+{
+  int   col, i, n;
+  double *p, *r, *rr, *f_p, *f_m, *val, *grad;
+  double eps = 0.0001;		/* same step as in apot_grad() */
+
+  /* global parameters have to be copied, this is done by update_calc_table() otherwise */
+  copy_apot_globals(xi_opt);
+
+  for (col = 0; col < paircol; col++) {
+    n = direct_num[col];
+    if (0 == n)
+      continue;
+    r = direct_r + direct_first[col];
+    if (direct_need_grad && NULL != apot_table.fgrad[col]) {
+      /* value and analytic derivative in one call */
+      p = xi_opt + opt_pot.first[col];
+      val = direct_val + direct_first[col];
+      grad = direct_grad + direct_first[col];
+      for (i = 0; i < n; i++)
+	apot_table.fgrad[col] (r[i], p, val + i, grad + i);
+      if (smooth_pot[col])
+	cutoff_grad_batch(r, n, apot_table.end[col], p[apot_table.n_par[col] - 1], val, grad);
+      continue;
+    }
+    direct_column(col, xi_opt, r, n, direct_val + direct_first[col]);
+    if (direct_need_grad) {
+      /* central differences for functions without derivative */
+      rr = direct_tmp;
+      f_p = direct_tmp + n;
+      f_m = direct_tmp + 2 * n;
+      for (i = 0; i < n; i++)
+	rr[i] = r[i] + eps;
+      direct_column(col, xi_opt, rr, n, f_p);
+      for (i = 0; i < n; i++)
+	rr[i] = r[i] - eps;
+      direct_column(col, xi_opt, rr, n, f_m);
+      for (i = 0; i < n; i++)
+	direct_grad[direct_first[col] + i] = (f_p[i] - f_m[i]) / (2.0 * eps);
+    }
+  }
+}
+
+#endif /* APOT */
+
 /****************************************************************
  *
  *  compute forces using pair potentials with spline interpolation
@@ -86,7 +325,7 @@
  *
  ****************************************************************/
 
-double calc_forces(double *xi_opt, double *forces, int flag)
+double calc_forces_pair(double *xi_opt, double *forces, int flag)
 {
   int   first, col, i;
   double *xi = NULL;
@@ -102,6 +341,9 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #ifdef STRESS
   int   us, stresses;
 #endif /* STRESS */
+#ifdef APOT
+  int   n_neigh;		/* number of the neighbor for direct evaluation */
+#endif /* APOT */
 
   /* pointer for neighbor table */
   neigh_t *neigh;
@@ -129,7 +371,8 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #if defined APOT && !defined MPI
     if (0 == format) {
       apot_check_params(xi_opt);
-      update_calc_table(xi_opt, xi, 0);
+      if (!use_direct)
+	update_calc_table(xi_opt, xi, 0);
     }
 #endif /* APOT && !MPI */
 
@@ -147,7 +390,8 @@ double calc_forces(double *xi_opt, double *forces, int flag)
     if (0 == myid)
       apot_check_params(xi_opt);
     MPI_Bcast(xi_opt, ndimtot, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    update_calc_table(xi_opt, xi, 0);
+    if (!use_direct)
+      update_calc_table(xi_opt, xi, 0);
 #else /* APOT */
     /* if flag==2 then the potential parameters have changed -> sync */
     if (2 == flag)
@@ -157,21 +401,41 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 
     /* init second derivatives for splines */
 
-    /* pair potentials */
-    for (col = 0; col < paircol; col++) {
-      first = calc_pot.first[col];
-      if (0 == format || 3 == format)
-	spline_ed(calc_pot.step[col], xi + first,
-	  calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
-      else			/* format >= 4 ! */
-	spline_ne(calc_pot.xcoord + first, xi + first,
-	  calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+#ifdef MPI_SHM
+    /* the potential table is shared, one process per node sets it up */
+    if (0 == shm_id) {
+#endif /* MPI_SHM */
+      /* pair potentials */
+      for (col = 0; col < paircol; col++) {
+#ifdef APOT
+	if (use_direct)
+	  break;
+#endif /* APOT */
+	first = calc_pot.first[col];
+	if (0 == format || 3 == format)
+	  spline_ed(calc_pot.step[col], xi + first,
+	    calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+	else			/* format >= 4 ! */
+	  spline_ne(calc_pot.xcoord + first, xi + first,
+	    calc_pot.last[col] - first + 1, *(xi + first - 2), 0.0, calc_pot.d2tab + first);
+      }
+#ifdef MPI_SHM
     }
+    MPI_Barrier(shm_comm);
+#endif /* MPI_SHM */
 
 #ifndef MPI
     myconf = nconf;
 #endif /* MPI */
 
+#ifdef APOT
+    if (!direct_init)
+      init_direct();
+    if (use_direct)
+      eval_direct(xi_opt);
+    n_neigh = 0;
+#endif /* APOT */
+
     /* region containing loop over configurations */
     {
 
@@ -189,10 +453,10 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  forces[stresses + i] = 0.0;
 #endif /* STRESS */
 
-#ifdef APOT
+#if defined APOT && defined PAIR
 	if (enable_cp)
 	  forces[energy_p + h] += chemical_potential(ntypes, na_type[h], xi_opt + cp_start);
-#endif /* APOT */
+#endif /* APOT && PAIR */
 
 	/* first loop over atoms: reset forces, densities */
 	for (i = 0; i < inconf[h]; i++) {
@@ -223,6 +487,12 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	    /* pair potential part */
 	    if (neigh->r < calc_pot.end[neigh->col[0]]) {
 	      /* fn value and grad are calculated in the same step */
+#ifdef APOT
+	      if (use_direct) {
+		phi_val = direct_val[direct_idx[n_neigh]];
+		phi_grad = direct_grad[direct_idx[n_neigh]];
+	      } else
+#endif /* APOT */
 	      if (uf)
 		phi_val =
 		  splint_comb_dir(&calc_pot, xi, neigh->slot[0], neigh->shift[0], neigh->step[0], &phi_grad);
@@ -264,6 +534,9 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #endif /* STRESS */
 	      }
 	    }			/* neighbor in range */
+#ifdef APOT
+	    n_neigh++;
+#endif /* APOT */
 	  }			/* loop over all neighbors */
 
 	  /* then we can calculate contribution of forces right away */
@@ -304,6 +577,12 @@ double calc_forces(double *xi_opt, double *forces, int flag)
     }				/* parallel region */
 
     /* dummy constraints (global) */
+#ifdef PAIR_KERNEL
+    /* the EAM constraints in the force vector are not used here */
+    if (0 == myid)
+      for (i = limit_p; i < dummy_p + 2 * ntypes; i++)
+	forces[i] = 0.0;
+#endif /* PAIR_KERNEL */
 #ifdef APOT
     /* add punishment for out of bounds (mostly for powell_lsq) */
     if (0 == myid) {
@@ -362,4 +641,4 @@ double calc_forces(double *xi_opt, double *forces, int flag)
   return -1.0;
 }
 
-#endif /* PAIR */
+#endif /* PAIR || PAIR_KERNEL */
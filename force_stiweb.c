@@ -38,6 +38,159 @@
 #include "splines.h"
 #include "utils.h"
 
+/* radial terms of all local neighbors, kept between force calculations */
+static double *radial_val = NULL;	/* r^-p, r^-q and exp(delta / (r - a1)) */
+static int *radial_first = NULL;	/* first neighbor of every local atom */
+static double *radial_par = NULL;	/* radial parameters of the last call */
+static int *radial_changed = NULL;	/* radial parameters of a column moved */
+static int radial_init = 0;
+
+/* arguments and values of the radial functions of one atom */
+static double *radial_x = NULL;
+static double *radial_y = NULL;
+static double *radial_pow = NULL;
+static double *radial_exp = NULL;
+static int radial_len = 0;
+
+/****************************************************************
+ *
+ *  radial_check: compare the radial parameters of every pair
+ *	column with the last force calculation, only the columns
+ *	that moved have to be tabulated again
+ *
+ ****************************************************************/
+
+static void radial_check(const sw_t *sw)
+{
+  int   i, col, n, nat;
+  double par[6];
+
+  if (!radial_init) {
+    nat = cnfstart[firstconf + myconf - 1] + inconf[firstconf + myconf - 1] - firstatom;
+    radial_first = (int *)malloc((nat + 1) * sizeof(int));
+    radial_par = (double *)calloc(6 * paircol, sizeof(double));
+    radial_changed = (int *)malloc(paircol * sizeof(int));
+    if (NULL == radial_first || NULL == radial_par || NULL == radial_changed)
+      error(1, "Cannot allocate memory for the radial functions");
+    n = 0;
+    for (i = 0; i < nat; i++) {
+      radial_first[i] = n;
+      n += conf_atoms[i].num_neigh;
+    }
+    radial_first[nat] = n;
+    radial_val = (double *)malloc((3 * n + 1) * sizeof(double));
+    if (NULL == radial_val)
+      error(1, "Cannot allocate memory for the radial functions");
+    reg_for_free(radial_first, "radial_first");
+    reg_for_free(radial_par, "radial_par");
+    reg_for_free(radial_changed, "radial_changed");
+    reg_for_free(radial_val, "radial_val");
+  }
+
+  for (col = 0; col < paircol; col++) {
+    par[0] = *(sw->p[col]);
+    par[1] = *(sw->q[col]);
+    par[2] = *(sw->delta[col]);
+    par[3] = *(sw->a1[col]);
+    par[4] = *(sw->gamma[col]);
+    par[5] = *(sw->a2[col]);
+    radial_changed[col] = !radial_init;
+    for (i = 0; i < 6; i++)
+      if (par[i] != radial_par[6 * col + i]) {
+	radial_changed[col] = 1;
+	radial_par[6 * col + i] = par[i];
+      }
+  }
+  radial_init = 1;
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  radial_terms: tabulate the powers r^-p, r^-q and the cutoff
+ *	exponentials exp(delta / (r - a1)), exp(gamma / (r - a2)) of
+ *	all neighbors of an atom whose column changed, with one
+ *	vectorized call each
+ *
+ *	returns the table of the atom, neighbor j has r^-p, r^-q and
+ *	exp(delta / (r - a1)) in entries 3j to 3j + 2, the second
+ *	exponential is stored as the threebody cutoff f, df
+ *
+ ****************************************************************/
+
+static double *radial_terms(atom_t *atom, const sw_t *sw)
+{
+  int   j, m, col;
+  int   n = 2 * atom->num_neigh;
+  double tmp_r;
+  double *val = radial_val + 3 * radial_first[atom - conf_atoms];
+  neigh_t *neigh;
+
+  if (n > radial_len) {
+    radial_len = n;
+    radial_x = (double *)realloc(radial_x, 2 * radial_len * sizeof(double));
+    radial_y = (double *)realloc(radial_y, radial_len * sizeof(double));
+    radial_pow = (double *)realloc(radial_pow, radial_len * sizeof(double));
+    radial_exp = (double *)realloc(radial_exp, radial_len * sizeof(double));
+    if (NULL == radial_x || NULL == radial_y || NULL == radial_pow || NULL == radial_exp)
+      error(1, "Cannot allocate memory for the radial functions");
+  }
+
+  /* radial_x holds the bases of the powers, then the exponents */
+  m = 0;
+  for (j = 0; j < atom->num_neigh; j++) {
+    neigh = atom->neigh + j;
+    col = neigh->col[0];
+    if (!radial_changed[col])
+      continue;
+    radial_x[m] = neigh->r;
+    radial_x[m + 1] = neigh->r;
+    radial_y[m] = -*(sw->p[col]);
+    radial_y[m + 1] = -*(sw->q[col]);
+    radial_x[n + m] = 0.0;
+    radial_x[n + m + 1] = 0.0;
+    if (neigh->r < *(sw->a1[col]))
+      radial_x[n + m] = *(sw->delta[col]) * (1.0 / (neigh->r - *(sw->a1[col])));
+    if (neigh->r < *(sw->a2[col])) {
+      tmp_r = neigh->r - *(sw->a2[col]);
+      if (tmp_r < -0.01 * *(sw->gamma[col]))
+	radial_x[n + m + 1] = *(sw->gamma[col]) * (1.0 / tmp_r);
+    }
+    m += 2;
+  }
+  if (0 == m)
+    return val;
+  power_m(m, radial_pow, radial_x, radial_y);
+  exp_m(m, radial_exp, radial_x + n);
+
+  m = 0;
+  for (j = 0; j < atom->num_neigh; j++) {
+    neigh = atom->neigh + j;
+    col = neigh->col[0];
+    if (!radial_changed[col])
+      continue;
+    val[3 * j] = radial_pow[m];
+    val[3 * j + 1] = radial_pow[m + 1];
+    val[3 * j + 2] = radial_exp[m];
+    /* threebody cutoff function and its derivative */
+    if (neigh->r < *(sw->a2[col])) {
+      tmp_r = neigh->r - *(sw->a2[col]);
+      if (tmp_r < -0.01 * *(sw->gamma[col])) {
+	tmp_r = 1.0 / tmp_r;
+	neigh->f = radial_exp[m + 1];
+	neigh->df = -neigh->f * *(sw->gamma[col]) * tmp_r * tmp_r / neigh->r;
+      } else {
+	neigh->f = 0.0;
+	neigh->df = 0.0;
+      }
+    }
+    m += 2;
+  }
+
+  return val;
+}
+
 /****************************************************************
  *
  *  compute forces using Stillinger-Weber potentials with spline interpolation
@@ -87,14 +240,14 @@
  *
  ****************************************************************/
 
-double calc_forces(double *xi_opt, double *forces, int flag)
+double calc_forces_stiweb(double *xi_opt, double *forces, int flag)
 {
   int   col, i = flag;
   double tmpsum = 0.0, sum = 0.0;
   const sw_t *sw = &apot_table.sw;
 
   atom_t *atom;
-  int   h, j, k;
+  int   h, j;
   int   n_i, n_j, n_k;
   int   self, uf;
 #ifdef STRESS
@@ -108,8 +261,8 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 
   /* pair variables */
   double phi_r, phi_a, inv_c, f_cut;
-  double power[2], x[2], y[2];
-  double tmp, tmp_r;
+  double tmp;
+  double *radial;
   double v2_val, v2_grad;
   vector tmp_force;
 
@@ -145,6 +298,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #endif /* MPI */
 
     update_stiweb_pointers(xi_opt);
+    radial_check(sw);
 
     /* region containing loop over configurations */
     {
@@ -179,6 +333,10 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	for (i = 0; i < inconf[h]; i++) {
 	  atom = conf_atoms + i + cnfstart[h] - firstatom;
 	  n_i = 3 * (cnfstart[h] + i);
+
+	  /* powers and exponentials of all neighbors before the angular loop */
+	  radial = radial_terms(atom, sw);
+
 	  /* loop over neighbors */
 	  for (j = 0; j < atom->num_neigh; j++) {
 	    neigh_j = atom->neigh + j;
@@ -189,15 +347,10 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	    col = neigh_j->col[0];
 	    if (neigh_j->r < *(sw->a1[col])) {
 	      /* fn value and grad are calculated in the same step */
-	      x[0] = neigh_j->r;
-	      x[1] = x[0];
-	      y[0] = -*(sw->p[col]);
-	      y[1] = -*(sw->q[col]);
-	      power_m(2, power, x, y);
-	      phi_r = *(sw->A[col]) * power[0];
-	      phi_a = -*(sw->B[col]) * power[1];
+	      phi_r = *(sw->A[col]) * radial[3 * j];
+	      phi_a = -*(sw->B[col]) * radial[3 * j + 1];
 	      inv_c = 1.0 / (neigh_j->r - *(sw->a1[col]));
-	      f_cut = exp(*(sw->delta[col]) * inv_c);
+	      f_cut = radial[3 * j + 2];
 	      v2_val = (phi_r + phi_a) * f_cut;
 	      if (uf) {
 		v2_grad = -v2_val * *(sw->delta[col]) * inv_c * inv_c
@@ -232,105 +385,85 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #endif /* STRESS */
 	      }
 	    }
-
-	    /* calculate for later */
-	    col = neigh_j->col[0];
-	    if (neigh_j->r < *(sw->a2[col])) {
-	      tmp_r = neigh_j->r - *(sw->a2[col]);
-	      if (tmp_r < -0.01 * *(sw->gamma[col])) {
-		tmp_r = 1.0 / tmp_r;
-		neigh_j->f = exp(*(sw->gamma[col]) * tmp_r);
-		neigh_j->df = -neigh_j->f * *(sw->gamma[col]) * tmp_r * tmp_r / neigh_j->r;
-	      } else {
-		neigh_j->f = 0.0;
-		neigh_j->df = 0.0;
-	      }
-	    }
 	  }			/* loop over neighbors j */
 
-	  /* loop over all neighbors */
-	  for (j = 0; j < atom->num_neigh - 1; j++) {
-	    /* Get pointer to neighbor j */
-	    neigh_j = atom->neigh + j;
-	    ijk = neigh_j->ijk_start;
-	    /* Force location for atom j */
+	  /* loop over all stored angles */
+	  for (ijk = 0; ijk < atom->num_angles; ijk++) {
+	    /* Store pointer to angular part (g) */
+	    angle = atom->angle_part + ijk;
+	    /* Get pointers to neighbors j and k */
+	    neigh_j = atom->neigh + angle->j;
+	    neigh_k = atom->neigh + angle->k;
+	    /* check if we are inside the cutoff radius */
+	    if (neigh_j->r >= *(sw->a2[neigh_j->col[0]]))
+	      continue;
+	    /* store lambda for atom triple i,j,k */
+	    lambda = *(sw->lambda[atom->type][neigh_j->type][neigh_k->type]);
+	    /* shortcut for types without threebody interaction */
+	    if (0.0 == lambda)
+	      continue;
+	    /* Force location for atoms j and k */
 	    n_j = 3 * neigh_j->nr;
+	    n_k = 3 * neigh_k->nr;
 	    /* check if we are inside the cutoff radius */
-	    if (neigh_j->r < *(sw->a2[neigh_j->col[0]])) {
-	      /* loop over remaining neighbors */
-	      for (k = j + 1; k < atom->num_neigh; k++) {
-		/* Store pointer to angular part (g) */
-		angle = atom->angle_part + ijk++;
-		/* Get pointer to neighbor k */
-		neigh_k = atom->neigh + k;
-		/* store lambda for atom triple i,j,k */
-		lambda = *(sw->lambda[atom->type][neigh_j->type][neigh_k->type]);
-		/* shortcut for types without threebody interaction */
-		if (0.0 == lambda)
-		  continue;
-		/* Force location for atom k */
-		n_k = 3 * neigh_k->nr;
-		/* check if we are inside the cutoff radius */
-		if (neigh_k->r < *(sw->a2[neigh_k->col[0]])) {
-		  /* potential term */
-		  tmp = angle->cos + 1.0 / 3.0;
-		  v3_val = lambda * neigh_j->f * neigh_k->f * tmp * tmp;
-
-		  /* total potential */
-		  forces[energy_p + h] += v3_val;
-
-		  /* forces */
-		  tmp_grad1 = lambda * neigh_j->f * neigh_k->f * 2.0 * tmp;
-		  tmp_grad2 = lambda * tmp * tmp;
-
-		  tmp_jj = 1.0 / (neigh_j->r2);
-		  tmp_jk = 1.0 / (neigh_j->r * neigh_k->r);
-		  tmp_kk = 1.0 / (neigh_k->r2);
-		  tmp_1 = tmp_grad2 * neigh_j->df * neigh_k->f - tmp_grad1 * angle->cos * tmp_jj;
-		  tmp_2 = tmp_grad1 * tmp_jk;
-
-		  force_j.x = tmp_1 * neigh_j->dist.x + tmp_2 * neigh_k->dist.x;
-		  force_j.y = tmp_1 * neigh_j->dist.y + tmp_2 * neigh_k->dist.y;
-		  force_j.z = tmp_1 * neigh_j->dist.z + tmp_2 * neigh_k->dist.z;
-
-		  tmp_1 = tmp_grad2 * neigh_k->df * neigh_j->f - tmp_grad1 * angle->cos * tmp_kk;
-		  force_k.x = tmp_1 * neigh_k->dist.x + tmp_2 * neigh_j->dist.x;
-		  force_k.y = tmp_1 * neigh_k->dist.y + tmp_2 * neigh_j->dist.y;
-		  force_k.z = tmp_1 * neigh_k->dist.z + tmp_2 * neigh_j->dist.z;
-
-		  /* update force on particle i */
-		  forces[n_i + 0] += force_j.x + force_k.x;
-		  forces[n_i + 1] += force_j.y + force_k.y;
-		  forces[n_i + 2] += force_j.z + force_k.z;
-
-		  /* update force on particle j */
-		  forces[n_j + 0] -= force_j.x;
-		  forces[n_j + 1] -= force_j.y;
-		  forces[n_j + 2] -= force_j.z;
-
-		  /* update force on particle k */
-		  forces[n_k + 0] -= force_k.x;
-		  forces[n_k + 1] -= force_k.y;
-		  forces[n_k + 2] -= force_k.z;
+	    if (neigh_k->r < *(sw->a2[neigh_k->col[0]])) {
+	      /* potential term */
+	      tmp = angle->cos + 1.0 / 3.0;
+	      v3_val = lambda * neigh_j->f * neigh_k->f * tmp * tmp;
+
+	      /* total potential */
+	      forces[energy_p + h] += v3_val;
+
+	      /* forces */
+	      tmp_grad1 = lambda * neigh_j->f * neigh_k->f * 2.0 * tmp;
+	      tmp_grad2 = lambda * tmp * tmp;
+
+	      tmp_jj = 1.0 / (neigh_j->r2);
+	      tmp_jk = 1.0 / (neigh_j->r * neigh_k->r);
+	      tmp_kk = 1.0 / (neigh_k->r2);
+	      tmp_1 = tmp_grad2 * neigh_j->df * neigh_k->f - tmp_grad1 * angle->cos * tmp_jj;
+	      tmp_2 = tmp_grad1 * tmp_jk;
+
+	      force_j.x = tmp_1 * neigh_j->dist.x + tmp_2 * neigh_k->dist.x;
+	      force_j.y = tmp_1 * neigh_j->dist.y + tmp_2 * neigh_k->dist.y;
+	      force_j.z = tmp_1 * neigh_j->dist.z + tmp_2 * neigh_k->dist.z;
+
+	      tmp_1 = tmp_grad2 * neigh_k->df * neigh_j->f - tmp_grad1 * angle->cos * tmp_kk;
+	      force_k.x = tmp_1 * neigh_k->dist.x + tmp_2 * neigh_j->dist.x;
+	      force_k.y = tmp_1 * neigh_k->dist.y + tmp_2 * neigh_j->dist.y;
+	      force_k.z = tmp_1 * neigh_k->dist.z + tmp_2 * neigh_j->dist.z;
+
+	      /* update force on particle i */
+	      forces[n_i + 0] += force_j.x + force_k.x;
+	      forces[n_i + 1] += force_j.y + force_k.y;
+	      forces[n_i + 2] += force_j.z + force_k.z;
+
+	      /* update force on particle j */
+	      forces[n_j + 0] -= force_j.x;
+	      forces[n_j + 1] -= force_j.y;
+	      forces[n_j + 2] -= force_j.z;
+
+	      /* update force on particle k */
+	      forces[n_k + 0] -= force_k.x;
+	      forces[n_k + 1] -= force_k.y;
+	      forces[n_k + 2] -= force_k.z;
 
 #ifdef STRESS			/* Distribute stress among atoms */
-		  if (us) {
-		    forces[stresses + 0] -= force_j.x * neigh_j->dist.x + force_k.x * neigh_k->dist.x;
-		    forces[stresses + 1] -= force_j.y * neigh_j->dist.y + force_k.y * neigh_k->dist.y;
-		    forces[stresses + 2] -= force_j.z * neigh_j->dist.z + force_k.z * neigh_k->dist.z;
-		    forces[stresses + 3] -= 0.5 * (force_j.x * neigh_j->dist.y + force_k.x * neigh_k->dist.y
-		      + force_j.y * neigh_j->dist.x + force_k.y * neigh_k->dist.x);
-		    forces[stresses + 4] -= 0.5 * (force_j.y * neigh_j->dist.z + force_k.y * neigh_k->dist.z
-		      + force_j.z * neigh_j->dist.y + force_k.z * neigh_k->dist.y);
-		    forces[stresses + 5] -= 0.5 * (force_j.z * neigh_j->dist.x + force_k.z * neigh_k->dist.x
-		      + force_j.x * neigh_j->dist.z + force_k.x * neigh_k->dist.z);
-		  }
+	      if (us) {
+		forces[stresses + 0] -= force_j.x * neigh_j->dist.x + force_k.x * neigh_k->dist.x;
+		forces[stresses + 1] -= force_j.y * neigh_j->dist.y + force_k.y * neigh_k->dist.y;
+		forces[stresses + 2] -= force_j.z * neigh_j->dist.z + force_k.z * neigh_k->dist.z;
+		forces[stresses + 3] -= 0.5 * (force_j.x * neigh_j->dist.y + force_k.x * neigh_k->dist.y
+		  + force_j.y * neigh_j->dist.x + force_k.y * neigh_k->dist.x);
+		forces[stresses + 4] -= 0.5 * (force_j.y * neigh_j->dist.z + force_k.y * neigh_k->dist.z
+		  + force_j.z * neigh_j->dist.y + force_k.z * neigh_k->dist.y);
+		forces[stresses + 5] -= 0.5 * (force_j.z * neigh_j->dist.x + force_k.z * neigh_k->dist.x
+		  + force_j.x * neigh_j->dist.z + force_k.x * neigh_k->dist.z);
+	      }
 #endif /* STRESS */
 
-		}
-	      }			/* k */
 	    }
-	  }			/* j */
+	  }			/* angles */
 	}
 	/* end second loop over all atoms */
 
@@ -500,4 +633,65 @@ void update_stiweb_pointers(double *xi)
   return;
 }
 
+/****************************************************************
+ *
+ *  init_stiweb_angles: find the fixed threebody cutoffs and the
+ *	type triplets whose lambda is fixed to zero, before the
+ *	angular tables are built
+ *
+ ****************************************************************/
+
+void init_stiweb_angles(void)
+{
+  int   i, j, k, n, col;
+  sw_t *sw = &apot_table.sw;
+
+  sw->cut_3 = (double *)malloc(paircol * sizeof(double));
+  sw->skip_3 = (int *)malloc(ntypes * ntypes * ntypes * sizeof(int));
+  if (NULL == sw->cut_3 || NULL == sw->skip_3)
+    error(1, "Cannot allocate memory for the threebody table");
+  reg_for_free(sw->cut_3, "sw->cut_3");
+  reg_for_free(sw->skip_3, "sw->skip_3");
+
+  /* a2 is the second parameter of the stiweb_3 potentials */
+  for (col = 0; col < paircol; col++) {
+    n = paircol + col;
+    sw->cut_3[col] = apot_fixed_param(n, 1) ? apot_table.values[n][1] : 0.0;
+  }
+
+  /* lambda is stored for i, j and k >= j in the last potential */
+  n = 0;
+  for (i = 0; i < ntypes; i++)
+    for (j = 0; j < ntypes; j++)
+      for (k = j; k < ntypes; k++) {
+	sw->skip_3[(i * ntypes + j) * ntypes + k] = sw->skip_3[(i * ntypes + k) * ntypes + j] =
+	  apot_fixed_param(2 * paircol, n) && 0.0 == apot_table.values[2 * paircol][n];
+	n++;
+      }
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  stiweb_angle: check if the angle between two neighbors of an
+ *	atom with the given type can contribute to the threebody
+ *	term, only these angles are stored in the angular table
+ *
+ ****************************************************************/
+
+int stiweb_angle(int type, neigh_t *neigh_j, neigh_t *neigh_k)
+{
+  const sw_t *sw = &apot_table.sw;
+  double cut_j = sw->cut_3[neigh_j->col[0]];
+  double cut_k = sw->cut_3[neigh_k->col[0]];
+
+  if (sw->skip_3[(type * ntypes + neigh_j->type) * ntypes + neigh_k->type])
+    return 0;
+  if ((cut_j > 0.0 && neigh_j->r >= cut_j) || (cut_k > 0.0 && neigh_k->r >= cut_k))
+    return 0;
+
+  return 1;
+}
+
 #endif /* STIWEB */
@@ -37,6 +37,158 @@
 #include "splines.h"
 #include "utils.h"
 
+/* radial terms of all local neighbors, kept between force calculations */
+static double *radial_val = NULL;	/* exp(-lambda r) and exp(-mu r) */
+static int *radial_first = NULL;	/* first entry of every local atom */
+static double *radial_par = NULL;	/* radial parameters of the last call */
+static int *radial_changed = NULL;	/* radial parameters of a column moved */
+static int radial_init = 0;
+
+/* arguments and values of the radial exponentials of one atom */
+static double *radial_x = NULL;
+static double *radial_y = NULL;
+static int radial_len = 0;
+
+/****************************************************************
+ *
+ *  radial_check: compare the radial parameters of every pair
+ *	column with the last force calculation, only the columns
+ *	that moved have to be tabulated again
+ *
+ ****************************************************************/
+
+static void radial_check(const tersoff_t *ters)
+{
+  int   i, col, n, nat;
+  double par[4];
+
+  if (!radial_init) {
+    nat = cnfstart[firstconf + myconf - 1] + inconf[firstconf + myconf - 1] - firstatom;
+    radial_first = (int *)malloc((nat + 1) * sizeof(int));
+    radial_par = (double *)calloc(4 * paircol, sizeof(double));
+    radial_changed = (int *)malloc(paircol * sizeof(int));
+    if (NULL == radial_first || NULL == radial_par || NULL == radial_changed)
+      error(1, "Cannot allocate memory for the radial terms");
+    n = 0;
+    for (i = 0; i < nat; i++) {
+      radial_first[i] = n;
+      n += conf_atoms[i].num_neigh;
+    }
+    radial_first[nat] = n;
+    radial_val = (double *)malloc((2 * n + 1) * sizeof(double));
+    if (NULL == radial_val)
+      error(1, "Cannot allocate memory for the radial terms");
+    reg_for_free(radial_first, "radial_first");
+    reg_for_free(radial_par, "radial_par");
+    reg_for_free(radial_changed, "radial_changed");
+    reg_for_free(radial_val, "radial_val");
+  }
+
+  for (col = 0; col < paircol; col++) {
+    par[0] = *(ters->lambda[col]);
+    par[1] = *(ters->mu[col]);
+#ifndef TERSOFFMOD
+    par[2] = *(ters->R[col]);
+    par[3] = *(ters->S[col]);
+#else
+    par[2] = *(ters->R1[col]);
+    par[3] = *(ters->R2[col]);
+#endif /* !TERSOFFMOD */
+    radial_changed[col] = !radial_init;
+    for (i = 0; i < 4; i++)
+      if (par[i] != radial_par[4 * col + i]) {
+	radial_changed[col] = 1;
+	radial_par[4 * col + i] = par[i];
+      }
+  }
+  radial_init = 1;
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  radial_terms: tabulate the cutoff function f_c, its derivative
+ *	and the exponentials exp(-lambda r) and exp(-mu r) for all
+ *	neighbors of an atom whose column changed, the exponentials
+ *	are evaluated in one vectorized call
+ *
+ *	returns the table of the atom, exp(-lambda r) of neighbor j
+ *	is entry 2 * j and exp(-mu r) is entry 2 * j + 1
+ *
+ ****************************************************************/
+
+static double *radial_terms(atom_t *atom, const tersoff_t *ters)
+{
+  int   j, m, col_j;
+  int   n = atom->num_neigh;
+  double cut_tmp, cut_tmp_j;
+  double *val = radial_val + 2 * radial_first[atom - conf_atoms];
+  neigh_t *neigh_j;
+
+  if (2 * n > radial_len) {
+    radial_len = 2 * n;
+    radial_x = (double *)realloc(radial_x, radial_len * sizeof(double));
+    radial_y = (double *)realloc(radial_y, radial_len * sizeof(double));
+    if (NULL == radial_x || NULL == radial_y)
+      error(1, "Cannot allocate memory for the radial exponentials");
+  }
+
+  m = 0;
+  for (j = 0; j < n; j++) {
+    neigh_j = atom->neigh + j;
+    col_j = neigh_j->col[0];
+    if (!radial_changed[col_j])
+      continue;
+#ifndef TERSOFFMOD
+    if (neigh_j->r < *(ters->S[col_j])) {
+      cut_tmp = M_PI / (*(ters->S[col_j]) - *(ters->R[col_j]));
+      cut_tmp_j = cut_tmp * (neigh_j->r - *(ters->R[col_j]));
+      if (neigh_j->r < *(ters->R[col_j])) {
+	neigh_j->f = 1.0;
+	neigh_j->df = 0.0;
+      } else {
+	neigh_j->f = 0.5 * (1.0 + cos(cut_tmp_j));
+	neigh_j->df = -0.5 * cut_tmp * sin(cut_tmp_j);
+      }
+    } else {
+      neigh_j->f = 0.0;
+      neigh_j->df = 0.0;
+    }
+#else
+    if (neigh_j->r < *(ters->R2[col_j])) {
+      cut_tmp = M_PI / (*(ters->R2[col_j]) - *(ters->R1[col_j]));
+      cut_tmp_j = cut_tmp * (neigh_j->r - *(ters->R1[col_j]));
+      if (neigh_j->r < *(ters->R1[col_j])) {
+	neigh_j->f = 1.0;
+	neigh_j->df = 0.0;
+      } else {
+	neigh_j->f = 0.5 * (1.0 + 1.125 * cos(cut_tmp_j) - 0.125 * cos(3.0 * cut_tmp_j));
+	neigh_j->df = -0.5 * cut_tmp * (1.125 * sin(cut_tmp_j) - 0.375 * sin(3.0 * cut_tmp_j));
+      }
+    } else {
+      neigh_j->f = 0.0;
+      neigh_j->df = 0.0;
+    }
+#endif /* !TERSOFFMOD */
+    radial_x[m++] = -*(ters->lambda[col_j]) * neigh_j->r;
+    radial_x[m++] = -*(ters->mu[col_j]) * neigh_j->r;
+  }
+  if (0 == m)
+    return val;
+  exp_m(m, radial_y, radial_x);
+
+  m = 0;
+  for (j = 0; j < n; j++) {
+    if (!radial_changed[atom->neigh[j].col[0]])
+      continue;
+    val[2 * j] = radial_y[m++];
+    val[2 * j + 1] = radial_y[m++];
+  }
+
+  return val;
+}
+
 /****************************************************************
  *
  *  compute forces using pair potentials with spline interpolation
@@ -88,7 +240,7 @@
 
 #ifndef TERSOFFMOD
 
-double calc_forces(double *xi_opt, double *forces, int flag)
+double calc_forces_tersoff(double *xi_opt, double *forces, int flag)
 {
   double tmpsum = 0.0, sum = 0.0;
   const tersoff_t *ters = &apot_table.tersoff;
@@ -100,7 +252,6 @@ double calc_forces(double *xi_opt, double *forces, int flag)
   int   h;			/* counter for configurations */
   int   i;			/* counter for atoms */
   int   j;			/* counter for neighbors (first loop) */
-  int   k;			/* counter for neighbors (second loop) */
   int   n_i;			/* index number of the ith atom */
   int   n_j;			/* index number of the jth atom */
   int   n_k;			/* index number of the kth atom */
@@ -110,11 +261,11 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #endif /* STRESS */
 
   int   col_j, col_k;
-  int   ijk;
+  int   ijk, ijk_end;
 
   /* pair variables */
   double phi_val, phi_grad, phi_a;
-  double cut_tmp, cut_tmp_j;
+  double *radial;
   double tmp_jk;
   double cos_theta, g_theta;
   double tmp_1, tmp_2, tmp_3, tmp_4, tmp_5, tmp_6, tmp_grad, tmp;
@@ -150,6 +301,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #endif /* MPI */
 
     update_tersoff_pointers(xi_opt);
+    radial_check(ters);
 
     /* region containing loop over configurations */
     {
@@ -188,6 +340,9 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  atom = conf_atoms + i + cnfstart[h] - firstatom;
 	  n_i = 3 * (cnfstart[h] + i);
 
+	  /* radial terms of all neighbors before the angular loops */
+	  radial = radial_terms(atom, ters);
+
 	  /* loop over neighbors */
 	  for (j = 0; j < atom->num_neigh; j++) {
 	    neigh_j = atom->neigh + j;
@@ -196,19 +351,8 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	    if (neigh_j->r < *(ters->S[col_j])) {
 	      self = (neigh_j->nr == i + cnfstart[h]) ? 1 : 0;
 
-	      /* calculate cutoff function f_c and store it for every neighbor */
-	      cut_tmp = M_PI / (*(ters->S[col_j]) - *(ters->R[col_j]));
-	      cut_tmp_j = cut_tmp * (neigh_j->r - *(ters->R[col_j]));
-	      if (neigh_j->r < *(ters->R[col_j])) {
-		neigh_j->f = 1.0;
-		neigh_j->df = 0.0;
-	      } else {
-		neigh_j->f = 0.5 * (1.0 + cos(cut_tmp_j));
-		neigh_j->df = -0.5 * cut_tmp * sin(cut_tmp_j);
-	      }
-
 	      /* calculate pair part f_c*A*exp(-lambda*r) and the derivative */
-	      tmp = exp(-*(ters->lambda[col_j]) * neigh_j->r);
+	      tmp = radial[2 * j];
 	      phi_val = neigh_j->f * *(ters->A[col_j]) * tmp;
 	      phi_grad = neigh_j->df - *(ters->lambda[col_j]) * neigh_j->f;
 	      phi_grad *= *(ters->A[col_j]) * tmp;
@@ -242,9 +386,6 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 		}
 #endif /* STRESS */
 	      }
-	    } else {
-	      neigh_j->f = 0.0;
-	      neigh_j->df = 0.0;
 	    }
 	  }			/* loop over neighbors */
 
@@ -255,7 +396,8 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	    col_j = neigh_j->col[0];
 	    /* check if we are within the cutoff range */
 	    if (neigh_j->r < *(ters->S[col_j])) {
-	      ijk = neigh_j->ijk_start;
+	      /* the angles of neighbor j end where the next ones start */
+	      ijk_end = (j + 1 < atom->num_neigh) ? atom->neigh[j + 1].ijk_start : atom->num_angles;
 	      n_j = 3 * neigh_j->nr;
 
 	      /* skip neighbor if coefficient is zero */
@@ -271,13 +413,11 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	      dzeta_j.y = 0.0;
 	      dzeta_j.z = 0.0;
 
-	      /* inner loop over neighbors */
-	      for (k = 0; k < atom->num_neigh; k++) {
-		if (k == j)
-		  continue;
-		neigh_k = atom->neigh + k;
+	      /* inner loop over the angles of neighbor j */
+	      for (ijk = neigh_j->ijk_start; ijk < ijk_end; ijk++) {
+		angle = atom->angle_part + ijk;
+		neigh_k = atom->neigh + angle->k;
 		col_k = neigh_k->col[0];
-		angle = atom->angle_part + ijk++;
 		if (neigh_k->r < *(ters->S[col_k])) {
 
 		  tmp_jk = 1.0 / (neigh_j->r * neigh_k->r);
@@ -319,7 +459,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 		}
 	      }			/* k */
 
-	      phi_a = 0.5 * *(ters->B[col_j]) * exp(-*(ters->mu[col_j]) * neigh_j->r);
+	      phi_a = 0.5 * *(ters->B[col_j]) * radial[2 * j + 1];
 
 	      tmp_pow_1 = *(ters->gamma[col_j]) * zeta;
 	      power_1(&tmp_4, &tmp_pow_1, ters->n[col_j]);
@@ -342,37 +482,35 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	      force_j.y = -tmp_6 * neigh_j->dist.y + tmp_5 * dzeta_j.y;
 	      force_j.z = -tmp_6 * neigh_j->dist.z + tmp_5 * dzeta_j.z;
 
-	      for (k = 0; k < atom->num_neigh; k++) {
-		if (k != j) {
-		  neigh_k = atom->neigh + k;
-		  col_k = neigh_k->col[0];
-		  if (neigh_k->r < *(ters->S[col_k])) {
-		    n_k = 3 * neigh_k->nr;
-		    /* update force on particle k */
-		    forces[n_k + 0] += tmp_5 * neigh_k->dzeta.x;
-		    forces[n_k + 1] += tmp_5 * neigh_k->dzeta.y;
-		    forces[n_k + 2] += tmp_5 * neigh_k->dzeta.z;
-
-		    /* Distribute stress among atoms */
+	      for (ijk = neigh_j->ijk_start; ijk < ijk_end; ijk++) {
+		neigh_k = atom->neigh + atom->angle_part[ijk].k;
+		col_k = neigh_k->col[0];
+		if (neigh_k->r < *(ters->S[col_k])) {
+		  n_k = 3 * neigh_k->nr;
+		  /* update force on particle k */
+		  forces[n_k + 0] += tmp_5 * neigh_k->dzeta.x;
+		  forces[n_k + 1] += tmp_5 * neigh_k->dzeta.y;
+		  forces[n_k + 2] += tmp_5 * neigh_k->dzeta.z;
+
+		  /* Distribute stress among atoms */
 #ifdef STRESS
-		    if (us) {
-		      forces[stresses + 0] += neigh_k->dist.x * tmp_5 * neigh_k->dzeta.x;
-		      forces[stresses + 1] += neigh_k->dist.y * tmp_5 * neigh_k->dzeta.y;
-		      forces[stresses + 2] += neigh_k->dist.z * tmp_5 * neigh_k->dzeta.z;
-		      forces[stresses + 3] +=
-			0.5 * tmp_5 * (neigh_k->dist.x * neigh_k->dzeta.y +
-			neigh_k->dist.y * neigh_k->dzeta.x);
-		      forces[stresses + 4] +=
-			0.5 * tmp_5 * (neigh_k->dist.y * neigh_k->dzeta.z +
-			neigh_k->dist.z * neigh_k->dzeta.y);
-		      forces[stresses + 5] +=
-			0.5 * tmp_5 * (neigh_k->dist.z * neigh_k->dzeta.x +
-			neigh_k->dist.x * neigh_k->dzeta.z);
-		    }
+		  if (us) {
+		    forces[stresses + 0] += neigh_k->dist.x * tmp_5 * neigh_k->dzeta.x;
+		    forces[stresses + 1] += neigh_k->dist.y * tmp_5 * neigh_k->dzeta.y;
+		    forces[stresses + 2] += neigh_k->dist.z * tmp_5 * neigh_k->dzeta.z;
+		    forces[stresses + 3] +=
+		      0.5 * tmp_5 * (neigh_k->dist.x * neigh_k->dzeta.y +
+		      neigh_k->dist.y * neigh_k->dzeta.x);
+		    forces[stresses + 4] +=
+		      0.5 * tmp_5 * (neigh_k->dist.y * neigh_k->dzeta.z +
+		      neigh_k->dist.z * neigh_k->dzeta.y);
+		    forces[stresses + 5] +=
+		      0.5 * tmp_5 * (neigh_k->dist.z * neigh_k->dzeta.x +
+		      neigh_k->dist.x * neigh_k->dzeta.z);
+		  }
 #endif /* STRESS */
 
-		  }
-		}		/* k != j */
+		}
 	      }			/* k loop */
 
 	      /* update force on particle j */
@@ -592,7 +730,7 @@ void update_tersoff_pointers(double *xi)
 
 #else /* !TERSOFFMOD */
 
-double calc_forces(double *xi_opt, double *forces, int flag)
+double calc_forces_tersoff(double *xi_opt, double *forces, int flag)
 {
   double tmpsum = 0.0, sum = 0.0;
   const tersoff_t *ters = &apot_table.tersoff;
@@ -621,6 +759,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #endif /* MPI */
 
     update_tersoff_pointers(xi_opt);
+    radial_check(ters);
 
     /* region containing loop over configurations */
     {
@@ -631,7 +770,6 @@ double calc_forces(double *xi_opt, double *forces, int flag)
       int   h;			/* counter for configurations */
       int   i;			/* counter for atoms */
       int   j;			/* counter for neighbors (first loop) */
-      int   k;			/* counter for neighbors (second loop) */
       int   n_i;		/* index number of the ith atom */
       int   n_j;		/* index number of the jth atom */
       int   n_k;		/* index number of the kth atom */
@@ -641,7 +779,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 #endif /* STRESS */
 
       int   col_j, col_k;
-      int   ijk;
+      int   ijk, ijk_end;
 
       /* pair variables */
       double phi_val, phi_grad;
@@ -654,6 +792,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
       vector dcos_j, dcos_k;
       vector dzeta_i, dzeta_j;
       vector force_j, tmp_force;
+      double *radial;
 
       /* loop over configurations */
       for (h = firstconf; h < firstconf + myconf; h++) {
@@ -690,6 +829,9 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	  atom = conf_atoms + i + cnfstart[h] - firstatom;
 	  n_i = 3 * (cnfstart[h] + i);
 
+	  /* radial terms of all neighbors before the angular loops */
+	  radial = radial_terms(atom, ters);
+
 	  /* loop over neighbors */
 	  /* calculate pair potential part: f*A*exp(-lambda*r) */
 	  for (j = 0; j < atom->num_neigh; j++) {
@@ -700,18 +842,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	      self = (neigh_j->nr == i + cnfstart[h]) ? 1 : 0;
 
 	      /* calculate cutoff function f_c and store it for every neighbor */
-	      tmp_1 = M_PI / (*(ters->R2[col_j]) - *(ters->R1[col_j]));
-	      tmp_2 = tmp_1 * (neigh_j->r - *(ters->R1[col_j]));
-	      if (neigh_j->r < *(ters->R1[col_j])) {
-		neigh_j->f = 1.0;
-		neigh_j->df = 0.0;
-	      } else {
-		neigh_j->f = 0.5 * (1.0 + 1.125 * cos(tmp_2) - 0.125 * cos(3.0 * tmp_2));
-		neigh_j->df = -0.5 * tmp_1 * (1.125 * sin(tmp_2) - 0.375 * sin(3.0 * tmp_2));
-	      }
-
-	      /* calculate pair part f_c*A*exp(-lambda*r) and the derivative */
-	      tmp_1 = exp(-*(ters->lambda[col_j]) * neigh_j->r);
+	      tmp_1 = radial[2 * j];
 	      phi_val = neigh_j->f * *(ters->A[col_j]) * tmp_1;
 	      phi_grad = neigh_j->df - *(ters->lambda[col_j]) * neigh_j->f;
 	      phi_grad *= *(ters->A[col_j]) * tmp_1;
@@ -745,9 +876,6 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 		}
 #endif /* STRESS */
 	      }
-	    } else {
-	      neigh_j->f = 0.0;
-	      neigh_j->df = 0.0;
 	    }
 	  }			/* loop over neighbors */
 
@@ -758,7 +886,8 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	    col_j = neigh_j->col[0];
 	    /* check if we are within the cutoff range */
 	    if (neigh_j->r < *(ters->R2[col_j])) {
-	      ijk = neigh_j->ijk_start;
+	      /* the angles of neighbor j end where the next ones start */
+	      ijk_end = (j + 1 < atom->num_neigh) ? atom->neigh[j + 1].ijk_start : atom->num_angles;
 	      n_j = 3 * neigh_j->nr;
 
 	      /* skip neighbor if coefficient is zero */
@@ -775,14 +904,11 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	      dzeta_j.y = 0.0;
 	      dzeta_j.z = 0.0;
 
-	      /* inner loop over neighbors */
-	      for (k = 0; k < atom->num_neigh; k++) {
-		if (k == j)
-		  continue;
-		neigh_k = atom->neigh + k;
+	      /* inner loop over the angles of neighbor j */
+	      for (ijk = neigh_j->ijk_start; ijk < ijk_end; ijk++) {
+		angle = atom->angle_part + ijk;
+		neigh_k = atom->neigh + angle->k;
 		col_k = neigh_k->col[0];
-		angle = atom->angle_part + ijk++;
-
 		if (neigh_k->r < *(ters->R2[col_k])) {
 		  cos_theta = angle->cos;
 		  dcos_j.x = (neigh_k->dist_r.x - neigh_j->dist_r.x * cos_theta) / neigh_j->r;
@@ -836,7 +962,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	      tmp_1 = pow(zeta, *(ters->eta[col_j]));
 	      b = pow(1.0 + tmp_1, -*(ters->delta[col_j]));
 
-	      tmp_2 = 0.5 * b * *(ters->B[col_j]) * exp(-*(ters->mu[col_j]) * neigh_j->r);
+	      tmp_2 = 0.5 * b * *(ters->B[col_j]) * radial[2 * j + 1];
 
 	      if (0.0 == zeta)
 		tmp_3 = 0.0;
@@ -880,43 +1006,41 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 	      }
 #endif /* STRESS */
 
-	      for (k = 0; k < atom->num_neigh; k++) {
-		if (k != j) {
-		  neigh_k = atom->neigh + k;
-		  col_k = neigh_k->col[0];
-		  if (neigh_k->r < *(ters->R2[col_k])) {
-		    n_k = 3 * neigh_k->nr;
-		    /* update force on particle k */
-		    forces[n_k + 0] -= tmp_3 * neigh_k->dzeta.x;
-		    forces[n_k + 1] -= tmp_3 * neigh_k->dzeta.y;
-		    forces[n_k + 2] -= tmp_3 * neigh_k->dzeta.z;
-
-		    /* Distribute stress among atoms */
+	      for (ijk = neigh_j->ijk_start; ijk < ijk_end; ijk++) {
+		neigh_k = atom->neigh + atom->angle_part[ijk].k;
+		col_k = neigh_k->col[0];
+		if (neigh_k->r < *(ters->R2[col_k])) {
+		  n_k = 3 * neigh_k->nr;
+		  /* update force on particle k */
+		  forces[n_k + 0] -= tmp_3 * neigh_k->dzeta.x;
+		  forces[n_k + 1] -= tmp_3 * neigh_k->dzeta.y;
+		  forces[n_k + 2] -= tmp_3 * neigh_k->dzeta.z;
+
+		  /* Distribute stress among atoms */
 #ifdef STRESS
-		    if (us) {
-		      tmp = neigh_k->dist.x * tmp_3 * neigh_k->dzeta.x;
-		      forces[stresses + 0] -= tmp;
-		      tmp = neigh_k->dist.y * tmp_3 * neigh_k->dzeta.y;
-		      forces[stresses + 1] -= tmp;
-		      tmp = neigh_k->dist.z * tmp_3 * neigh_k->dzeta.z;
-		      forces[stresses + 2] -= tmp;
-		      tmp =
-			0.5 * tmp_3 * (neigh_k->dist.x * neigh_k->dzeta.y +
-			neigh_k->dist.y * neigh_k->dzeta.x);
-		      forces[stresses + 3] -= tmp;
-		      tmp =
-			0.5 * tmp_3 * (neigh_k->dist.y * neigh_k->dzeta.z +
-			neigh_k->dist.z * neigh_k->dzeta.y);
-		      forces[stresses + 4] -= tmp;
-		      tmp =
-			0.5 * tmp_3 * (neigh_k->dist.z * neigh_k->dzeta.x +
-			neigh_k->dist.x * neigh_k->dzeta.z);
-		      forces[stresses + 5] -= tmp;
-		    }
+		  if (us) {
+		    tmp = neigh_k->dist.x * tmp_3 * neigh_k->dzeta.x;
+		    forces[stresses + 0] -= tmp;
+		    tmp = neigh_k->dist.y * tmp_3 * neigh_k->dzeta.y;
+		    forces[stresses + 1] -= tmp;
+		    tmp = neigh_k->dist.z * tmp_3 * neigh_k->dzeta.z;
+		    forces[stresses + 2] -= tmp;
+		    tmp =
+		      0.5 * tmp_3 * (neigh_k->dist.x * neigh_k->dzeta.y +
+		      neigh_k->dist.y * neigh_k->dzeta.x);
+		    forces[stresses + 3] -= tmp;
+		    tmp =
+		      0.5 * tmp_3 * (neigh_k->dist.y * neigh_k->dzeta.z +
+		      neigh_k->dist.z * neigh_k->dzeta.y);
+		    forces[stresses + 4] -= tmp;
+		    tmp =
+		      0.5 * tmp_3 * (neigh_k->dist.z * neigh_k->dzeta.x +
+		      neigh_k->dist.x * neigh_k->dzeta.z);
+		    forces[stresses + 5] -= tmp;
+		  }
 #endif /* STRESS */
 
-		  }
-		}		/* k != j */
+		}
 	      }			/* k loop */
 	    }			/* j */
 	  }
@@ -1116,4 +1240,58 @@ void update_tersoff_pointers(double *xi)
 }
 
 #endif /* !TERSOFFMOD */
+
+/****************************************************************
+ *
+ *  init_tersoff_angles: find the threebody cutoffs that are fixed
+ *	during the fit, before the angular tables are built
+ *
+ ****************************************************************/
+
+void init_tersoff_angles(void)
+{
+  int   col;
+  tersoff_t *ters = &apot_table.tersoff;
+
+  ters->cut_3 = (double *)malloc(paircol * sizeof(double));
+  if (NULL == ters->cut_3)
+    error(1, "Cannot allocate memory for the threebody cutoffs");
+  reg_for_free(ters->cut_3, "tersoff->cut_3");
+
+  for (col = 0; col < paircol; col++) {
+#ifndef TERSOFFMOD
+    /* S and R are swapped if R > S, so both have to be fixed */
+    if (apot_fixed_param(col, 9) && apot_fixed_param(col, 10))
+      ters->cut_3[col] = MAX(apot_table.values[col][9], apot_table.values[col][10]);
+#else
+    if (apot_fixed_param(col, 15))
+      ters->cut_3[col] = apot_table.values[col][15];
+#endif /* !TERSOFFMOD */
+    else
+      ters->cut_3[col] = 0.0;
+  }
+
+  return;
+}
+
+/****************************************************************
+ *
+ *  tersoff_angle: check if both neighbors of an angle are inside
+ *	the threebody cutoff, only these angles are stored in the
+ *	angular table
+ *
+ ****************************************************************/
+
+int tersoff_angle(neigh_t *neigh_j, neigh_t *neigh_k)
+{
+  const tersoff_t *ters = &apot_table.tersoff;
+  double cut_j = ters->cut_3[neigh_j->col[0]];
+  double cut_k = ters->cut_3[neigh_k->col[0]];
+
+  if ((cut_j > 0.0 && neigh_j->r >= cut_j) || (cut_k > 0.0 && neigh_k->r >= cut_k))
+    return 0;
+
+  return 1;
+}
+
 #endif /* TERSOFF */
@@ -30,9 +30,44 @@
 
 #include "potfit.h"
 
+#include "ewald.h"
 #include "functions.h"
 #include "utils.h"
 
+/* force kernels of this binary, the first one is the default */
+static const force_kernel_t force_kernels[] = {
+#ifdef PAIR
+  {"PAIR", calc_forces_pair, 0},
+#elif defined EAM && !defined COULOMB
+#ifndef TBEAM
+  {"EAM", calc_forces_eam, 1},
+#else
+  {"TBEAM", calc_forces_eam, 1},
+#endif /* TBEAM */
+#elif defined ADP
+  {"ADP", calc_forces_adp, 1},
+#elif defined COULOMB && !defined EAM
+  {"ELSTAT", calc_forces_elstat, 0},
+#elif defined COULOMB && defined EAM
+  {"EAM_ELSTAT", calc_forces_eam_elstat, 1},
+#elif defined MEAM
+  {"MEAM", calc_forces_meam, 1},
+#elif defined STIWEB
+  {"STIWEB", calc_forces_stiweb, 0},
+#elif defined TERSOFF
+#ifdef TERSOFFMOD
+  {"TERSOFFMOD", calc_forces_tersoff, 0},
+#else
+  {"TERSOFF", calc_forces_tersoff, 0},
+#endif /* TERSOFFMOD */
+#endif /* interaction type */
+#ifdef PAIR_KERNEL
+  {"PAIR", calc_forces_pair, 0},
+#endif /* PAIR_KERNEL */
+};
+
+#define N_KERNELS ((int)(sizeof(force_kernels) / sizeof(force_kernel_t)))
+
 /****************************************************************
  *
  *  init_forces() is called after all parameters and potentials are
@@ -43,6 +78,8 @@
 void init_forces()
 {
 #ifdef COULOMB
+  if (dp_ewald > 0.0)
+    init_ewald();
   if (apot_table.sw_kappa)
     init_tails(apot_table.dp_kappa[0]);
 #endif /* COULOMB */
@@ -126,3 +163,48 @@ void set_force_vector_pointers()
 
 #endif /* STRESS */
 }
+
+/****************************************************************
+ *
+ *  set_force_kernel() makes kernel k of this binary the active one,
+ *  	the MPI workers get k from the root process
+ *
+ ****************************************************************/
+
+void set_force_kernel(int k)
+{
+  if (k < 0 || k >= N_KERNELS)
+    error(1, "Invalid force kernel %d", k);
+
+  force_kernel = k;
+  interaction_name = force_kernels[k].name;
+  calc_forces = force_kernels[k].calc_forces;
+#if defined EAM || defined ADP || defined MEAM
+  embedding = force_kernels[k].embedding;
+#endif /* EAM || ADP || MEAM */
+}
+
+/****************************************************************
+ *
+ *  select_force_kernel() chooses the kernel by the model name from
+ *  	the #T line of the potential file
+ *
+ ****************************************************************/
+
+void select_force_kernel(const char *name)
+{
+  int   k;
+
+  for (k = 0; k < N_KERNELS; k++)
+    if (0 == strcmp(name, force_kernels[k].name)) {
+      set_force_kernel(k);
+      return;
+    }
+
+  error(0, "Wrong potential type found in potential file!\n");
+  error(0, "This binary supports %s", force_kernels[0].name);
+  for (k = 1; k < N_KERNELS; k++)
+    fprintf(stderr, " and %s", force_kernels[k].name);
+  fprintf(stderr, " potentials.\n");
+  error(1, "Your potential file contains a %s potential.\n", name);
+}
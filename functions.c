@@ -30,6 +30,7 @@
 
 #include "potfit.h"
 
+#include "expression.h"
 #include "functions.h"
 #include "utils.h"
 
@@ -40,6 +41,25 @@
 /* macro for simplified addition of new potential functions */
 #define add_pot(a,b) add_potential(#a,b,&a ## _value)
 
+/* macro for adding the batch version of a potential function */
+#define add_batch(a) add_batch_function(#a,&a ## _batch)
+
+/* macro for adding the version of a potential function with derivative */
+#define add_grad(a) add_grad_function(#a,&a ## _grad)
+
+/* macros for adding parameter constraints and punishments */
+#define add_check(a) add_check_function(#a,&a ## _check)
+#define add_punish(a) add_punish_function(#a,&a ## _punish)
+
+/* scratch space for the batch functions */
+static double *batch_buf = NULL;
+static int batch_len = 0;
+
+/* number of entries allocated in function_table */
+static int function_table_size = 0;
+
+static void resize_function_table(int);
+
 /****************************************************************
  *
  * initialize the function_table for analytic potentials
@@ -48,8 +68,6 @@
 
 void apot_init(void)
 {
-  int   i;
-
   add_pot(lj, 2);
   add_pot(eopp, 6);
   add_pot(morse, 3);
@@ -106,11 +124,79 @@ void apot_init(void)
 #endif /* !TERSOFFMOD */
 #endif /* TERSOFF */
 
+  /* batch versions for tabulating the most common functions */
+  add_batch(eopp);
+  add_batch(morse);
+  add_batch(power_decay);
+  add_batch(exp_decay);
+  add_batch(csw2);
+  add_batch(universal);
+  add_batch(mishin);
+
+  /* analytic derivatives, all other functions are differentiated numerically */
+  add_grad(lj);
+  add_grad(eopp);
+  add_grad(morse);
+#ifndef COULOMB
+  add_grad(ms);
+  add_grad(buck);
+#endif /* !COULOMB */
+  add_grad(softshell);
+  add_grad(eopp_exp);
+  add_grad(meopp);
+  add_grad(power);
+  add_grad(power_decay);
+  add_grad(exp_decay);
+  add_grad(bjs);
+  add_grad(parabola);
+  add_grad(csw);
+  add_grad(universal);
+  add_grad(const);
+  add_grad(sqrt);
+  add_grad(mexp_decay);
+  add_grad(strmm);
+  add_grad(double_morse);
+  add_grad(double_exp);
+  add_grad(poly_5);
+  add_grad(kawamura);
+  add_grad(kawamura_mix);
+  add_grad(exp_plus);
+  add_grad(mishin);
+  add_grad(gen_lj);
+  add_grad(gljm);
+  add_grad(vas);
+  add_grad(vpair);
+  add_grad(csw2);
+  add_grad(sheng_phi1);
+  add_grad(sheng_phi2);
+  add_grad(sheng_rho);
+  add_grad(sheng_F);
+#ifdef STIWEB
+  add_grad(stiweb_2);
+  add_grad(stiweb_3);
+#endif /* STIWEB */
+
+  /* parameter constraints and punishments */
+  add_check(eopp);
+  add_punish(eopp);
+  add_check(csw2);
+#if defined EAM || defined ADP || defined MEAM
+  add_punish(universal);
+#endif /* EAM || ADP || MEAM */
+#if defined TERSOFF && !defined TERSOFFMOD
+  add_check(tersoff_pot);
+#endif /* TERSOFF && !TERSOFFMOD */
+
+  /* leave room for the user-defined functions, the arrays must not move after this */
+  resize_function_table(n_functions + EXPR_MAX);
+
   reg_for_free(function_table.name, "function_table.name");
   reg_for_free(function_table.n_par, "function_table.n_par");
   reg_for_free(function_table.fvalue, "function_table.fvalue");
-  for (i = 0; i < n_functions; i++)
-    reg_for_free(function_table.name[i], "function_table.name[i]");
+  reg_for_free(function_table.fbatch, "function_table.fbatch");
+  reg_for_free(function_table.fgrad, "function_table.fgrad");
+  reg_for_free(function_table.fcheck, "function_table.fcheck");
+  reg_for_free(function_table.fpunish, "function_table.fpunish");
 }
 
 /****************************************************************
@@ -131,13 +217,12 @@ void add_potential(const char *name, int parameter, fvalue_pointer fval)
     }
   }
 
-  /* allocate memory */
-  function_table.name = (char **)realloc(function_table.name, (k + 1) * sizeof(char *));
+  if (k == function_table_size)
+    resize_function_table(k + 1);
   function_table.name[k] = (char *)malloc(255 * sizeof(char));
-  function_table.n_par = (int *)realloc(function_table.n_par, (k + 1) * sizeof(int));
-  function_table.fvalue = (fvalue_pointer *) realloc(function_table.fvalue, (k + 1) * sizeof(fvalue_pointer));
-  if (function_table.name[k] == NULL || function_table.n_par == NULL || function_table.fvalue == NULL)
+  if (function_table.name[k] == NULL)
     error(1, "Could not allocate memory for function_table!");
+  reg_for_free(function_table.name[k], "function_table.name[%d]", k);
 
   /* assign values */
   for (i = 0; i < 255; i++)
@@ -145,53 +230,180 @@ void add_potential(const char *name, int parameter, fvalue_pointer fval)
   strncpy(function_table.name[k], name, strlen(name));
   function_table.n_par[k] = parameter;
   function_table.fvalue[k] = fval;
+  function_table.fbatch[k] = NULL;
+  function_table.fgrad[k] = NULL;
+  function_table.fcheck[k] = NULL;
+  function_table.fpunish[k] = NULL;
 
   n_functions++;
 }
 
 /****************************************************************
  *
- * return the number of parameters for a specific analytic potential
+ * resize function_table to hold size functions
  *
  ****************************************************************/
 
-int apot_parameters(char *name)
+static void resize_function_table(int size)
+{
+  function_table.name = (char **)realloc(function_table.name, size * sizeof(char *));
+  function_table.n_par = (int *)realloc(function_table.n_par, size * sizeof(int));
+  function_table.fvalue = (fvalue_pointer *) realloc(function_table.fvalue, size * sizeof(fvalue_pointer));
+  function_table.fbatch =
+    (fvalue_batch_pointer *) realloc(function_table.fbatch, size * sizeof(fvalue_batch_pointer));
+  function_table.fgrad = (fgrad_pointer *) realloc(function_table.fgrad, size * sizeof(fgrad_pointer));
+  function_table.fcheck = (fcheck_pointer *) realloc(function_table.fcheck, size * sizeof(fcheck_pointer));
+  function_table.fpunish =
+    (fpunish_pointer *) realloc(function_table.fpunish, size * sizeof(fpunish_pointer));
+  if (function_table.name == NULL || function_table.n_par == NULL || function_table.fvalue == NULL
+    || function_table.fbatch == NULL || function_table.fgrad == NULL || function_table.fcheck == NULL
+    || function_table.fpunish == NULL)
+    error(1, "Could not allocate memory for function_table!");
+
+  function_table_size = size;
+}
+
+/****************************************************************
+ *
+ * index of an analytic function in function_table, -1 if unknown
+ *
+ ****************************************************************/
+
+static int function_index(const char *name)
 {
   int   i;
 
-  for (i = 0; i < n_functions; i++) {
-    if (strcmp(function_table.name[i], name) == 0) {
-      return function_table.n_par[i];
-    }
-  }
+  for (i = 0; i < n_functions; i++)
+    if (strcmp(function_table.name[i], name) == 0)
+      return i;
 
   return -1;
 }
 
+/****************************************************************
+ *
+ * add the batch version of an analytic function to function_table
+ *
+ ****************************************************************/
+
+void add_batch_function(const char *name, fvalue_batch_pointer fbatch)
+{
+  int   i = function_index(name);
+
+  if (i < 0)
+    error(1, "Cannot add batch function for unknown potential \"%s\".", name);
+
+  function_table.fbatch[i] = fbatch;
+}
+
+/****************************************************************
+ *
+ * add the version of an analytic function with derivative
+ *
+ ****************************************************************/
+
+void add_grad_function(const char *name, fgrad_pointer fgrad)
+{
+  int   i = function_index(name);
+
+  if (i < 0)
+    error(1, "Cannot add derivative for unknown potential \"%s\".", name);
+
+  function_table.fgrad[i] = fgrad;
+}
+
+/****************************************************************
+ *
+ * add parameter constraints of an analytic function,
+ * called by apot_check_params() before every force calculation
+ *
+ ****************************************************************/
+
+void add_check_function(const char *name, fcheck_pointer fcheck)
+{
+  int   i = function_index(name);
+
+  if (i < 0)
+    error(1, "Cannot add constraints for unknown potential \"%s\".", name);
+
+  function_table.fcheck[i] = fcheck;
+}
+
+/****************************************************************
+ *
+ * add punishment of an analytic function,
+ * called by apot_punish() after every force calculation
+ *
+ ****************************************************************/
+
+void add_punish_function(const char *name, fpunish_pointer fpunish)
+{
+  int   i = function_index(name);
+
+  if (i < 0)
+    error(1, "Cannot add punishment for unknown potential \"%s\".", name);
+
+  function_table.fpunish[i] = fpunish;
+}
+
+/****************************************************************
+ *
+ * return the number of parameters for a specific analytic potential
+ *
+ ****************************************************************/
+
+int apot_parameters(char *name)
+{
+  int   i = function_index(name);
+
+  return (i < 0) ? -1 : function_table.n_par[i];
+}
+
 /****************************************************************
  *
  * assign function pointers to corresponding functions
  *
+ * The names are resolved once into indices of function_table,
+ * all later lookups use apt->fid.
+ *
  ****************************************************************/
 
 int apot_assign_functions(apot_table_t *apt)
 {
-  int   i, j;
+  int   i;
 
   for (i = 0; i < apt->number; i++) {
-    for (j = 0; j < n_functions; j++) {
-      if (strcmp(apt->names[i], function_table.name[j]) == 0) {
-	apt->fvalue[i] = function_table.fvalue[j];
-	break;
-      }
-      if (j == n_functions - 1)
-	return -1;
-    }
+    apt->fid[i] = function_index(apt->names[i]);
+    if (apt->fid[i] < 0)
+      return -1;
   }
 
+  apot_set_functions(apt);
+
   return 0;
 }
 
+/****************************************************************
+ *
+ * set the function pointers from the indices in apt->fid
+ *
+ * Function pointers are only valid in the process that sets them,
+ * so the other MPI processes receive the indices and call this.
+ *
+ ****************************************************************/
+
+void apot_set_functions(apot_table_t *apt)
+{
+  int   i, j;
+
+  for (i = 0; i < apt->number; i++) {
+    j = apt->fid[i];
+    apt->fvalue[i] = function_table.fvalue[j];
+    apt->fbatch[i] = function_table.fbatch[j];
+    apt->fgrad[i] = function_table.fgrad[j];
+  }
+}
+
 /****************************************************************
  *
  * check for special functions needed by certain potential models
@@ -973,6 +1185,13 @@ void newpot_value(double r, double *p, double *f)
   *f = r * p[0] + p[1];
 }
 
+/* optional, value and first derivative, register with add_grad(newpot) */
+void newpot_grad(double r, double *p, double *f, double *df)
+{
+  *f = r * p[0] + p[1];
+  *df = p[0];
+}
+
 /* end of template */
 
 /****************************************************************
@@ -983,225 +1202,949 @@ void newpot_value(double r, double *p, double *f)
 
 /****************************************************************
  *
- * function for smooth cutoff radius
+ * batch versions of the analytic potentials
+ *
+ * They evaluate a function at n points at once, so that the powers
+ * and exponentials can be computed with the vector math routines.
+ * Used for tabulating the potentials in update_calc_table().
  *
  ****************************************************************/
 
-double cutoff(double r, double r0, double h)
+/* get scratch space for 6 * n doubles */
+static double *batch_scratch(int n)
 {
-  if ((r - r0) > 0)
-    return 0;
+  if (6 * n > batch_len) {
+    batch_len = 6 * n;
+    batch_buf = (double *)realloc(batch_buf, batch_len * sizeof(double));
+    if (NULL == batch_buf)
+      error(1, "Cannot allocate memory for analytic function evaluation");
+  }
 
-  static double val;
+  return batch_buf;
+}
 
-  val = (r - r0) / h;
-  val *= val;
-  val *= val;
+void eopp_batch(const double *r, int n, const double *p, double *f)
+{
+  int   i;
+  double *x = batch_scratch(n);
+  double *y = x + 2 * n;
+  double *power = x + 4 * n;
+
+  for (i = 0; i < n; i++) {
+    x[i] = r[i];
+    x[n + i] = r[i];
+    y[i] = p[1];
+    y[n + i] = p[3];
+  }
 
-  return val / (1.0 + val);
-}
+  power_m(2 * n, power, x, y);
 
-/****************************************************************
- *
- * check analytic parameters for special conditions
- *
- ****************************************************************/
+  for (i = 0; i < n; i++)
+    f[i] = p[0] / power[i] + (p[2] / power[n + i]) * cos(p[4] * r[i] + p[5]);
+}
 
-int apot_check_params(double *params)
+void morse_batch(const double *r, int n, const double *p, double *f)
 {
-  int   i, j = 2, k;
-#ifdef TERSOFF
-  double temp;
-#endif /* TERSOFF */
+  int   i;
+  double *x = batch_scratch(n);
+  double *e = x + 2 * n;
 
-  for (i = 0; i < apot_table.number; i++) {
+  for (i = 0; i < n; i++) {
+    x[i] = -2 * p[1] * (r[i] - p[2]);
+    x[n + i] = -p[1] * (r[i] - p[2]);
+  }
 
-    /* last parameter of eopp potential is 2 pi periodic */
-    if (strcmp(apot_table.names[i], "eopp") == 0) {
-      k = j + 5;
-      if (params[k] > 2 * M_PI)
-	do {
-	  params[k] -= 2 * M_PI;
-	} while (params[k] > 2 * M_PI);
-      if (params[k] < 0)
-	do {
-	  params[k] += 2 * M_PI;
-	} while (params[k] < 0);
-    }
+  exp_m(2 * n, e, x);
 
-    /* the third parameter of csw2 potential is 2 pi periodic */
-    if (strcmp(apot_table.names[i], "csw2") == 0) {
-      k = j + 2;
-      if (params[k] > 2 * M_PI)
-	do {
-	  params[k] -= 2 * M_PI;
-	} while (params[k] > 2 * M_PI);
-      if (params[k] < 0)
-	do {
-	  params[k] += 2 * M_PI;
-	} while (params[k] < 0);
-    }
-#ifdef TERSOFF
-    /* the parameter S has to be greater than the parameter R */
-    /* switch them if this is not the case */
-    if (strcmp(apot_table.names[i], "tersoff_pot") == 0) {
-      k = j + 9;
-      if (params[k] < params[k + 1]) {
-	temp = params[k];
-	params[k] = params[k + 1];
-	params[k + 1] = temp;
-      }
-    }
-#endif /* TERSOFF */
+  for (i = 0; i < n; i++)
+    f[i] = p[0] * (e[i] - 2.0 * e[n + i]);
+}
 
-    /* jump to next potential */
-    j += 2 + apot_parameters(apot_table.names[i]) + smooth_pot[i];
+void power_decay_batch(const double *r, int n, const double *p, double *f)
+{
+  int   i;
+  double *x = batch_scratch(n);
+  double *y = x + 2 * n;
+  double *power = x + 4 * n;
 
+  for (i = 0; i < n; i++) {
+    x[i] = 1.0 / r[i];
+    y[i] = p[1];
   }
 
-  return 0;
+  power_m(n, power, x, y);
+
+  for (i = 0; i < n; i++)
+    f[i] = p[0] * power[i];
 }
 
-/****************************************************************
- *
- * punish analytic potential for bad habits
- *
- ****************************************************************/
+void exp_decay_batch(const double *r, int n, const double *p, double *f)
+{
+  int   i;
+  double *x = batch_scratch(n);
+  double *e = x + 2 * n;
 
-double apot_punish(double *params, double *forces)
+  for (i = 0; i < n; i++)
+    x[i] = -p[1] * r[i];
+
+  exp_m(n, e, x);
+
+  for (i = 0; i < n; i++)
+    f[i] = p[0] * e[i];
+}
+
+void csw2_batch(const double *r, int n, const double *p, double *f)
 {
-  int   i, j;
-  double x, tmpsum = 0.0, min, max;
+  int   i;
+  double *x = batch_scratch(n);
+  double *y = x + 2 * n;
+  double *power = x + 4 * n;
 
-  /* loop over individual parameters */
-  for (i = 0; i < ndim; i++) {
-    min = apot_table.pmin[apot_table.idxpot[i]][apot_table.idxparam[i]];
-    max = apot_table.pmax[apot_table.idxpot[i]][apot_table.idxparam[i]];
-    /* punishment for out of bounds */
-    if (x = params[idx[i]] - min, x < 0) {
-      tmpsum += APOT_PUNISH * x * x;
-      forces[punish_par_p + i] = APOT_PUNISH * x * x;
-    } else if (x = params[idx[i]] - max, x > 0) {
-      tmpsum += APOT_PUNISH * x * x;
-      forces[punish_par_p + i] = APOT_PUNISH * x * x;
-    }
+  for (i = 0; i < n; i++) {
+    x[i] = r[i];
+    y[i] = p[3];
   }
 
-  j = 2;
-  /* loop over potentials */
-  for (i = 0; i < apot_table.number; i++) {
+  power_m(n, power, x, y);
 
-    /* punish eta_1 < eta_2 for eopp function */
-    if (strcmp(apot_table.names[i], "eopp") == 0) {
-      x = params[j + 1] - params[j + 3];
-      if (x < 0) {
-	forces[punish_pot_p + i] = apot_punish_value * (1 + x) * (1 + x);
-	tmpsum += apot_punish_value * (1 + x) * (1 + x);
-      }
-    }
-#if defined EAM || defined ADP || defined MEAM
-    /* punish m=n for universal embedding function */
-    if (strcmp(apot_table.names[i], "universal") == 0) {
-      x = params[j + 2] - params[j + 1];
-      if (fabs(x) < 1e-6) {
-	forces[punish_pot_p + i] = apot_punish_value / (x * x);
-	tmpsum += apot_punish_value / (x * x);
-      }
-    }
-#endif /* EAM */
+  for (i = 0; i < n; i++)
+    f[i] = (1.0 + p[0] * cos(p[1] * r[i] + p[2])) / power[i];
+}
 
-    /* jump to next potential */
-    j += 2 + apot_table.n_par[i];
+void universal_batch(const double *r, int n, const double *p, double *f)
+{
+  int   i;
+  double *x = batch_scratch(n);
+  double *y = x + 2 * n;
+  double *power = x + 4 * n;
+
+  for (i = 0; i < n; i++) {
+    x[i] = r[i];
+    x[n + i] = r[i];
+    y[i] = p[1];
+    y[n + i] = p[2];
   }
 
-  return tmpsum;
-}
+  power_m(2 * n, power, x, y);
 
-/****************************************************************
- *
- * calculate gradient for analytic potential
- *
- ****************************************************************/
+  for (i = 0; i < n; i++)
+    f[i] = p[0] * (p[2] / (p[2] - p[1]) * power[i] - p[1] / (p[2] - p[1]) * power[n + i]) + p[3] * r[i];
+}
 
-double apot_grad(double r, double *p, void (*function) (double, double *, double *))
+void mishin_batch(const double *r, int n, const double *p, double *f)
 {
-  double a, b, h = 0.0001;
+  int   i;
+  double *x = batch_scratch(n);
+  double *y = x + n;
+  double *power = x + 2 * n;
+  double *z = x + 3 * n;
+  double *temp = x + 4 * n;
+
+  for (i = 0; i < n; i++) {
+    x[i] = r[i] - p[3];
+    y[i] = p[4];
+    z[i] = -p[5] * r[i];
+  }
 
-  function(r + h, p, &a);
-  function(r - h, p, &b);
+  power_m(n, power, x, y);
+  exp_m(n, temp, z);
 
-  return (a - b) / (2.0 * h);
+  for (i = 0; i < n; i++)
+    f[i] = p[0] * power[i] * temp[i] * (1.0 + p[1] * temp[i]) + p[2];
 }
 
-#ifdef COULOMB
-
 /****************************************************************
  *
- * ms potential + first derivative
+ * analytic potentials together with their first derivative
+ *
+ * Functions without such a version are differentiated numerically
+ * by apot_value_grad().
  *
  ****************************************************************/
 
-void ms_init(double r, double *pot, double *grad, double *p)
+void lj_grad(double r, double *p, double *f, double *df)
 {
-  static double x[4];
+  double sig_d_rad6, sig_d_rad12;
 
-  x[0] = 1 - r / p[2];
-  x[1] = exp(p[1] * x[0]);
-  x[2] = exp(p[1] * x[0] / 2);
-  x[3] = p[0] * p[1] / (r * p[2]);
+  sig_d_rad6 = (p[1] * p[1]) / (r * r);
+  sig_d_rad6 = sig_d_rad6 * sig_d_rad6 * sig_d_rad6;
+  sig_d_rad12 = dsquare(sig_d_rad6);
 
-  *pot = p[0] * (x[1] - 2 * x[2]);
-  *grad = x[3] * (-x[1] + x[2]);
+  *f = 4.0 * p[0] * (sig_d_rad12 - sig_d_rad6);
+  *df = 4.0 * p[0] * (6.0 * sig_d_rad6 - 12.0 * sig_d_rad12) / r;
 }
 
-/****************************************************************
- *
- * buckingham potential + first derivative
- *
- ****************************************************************/
-
-void buck_init(double r, double *pot, double *grad, double *p)
+void eopp_grad(double r, double *p, double *f, double *df)
 {
-  static double x[3];
+  double x[2], y[2], power[2];
+  double c, s;
 
-  x[0] = dsquare(p[1]) / dsquare(r);
-  x[1] = p[2] * x[0] * x[0] * x[0];
-  x[2] = p[0] * exp(-r / p[1]);
+  x[0] = r;
+  x[1] = r;
+  y[0] = p[1];
+  y[1] = p[3];
 
-  *pot = x[2] - x[1];
-  *grad = -x[2] / p[1] + 6 * x[1] / r;
-}
+  power_m(2, power, x, y);
 
-/****************************************************************
- *
- * shifted ms potential
- *
- ****************************************************************/
+  c = cos(p[4] * r + p[5]);
+  s = sin(p[4] * r + p[5]);
 
-void ms_shift(double r, double *p, double *f)
+  *f = p[0] / power[0] + (p[2] / power[1]) * c;
+  *df = -p[1] * p[0] / (power[0] * r) - (p[2] / power[1]) * (p[3] * c / r + p[4] * s);
+}
+
+void morse_grad(double r, double *p, double *f, double *df)
 {
-  static double pot, grad, pot_cut, grad_cut;
+  double e1, e2;
 
-  ms_init(r, &pot, &grad, p);
-  ms_init(dp_cut, &pot_cut, &grad_cut, p);
+  e2 = exp(-2 * p[1] * (r - p[2]));
+  e1 = exp(-p[1] * (r - p[2]));
 
-  *f = pot - pot_cut - (r - dp_cut) * grad_cut;
+  *f = p[0] * (e2 - 2.0 * e1);
+  *df = -2.0 * p[0] * p[1] * (e2 - e1);
 }
 
-/****************************************************************
- *
- * shifted buckingham potential
- *
- ****************************************************************/
-
-void buck_shift(double r, double *p, double *f)
+void ms_grad(double r, double *p, double *f, double *df)
 {
-  static double pot, grad, pot_cut, grad_cut;
+  double x, e1, e2;
 
-  buck_init(r, &pot, &grad, p);
-  buck_init(dp_cut, &pot_cut, &grad_cut, p);
+  x = 1.0 - r / p[2];
+  e1 = exp(p[1] * x);
+  e2 = exp((p[1] * x) / 2.0);
 
-  *f = pot - pot_cut - r * (r - dp_cut) * grad_cut;
+  *f = p[0] * (e1 - 2.0 * e2);
+  *df = -p[0] * p[1] * (e1 - e2) / p[2];
+}
+
+void buck_grad(double r, double *p, double *f, double *df)
+{
+  double x, y, e;
+
+  x = (p[1] * p[1]) / (r * r);
+  y = x * x * x;
+  e = exp(-r / p[1]);
+
+  *f = p[0] * e - p[2] * y;
+  *df = -p[0] * e / p[1] + 6.0 * p[2] * y / r;
+}
+
+void softshell_grad(double r, double *p, double *f, double *df)
+{
+  double x, y;
+
+  x = p[0] / r;
+  y = p[1];
+
+  power_1(f, &x, &y);
+
+  *df = -p[1] * (*f) / r;
+}
+
+void eopp_exp_grad(double r, double *p, double *f, double *df)
+{
+  double power, e, c, s;
+
+  power_1(&power, &r, &p[3]);
+
+  e = exp(-p[1] * r);
+  c = cos(p[4] * r + p[5]);
+  s = sin(p[4] * r + p[5]);
+
+  *f = p[0] * e + (p[2] / power) * c;
+  *df = -p[1] * p[0] * e - (p[2] / power) * (p[3] * c / r + p[4] * s);
+}
+
+void meopp_grad(double r, double *p, double *f, double *df)
+{
+  double x[2], y[2], power[2];
+  double c, s;
+
+  x[0] = r - p[6];
+  x[1] = r;
+  y[0] = p[1];
+  y[1] = p[3];
+
+  power_m(2, power, x, y);
+
+  c = cos(p[4] * r + p[5]);
+  s = sin(p[4] * r + p[5]);
+
+  *f = p[0] / power[0] + (p[2] / power[1]) * c;
+  *df = -p[1] * p[0] / (power[0] * x[0]) - (p[2] / power[1]) * (p[3] * c / r + p[4] * s);
+}
+
+void power_grad(double r, double *p, double *f, double *df)
+{
+  double x[2], y[2], power[2];
+
+  /* r^(p1 - 1) directly, r might be zero */
+  x[0] = r;
+  x[1] = r;
+  y[0] = p[1];
+  y[1] = p[1] - 1.0;
+
+  power_m(2, power, x, y);
+
+  *f = p[0] * power[0];
+  *df = p[0] * p[1] * power[1];
+}
+
+void power_decay_grad(double r, double *p, double *f, double *df)
+{
+  double x, y, power;
+
+  x = 1.0 / r;
+  y = p[1];
+
+  power_1(&power, &x, &y);
+
+  *f = p[0] * power;
+  *df = -p[1] * (*f) / r;
+}
+
+void exp_decay_grad(double r, double *p, double *f, double *df)
+{
+  *f = p[0] * exp(-p[1] * r);
+  *df = -p[1] * (*f);
+}
+
+void bjs_grad(double r, double *p, double *f, double *df)
+{
+  double power;
+
+  if (r == 0.0) {
+    *f = 0.0;
+    *df = 0.0;
+  } else {
+    power_1(&power, &r, &p[1]);
+    *f = p[0] * (1.0 - p[1] * log(r)) * power + p[2] * r;
+    *df = -p[0] * p[1] * p[1] * log(r) * power / r + p[2];
+  }
+}
+
+void parabola_grad(double r, double *p, double *f, double *df)
+{
+  *f = (r * r) * p[0] + r * p[1] + p[2];
+  *df = 2.0 * r * p[0] + p[1];
+}
+
+void csw_grad(double r, double *p, double *f, double *df)
+{
+  double power, c, s;
+
+  power_1(&power, &r, &p[3]);
+
+  c = cos(p[2] * r);
+  s = sin(p[2] * r);
+
+  *f = (1.0 + p[0] * c + p[1] * s) / power;
+  *df = p[2] * (p[1] * c - p[0] * s) / power - p[3] * (*f) / r;
+}
+
+void csw2_grad(double r, double *p, double *f, double *df)
+{
+  double power;
+
+  power_1(&power, &r, &p[3]);
+
+  *f = (1.0 + p[0] * cos(p[1] * r + p[2])) / power;
+  *df = -p[0] * p[1] * sin(p[1] * r + p[2]) / power - p[3] * (*f) / r;
+}
+
+void universal_grad(double r, double *p, double *f, double *df)
+{
+  double x[4], y[4], power[4];
+
+  /* r^(p1 - 1) and r^(p2 - 1) directly, r might be zero */
+  x[0] = r;
+  x[1] = r;
+  x[2] = r;
+  x[3] = r;
+  y[0] = p[1];
+  y[1] = p[2];
+  y[2] = p[1] - 1.0;
+  y[3] = p[2] - 1.0;
+
+  power_m(4, power, x, y);
+
+  *f = p[0] * (p[2] / (p[2] - p[1]) * power[0] - p[1] / (p[2] - p[1]) * power[1]) + p[3] * r;
+  *df = p[0] * p[1] * p[2] / (p[2] - p[1]) * (power[2] - power[3]) + p[3];
+}
+
+void const_grad(double r, double *p, double *f, double *df)
+{
+  *f = *p + 0.0 * r;
+  *df = 0.0;
+}
+
+void sqrt_grad(double r, double *p, double *f, double *df)
+{
+  double s = sqrt(r / p[1]);
+
+  *f = p[0] * s;
+  *df = 0.5 * p[0] / (p[1] * s);
+}
+
+void mexp_decay_grad(double r, double *p, double *f, double *df)
+{
+  *f = p[0] * exp(-p[1] * (r - p[2]));
+  *df = -p[1] * (*f);
+}
+
+void strmm_grad(double r, double *p, double *f, double *df)
+{
+  double r_0, e1, e2;
+
+  r_0 = r - p[4];
+  e1 = exp(-p[1] / 2.0 * r_0);
+  e2 = exp(-p[3] * r_0);
+
+  *f = 2.0 * p[0] * e1 - p[2] * (1.0 + p[3] * r_0) * e2;
+  *df = -p[0] * p[1] * e1 + p[2] * p[3] * p[3] * r_0 * e2;
+}
+
+void double_morse_grad(double r, double *p, double *f, double *df)
+{
+  double e1, e2, e3, e4;
+
+  e1 = exp(-2.0 * p[1] * (r - p[2]));
+  e2 = exp(-p[1] * (r - p[2]));
+  e3 = exp(-2.0 * p[4] * (r - p[5]));
+  e4 = exp(-p[4] * (r - p[5]));
+
+  *f = (p[0] * (e1 - 2.0 * e2) + p[3] * (e3 - 2.0 * e4)) + p[6];
+  *df = -2.0 * (p[0] * p[1] * (e1 - e2) + p[3] * p[4] * (e3 - e4));
+}
+
+void double_exp_grad(double r, double *p, double *f, double *df)
+{
+  double e1, e2;
+
+  e1 = exp(-p[1] * dsquare(r - p[2]));
+  e2 = exp(-p[3] * (r - p[4]));
+
+  *f = (p[0] * e1 + e2);
+  *df = -2.0 * p[0] * p[1] * (r - p[2]) * e1 - p[3] * e2;
+}
+
+void poly_5_grad(double r, double *p, double *f, double *df)
+{
+  double dr;
+
+  dr = (r - 1.0) * (r - 1.0);
+
+  *f = p[0] + 0.5 * p[1] * dr + p[2] * (r - 1.0) * dr + p[3] * (dr * dr) + p[4] * (dr * dr) * (r - 1.0);
+  *df = p[1] * (r - 1.0) + 3.0 * p[2] * dr + 4.0 * p[3] * (r - 1.0) * dr + 5.0 * p[4] * (dr * dr);
+}
+
+void kawamura_grad(double r, double *p, double *f, double *df)
+{
+  double r6, e;
+
+  r6 = r * r * r;
+  r6 *= r6;
+  e = exp((p[3] + p[4] - r) / (p[5] + p[6]));
+
+  *f = p[0] * p[1] / r + p[2] * (p[5] + p[6]) * e - p[7] * p[8] / r6;
+  *df = -p[0] * p[1] / (r * r) - p[2] * e + 6.0 * p[7] * p[8] / (r6 * r);
+}
+
+void kawamura_mix_grad(double r, double *p, double *f, double *df)
+{
+  double r6, e, e1, e2;
+
+  r6 = r * r * r;
+  r6 *= r6;
+  e = exp((p[3] + p[4] - r) / (p[5] + p[6]));
+  e1 = exp(-2 * p[10] * (r - p[11]));
+  e2 = exp(-p[10] * (r - p[11]));
+
+  *f = p[0] * p[1] / r + p[2] * (p[5] + p[6]) * e - p[7] * p[8] / r6 + p[2] * p[9] * (e1 - 2.0 * e2);
+  *df = -p[0] * p[1] / (r * r) - p[2] * e + 6.0 * p[7] * p[8] / (r6 * r)
+    - 2.0 * p[2] * p[9] * p[10] * (e1 - e2);
+}
+
+void exp_plus_grad(double r, double *p, double *f, double *df)
+{
+  double e = exp(-p[1] * r);
+
+  *f = p[0] * e + p[2];
+  *df = -p[1] * p[0] * e;
+}
+
+void mishin_grad(double r, double *p, double *f, double *df)
+{
+  double z, temp, power;
+
+  z = r - p[3];
+  temp = exp(-p[5] * r);
+
+  power_1(&power, &z, &p[4]);
+
+  *f = p[0] * power * temp * (1.0 + p[1] * temp) + p[2];
+  *df = p[0] * power * temp * (p[4] / z * (1.0 + p[1] * temp) - p[5] * (1.0 + 2.0 * p[1] * temp));
+}
+
+void gen_lj_grad(double r, double *p, double *f, double *df)
+{
+  double x[2], y[2], power[2];
+
+  x[0] = r / p[3];
+  x[1] = x[0];
+  y[0] = p[1];
+  y[1] = p[2];
+
+  power_m(2, power, x, y);
+
+  *f = p[0] / (p[2] - p[1]) * (p[2] / power[0] - p[1] / power[1]) + p[4];
+  *df = p[0] * p[1] * p[2] / (p[2] - p[1]) * (1.0 / power[1] - 1.0 / power[0]) / r;
+}
+
+void gljm_grad(double r, double *p, double *f, double *df)
+{
+  double x[3], y[3], power[3];
+  double temp, dpower, dtemp;
+
+  x[0] = r / p[3];
+  x[1] = x[0];
+  x[2] = r - p[9];
+  y[0] = p[1];
+  y[1] = p[2];
+  y[2] = p[10];
+
+  power_m(3, power, x, y);
+
+  temp = exp(-p[11] * power[2]);
+  dpower = p[10] * power[2] / x[2];
+  dtemp = -p[11] * dpower * temp;
+
+  *f =
+    p[0] / (p[2] - p[1]) * (p[2] / power[0] - p[1] / power[1]) + p[4] +
+    p[5] * (p[6] * power[2] * temp * (1.0 + p[7] * temp) + p[8]);
+  *df = p[0] * p[1] * p[2] / (p[2] - p[1]) * (1.0 / power[1] - 1.0 / power[0]) / r +
+    p[5] * p[6] * (dpower * temp * (1.0 + p[7] * temp) + power[2] * dtemp * (1.0 + 2.0 * p[7] * temp));
+}
+
+void vas_grad(double r, double *p, double *f, double *df)
+{
+  *f = exp(p[0] / (r - p[1]));
+  *df = -p[0] / dsquare(r - p[1]) * (*f);
+}
+
+void vpair_grad(double r, double *p, double *f, double *df)
+{
+  double x[7], y, z;
+
+  y = r;
+  z = p[1];
+  power_1(&x[0], &y, &z);
+  x[1] = r * r;
+  x[2] = x[1] * x[1];
+  x[3] = p[2] * p[2];
+  x[4] = p[3] * p[3];
+  x[5] = p[4] * x[4] + p[5] * x[3];
+  x[6] = exp(-r / p[6]);
+
+  *f = 14.4 * (p[0] / x[0] - 0.5 * (x[5] / x[2]) * x[6]);
+  *df = 14.4 * (-p[1] * p[0] / (x[0] * r) + 0.5 * (x[5] / x[2]) * x[6] * (4.0 / r + 1.0 / p[6]));
+}
+
+void sheng_phi1_grad(double r, double *p, double *f, double *df)
+{
+  double y, e1, e2;
+
+  y = r - p[4];
+  e1 = exp(-p[1] * r * r);
+  e2 = exp(-p[3] * y * y);
+
+  *f = p[0] * e1 + p[2] * e2;
+  *df = -2.0 * (p[0] * p[1] * r * e1 + p[2] * p[3] * y * e2);
+}
+
+void sheng_phi2_grad(double r, double *p, double *f, double *df)
+{
+  double y, z, e;
+
+  y = r - p[3];
+  z = p[2] * p[2] + y * y;
+  e = exp(-p[1] * r * r);
+
+  *f = p[0] * e + p[2] / z;
+  *df = -2.0 * (p[0] * p[1] * r * e + p[2] * y / (z * z));
+}
+
+void sheng_rho_grad(double r, double *p, double *f, double *df)
+{
+  double sig_d_rad6, sig_d_rad12, x, y, power;
+
+  if (r <= 1.45) {
+    x = r;
+    y = p[1];
+    power_1(&power, &x, &y);
+    *f = p[0] * power + p[2];
+    *df = p[0] * p[1] * power / r;
+  } else {
+    sig_d_rad6 = (p[4] * p[4]) / (r * r);
+    sig_d_rad6 = sig_d_rad6 * sig_d_rad6 * sig_d_rad6;
+    sig_d_rad12 = dsquare(sig_d_rad6);
+    *f = 4.0 * p[3] * (sig_d_rad12 - sig_d_rad6);
+    *df = 4.0 * p[3] * (6.0 * sig_d_rad6 - 12.0 * sig_d_rad12) / r;
+  }
+}
+
+void sheng_F_grad(double r, double *p, double *f, double *df)
+{
+  double x[2], y[2], power[2];
+
+  /* r^(p1 - 1) directly, r might be zero */
+  x[0] = r;
+  x[1] = r;
+  y[0] = p[1];
+  y[1] = p[1] - 1.0;
+
+  power_m(2, power, x, y);
+
+  *f = p[0] * power[0] + p[2] * r + p[3];
+  *df = p[0] * p[1] * power[1] + p[2];
+}
+
+#ifdef STIWEB
+
+void stiweb_2_grad(double r, double *p, double *f, double *df)
+{
+  double x[2], y[2], power[2];
+  double e;
+
+  x[0] = r;
+  x[1] = r;
+  y[0] = -p[2];
+  y[1] = -p[3];
+
+  power_m(2, power, x, y);
+
+  e = exp(p[4] / (r - p[5]));
+
+  *f = (p[0] * power[0] - p[1] * power[1]) * e;
+  *df = (p[1] * p[3] * power[1] - p[0] * p[2] * power[0]) * e / r - p[4] / dsquare(r - p[5]) * (*f);
+}
+
+void stiweb_3_grad(double r, double *p, double *f, double *df)
+{
+  *f = exp(p[0] / (r - p[1]));
+  *df = -p[0] / dsquare(r - p[1]) * (*f);
+}
+
+#endif /* STIWEB */
+
+/****************************************************************
+ *
+ * function for smooth cutoff radius
+ *
+ ****************************************************************/
+
+double cutoff(double r, double r0, double h)
+{
+  if ((r - r0) > 0)
+    return 0;
+
+  static double val;
+
+  val = (r - r0) / h;
+  val *= val;
+  val *= val;
+
+  return val / (1.0 + val);
+}
+
+/****************************************************************
+ *
+ * multiply n function values with the smooth cutoff function
+ *
+ ****************************************************************/
+
+void cutoff_batch(const double *r, int n, double r0, double h, double *f)
+{
+  int   i;
+  double val;
+
+  for (i = 0; i < n; i++) {
+    val = (r[i] - r0) / h;
+    val *= val;
+    val *= val;
+    f[i] *= ((r[i] - r0) > 0) ? 0.0 : val / (1.0 + val);
+  }
+}
+
+/****************************************************************
+ *
+ * multiply n function values with the smooth cutoff function,
+ * the derivatives df are updated with the product rule
+ *
+ ****************************************************************/
+
+void cutoff_grad_batch(const double *r, int n, double r0, double h, double *f, double *df)
+{
+  int   i;
+  double x, x4, c, dc;
+
+  for (i = 0; i < n; i++) {
+    if ((r[i] - r0) > 0) {
+      f[i] = 0.0;
+      df[i] = 0.0;
+      continue;
+    }
+    x = (r[i] - r0) / h;
+    x4 = x * x;
+    x4 *= x4;
+    c = x4 / (1.0 + x4);
+    dc = 4.0 * x * x * x / (h * (1.0 + x4) * (1.0 + x4));
+    df[i] = df[i] * c + f[i] * dc;
+    f[i] *= c;
+  }
+}
+
+/****************************************************************
+ *
+ * parameter constraints and punishments of individual functions,
+ * p points to the parameters of one potential
+ *
+ ****************************************************************/
+
+/* keep the angle in [0, 2 pi] */
+static void wrap_angle(double *x)
+{
+  while (*x > 2 * M_PI)
+    *x -= 2 * M_PI;
+  while (*x < 0)
+    *x += 2 * M_PI;
+}
+
+/* last parameter of eopp potential is 2 pi periodic */
+void eopp_check(double *p)
+{
+  wrap_angle(p + 5);
+}
+
+/* punish eta_1 < eta_2 for eopp function */
+double eopp_punish(double *p)
+{
+  double x = p[1] - p[3];
+
+  return (x < 0) ? apot_punish_value * (1 + x) * (1 + x) : 0.0;
+}
+
+/* the third parameter of csw2 potential is 2 pi periodic */
+void csw2_check(double *p)
+{
+  wrap_angle(p + 2);
+}
+
+#if defined EAM || defined ADP || defined MEAM
+
+/* punish m=n for universal embedding function */
+double universal_punish(double *p)
+{
+  double x = p[2] - p[1];
+
+  return (fabs(x) < 1e-6) ? apot_punish_value / (x * x) : 0.0;
+}
+
+#endif /* EAM || ADP || MEAM */
+
+#if defined TERSOFF && !defined TERSOFFMOD
+
+/* the parameter S has to be greater than the parameter R */
+/* switch them if this is not the case */
+void tersoff_pot_check(double *p)
+{
+  double temp;
+
+  if (p[9] < p[10]) {
+    temp = p[9];
+    p[9] = p[10];
+    p[10] = temp;
+  }
+}
+
+#endif /* TERSOFF && !TERSOFFMOD */
+
+/****************************************************************
+ *
+ * check analytic parameters for special conditions
+ *
+ ****************************************************************/
+
+int apot_check_params(double *params)
+{
+  int   i;
+  fcheck_pointer check;
+
+  for (i = 0; i < apot_table.number; i++) {
+    check = function_table.fcheck[apot_table.fid[i]];
+    if (NULL != check)
+      check(params + opt_pot.first[i]);
+  }
+
+  return 0;
+}
+
+/****************************************************************
+ *
+ * check if parameter j of potential n can not change during the fit,
+ * either by min == max or as part of an invariant potential
+ *
+ ****************************************************************/
+
+int apot_fixed_param(int n, int j)
+{
+  if (apot_table.pmin[n][j] == apot_table.pmax[n][j])
+    return 1;
+  if (invar_pot[n] && NULL == strchr(apot_table.param_name[n][j], '!'))
+    return 1;
+
+  return 0;
+}
+
+/****************************************************************
+ *
+ * punish analytic potential for bad habits
+ *
+ ****************************************************************/
+
+double apot_punish(double *params, double *forces)
+{
+  int   i;
+  double x, tmpsum = 0.0, min, max;
+  fpunish_pointer punish;
+
+  /* loop over individual parameters */
+  for (i = 0; i < ndim; i++) {
+    min = apot_table.pmin[apot_table.idxpot[i]][apot_table.idxparam[i]];
+    max = apot_table.pmax[apot_table.idxpot[i]][apot_table.idxparam[i]];
+    /* punishment for out of bounds */
+    if (x = params[idx[i]] - min, x < 0) {
+      tmpsum += APOT_PUNISH * x * x;
+      forces[punish_par_p + i] = APOT_PUNISH * x * x;
+    } else if (x = params[idx[i]] - max, x > 0) {
+      tmpsum += APOT_PUNISH * x * x;
+      forces[punish_par_p + i] = APOT_PUNISH * x * x;
+    }
+  }
+
+  /* loop over potentials */
+  for (i = 0; i < apot_table.number; i++) {
+    punish = function_table.fpunish[apot_table.fid[i]];
+    if (NULL != punish && (x = punish(params + opt_pot.first[i]), x != 0.0)) {
+      forces[punish_pot_p + i] = x;
+      tmpsum += x;
+    }
+  }
+
+  return tmpsum;
+}
+
+/****************************************************************
+ *
+ * calculate gradient for analytic potential
+ *
+ ****************************************************************/
+
+double apot_grad(double r, double *p, void (*function) (double, double *, double *))
+{
+  double a, b, h = 0.0001;
+
+  function(r + h, p, &a);
+  function(r - h, p, &b);
+
+  return (a - b) / (2.0 * h);
+}
+
+/****************************************************************
+ *
+ * value and first derivative of analytic potential col,
+ * numerical derivative if there is no analytic one
+ *
+ ****************************************************************/
+
+void apot_value_grad(int col, double r, double *p, double *f, double *df)
+{
+  if (NULL != apot_table.fgrad[col])
+    apot_table.fgrad[col] (r, p, f, df);
+  else {
+    apot_table.fvalue[col] (r, p, f);
+    *df = apot_grad(r, p, apot_table.fvalue[col]);
+  }
+}
+
+#ifdef COULOMB
+
+/****************************************************************
+ *
+ * ms potential + first derivative
+ *
+ ****************************************************************/
+
+void ms_init(double r, double *pot, double *grad, double *p)
+{
+  static double x[4];
+
+  x[0] = 1 - r / p[2];
+  x[1] = exp(p[1] * x[0]);
+  x[2] = exp(p[1] * x[0] / 2);
+  x[3] = p[0] * p[1] / (r * p[2]);
+
+  *pot = p[0] * (x[1] - 2 * x[2]);
+  *grad = x[3] * (-x[1] + x[2]);
+}
+
+/****************************************************************
+ *
+ * buckingham potential + first derivative
+ *
+ ****************************************************************/
+
+void buck_init(double r, double *pot, double *grad, double *p)
+{
+  static double x[3];
+
+  x[0] = dsquare(p[1]) / dsquare(r);
+  x[1] = p[2] * x[0] * x[0] * x[0];
+  x[2] = p[0] * exp(-r / p[1]);
+
+  *pot = x[2] - x[1];
+  *grad = -x[2] / p[1] + 6 * x[1] / r;
+}
+
+/****************************************************************
+ *
+ * shifted ms potential
+ *
+ ****************************************************************/
+
+void ms_shift(double r, double *p, double *f)
+{
+  static double pot, grad, pot_cut, grad_cut;
+
+  ms_init(r, &pot, &grad, p);
+  ms_init(dp_cut, &pot_cut, &grad_cut, p);
+
+  *f = pot - pot_cut - (r - dp_cut) * grad_cut;
+}
+
+/****************************************************************
+ *
+ * shifted buckingham potential
+ *
+ ****************************************************************/
+
+void buck_shift(double r, double *p, double *f)
+{
+  static double pot, grad, pot_cut, grad_cut;
+
+  buck_init(r, &pot, &grad, p);
+  buck_init(dp_cut, &pot_cut, &grad_cut, p);
+
+  *f = pot - pot_cut - r * (r - dp_cut) * grad_cut;
 }
 
 /****************************************************************
@@ -1235,6 +2178,12 @@ void elstat_shift(double r, double dp_kappa, double *fnval_tail, double *grad_ta
   static double ftail, gtail, ggtail, ftail_cut, gtail_cut, ggtail_cut;
   static double x[3];
 
+  /* the Ewald sum needs the unshifted real space part */
+  if (dp_ewald > 0.0) {
+    elstat_value(r, dp_kappa, fnval_tail, grad_tail, ggrad_tail);
+    return;
+  }
+
   x[0] = r * r;
   x[1] = dp_cut * dp_cut;
   x[2] = x[0] - x[1];
@@ -86,23 +86,95 @@ void  tersoff_mod_pot_value(double, double *, double *);
 #endif /* !TERSOFFMOD */
 #endif /* TERSOFF */
 
+/* batch versions of the most common functions */
+void  eopp_batch(const double *, int, const double *, double *);
+void  morse_batch(const double *, int, const double *, double *);
+void  power_decay_batch(const double *, int, const double *, double *);
+void  exp_decay_batch(const double *, int, const double *, double *);
+void  csw2_batch(const double *, int, const double *, double *);
+void  universal_batch(const double *, int, const double *, double *);
+void  mishin_batch(const double *, int, const double *, double *);
+
+/* value and first derivative */
+void  lj_grad(double, double *, double *, double *);
+void  eopp_grad(double, double *, double *, double *);
+void  morse_grad(double, double *, double *, double *);
+void  ms_grad(double, double *, double *, double *);
+void  buck_grad(double, double *, double *, double *);
+void  softshell_grad(double, double *, double *, double *);
+void  eopp_exp_grad(double, double *, double *, double *);
+void  meopp_grad(double, double *, double *, double *);
+void  power_grad(double, double *, double *, double *);
+void  power_decay_grad(double, double *, double *, double *);
+void  exp_decay_grad(double, double *, double *, double *);
+void  bjs_grad(double, double *, double *, double *);
+void  parabola_grad(double, double *, double *, double *);
+void  csw_grad(double, double *, double *, double *);
+void  universal_grad(double, double *, double *, double *);
+void  const_grad(double, double *, double *, double *);
+void  sqrt_grad(double, double *, double *, double *);
+void  mexp_decay_grad(double, double *, double *, double *);
+void  strmm_grad(double, double *, double *, double *);
+void  double_morse_grad(double, double *, double *, double *);
+void  double_exp_grad(double, double *, double *, double *);
+void  poly_5_grad(double, double *, double *, double *);
+void  kawamura_grad(double, double *, double *, double *);
+void  kawamura_mix_grad(double, double *, double *, double *);
+void  exp_plus_grad(double, double *, double *, double *);
+void  mishin_grad(double, double *, double *, double *);
+void  gen_lj_grad(double, double *, double *, double *);
+void  gljm_grad(double, double *, double *, double *);
+void  vas_grad(double, double *, double *, double *);
+void  vpair_grad(double, double *, double *, double *);
+void  csw2_grad(double, double *, double *, double *);
+void  sheng_phi1_grad(double, double *, double *, double *);
+void  sheng_phi2_grad(double, double *, double *, double *);
+void  sheng_rho_grad(double, double *, double *, double *);
+void  sheng_F_grad(double, double *, double *, double *);
+
+#ifdef STIWEB
+void  stiweb_2_grad(double, double *, double *, double *);
+void  stiweb_3_grad(double, double *, double *, double *);
+#endif /* STIWEB */
+
+/* parameter constraints and punishments */
+void  eopp_check(double *);
+double eopp_punish(double *);
+void  csw2_check(double *);
+#if defined EAM || defined ADP || defined MEAM
+double universal_punish(double *);
+#endif /* EAM || ADP || MEAM */
+#if defined TERSOFF && !defined TERSOFFMOD
+void  tersoff_pot_check(double *);
+#endif /* TERSOFF && !TERSOFFMOD */
+
 /* template for new potential function called newpot */
 
 /* "newpot" potential */
 void  newpot_value(double, double *, double *);
+void  newpot_grad(double, double *, double *, double *);
 
 /* end of template */
 
 /* functions for analytic potential initialization */
 void  apot_init(void);
 void  add_potential(const char *, int, fvalue_pointer);
+void  add_batch_function(const char *, fvalue_batch_pointer);
+void  add_grad_function(const char *, fgrad_pointer);
+void  add_check_function(const char *, fcheck_pointer);
+void  add_punish_function(const char *, fpunish_pointer);
 int   apot_assign_functions(apot_table_t *);
+void  apot_set_functions(apot_table_t *);
 int   apot_check_params(double *);
+int   apot_fixed_param(int, int);
 int   apot_parameters(char *);
 void  check_apot_functions(void);
 double apot_grad(double, double *, void (*function) (double, double *, double *));
+void  apot_value_grad(int, double, double *, double *, double *);
 double apot_punish(double *, double *);
 double cutoff(double, double, double);
+void  cutoff_batch(const double *, int, double, double, double *);
+void  cutoff_grad_batch(const double *, int, double, double, double *, double *);
 
 #ifdef DEBUG
 void  debug_apot();
@@ -32,8 +32,16 @@
 
 #ifdef MPI
 
+#include "expression.h"
+#include "functions.h"
 #include "utils.h"
 
+#ifdef MPI_SHM
+/* windows of all node-shared arrays, freed in shutdown_mpi() */
+static MPI_Win *shm_win = NULL;
+static int num_shm_win = 0;
+#endif /* MPI_SHM */
+
 /****************************************************************
  *
  * set up mpi
@@ -47,6 +55,16 @@ void init_mpi(int argc, char **argv)
     fprintf(stderr, "MPI_Init failed!\n");
   MPI_Comm_size(MPI_COMM_WORLD, &num_cpus);
   MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+
+#ifdef MPI_SHM
+  /* one communicator per node, ordered like MPI_COMM_WORLD, so that
+     rank 0 is always the head process of its node */
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, myid, MPI_INFO_NULL, &shm_comm);
+  MPI_Comm_rank(shm_comm, &shm_id);
+  MPI_Comm_size(shm_comm, &shm_cpus);
+  /* the head processes get a communicator of their own */
+  MPI_Comm_split(MPI_COMM_WORLD, (0 == shm_id) ? 0 : MPI_UNDEFINED, myid, &head_comm);
+#endif /* MPI_SHM */
 }
 
 
@@ -65,9 +83,68 @@ void shutdown_mpi(void)
     MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
   }
   MPI_Barrier(MPI_COMM_WORLD);	/* Wait for all processes to arrive */
+#ifdef MPI_SHM
+  while (num_shm_win > 0)
+    MPI_Win_free(&shm_win[--num_shm_win]);
+  free(shm_win);
+  if (0 == shm_id)
+    MPI_Comm_free(&head_comm);
+  MPI_Comm_free(&shm_comm);
+#endif /* MPI_SHM */
   MPI_Finalize();		/* Shutdown */
 }
 
+#ifdef MPI_SHM
+
+/****************************************************************
+ *
+ * shm_alloc: allocate an array which is shared by all processes
+ * 	on one node; only the head process of the node reserves
+ * 	memory, all others get a pointer into its segment
+ *
+ ****************************************************************/
+
+void *shm_alloc(int count, int size)
+{
+  MPI_Aint bytes = 0;
+  int   disp;
+  void *ptr = NULL;
+
+  shm_win = (MPI_Win *)realloc(shm_win, (num_shm_win + 1) * sizeof(MPI_Win));
+  if (NULL == shm_win)
+    error(1, "Cannot allocate memory for shared memory windows");
+
+  if (0 == shm_id)
+    bytes = (MPI_Aint)count * size;
+  MPI_Win_allocate_shared(bytes, size, MPI_INFO_NULL, shm_comm, &ptr, &shm_win[num_shm_win]);
+  MPI_Win_shared_query(shm_win[num_shm_win], 0, &bytes, &disp, &ptr);
+  num_shm_win++;
+
+  return ptr;
+}
+
+/****************************************************************
+ *
+ * shm_share: move an array from rank 0 into node-shared memory
+ * 	and send it to the head processes of all other nodes
+ *
+ ****************************************************************/
+
+static void *shm_share(void *data, int count, int size, MPI_Datatype type)
+{
+  void *ptr = shm_alloc(count, size);
+
+  if (0 == myid)
+    memcpy(ptr, data, (size_t)count * size);
+  if (0 == shm_id)
+    MPI_Bcast(ptr, count, type, 0, head_comm);
+  MPI_Barrier(shm_comm);
+
+  return ptr;
+}
+
+#endif /* MPI_SHM */
+
 /****************************************************************
  *
  * broadcast_param: Broadcast parameters etc to other nodes
@@ -88,7 +165,8 @@ void broadcast_params()
   atom_t testatom;
   int   calclen, size, i, each, odd, count;
 #ifdef APOT
-  int   j;
+  int   j, n_expr;
+  char  def[EXPR_LEN];
 #endif /* APOT */
 
   MPI_Bcast(&init_done, 1, MPI_INT, 0, MPI_COMM_WORLD);
@@ -141,39 +219,39 @@ void broadcast_params()
 #endif /* TERSOFF */
 
   count = 0;
-  MPI_Address(&testneigh.type, 		&displs[count++]);
-  MPI_Address(&testneigh.nr, 		&displs[count++]);
-  MPI_Address(&testneigh.r, 		&displs[count++]);
-  MPI_Address(&testneigh.r2, 		&displs[count++]);
-  MPI_Address(&testneigh.inv_r, 	&displs[count++]);
-  MPI_Address(&testneigh.dist, 		&displs[count++]);
-  MPI_Address(&testneigh.dist_r,	&displs[count++]);
-  MPI_Address(testneigh.slot, 		&displs[count++]);
-  MPI_Address(testneigh.shift, 		&displs[count++]);
-  MPI_Address(testneigh.step, 		&displs[count++]);
-  MPI_Address(testneigh.col, 		&displs[count++]);
+  MPI_Get_address(&testneigh.type, 		&displs[count++]);
+  MPI_Get_address(&testneigh.nr, 		&displs[count++]);
+  MPI_Get_address(&testneigh.r, 		&displs[count++]);
+  MPI_Get_address(&testneigh.r2, 		&displs[count++]);
+  MPI_Get_address(&testneigh.inv_r, 	&displs[count++]);
+  MPI_Get_address(&testneigh.dist, 		&displs[count++]);
+  MPI_Get_address(&testneigh.dist_r,	&displs[count++]);
+  MPI_Get_address(testneigh.slot, 		&displs[count++]);
+  MPI_Get_address(testneigh.shift, 		&displs[count++]);
+  MPI_Get_address(testneigh.step, 		&displs[count++]);
+  MPI_Get_address(testneigh.col, 		&displs[count++]);
 #ifdef ADP
-  MPI_Address(&testneigh.sqrdist, 	&displs[count++]);
-  MPI_Address(&testneigh.u_val, 	&displs[count++]);
-  MPI_Address(&testneigh.u_grad, 	&displs[count++]);
-  MPI_Address(&testneigh.w_val, 	&displs[count++]);
-  MPI_Address(&testneigh.w_grad, 	&displs[count++]);
+  MPI_Get_address(&testneigh.sqrdist, 	&displs[count++]);
+  MPI_Get_address(&testneigh.u_val, 	&displs[count++]);
+  MPI_Get_address(&testneigh.u_grad, 	&displs[count++]);
+  MPI_Get_address(&testneigh.w_val, 	&displs[count++]);
+  MPI_Get_address(&testneigh.w_grad, 	&displs[count++]);
 #endif /* ADP */
 #ifdef COULOMB
-  MPI_Address(&testneigh.fnval_el, 	&displs[count++]);
-  MPI_Address(&testneigh.grad_el, 	&displs[count++]);
-  MPI_Address(&testneigh.ggrad_el, 	&displs[count++]);
+  MPI_Get_address(&testneigh.fnval_el, 	&displs[count++]);
+  MPI_Get_address(&testneigh.grad_el, 	&displs[count++]);
+  MPI_Get_address(&testneigh.ggrad_el, 	&displs[count++]);
 #endif /* COULOMB */
 #ifdef THREEBODY
-  MPI_Address(&testneigh.f, 		&displs[count++]);
-  MPI_Address(&testneigh.df, 		&displs[count++]);
-  MPI_Address(&testneigh.ijk_start, 	&displs[count++]);
+  MPI_Get_address(&testneigh.f, 		&displs[count++]);
+  MPI_Get_address(&testneigh.df, 		&displs[count++]);
+  MPI_Get_address(&testneigh.ijk_start, 	&displs[count++]);
 #endif /* THREEBODY */
 #ifdef MEAM
-  MPI_Address(&testneigh.drho, 		&displs[count++]);
+  MPI_Get_address(&testneigh.drho, 		&displs[count++]);
 #endif /* MEAM */
 #ifdef TERSOFF
-  MPI_Address(&testneigh.dzeta, 	&displs[count++]);
+  MPI_Get_address(&testneigh.dzeta, 	&displs[count++]);
 #endif /* MEAM */
 
   /* *INDENT-ON* */
@@ -192,6 +270,8 @@ void broadcast_params()
   /* *INDENT-OFF* */
   size = 0;
   blklens[size] = 1; 		typen[size++] = MPI_DOUBLE;    	/* cos */
+  blklens[size] = 1;         	typen[size++] = MPI_INT;     	/* j */
+  blklens[size] = 1;         	typen[size++] = MPI_INT;     	/* k */
 #ifdef MEAM
   blklens[size] = 1;         	typen[size++] = MPI_INT;     	/* slot */
   blklens[size] = 1;         	typen[size++] = MPI_DOUBLE;    	/* shift */
@@ -201,13 +281,15 @@ void broadcast_params()
 #endif /* MEAM */
 
   count = 0;
-  MPI_Address(&testangl.cos, 		&displs[count++]);
+  MPI_Get_address(&testangl.cos, 		&displs[count++]);
+  MPI_Get_address(&testangl.j, 		&displs[count++]);
+  MPI_Get_address(&testangl.k, 		&displs[count++]);
 #ifdef MEAM
-  MPI_Address(&testangl.slot, 		&displs[count++]);
-  MPI_Address(&testangl.shift, 		&displs[count++]);
-  MPI_Address(&testangl.step, 		&displs[count++]);
-  MPI_Address(&testangl.g, 		&displs[count++]);
-  MPI_Address(&testangl.dg, 		&displs[count++]);
+  MPI_Get_address(&testangl.slot, 		&displs[count++]);
+  MPI_Get_address(&testangl.shift, 		&displs[count++]);
+  MPI_Get_address(&testangl.step, 		&displs[count++]);
+  MPI_Get_address(&testangl.g, 		&displs[count++]);
+  MPI_Get_address(&testangl.dg, 		&displs[count++]);
 #endif /* MEAM */
   /* *INDENT-ON* */
 
@@ -217,7 +299,7 @@ void broadcast_params()
   }
   displs[0] = 0;
 
-  MPI_Type_struct(size, blklens, displs, typen, &MPI_ANGL);
+  MPI_Type_create_struct(size, blklens, displs, typen, &MPI_ANGL);
   MPI_Type_commit(&MPI_ANGL);
 #endif /* THREEBODY */
 
@@ -261,36 +343,36 @@ void broadcast_params()
   /* DO NOT BROADCAST ANGLES !!! DYNAMIC ALLOCATION */
 
   count = 0;
-  MPI_Address(&testatom.type, 		&displs[count++]);
-  MPI_Address(&testatom.num_neigh, 	&displs[count++]);
-  MPI_Address(&testatom.pos, 		&displs[count++]);
-  MPI_Address(&testatom.force, 		&displs[count++]);
-  MPI_Address(&testatom.absforce, 	&displs[count++]);
-  MPI_Address(&testatom.conf, 		&displs[count++]);
+  MPI_Get_address(&testatom.type, 		&displs[count++]);
+  MPI_Get_address(&testatom.num_neigh, 	&displs[count++]);
+  MPI_Get_address(&testatom.pos, 		&displs[count++]);
+  MPI_Get_address(&testatom.force, 		&displs[count++]);
+  MPI_Get_address(&testatom.absforce, 	&displs[count++]);
+  MPI_Get_address(&testatom.conf, 		&displs[count++]);
 #ifdef CONTRIB
-  MPI_Address(&testatom.contrib, 	&displs[count++]);
+  MPI_Get_address(&testatom.contrib, 	&displs[count++]);
 #endif /* CONTRIB */
 #if defined EAM || defined ADP || defined MEAM
-  MPI_Address(&testatom.rho, 		&displs[count++]);
-  MPI_Address(&testatom.gradF, 		&displs[count++]);
+  MPI_Get_address(&testatom.rho, 		&displs[count++]);
+  MPI_Get_address(&testatom.gradF, 		&displs[count++]);
 #endif /* EAM || ADP */
 #ifdef ADP
-  MPI_Address(&testatom.mu, 		&displs[count++]);
-  MPI_Address(&testatom.lambda, 	&displs[count++]);
-  MPI_Address(&testatom.nu, 		&displs[count++]);
+  MPI_Get_address(&testatom.mu, 		&displs[count++]);
+  MPI_Get_address(&testatom.lambda, 	&displs[count++]);
+  MPI_Get_address(&testatom.nu, 		&displs[count++]);
 #endif /* ADP */
 #ifdef DIPOLE
-  MPI_Address(&testatom.E_stat, 	&displs[count++]);
-  MPI_Address(&testatom.p_sr, 		&displs[count++]);
-  MPI_Address(&testatom.E_ind, 		&displs[count++]);
-  MPI_Address(&testatom.p_ind, 		&displs[count++]);
-  MPI_Address(&testatom.E_old, 		&displs[count++]);
-  MPI_Address(&testatom.E_tot, 		&displs[count++]);
+  MPI_Get_address(&testatom.E_stat, 	&displs[count++]);
+  MPI_Get_address(&testatom.p_sr, 		&displs[count++]);
+  MPI_Get_address(&testatom.E_ind, 		&displs[count++]);
+  MPI_Get_address(&testatom.p_ind, 		&displs[count++]);
+  MPI_Get_address(&testatom.E_old, 		&displs[count++]);
+  MPI_Get_address(&testatom.E_tot, 		&displs[count++]);
 #endif /* DIPOLE */
 #ifdef THREEBODY
-  MPI_Address(&testatom.num_angles, 	&displs[count++]);
+  MPI_Get_address(&testatom.num_angles, 	&displs[count++]);
 #ifdef MEAM
-  MPI_Address(&testatom.rho_eam,	&displs[count++]);
+  MPI_Get_address(&testatom.rho_eam,	&displs[count++]);
 #endif /* MEAM */
 #endif /* THREEBODY */
 
@@ -312,27 +394,41 @@ void broadcast_params()
   MPI_Bcast(&nconf, 1, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast(&paircol, 1, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast(&opt, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&force_kernel, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (myid > 0)
+    set_force_kernel(force_kernel);
 #ifdef COULOMB
   MPI_Bcast(&dp_cut, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&dp_ewald, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 #endif /* COULOMB */
 #ifdef DIPOLE
   MPI_Bcast(&dp_tol, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Bcast(&dp_mix, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&dp_solver, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&dp_tensor_mem, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 #endif /* DIPOLE */
   if (myid > 0) {
     inconf = (int *)malloc(nconf * sizeof(int));
     cnfstart = (int *)malloc(nconf * sizeof(int));
-    force_0 = (double *)malloc(mdim * sizeof(double));
-    conf_weight = (double *)malloc(nconf * sizeof(double));
     reg_for_free(inconf, "inconf");
     reg_for_free(cnfstart, "cnfstart");
+#ifndef MPI_SHM
+    force_0 = (double *)malloc(mdim * sizeof(double));
+    conf_weight = (double *)malloc(nconf * sizeof(double));
     reg_for_free(force_0, "force_0");
     reg_for_free(conf_weight, "conf_weight");
+#endif /* !MPI_SHM */
   }
   MPI_Bcast(inconf, nconf, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast(cnfstart, nconf, MPI_INT, 0, MPI_COMM_WORLD);
+#ifdef MPI_SHM
+  /* reference data is read-only, one copy per node is enough */
+  force_0 = (double *)shm_share(force_0, mdim, sizeof(double), MPI_DOUBLE);
+  conf_weight = (double *)shm_share(conf_weight, nconf, sizeof(double), MPI_DOUBLE);
+#else
   MPI_Bcast(force_0, mdim, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Bcast(conf_weight, nconf, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+#endif /* MPI_SHM */
 
   /* Broadcast weights... */
   MPI_Bcast(&eweight, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
@@ -351,18 +447,20 @@ void broadcast_params()
     calc_pot.invstep = (double *)malloc(size * sizeof(double));
     calc_pot.first = (int *)malloc(size * sizeof(int));
     calc_pot.last = (int *)malloc(size * sizeof(int));
-    calc_pot.table = (double *)malloc(calclen * sizeof(double));
-    calc_pot.xcoord = (double *)malloc(calclen * sizeof(double));
-    calc_pot.d2tab = (double *)malloc(calclen * sizeof(double));
     reg_for_free(calc_pot.begin, "calc_pot.begin");
     reg_for_free(calc_pot.end, "calc_pot.end");
     reg_for_free(calc_pot.step, "calc_pot.step");
     reg_for_free(calc_pot.invstep, "calc_pot.invstep");
     reg_for_free(calc_pot.first, "calc_pot.first");
     reg_for_free(calc_pot.last, "calc_pot.last");
+#ifndef MPI_SHM
+    calc_pot.table = (double *)malloc(calclen * sizeof(double));
+    calc_pot.xcoord = (double *)malloc(calclen * sizeof(double));
+    calc_pot.d2tab = (double *)malloc(calclen * sizeof(double));
     reg_for_free(calc_pot.table, "calc_pot.table");
     reg_for_free(calc_pot.xcoord, "calc_pot.xcoord");
     reg_for_free(calc_pot.d2tab, "calc_pot.d2tab");
+#endif /* !MPI_SHM */
   }
   MPI_Bcast(calc_pot.begin, size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Bcast(calc_pot.end, size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
@@ -370,12 +468,21 @@ void broadcast_params()
   MPI_Bcast(calc_pot.invstep, size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Bcast(calc_pot.first, size, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast(calc_pot.last, size, MPI_INT, 0, MPI_COMM_WORLD);
+#ifdef MPI_SHM
+  /* the sampled potential is only written by the head process of each node,
+     see update_calc_table() and the spline setup in calc_forces() */
+  calc_pot.table = (double *)shm_share(calc_pot.table, calclen, sizeof(double), MPI_DOUBLE);
+  calc_pot.d2tab = (double *)shm_share(calc_pot.d2tab, calclen, sizeof(double), MPI_DOUBLE);
+  calc_pot.xcoord = (double *)shm_share(calc_pot.xcoord, calclen, sizeof(double), MPI_DOUBLE);
+#else
   MPI_Bcast(calc_pot.table, calclen, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Bcast(calc_pot.d2tab, calclen, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Bcast(calc_pot.xcoord, calclen, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+#endif /* MPI_SHM */
 
 #ifdef APOT
   MPI_Bcast(&enable_cp, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&apot_direct, 1, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast(&opt_pot.len, 1, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast(&apot_table.number, 1, MPI_INT, 0, MPI_COMM_WORLD);
 #ifdef COULOMB
@@ -406,7 +513,10 @@ void broadcast_params()
     invar_pot = (int *)malloc(apot_table.number * sizeof(int));
     rcut = (double *)malloc(ntypes * ntypes * sizeof(double));
     rmin = (double *)malloc(ntypes * ntypes * sizeof(double));
+    apot_table.fid = (int *)malloc(apot_table.number * sizeof(int));
     apot_table.fvalue = (fvalue_pointer *) malloc(apot_table.number * sizeof(fvalue_pointer));
+    apot_table.fbatch = (fvalue_batch_pointer *) malloc(apot_table.number * sizeof(fvalue_batch_pointer));
+    apot_table.fgrad = (fgrad_pointer *) malloc(apot_table.number * sizeof(fgrad_pointer));
     opt_pot.table = (double *)malloc(opt_pot.len * sizeof(double));
     opt_pot.first = (int *)malloc(apot_table.number * sizeof(int));
     reg_for_free(calc_list, "calc_list");
@@ -421,7 +531,10 @@ void broadcast_params()
     reg_for_free(invar_pot, "invar_pot");
     reg_for_free(rcut, "rcut");
     reg_for_free(rmin, "rmin");
+    reg_for_free(apot_table.fid, "apot_table.fid");
     reg_for_free(apot_table.fvalue, "apot_table.fvalue");
+    reg_for_free(apot_table.fbatch, "apot_table.fbatch");
+    reg_for_free(apot_table.fgrad, "apot_table.fgrad");
     reg_for_free(opt_pot.table, "opt_pot.first");
     reg_for_free(opt_pot.first, "opt_pot.first");
   }
@@ -431,7 +544,22 @@ void broadcast_params()
   MPI_Bcast(apot_table.n_par, apot_table.number, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast(rcut, ntypes * ntypes, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Bcast(rmin, ntypes * ntypes, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-  MPI_Bcast(apot_table.fvalue, apot_table.number, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  /* function pointers differ between processes, send the function indices */
+  MPI_Bcast(apot_table.fid, apot_table.number, MPI_INT, 0, MPI_COMM_WORLD);
+  if (myid > 0)
+    apot_init();
+  /* user-defined functions are compiled in the same order on all processes */
+  n_expr = expression_count();
+  MPI_Bcast(&n_expr, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  for (i = 0; i < n_expr; i++) {
+    if (0 == myid)
+      strcpy(def, expression_definition(i));
+    MPI_Bcast(def, EXPR_LEN, MPI_CHAR, 0, MPI_COMM_WORLD);
+    if (myid > 0)
+      define_expression(def);
+  }
+  if (myid > 0)
+    apot_set_functions(&apot_table);
   MPI_Bcast(apot_table.end, apot_table.number, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Bcast(apot_table.begin, apot_table.number, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Bcast(apot_table.idxpot, apot_table.number, MPI_INT, 0, MPI_COMM_WORLD);
@@ -524,6 +652,15 @@ void broadcast_params()
   MPI_Scatterv(usestress, conf_len, conf_dist, MPI_INT, conf_us, myconf, MPI_INT, 0, MPI_COMM_WORLD);
 #endif /* STRESS */
 
+#ifdef COULOMB
+  /* box vectors for the Ewald sum, only a few per configuration */
+  if (myid > 0) {
+    boxes = (vector *)malloc(3 * nconf * sizeof(vector));
+    reg_for_free(boxes, "boxes");
+  }
+  MPI_Bcast(boxes, 3 * nconf, MPI_VECTOR, 0, MPI_COMM_WORLD);
+#endif /* COULOMB */
+
   reg_for_free(conf_vol, "conf_vol");
   reg_for_free(conf_uf, "conf_uf");
 #ifdef STRESS
@@ -142,6 +142,17 @@ void check_parameters_complete(char *paramfile)
   if (strcmp(tempfile, "\0") == 0)
     error(1, "Missing parameter or invalid value in %s : tempfile is \"%s\"", paramfile, tempfile);
 
+  if (tempfile_interval < 0)
+    error(1, "Missing parameter or invalid value in %s : tempfile_interval is \"%f\"", paramfile,
+      tempfile_interval);
+
+  if (checkpoint_interval < 0)
+    error(1, "Missing parameter or invalid value in %s : checkpoint_interval is \"%f\"", paramfile,
+      checkpoint_interval);
+
+  if (restart && strcmp(checkpointfile, "\0") == 0)
+    error(1, "Missing parameter or invalid value in %s : restart requires a checkpointfile", paramfile);
+
   if (eweight < 0)
     error(1, "Missing parameter or invalid value in %s : eng_weight is \"%f\"", paramfile, eweight);
 
@@ -156,9 +167,14 @@ void check_parameters_complete(char *paramfile)
 #ifdef APOT
   if (plotmin < 0)
     error(1, "Missing parameter or invalid value in %s : plotmin is \"%f\"", paramfile, plotmin);
+  if (apot_tolerance < 0)
+    error(1, "Missing parameter or invalid value in %s : apot_tolerance is \"%f\"", paramfile,
+      apot_tolerance);
 #ifdef PAIR
   if (enable_cp != 0 && enable_cp != 1)
     error(1, "Missing parameter or invalid value in %s : enable_cp is \"%d\"", paramfile, enable_cp);
+  if (apot_direct < 0 || apot_direct > 2)
+    error(1, "Missing parameter or invalid value in %s : apot_direct is \"%d\"", paramfile, apot_direct);
 #endif /* PAIR */
 #endif /* APOT */
 
@@ -279,11 +295,19 @@ void read_paramfile(FILE *pf)
     else if (strcasecmp(token, "plotmin") == 0) {
       getparam("plotmin", &plotmin, PARAM_DOUBLE, 1, 1);
     }
+    /* accuracy of the tabulated analytic potentials */
+    else if (strcasecmp(token, "apot_tolerance") == 0) {
+      getparam("apot_tolerance", &apot_tolerance, PARAM_DOUBLE, 1, 1);
+    }
 #ifdef PAIR
     /* exclude chemical potential from energy calculations */
     else if (strcasecmp(token, "enable_cp") == 0) {
       getparam("enable_cp", &enable_cp, PARAM_INT, 1, 1);
     }
+    /* evaluate analytic pair potentials directly, 2 = choose automatically */
+    else if (strcasecmp(token, "apot_direct") == 0) {
+      getparam("apot_direct", &apot_direct, PARAM_INT, 1, 1);
+    }
 #endif /* PAIR */
 #endif /* APOT */
     /* how far should the imd pot be extended */
@@ -314,6 +338,26 @@ void read_paramfile(FILE *pf)
     else if (strcasecmp(token, "tempfile") == 0) {
       getparam("tempfile", tempfile, PARAM_STR, 1, 255);
     }
+    /* minimal time between two backup potentials */
+    else if (strcasecmp(token, "tempfile_interval") == 0) {
+      getparam("tempfile_interval", &tempfile_interval, PARAM_DOUBLE, 1, 1);
+    }
+    /* cache file for configurations and neighbor lists */
+    else if (strcasecmp(token, "config_cache") == 0) {
+      getparam("config_cache", config_cache, PARAM_STR, 1, 255);
+    }
+    /* checkpoint file for the optimizer state */
+    else if (strcasecmp(token, "checkpointfile") == 0) {
+      getparam("checkpointfile", checkpointfile, PARAM_STR, 1, 255);
+    }
+    /* minimal time between two checkpoints */
+    else if (strcasecmp(token, "checkpoint_interval") == 0) {
+      getparam("checkpoint_interval", &checkpoint_interval, PARAM_DOUBLE, 1, 1);
+    }
+    /* restart from checkpoint file */
+    else if (strcasecmp(token, "restart") == 0) {
+      getparam("restart", &restart, PARAM_INT, 1, 1);
+    }
     /* seed for RNG */
     else if (strcasecmp(token, "seed") == 0) {
       getparam("seed", &seed, PARAM_INT, 1, 1);
@@ -353,11 +397,25 @@ void read_paramfile(FILE *pf)
     else if (strcasecmp(token, "write_lammps") == 0) {
       getparam("write_lammps", &write_lammps, PARAM_INT, 1, 1);
     }
+    /* write error reports also as CSV */
+    else if (strcasecmp(token, "write_csv") == 0) {
+      getparam("write_csv", &write_csv, PARAM_INT, 1, 1);
+    }
+#ifndef APOT
+    /* write final potential also in binary format */
+    else if (strcasecmp(token, "write_binpot") == 0) {
+      getparam("write_binpot", &write_binpot, PARAM_INT, 1, 1);
+    }
+#endif /* !APOT */
 #ifdef COULOMB
     /* cutoff-radius for long-range interactions */
     else if (strcasecmp(token, "dp_cut") == 0) {
       getparam("dp_cut", &dp_cut, PARAM_DOUBLE, 1, 1);
     }
+    /* accuracy of the Ewald sum, 0 disables the reciprocal part */
+    else if (strcasecmp(token, "dp_ewald") == 0) {
+      getparam("dp_ewald", &dp_ewald, PARAM_DOUBLE, 1, 1);
+    }
 #endif /* COULOMB */
 #ifdef DIPOLE
     /* dipole iteration precision */
@@ -368,6 +426,14 @@ void read_paramfile(FILE *pf)
     else if (strcasecmp(token, "dp_mix") == 0) {
       getparam("dp_mix", &dp_mix, PARAM_DOUBLE, 1, 1);
     }
+    /* solver for the induced dipoles */
+    else if (strcasecmp(token, "dp_solver") == 0) {
+      getparam("dp_solver", &dp_solver, PARAM_INT, 1, 1);
+    }
+    /* memory for the stored dipole field tensors in MB */
+    else if (strcasecmp(token, "dp_tensor_mem") == 0) {
+      getparam("dp_tensor_mem", &dp_tensor_mem, PARAM_DOUBLE, 1, 1);
+    }
 #endif /* DIPOLE */
     /* global scaling parameter */
     else if (strcasecmp(token, "cell_scale") == 0) {
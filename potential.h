@@ -31,6 +31,21 @@
 #ifndef POTENTIAL_H
 #define POTENTIAL_H
 
+#ifndef APOT
+#define BINPOT_MAGIC "potfitbp"
+#define BINPOT_VERSION 1
+
+/* header of the binary part of a format 5 potential file */
+typedef struct {
+  char  magic[8];
+  int   version;
+  int   sizes[2];		/* sizeof double, int */
+  int   format;			/* format of the table (3 or 4) */
+  int   len;
+  int   idxlen;
+} binpot_header_t;
+#endif /* !APOT */
+
 /* reading the potential file */
 void  read_pot_table(pot_table_t *, char *);
 #ifdef APOT
@@ -38,12 +53,15 @@ void  read_pot_table0(pot_table_t *, apot_table_t *, char *, FILE *);
 #else
 void  read_pot_table3(pot_table_t *, int, char *, FILE *);
 void  read_pot_table4(pot_table_t *, int, char *, FILE *);
+void  read_pot_table5(pot_table_t *, int, char *, FILE *);
 #endif /* APOT */
 
 /* calculating the potential tables */
 void  init_calc_table(pot_table_t *, pot_table_t *);
 #ifdef APOT
 void  update_apot_table(double *);
+void  init_apot_sampling(void);
+void  copy_apot_globals(double *);
 void  update_calc_table(double *, double *, int);
 #endif /* APOT */
 
@@ -53,7 +71,14 @@ void  write_pot_table0(apot_table_t *, char *);
 #else
 void  write_pot_table3(pot_table_t *, char *);
 void  write_pot_table4(pot_table_t *, char *);
+void  write_pot_table5(pot_table_t *, char *);
+#endif /* APOT */
+#ifdef APOT
+void  write_pot_temp(apot_table_t *, int);
+#else
+void  write_pot_temp(pot_table_t *, int);
 #endif /* APOT */
+void  finish_pot_temp(void);
 void  write_pot_table_imd(pot_table_t *, char *);
 void  write_pot_table_lammps(pot_table_t *);
 void  write_plotpot_pair(pot_table_t *, char *);
@@ -30,8 +30,10 @@
 
 #include "potfit.h"
 
+#include "expression.h"
 #include "functions.h"
 #include "potential.h"
+#include "splines.h"
 #include "utils.h"
 
 /****************************************************************
@@ -93,46 +95,8 @@ void read_pot_table(pot_table_t *pt, char *filename)
       else
 	printf(" - Potential file format %d (analytic potentials) detected\n", format);
 
-      /* only pair potentials for
-       * - pair interactions
-       * - coulomb interactions
-       * - dipole interactions
-       */
-      npots = paircol;
-
-      /* more potential functions for other interactions */
-#ifdef EAM
-      npots = paircol + 2 * ntypes;
-#ifdef TBEAM			/* TBEAM */
-      npots += 2 * ntypes;
-#endif /* TBEAM */
-#endif /* EAM */
-
-#ifdef ADP
-      npots = 3 * paircol + 2 * ntypes;
-#endif /* ADP */
-
-#ifdef MEAM
-      npots = 2 * paircol + 3 * ntypes;
-#endif /* MEAM */
-
-#ifdef STIWEB
-      npots = 2 * paircol + 1;
-#endif /* STIWEB */
-
-#if defined TERSOFF && !defined TERSOFFMOD
-      npots = ntypes * ntypes;
-#endif /* TERSOFF && !TERSOFFMOD */
-
-      if (size == npots) {
-	printf(" - Using %d %s potentials to calculate forces\n", npots, interaction_name);
-	fflush(stdout);
-      } else {
-	error(0, "Wrong number of data columns in %s potential file \"%s\".\n", interaction_name, filename);
-	error(1, "For ntypes=%d there should be %d, but there are %d.", ntypes, npots, size);
-      }
       /* recognized format? */
-      if ((format != 0) && (format != 3) && (format != 4))
+      if ((format != 0) && (format != 3) && (format != 4) && (format != 5))
 	error(1, "Unrecognized potential format specified for file %s", filename);
       gradient = (int *)malloc(size * sizeof(int));
       invar_pot = (int *)malloc(size * sizeof(int));
@@ -153,11 +117,7 @@ void read_pot_table(pot_table_t *pt, char *filename)
     else if (buffer[1] == 'T') {
       if ((str = strchr(buffer + 3, '\n')) != NULL)
 	*str = '\0';
-      if (strcmp(buffer + 3, interaction_name) != 0) {
-	error(0, "Wrong potential type found in potential file!\n");
-	error(0, "This binary only supports %s potentials.\n", interaction_name);
-	error(1, "Your potential file contains a %s potential.\n", buffer + 3);
-      }
+      select_force_kernel(buffer + 3);
     }
 
     /* header line with invariant potentials */
@@ -206,6 +166,47 @@ void read_pot_table(pot_table_t *pt, char *filename)
   if (!have_format)
     error(1, "Format not specified in header of potential file %s", filename);
 
+  /* only pair potentials for
+   * - pair interactions
+   * - coulomb interactions
+   * - dipole interactions
+   */
+  npots = paircol;
+
+  /* more potential functions for other interactions */
+#ifdef EAM
+  if (embedding) {
+    npots = paircol + 2 * ntypes;
+#ifdef TBEAM			/* TBEAM */
+    npots += 2 * ntypes;
+#endif /* TBEAM */
+  }
+#endif /* EAM */
+
+#ifdef ADP
+  npots = 3 * paircol + 2 * ntypes;
+#endif /* ADP */
+
+#ifdef MEAM
+  npots = 2 * paircol + 3 * ntypes;
+#endif /* MEAM */
+
+#ifdef STIWEB
+  npots = 2 * paircol + 1;
+#endif /* STIWEB */
+
+#if defined TERSOFF && !defined TERSOFFMOD
+  npots = ntypes * ntypes;
+#endif /* TERSOFF && !TERSOFFMOD */
+
+  if (size == npots) {
+    printf(" - Using %d %s potentials to calculate forces\n", npots, interaction_name);
+    fflush(stdout);
+  } else {
+    error(0, "Wrong number of data columns in %s potential file \"%s\".\n", interaction_name, filename);
+    error(1, "For ntypes=%d there should be %d, but there are %d.", ntypes, npots, size);
+  }
+
   /* allocate info block of function table */
   pt->len = 0;
   pt->ncols = size;
@@ -227,7 +228,10 @@ void read_pot_table(pot_table_t *pt, char *filename)
   apt->begin = (double *)malloc(size * sizeof(double));
   apt->end = (double *)malloc(size * sizeof(double));
   apt->param_name = (char ***)malloc(size * sizeof(char **));
+  apt->fid = (int *)malloc(size * sizeof(int));
   apt->fvalue = (fvalue_pointer *) malloc(size * sizeof(fvalue_pointer));
+  apt->fbatch = (fvalue_batch_pointer *) malloc(size * sizeof(fvalue_batch_pointer));
+  apt->fgrad = (fgrad_pointer *) malloc(size * sizeof(fgrad_pointer));
 #ifdef PAIR
   if (enable_cp) {
     apt->values = (double **)malloc((size + 1) * sizeof(double *));
@@ -295,8 +299,9 @@ void read_pot_table(pot_table_t *pt, char *filename)
     apt->names[i] = (char *)malloc(20 * sizeof(char));
 
   if ((apt->n_par == NULL) || (apt->begin == NULL) || (apt->end == NULL)
-    || (apt->fvalue == NULL) || (apt->names == NULL) || (apt->pmin == NULL)
-    || (apt->pmax == NULL) || (apt->param_name == NULL)
+    || (apt->fid == NULL) || (apt->fvalue == NULL) || (apt->fbatch == NULL) || (apt->fgrad == NULL)
+    || (apt->names == NULL)
+    || (apt->pmin == NULL) || (apt->pmax == NULL) || (apt->param_name == NULL)
     || (apt->values == NULL))
     error(1, "Cannot allocate info block for analytic potential table %s", filename);
 #endif /* APOT */
@@ -312,6 +317,9 @@ void read_pot_table(pot_table_t *pt, char *filename)
 	break;
       case 4:
 	read_pot_table4(pt, size, filename, infile);
+	break;
+      case 5:
+	read_pot_table5(pt, size, filename, infile);
 #endif /* APOT */
   }
 
@@ -334,12 +342,14 @@ void read_pot_table(pot_table_t *pt, char *filename)
       rcut[i * ntypes + j] = pt->end[k];
     }
 #if defined EAM || defined ADP || defined MEAM
-  for (i = 0; i < ntypes; i++) {
-    for (j = 0; j < ntypes; j++) {
-      rcut[i * ntypes + j] = MAX(rcut[i * ntypes + j], pt->end[(ntypes * (ntypes + 1)) / 2 + i]);
-      rcut[i * ntypes + j] = MAX(rcut[i * ntypes + j], pt->end[(ntypes * (ntypes + 1)) / 2 + j]);
-      rmin[i * ntypes + j] = MAX(rmin[i * ntypes + j], pt->begin[(ntypes * (ntypes + 1)) / 2 + i]);
-      rmin[i * ntypes + j] = MAX(rmin[i * ntypes + j], pt->begin[(ntypes * (ntypes + 1)) / 2 + j]);
+  if (embedding) {
+    for (i = 0; i < ntypes; i++) {
+      for (j = 0; j < ntypes; j++) {
+	rcut[i * ntypes + j] = MAX(rcut[i * ntypes + j], pt->end[(ntypes * (ntypes + 1)) / 2 + i]);
+	rcut[i * ntypes + j] = MAX(rcut[i * ntypes + j], pt->end[(ntypes * (ntypes + 1)) / 2 + j]);
+	rmin[i * ntypes + j] = MAX(rmin[i * ntypes + j], pt->begin[(ntypes * (ntypes + 1)) / 2 + i]);
+	rmin[i * ntypes + j] = MAX(rmin[i * ntypes + j], pt->begin[(ntypes * (ntypes + 1)) / 2 + j]);
+      }
     }
   }
 #endif /* EAM || ADP || MEAM */
@@ -381,7 +391,10 @@ void read_pot_table(pot_table_t *pt, char *filename)
   reg_for_free(apt->begin, "apt->begin");
   reg_for_free(apt->end, "apt->end");
   reg_for_free(apt->param_name, "apt->param_name");
+  reg_for_free(apt->fid, "apt->fid");
   reg_for_free(apt->fvalue, "apt->fvalue");
+  reg_for_free(apt->fbatch, "apt->fbatch");
+  reg_for_free(apt->fgrad, "apt->fgrad");
   reg_for_free(apt->values, "apt->values");
   reg_for_free(apt->invar_par, "apt->invar_par");
   reg_for_free(apt->pmin, "apt->pmin");
@@ -446,7 +459,7 @@ void read_pot_table(pot_table_t *pt, char *filename)
 void read_pot_table0(pot_table_t *pt, apot_table_t *apt, char *filename, FILE *infile)
 {
   int   i, j, k, l, ret_val;
-  char  buffer[255], name[255];
+  char  buffer[255], name[255], line[EXPR_LEN];
   char *token;
   double *val, *list, temp;
   fpos_t filepos, startpos;
@@ -457,6 +470,21 @@ void read_pot_table0(pot_table_t *pt, apot_table_t *apt, char *filename, FILE *i
   /* save starting position */
   fgetpos(infile, &startpos);
 
+  /* compile user-defined functions, they have to be known before the potentials are read */
+  while (NULL != fgets(line, EXPR_LEN, infile)) {
+    if (1 == sscanf(line, "%s", buffer) && 0 == strcmp(buffer, "function")) {
+      if (NULL == strchr(line, '\n') && !feof(infile))
+	error(1, "Function definition in %s is longer than %d characters.", filename, EXPR_LEN);
+      token = strstr(line, "function") + 8;
+      token += strspn(token, " \t");
+      token[strcspn(token, "\r\n")] = '\0';
+      j = define_expression(token);
+      printf(" - Compiled function %s (%d instructions)\n",
+	function_table.name[n_functions - 1], j);
+    }
+  }
+  fsetpos(infile, &startpos);
+
 #ifdef PAIR
   /* read cp */
   if (enable_cp) {
@@ -1241,6 +1269,80 @@ void read_pot_table0(pot_table_t *pt, apot_table_t *apt, char *filename, FILE *i
 
 #else /* APOT */
 
+/****************************************************************
+ *
+ *  buffered reading of tabulated potentials
+ *
+ *  The tables of format 3 and 4 can have hundreds of thousands of
+ *  values. They are read into memory in one piece and parsed from
+ *  there, which is much faster than calling fscanf() for every
+ *  number. The numbers are converted by parse_double().
+ *
+ ****************************************************************/
+
+static char *pot_buf = NULL;	/* rest of the potential file */
+static char *pot_pos = NULL;	/* current position in pot_buf */
+
+static void buffer_pot_file(FILE *infile, char *filename)
+{
+  size_t len = 0, size = 1 << 20, n;
+
+  pot_buf = (char *)malloc(size);
+  while (NULL != pot_buf && (n = fread(pot_buf + len, 1, size - len - 1, infile)) > 0) {
+    len += n;
+    if (len == size - 1) {
+      size *= 2;
+      pot_buf = (char *)realloc(pot_buf, size);
+    }
+  }
+  if (NULL == pot_buf)
+    error(1, "Cannot allocate memory for reading the potential file %s", filename);
+  pot_buf[len] = '\0';
+  pot_pos = pot_buf;
+}
+
+static void free_pot_buffer(void)
+{
+  free(pot_buf);
+  pot_buf = NULL;
+  pot_pos = NULL;
+}
+
+/* read one number from the buffer, returns 1 on success and 0 otherwise */
+static int scan_value(double *x)
+{
+  char *end;
+
+  *x = parse_double(pot_pos, &end);
+  if (end == pot_pos)
+    return 0;
+  pot_pos = end;
+
+  return 1;
+}
+
+/* read two numbers, returns the number of values read */
+static int scan_values(double *x, double *y)
+{
+  if (0 == scan_value(x))
+    return 0;
+
+  return 1 + scan_value(y);
+}
+
+/* read an integer, returns 1 on success and 0 otherwise */
+static int scan_int(int *n)
+{
+  char *end;
+
+  *n = (int)strtol(pot_pos, &end, 10);
+  if (end == pot_pos)
+    return 0;
+  pot_pos = end;
+
+  return 1;
+}
+
 /****************************************************************
  *
  *  read potential in third format:
@@ -1267,9 +1369,11 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
   int   nvals[size];
   double *val;
 
+  buffer_pot_file(infile, filename);
+
   /* read the info block of the function table */
   for (i = 0; i < size; i++) {
-    if (3 > fscanf(infile, "%lf %lf %d", &pt->begin[i], &pt->end[i], &nvals[i]))
+    if (2 > scan_values(&pt->begin[i], &pt->end[i]) || 1 > scan_int(&nvals[i]))
       error(1, "Premature end of potential file %s", filename);
     pt->step[i] = (pt->end[i] - pt->begin[i]) / (nvals[i] - 1);
     pt->invstep[i] = 1.0 / pt->step[i];
@@ -1308,7 +1412,7 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
   /* read pair potentials */
   for (i = 0; i < paircol; i++) {
     if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
+      if (2 > scan_values(val, val + 1))
 	error(1, "Premature end of potential file %s", filename);
     } else {
       *val = 1e30;
@@ -1325,7 +1429,7 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
       l++;
     /* read values */
     for (j = 0; j < nvals[i]; j++) {
-      if (1 > fscanf(infile, "%lf\n", val))
+      if (1 > scan_value(val))
 	error(1, "Premature end of potential file %s", filename);
       else
 	val++;
@@ -1338,142 +1442,144 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
   }
 
 #if defined EAM || defined ADP || defined MEAM
-  /* read EAM transfer function rho(r) */
-  for (i = paircol; i < paircol + ntypes; i++) {
-    if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
-	error(1, "Premature end of potential file %s", filename);
-    } else {
-      *val = 1e30;
-      *(val + 1) = 0.0;
-    }
-    val += 2;
-    if ((!invar_pot[i]) && (gradient[i] >> 1))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    if ((!invar_pot[i]) && (gradient[i] % 2))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    /* read values */
-    for (j = 0; j < nvals[i]; j++) {
-      if (1 > fscanf(infile, "%lf\n", val))
-	error(1, "Premature end of potential file %s", filename);
+  if (embedding) {
+    /* read EAM transfer function rho(r) */
+    for (i = paircol; i < paircol + ntypes; i++) {
+      if (have_grad) {
+	if (2 > scan_values(val, val + 1))
+	  error(1, "Premature end of potential file %s", filename);
+      } else {
+	*val = 1e30;
+	*(val + 1) = 0.0;
+      }
+      val += 2;
+      if ((!invar_pot[i]) && (gradient[i] >> 1))
+	pt->idx[k++] = l++;
       else
-	val++;
-      pt->xcoord[l] = pt->begin[i] + j * pt->step[i];
-      if ((!invar_pot[i]) && (j < nvals[i] - 1))
+	l++;
+      if ((!invar_pot[i]) && (gradient[i] % 2))
 	pt->idx[k++] = l++;
       else
 	l++;
+      /* read values */
+      for (j = 0; j < nvals[i]; j++) {
+	if (1 > scan_value(val))
+	  error(1, "Premature end of potential file %s", filename);
+	else
+	  val++;
+	pt->xcoord[l] = pt->begin[i] + j * pt->step[i];
+	if ((!invar_pot[i]) && (j < nvals[i] - 1))
+	  pt->idx[k++] = l++;
+	else
+	  l++;
+      }
     }
-  }
 
-  /* read EAM embedding function F(n) */
-  for (i = paircol + ntypes; i < paircol + 2 * ntypes; i++) {
-    if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
-	error(1, "Premature end of potential file %s", filename);
-    } else {
-      *val = 1.e30;
-      *(val + 1) = 1.e30;
-    }
-    val += 2;
-    if ((!invar_pot[i]) && (gradient[i] >> 1))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    if ((!invar_pot[i]) && (gradient[i] % 2))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    /* read values */
-    for (j = 0; j < nvals[i]; j++) {
-      if (1 > fscanf(infile, "%lf\n", val))
-	error(1, "Premature end of potential file %s", filename);
+    /* read EAM embedding function F(n) */
+    for (i = paircol + ntypes; i < paircol + 2 * ntypes; i++) {
+      if (have_grad) {
+	if (2 > scan_values(val, val + 1))
+	  error(1, "Premature end of potential file %s", filename);
+      } else {
+	*val = 1.e30;
+	*(val + 1) = 1.e30;
+      }
+      val += 2;
+      if ((!invar_pot[i]) && (gradient[i] >> 1))
+	pt->idx[k++] = l++;
       else
-	val++;
-      pt->xcoord[l] = pt->begin[i] + j * pt->step[i];
-      if (!invar_pot[i])
+	l++;
+      if ((!invar_pot[i]) && (gradient[i] % 2))
 	pt->idx[k++] = l++;
       else
 	l++;
+      /* read values */
+      for (j = 0; j < nvals[i]; j++) {
+	if (1 > scan_value(val))
+	  error(1, "Premature end of potential file %s", filename);
+	else
+	  val++;
+	pt->xcoord[l] = pt->begin[i] + j * pt->step[i];
+	if (!invar_pot[i])
+	  pt->idx[k++] = l++;
+	else
+	  l++;
+      }
     }
-  }
 
 #ifdef TBEAM
-  /* read TBEAM transfer function rho(r) for the s-band */
-  for (i = paircol + 2 * ntypes; i < paircol + 3 * ntypes; i++) {
-    if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
-	error(1, "Premature end of potential file %s", filename);
-    } else {
-      *val = 1e30;
-      *(val + 1) = 0.0;
-    }
-    val += 2;
-    if ((!invar_pot[i]) && (gradient[i] >> 1))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    if ((!invar_pot[i]) && (gradient[i] % 2))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    /* read values */
-    for (j = 0; j < nvals[i]; j++) {
-      if (1 > fscanf(infile, "%lf\n", val))
-	error(1, "Premature end of potential file %s", filename);
+    /* read TBEAM transfer function rho(r) for the s-band */
+    for (i = paircol + 2 * ntypes; i < paircol + 3 * ntypes; i++) {
+      if (have_grad) {
+	if (2 > scan_values(val, val + 1))
+	  error(1, "Premature end of potential file %s", filename);
+      } else {
+	*val = 1e30;
+	*(val + 1) = 0.0;
+      }
+      val += 2;
+      if ((!invar_pot[i]) && (gradient[i] >> 1))
+	pt->idx[k++] = l++;
       else
-	val++;
-      pt->xcoord[l] = pt->begin[i] + j * pt->step[i];
-      if ((!invar_pot[i]) && (j < nvals[i] - 1))
+	l++;
+      if ((!invar_pot[i]) && (gradient[i] % 2))
 	pt->idx[k++] = l++;
       else
 	l++;
+      /* read values */
+      for (j = 0; j < nvals[i]; j++) {
+	if (1 > scan_value(val))
+	  error(1, "Premature end of potential file %s", filename);
+	else
+	  val++;
+	pt->xcoord[l] = pt->begin[i] + j * pt->step[i];
+	if ((!invar_pot[i]) && (j < nvals[i] - 1))
+	  pt->idx[k++] = l++;
+	else
+	  l++;
+      }
     }
-  }
 
-  /* read TBEAM embedding function F(n) for the s-band */
-  for (i = paircol + 3 * ntypes; i < paircol + 4 * ntypes; i++) {
-    if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
-	error(1, "Premature end of potential file %s", filename);
-    } else {
-      *val = 1.e30;
-      *(val + 1) = 1.e30;
-    }
-    val += 2;
-    if ((!invar_pot[i]) && (gradient[i] >> 1))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    if ((!invar_pot[i]) && (gradient[i] % 2))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    /* read values */
-    for (j = 0; j < nvals[i]; j++) {
-      if (1 > fscanf(infile, "%lf\n", val))
-	error(1, "Premature end of potential file %s", filename);
+    /* read TBEAM embedding function F(n) for the s-band */
+    for (i = paircol + 3 * ntypes; i < paircol + 4 * ntypes; i++) {
+      if (have_grad) {
+	if (2 > scan_values(val, val + 1))
+	  error(1, "Premature end of potential file %s", filename);
+      } else {
+	*val = 1.e30;
+	*(val + 1) = 1.e30;
+      }
+      val += 2;
+      if ((!invar_pot[i]) && (gradient[i] >> 1))
+	pt->idx[k++] = l++;
       else
-	val++;
-      pt->xcoord[l] = pt->begin[i] + j * pt->step[i];
-      if (!invar_pot[i])
+	l++;
+      if ((!invar_pot[i]) && (gradient[i] % 2))
 	pt->idx[k++] = l++;
       else
 	l++;
+      /* read values */
+      for (j = 0; j < nvals[i]; j++) {
+	if (1 > scan_value(val))
+	  error(1, "Premature end of potential file %s", filename);
+	else
+	  val++;
+	pt->xcoord[l] = pt->begin[i] + j * pt->step[i];
+	if (!invar_pot[i])
+	  pt->idx[k++] = l++;
+	else
+	  l++;
+      }
     }
-  }
 #endif /* TBEAM */
+  }
 #endif /* EAM || ADP || MEAM */
 
 #ifdef ADP
   /* read ADP dipole function u(r) */
   for (i = paircol + 2 * ntypes; i < 2 * (paircol + ntypes); i++) {
     if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
+      if (2 > scan_values(val, val + 1))
 	error(1, "Premature end of potential file %s", filename);
     } else {
       *val = 1e30;
@@ -1490,7 +1596,7 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
       l++;
     /* read values */
     for (j = 0; j < nvals[i]; j++) {
-      if (1 > fscanf(infile, "%lf\n", val))
+      if (1 > scan_value(val))
 	error(1, "Premature end of potential file %s", filename);
       else
 	val++;
@@ -1505,7 +1611,7 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
   /* read adp quadrupole function w(r) */
   for (i = 2 * (paircol + ntypes); i < 3 * paircol + 2 * ntypes; i++) {
     if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
+      if (2 > scan_values(val, val + 1))
 	error(1, "Premature end of potential file %s", filename);
     } else {
       *val = 1.e30;
@@ -1522,7 +1628,7 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
       l++;
     /* read values */
     for (j = 0; j < nvals[i]; j++) {
-      if (1 > fscanf(infile, "%lf\n", val))
+      if (1 > scan_value(val))
 	error(1, "Premature end of potential file %s", filename);
       else
 	val++;
@@ -1538,7 +1644,7 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
 #ifdef MEAM
   for (i = paircol + 2 * ntypes; i < 2 * paircol + 2 * ntypes; i++) {	/* read in second pair pot    f */
     if (have_grad) {		/* read gradient */
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
+      if (2 > scan_values(val, val + 1))
 	error(1, "Premature end of potential file %s", filename);;
     } else {
       *val = 1e30;
@@ -1554,7 +1660,7 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
     else
       l++;
     for (j = 0; j < nvals[i]; j++) {	/* read values */
-      if (1 > fscanf(infile, "%lf\n", val)) {
+      if (1 > scan_value(val)) {
 	error(1, "Premature end of potential file %s", filename);;
       } else
 	val++;
@@ -1573,7 +1679,7 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
   }
   for (i = 2 * paircol + 2 * ntypes; i < 2 * paircol + 3 * ntypes; i++) {	/* read in angl part */
     if (have_grad) {		/* read gradient */
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
+      if (2 > scan_values(val, val + 1))
 	error(1, "Premature end of potential file %s", filename);;
     } else {
       *val = 0;
@@ -1589,7 +1695,7 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
     else
       l++;
     for (j = 0; j < nvals[i]; j++) {	/* read values */
-      if (1 > fscanf(infile, "%lf\n", val)) {
+      if (1 > scan_value(val)) {
 	error(1, "Premature end of potential file %s", filename);;
       } else
 	val++;
@@ -1602,6 +1708,8 @@ void read_pot_table3(pot_table_t *pt, int size, char *filename, FILE *infile)
   }
 #endif /* MEAM */
 
+  free_pot_buffer();
+
   pt->idxlen = k;
   init_calc_table(pt, &calc_pot);
 
@@ -1633,9 +1741,11 @@ void read_pot_table4(pot_table_t *pt, int size, char *filename, FILE *infile)
   int   nvals[size];
   double *val, *ord;
 
+  buffer_pot_file(infile, filename);
+
   /* read the info block of the function table */
   for (i = 0; i < size; i++) {
-    if (1 > fscanf(infile, "%d", &nvals[i]))
+    if (1 > scan_int(&nvals[i]))
       error(1, "Premature end of potential file %s", filename);
     pt->step[i] = 0.0;
     pt->invstep[i] = 0.0;
@@ -1671,7 +1781,7 @@ void read_pot_table4(pot_table_t *pt, int size, char *filename, FILE *infile)
   /* read pair potentials */
   for (i = 0; i < paircol; i++) {
     if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
+      if (2 > scan_values(val, val + 1))
 	error(1, "Premature end of potential file %s", filename);
     } else {
       *val = 1e30;
@@ -1689,7 +1799,7 @@ void read_pot_table4(pot_table_t *pt, int size, char *filename, FILE *infile)
       l++;
     /* read values */
     for (j = 0; j < nvals[i]; j++) {
-      if (2 > fscanf(infile, "%lf %lf\n", ord, val))
+      if (2 > scan_values(ord, val))
 	error(1, "Premature end of potential file %s", filename);
       else {
 	val++;
@@ -1711,97 +1821,99 @@ void read_pot_table4(pot_table_t *pt, int size, char *filename, FILE *infile)
 
   }
 #if defined EAM || defined ADP
+  if (embedding) {
 #ifndef TBEAM			/* EAM ADP MEAM */
-  den_count = ntypes;
-  emb_count = ntypes;
+    den_count = ntypes;
+    emb_count = ntypes;
 #else /* TBEAM */
-  if (ntypes == 1) {
-    den_count = ntypes + 1;
-  } else {
-    den_count = ntypes * (ntypes + 1) / 2;
-  }
-  emb_count = 2 * ntypes;
-#endif /* END EAM or TBEAM */
-  /* read EAM transfer function rho(r) */
-  for (i = paircol; i < paircol + den_count; i++) {
-    if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
-	error(1, "Premature end of potential file %s", filename);
+    if (ntypes == 1) {
+      den_count = ntypes + 1;
     } else {
-      *val = 1e30;
-      *(val + 1) = 0.0;
+      den_count = ntypes * (ntypes + 1) / 2;
     }
-    val += 2;
-    ord += 2;
-    if ((!invar_pot[i]) && (gradient[i] >> 1))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    if ((!invar_pot[i]) && (gradient[i] % 2))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    /* read values */
-    for (j = 0; j < nvals[i]; j++) {
-      if (2 > fscanf(infile, "%lf %lf\n", ord, val))
-	error(1, "Premature end of potential file %s", filename);
-      else {
-	ord++;
-	val++;
+    emb_count = 2 * ntypes;
+#endif /* END EAM or TBEAM */
+    /* read EAM transfer function rho(r) */
+    for (i = paircol; i < paircol + den_count; i++) {
+      if (have_grad) {
+	if (2 > scan_values(val, val + 1))
+	  error(1, "Premature end of potential file %s", filename);
+      } else {
+	*val = 1e30;
+	*(val + 1) = 0.0;
       }
-      if ((j > 0) && (*(ord - 1) <= *(ord - 2)))
-	error(1, "Abscissa not monotonous in potential %d.", i);
-      if ((!invar_pot[i]) && (j < nvals[i] - 1))
+      val += 2;
+      ord += 2;
+      if ((!invar_pot[i]) && (gradient[i] >> 1))
 	pt->idx[k++] = l++;
       else
 	l++;
-    }
-    pt->begin[i] = pt->xcoord[pt->first[i]];
-    pt->end[i] = pt->xcoord[pt->last[i]];
-    /* pt->step is average step length.. */
-    pt->step[i] = (pt->end[i] - pt->begin[i]) / ((double)nvals[i] - 1);
-    pt->invstep[i] = 1.0 / pt->step[i];
-  }
-
-  /* read EAM embedding function F(n) */
-  for (i = paircol + den_count; i < paircol + den_count + emb_count; i++) {
-    if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
-	error(1, "Premature end of potential file %s", filename);
-    } else {
-      *val = 1e30;
-      *(val + 1) = 1.e30;
-    }
-    val += 2;
-    ord += 2;
-    if ((!invar_pot[i]) && (gradient[i] >> 1))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    if ((!invar_pot[i]) && (gradient[i] % 2))
-      pt->idx[k++] = l++;
-    else
-      l++;
-    /* read values */
-    for (j = 0; j < nvals[i]; j++) {
-      if (1 > fscanf(infile, "%lf %lf\n", ord, val))
-	error(1, "Premature end of potential file %s", filename);
-      else {
-	ord++;
-	val++;
+      if ((!invar_pot[i]) && (gradient[i] % 2))
+	pt->idx[k++] = l++;
+      else
+	l++;
+      /* read values */
+      for (j = 0; j < nvals[i]; j++) {
+	if (2 > scan_values(ord, val))
+	  error(1, "Premature end of potential file %s", filename);
+	else {
+	  ord++;
+	  val++;
+	}
+	if ((j > 0) && (*(ord - 1) <= *(ord - 2)))
+	  error(1, "Abscissa not monotonous in potential %d.", i);
+	if ((!invar_pot[i]) && (j < nvals[i] - 1))
+	  pt->idx[k++] = l++;
+	else
+	  l++;
       }
-      if ((j > 0) && (*(ord - 1) <= *(ord - 2)))
-	error(1, "Abscissa not monotonous in potential %d.", i);
-      if (!invar_pot[i])
+      pt->begin[i] = pt->xcoord[pt->first[i]];
+      pt->end[i] = pt->xcoord[pt->last[i]];
+      /* pt->step is average step length.. */
+      pt->step[i] = (pt->end[i] - pt->begin[i]) / ((double)nvals[i] - 1);
+      pt->invstep[i] = 1.0 / pt->step[i];
+    }
+
+    /* read EAM embedding function F(n) */
+    for (i = paircol + den_count; i < paircol + den_count + emb_count; i++) {
+      if (have_grad) {
+	if (2 > scan_values(val, val + 1))
+	  error(1, "Premature end of potential file %s", filename);
+      } else {
+	*val = 1e30;
+	*(val + 1) = 1.e30;
+      }
+      val += 2;
+      ord += 2;
+      if ((!invar_pot[i]) && (gradient[i] >> 1))
+	pt->idx[k++] = l++;
+      else
+	l++;
+      if ((!invar_pot[i]) && (gradient[i] % 2))
 	pt->idx[k++] = l++;
       else
 	l++;
+      /* read values */
+      for (j = 0; j < nvals[i]; j++) {
+	if (1 > scan_values(ord, val))
+	  error(1, "Premature end of potential file %s", filename);
+	else {
+	  ord++;
+	  val++;
+	}
+	if ((j > 0) && (*(ord - 1) <= *(ord - 2)))
+	  error(1, "Abscissa not monotonous in potential %d.", i);
+	if (!invar_pot[i])
+	  pt->idx[k++] = l++;
+	else
+	  l++;
+      }
+      pt->begin[i] = pt->xcoord[pt->first[i]];
+      pt->end[i] = pt->xcoord[pt->last[i]];
+      /* pt->step is average step length.. */
+      pt->step[i] = (pt->end[i] - pt->begin[i]) / ((double)nvals[i] - 1);
+      pt->invstep[i] = 1.0 / pt->step[i];
     }
-    pt->begin[i] = pt->xcoord[pt->first[i]];
-    pt->end[i] = pt->xcoord[pt->last[i]];
-    /* pt->step is average step length.. */
-    pt->step[i] = (pt->end[i] - pt->begin[i]) / ((double)nvals[i] - 1);
-    pt->invstep[i] = 1.0 / pt->step[i];
   }
 #endif /* EAM || ADP */
 
@@ -1809,7 +1921,7 @@ void read_pot_table4(pot_table_t *pt, int size, char *filename, FILE *infile)
   /* read ADP dipole function u(r) */
   for (i = paircol + 2 * ntypes; i < 2 * (paircol + ntypes); i++) {
     if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
+      if (2 > scan_values(val, val + 1))
 	error(1, "Premature end of potential file %s", filename);
     } else {
       *val = 1e30;
@@ -1827,7 +1939,7 @@ void read_pot_table4(pot_table_t *pt, int size, char *filename, FILE *infile)
       l++;
     /* read values */
     for (j = 0; j < nvals[i]; j++) {
-      if (2 > fscanf(infile, "%lf %lf\n", ord, val))
+      if (2 > scan_values(ord, val))
 	error(1, "Premature end of potential file %s", filename);
       else {
 	ord++;
@@ -1850,7 +1962,7 @@ void read_pot_table4(pot_table_t *pt, int size, char *filename, FILE *infile)
   /* read adp quadrupole function w(r) */
   for (i = 2 * (paircol + ntypes); i < 3 * paircol + 2 * ntypes; i++) {
     if (have_grad) {
-      if (2 > fscanf(infile, "%lf %lf\n", val, val + 1))
+      if (2 > scan_values(val, val + 1))
 	error(1, "Premature end of potential file %s", filename);
     } else {
       *val = 1e30;
@@ -1868,7 +1980,7 @@ void read_pot_table4(pot_table_t *pt, int size, char *filename, FILE *infile)
       l++;
     /* read values */
     for (j = 0; j < nvals[i]; j++) {
-      if (1 > fscanf(infile, "%lf %lf\n", ord, val))
+      if (1 > scan_values(ord, val))
 	error(1, "Premature end of potential file %s", filename);
       else {
 	ord++;
@@ -1889,12 +2001,92 @@ void read_pot_table4(pot_table_t *pt, int size, char *filename, FILE *infile)
   }
 #endif /* ADP */
 
+  free_pot_buffer();
+
   pt->idxlen = k;
   init_calc_table(pt, &calc_pot);
 
   return;
 }
 
+/****************************************************************
+ *
+ *  read potential in binary format (format 5):
+ *
+ *  The text header is followed by a binpot_header_t and the
+ *  arrays of the potential table exactly as they are kept in
+ *  memory, see write_pot_table5(). The table gets the format of
+ *  the file it was created from (3 or 4), so the rest of potfit
+ *  treats it like the text version.
+ *
+ ****************************************************************/
+
+static void read_binary(void *data, size_t size, size_t n, char *filename, FILE *infile)
+{
+  if (n > 0 && fread(data, size, n, infile) != n)
+    error(1, "Premature end of binary potential file %s", filename);
+}
+
+void read_pot_table5(pot_table_t *pt, int size, char *filename, FILE *infile)
+{
+  int   i;
+  binpot_header_t header;
+
+  read_binary(&header, sizeof(header), 1, filename, infile);
+  if (0 != memcmp(header.magic, BINPOT_MAGIC, sizeof(header.magic))
+    || BINPOT_VERSION != header.version)
+    error(1, "%s is not a binary potential file of this potfit version", filename);
+  if (sizeof(double) != header.sizes[0] || sizeof(int) != header.sizes[1])
+    error(1, "Binary potential file %s was written on an incompatible machine", filename);
+  if ((3 != header.format && 4 != header.format) || header.len < 0 || header.idxlen < 0)
+    error(1, "Corrupt header in binary potential file %s", filename);
+
+  read_binary(pt->begin, sizeof(double), size, filename, infile);
+  read_binary(pt->end, sizeof(double), size, filename, infile);
+  read_binary(pt->step, sizeof(double), size, filename, infile);
+  read_binary(pt->invstep, sizeof(double), size, filename, infile);
+  read_binary(pt->first, sizeof(int), size, filename, infile);
+  read_binary(pt->last, sizeof(int), size, filename, infile);
+
+  /* allocate the function table */
+  pt->len = header.len;
+  pt->idxlen = header.idxlen;
+  pt->table = (double *)malloc(pt->len * sizeof(double));
+  reg_for_free(pt->table, "pt->table");
+  pt->xcoord = (double *)malloc(pt->len * sizeof(double));
+  reg_for_free(pt->xcoord, "pt->xcoord");
+  pt->d2tab = (double *)malloc(pt->len * sizeof(double));
+  reg_for_free(pt->d2tab, "pt->d2tab");
+  pt->idx = (int *)malloc(pt->len * sizeof(int));
+  reg_for_free(pt->idx, "pt->idx");
+  if ((NULL == pt->table) || (NULL == pt->xcoord) || (NULL == pt->idx) || (NULL == pt->d2tab))
+    error(1, "Cannot allocate memory for potential table");
+  if (pt->idxlen > pt->len)
+    error(1, "Corrupt header in binary potential file %s", filename);
+
+  read_binary(pt->table, sizeof(double), pt->len, filename, infile);
+  read_binary(pt->xcoord, sizeof(double), pt->len, filename, infile);
+  read_binary(pt->idx, sizeof(int), pt->idxlen, filename, infile);
+  for (i = 0; i < pt->len; i++)
+    pt->d2tab[i] = 0.0;
+  for (i = pt->idxlen; i < pt->len; i++)
+    pt->idx[i] = 0;
+
+  for (i = 0; i < size; i++)
+    if (pt->first[i] < 2 || pt->last[i] < pt->first[i] || pt->last[i] >= pt->len)
+      error(1, "Corrupt potential table in binary potential file %s", filename);
+  for (i = 0; i < pt->idxlen; i++)
+    if (pt->idx[i] < 0 || pt->idx[i] >= pt->len)
+      error(1, "Corrupt potential table in binary potential file %s", filename);
+
+  format = header.format;
+  printf(" - Binary table of a format %d potential with %d values\n", format, pt->len);
+
+  init_calc_table(pt, &calc_pot);
+
+  return;
+}
+
 #endif /* APOT */
 
 /****************************************************************
@@ -2000,6 +2192,108 @@ void init_calc_table(pot_table_t *optt, pot_table_t *calct)
 
 #ifdef APOT
 
+/****************************************************************
+ *
+ * value of analytic potential col at r, including the cutoff
+ *
+ ****************************************************************/
+
+static double apot_sample(int col, double r, double h)
+{
+  double f;
+
+  apot_table.fvalue[col] (r, apot_table.values[col], &f);
+
+  return smooth_pot[col] ? f * cutoff(r, apot_table.end[col], h) : f;
+}
+
+/****************************************************************
+ *
+ * largest deviation between analytic potential col and the
+ * cubic spline through n equidistant samples, checked at the
+ * midpoints of all intervals
+ *
+ ****************************************************************/
+
+static double apot_sampling_error(int col, int n, double *y, double *d2)
+{
+  int   j;
+  double d, f, s, err = 0.0, h = 0.0;
+  double step = (calc_pot.end[col] - calc_pot.begin[col]) / (n - 1);
+
+  if (smooth_pot[col])
+    h = apot_table.values[col][apot_table.n_par[col] - 1];
+
+  for (j = 0; j < n; j++)
+    y[j] = apot_sample(col, calc_pot.begin[col] + j * step, h);
+
+  /* same boundary conditions as in calc_forces() */
+  spline_ed(step, y, n, 1e30, 0.0, d2);
+
+  for (j = 0; j < n - 1; j++) {
+    f = apot_sample(col, calc_pot.begin[col] + (j + 0.5) * step, h);
+    s = 0.5 * (y[j] + y[j + 1]) - step * step / 16.0 * (d2[j] + d2[j + 1]);
+    d = fabs(f - s);
+    if (isnan(d))
+      return d;
+    err = MAX(err, d);
+  }
+
+  return err;
+}
+
+/****************************************************************
+ *
+ * init_apot_sampling: lay out the sampling points of calc_pot
+ *
+ * Every column gets APOT_STEPS equidistant points by default.
+ * With apot_tolerance > 0 it gets the smallest number of points,
+ * but at least APOT_MIN_STEPS, that reproduces the function with
+ * the starting parameters within apot_tolerance.
+ * The columns are stored without gaps, so the whole table shrinks,
+ * and calc_pot.idx is rebuilt to list the new sampling points.
+ *
+ ****************************************************************/
+
+void init_apot_sampling(void)
+{
+  int   i, j, n, x = 0, k = 0;
+  double y[APOT_STEPS], d2[APOT_STEPS];
+
+  for (i = 0; i < calc_pot.ncols; i++) {
+    n = APOT_STEPS;
+    if (apot_tolerance > 0.0) {
+      n = APOT_MIN_STEPS;
+      while (n < APOT_STEPS && !(apot_sampling_error(i, n, y, d2) <= apot_tolerance))
+	n = MIN(APOT_STEPS, n + n / 4);
+      if (n == APOT_STEPS && !(apot_sampling_error(i, n, y, d2) <= apot_tolerance))
+	warning("Potential %d (%s) is not sampled within apot_tolerance with %d points.\n", i,
+	  apot_table.names[i], APOT_STEPS);
+    }
+
+    /* gradients at both ends, natural spline at the beginning */
+    calc_pot.table[x] = 10e30;
+    calc_pot.table[x + 1] = 0.0;
+    calc_pot.first[i] = (x += 2);
+    calc_pot.last[i] = (x += n - 1);
+    x++;
+    calc_pot.step[i] = (calc_pot.end[i] - calc_pot.begin[i]) / (n - 1);
+    calc_pot.invstep[i] = 1.0 / calc_pot.step[i];
+    for (j = 0; j < n; j++) {
+      calc_pot.xcoord[calc_pot.first[i] + j] = calc_pot.begin[i] + j * calc_pot.step[i];
+      calc_pot.idx[k++] = calc_pot.first[i] + j;
+    }
+  }
+  calc_pot.idxlen = k;
+
+  if (apot_tolerance > 0.0)
+    printf("Sampling the analytic potentials with %d instead of %d points (apot_tolerance %g).\n",
+      x - 2 * calc_pot.ncols, calc_pot.ncols * APOT_STEPS, apot_tolerance);
+
+  /* only the used part has to be updated and broadcast */
+  calc_pot.len = x + ntypes + compnodes;
+}
+
 /****************************************************************
  *
  * update apot_table from opt_pot_table, including globals
@@ -2027,28 +2321,50 @@ void update_apot_table(double *xi)
 
 /****************************************************************
  *
- * update calc_pot.table from opt_pot.table, including globals
+ * copy the global parameters to their positions in opt_pot.table
  *
  ****************************************************************/
 
-void update_calc_table(double *xi_opt, double *xi_calc, int do_all)
+void copy_apot_globals(double *xi_opt)
 {
-  int   i, j, k, m, n, change;
-  double f, h = 0;
-  double *list, *val;
+  int   i, j, m, n;
 
-  val = xi_opt;
-  list = calc_list + 2;
-  /* copy global parameters to the right positions */
   if (have_globals) {
     for (i = 0; i < apot_table.globals; i++) {
       for (j = 0; j < apot_table.n_glob[i]; j++) {
 	m = apot_table.global_idx[i][j][0];
 	n = apot_table.global_idx[i][j][1];
-	*(val + opt_pot.first[m] + n) = *(val + global_idx + i);
+	*(xi_opt + opt_pot.first[m] + n) = *(xi_opt + global_idx + i);
       }
     }
   }
+}
+
+/****************************************************************
+ *
+ * update calc_pot.table from opt_pot.table, including globals
+ *
+ ****************************************************************/
+
+void update_calc_table(double *xi_opt, double *xi_calc, int do_all)
+{
+  int   i, j, k, n, change;
+#ifdef DEBUG
+  int   m;
+#endif /* DEBUG */
+  int   writer = 1;
+  double f, h = 0;
+  double *list, *val;
+
+#ifdef MPI_SHM
+  /* xi_calc is shared by all processes on a node, only one fills it */
+  writer = (0 == shm_id);
+#endif /* MPI_SHM */
+
+  val = xi_opt;
+  list = calc_list + 2;
+  /* copy global parameters to the right positions */
+  copy_apot_globals(xi_opt);
   for (i = 0; i < calc_pot.ncols; i++) {
     if (smooth_pot[i] && (do_all || !invar_pot[i])) {
       h = *(val + 1 + apot_table.n_par[i]);
@@ -2056,7 +2372,7 @@ void update_calc_table(double *xi_opt, double *xi_calc, int do_all)
 	error(1, "The cutoff parameter for potential %d is 0!", i);
     }
 
-    (*val) = apot_grad(calc_pot.begin[i], val + 2, apot_table.fvalue[i]);
+    apot_value_grad(i, calc_pot.begin[i], val + 2, &f, val);
     val += 2;
     /* check if something has changed */
     change = 0;
@@ -2066,11 +2382,23 @@ void update_calc_table(double *xi_opt, double *xi_calc, int do_all)
 	list[j] = val[j];
       }
     }
-    if (do_all || (change && !invar_pot[i])) {
-      for (j = 0; j < APOT_STEPS; j++) {
-	k = i * APOT_STEPS + (i + 1) * 2 + j;
-	apot_table.fvalue[i] (calc_pot.xcoord[k], val, &f);
-	*(xi_calc + k) = smooth_pot[i] ? f * cutoff(calc_pot.xcoord[k], apot_table.end[i], h) : f;
+    if (writer && (do_all || (change && !invar_pot[i]))) {
+      k = calc_pot.first[i];
+      n = calc_pot.last[i] - k + 1;
+      /* tabulate the whole column at once if possible */
+      if (NULL != apot_table.fbatch[i]) {
+	apot_table.fbatch[i] (calc_pot.xcoord + k, n, val, xi_calc + k);
+	if (smooth_pot[i])
+	  cutoff_batch(calc_pot.xcoord + k, n, apot_table.end[i], h, xi_calc + k);
+      }
+      for (j = 0; j < n; j++) {
+	k = calc_pot.first[i] + j;
+	if (NULL != apot_table.fbatch[i])
+	  f = *(xi_calc + k);
+	else {
+	  apot_table.fvalue[i] (calc_pot.xcoord[k], val, &f);
+	  *(xi_calc + k) = smooth_pot[i] ? f * cutoff(calc_pot.xcoord[k], apot_table.end[i], h) : f;
+	}
 	if (isnan(f) || isnan(*(xi_calc + k))) {
 #ifdef DEBUG
 	  error(0, "Potential value was nan or inf. Aborting.\n");
@@ -30,7 +30,12 @@
 
 #include "potfit.h"
 
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "elements.h"
+#include "expression.h"
 #include "functions.h"
 #include "potential.h"
 #include "splines.h"
@@ -38,6 +43,35 @@
 
 #define NPLOT 1000
 
+/* state of the background writer of the temporary potential file */
+static int pot_capture = 0;	/* write_pot_table writes into memory */
+static char *capt_buf = NULL;	/* snapshot formatted by write_pot_table */
+static size_t capt_len = 0;
+static char *temp_buf = NULL;	/* snapshot being written */
+static size_t temp_len = 0;
+static char *pend_buf = NULL;	/* newest snapshot waiting for temp_buf */
+static size_t pend_len = 0;
+static int temp_busy = 0;	/* a background write is running */
+static int temp_started = 0;	/* temp_thread has to be joined */
+static time_t temp_last = 0;	/* time of the last temporary potential */
+static pthread_t temp_thread;
+static pthread_mutex_t temp_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************
+ *
+ *  open_pot_file: open an output file for a potential table,
+ *	or a memory buffer for write_pot_temp()
+ *
+ ****************************************************************/
+
+static FILE *open_pot_file(char *filename)
+{
+  if (pot_capture)
+    return open_memstream(&capt_buf, &capt_len);
+
+  return fopen(filename, "w");
+}
+
 #ifdef COULOMB
 
 /****************************************************************
@@ -108,7 +142,7 @@ void write_pot_table0(apot_table_t *apt, char *filename)
   FILE *outfile;
 
   /* open file */
-  outfile = fopen(filename, "w");
+  outfile = open_pot_file(filename);
   if (NULL == outfile)
     error(1, "Could not open file %s\n", filename);
 
@@ -130,12 +164,14 @@ void write_pot_table0(apot_table_t *apt, char *filename)
 	fprintf(outfile, " %s-%s", elements[i], elements[j]);
 
 #if defined EAM || defined ADP || defined MEAM
-    /* transfer functions */
-    for (i = 0; i < ntypes; i++)
-      fprintf(outfile, " %s", elements[i]);
-    /* embedding functions */
-    for (i = 0; i < ntypes; i++)
-      fprintf(outfile, " %s", elements[i]);
+    if (embedding) {
+      /* transfer functions */
+      for (i = 0; i < ntypes; i++)
+	fprintf(outfile, " %s", elements[i]);
+      /* embedding functions */
+      for (i = 0; i < ntypes; i++)
+	fprintf(outfile, " %s", elements[i]);
+    }
 #endif /* EAM || ADP || MEAM */
 
 #ifdef ADP
@@ -264,6 +300,12 @@ void write_pot_table0(apot_table_t *apt, char *filename)
     if (i != (apt->number - 1))
       fprintf(outfile, "\n");
   }
+
+  /* write user-defined functions */
+  if (expression_count() > 0)
+    fprintf(outfile, "\n");
+  for (i = 0; i < expression_count(); i++)
+    fprintf(outfile, "function %s\n", expression_definition(i));
   fclose(outfile);
 
   return;
@@ -287,7 +329,7 @@ void write_pot_table3(pot_table_t *pt, char *filename)
     flag = 1;
 
   /* open file */
-  outfile = fopen(filename, "w");
+  outfile = open_pot_file(filename);
   if (NULL == outfile)
     error(1, "Could not open file %s\n", filename);
 
@@ -310,20 +352,22 @@ void write_pot_table3(pot_table_t *pt, char *filename)
       for (j = i; j < ntypes; j++)
 	fprintf(outfile, " %s-%s", elements[i], elements[j]);
 #if defined EAM || defined MEAM
-    /* transfer functions */
-    for (i = 0; i < ntypes; i++)
-      fprintf(outfile, " %s", elements[i]);
-    /* embedding functions */
-    for (i = 0; i < ntypes; i++)
-      fprintf(outfile, " %s", elements[i]);
+    if (embedding) {
+      /* transfer functions */
+      for (i = 0; i < ntypes; i++)
+	fprintf(outfile, " %s", elements[i]);
+      /* embedding functions */
+      for (i = 0; i < ntypes; i++)
+	fprintf(outfile, " %s", elements[i]);
 #ifdef TBEAM
-    /* transfer functions s-band */
-    for (i = 0; i < ntypes; i++)
-      fprintf(outfile, " %s", elements[i]);
-    /* embedding functions s-band */
-    for (i = 0; i < ntypes; i++)
-      fprintf(outfile, " %s", elements[i]);
+      /* transfer functions s-band */
+      for (i = 0; i < ntypes; i++)
+	fprintf(outfile, " %s", elements[i]);
+      /* embedding functions s-band */
+      for (i = 0; i < ntypes; i++)
+	fprintf(outfile, " %s", elements[i]);
 #endif /* TBEAM */
+    }
 #endif /* EAM || MEAM */
 #ifdef MEAM
     /* pre-anglpart */
@@ -386,7 +430,7 @@ void write_pot_table4(pot_table_t *pt, char *filename)
     flag = 1;
 
   /* open file */
-  outfile = fopen(filename, "w");
+  outfile = open_pot_file(filename);
   if (NULL == outfile)
     error(1, "Could not open file %s\n", filename);
 
@@ -409,20 +453,22 @@ void write_pot_table4(pot_table_t *pt, char *filename)
       for (j = i; j < ntypes; j++)
 	fprintf(outfile, " %s-%s", elements[i], elements[j]);
 #ifdef EAM
-    /* transfer functions */
-    for (i = 0; i < ntypes; i++)
-      fprintf(outfile, " %s", elements[i]);
-    /* embedding functions */
-    for (i = 0; i < ntypes; i++)
-      fprintf(outfile, " %s", elements[i]);
+    if (embedding) {
+      /* transfer functions */
+      for (i = 0; i < ntypes; i++)
+	fprintf(outfile, " %s", elements[i]);
+      /* embedding functions */
+      for (i = 0; i < ntypes; i++)
+	fprintf(outfile, " %s", elements[i]);
 #ifdef TBEAM
-    /* transfer functions s-band */
-    for (i = 0; i < ntypes; i++)
-      fprintf(outfile, " %s", elements[i]);
-    /* embedding functions s-band */
-    for (i = 0; i < ntypes; i++)
-      fprintf(outfile, " %s", elements[i]);
+      /* transfer functions s-band */
+      for (i = 0; i < ntypes; i++)
+	fprintf(outfile, " %s", elements[i]);
+      /* embedding functions s-band */
+      for (i = 0; i < ntypes; i++)
+	fprintf(outfile, " %s", elements[i]);
 #endif /* TBEAM */
+    }
 #endif /* EAM */
   }
   if (have_invar) {
@@ -458,6 +504,76 @@ void write_pot_table4(pot_table_t *pt, char *filename)
     fclose(outfile2);
 }
 
+/****************************************************************
+ *
+ *  write potential table in binary format (format 5)
+ *
+ *  The usual header is followed by the arrays of the table in
+ *  native byte order. Reading it back gives exactly the same
+ *  table without parsing any numbers.
+ *
+ ****************************************************************/
+
+static void write_binary(const void *data, size_t size, size_t n, char *filename, FILE *outfile)
+{
+  if (n > 0 && fwrite(data, size, n, outfile) != n)
+    error(1, "Could not write to file %s\n", filename);
+}
+
+void write_pot_table5(pot_table_t *pt, char *filename)
+{
+  FILE *outfile = NULL;
+  int   i;
+  binpot_header_t header;
+
+  /* open file */
+  outfile = fopen(filename, "wb");
+  if (NULL == outfile)
+    error(1, "Could not open file %s\n", filename);
+
+  /* write header */
+  fprintf(outfile, "#F 5 %d", pt->ncols);
+  fprintf(outfile, "\n#T %s", interaction_name);
+  if (have_elements) {
+    fprintf(outfile, "\n#C");
+    for (i = 0; i < ntypes; i++)
+      fprintf(outfile, " %s", elements[i]);
+  }
+  if (have_invar) {
+    fprintf(outfile, "\n#I");
+    for (i = 0; i < pt->ncols; i++)
+      fprintf(outfile, " %d", invar_pot[i]);
+  }
+  fprintf(outfile, "\n#G");
+  for (i = 0; i < pt->ncols; i++)
+    fprintf(outfile, " %d", gradient[i]);
+  fprintf(outfile, "\n#E\n");
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BINPOT_MAGIC, sizeof(header.magic));
+  header.version = BINPOT_VERSION;
+  header.sizes[0] = sizeof(double);
+  header.sizes[1] = sizeof(int);
+  header.format = format;
+  header.len = pt->len;
+  header.idxlen = pt->idxlen;
+
+  /* write data */
+  write_binary(&header, sizeof(header), 1, filename, outfile);
+  write_binary(pt->begin, sizeof(double), pt->ncols, filename, outfile);
+  write_binary(pt->end, sizeof(double), pt->ncols, filename, outfile);
+  write_binary(pt->step, sizeof(double), pt->ncols, filename, outfile);
+  write_binary(pt->invstep, sizeof(double), pt->ncols, filename, outfile);
+  write_binary(pt->first, sizeof(int), pt->ncols, filename, outfile);
+  write_binary(pt->last, sizeof(int), pt->ncols, filename, outfile);
+  write_binary(pt->table, sizeof(double), pt->len, filename, outfile);
+  write_binary(pt->xcoord, sizeof(double), pt->len, filename, outfile);
+  write_binary(pt->idx, sizeof(int), pt->idxlen, filename, outfile);
+
+  if (0 != fclose(outfile))
+    error(1, "Could not write to file %s\n", filename);
+}
+
 #endif /* APOT */
 
 /****************************************************************
@@ -675,105 +791,107 @@ void write_pot_table_imd(pot_table_t *pt, char *prefix)
   printf("IMD pair potential written to \t\t%s\n", filename);
 
 #if defined EAM || defined ADP || defined MEAM
-  /* write transfer function (over r^2) */
-  sprintf(filename, "%s_rho.imd.pt", prefix);
-  outfile = fopen(filename, "w");
-  if (NULL == outfile)
-    error(1, "Could not open file %s\n", filename);
+  if (embedding) {
+    /* write transfer function (over r^2) */
+    sprintf(filename, "%s_rho.imd.pt", prefix);
+    outfile = fopen(filename, "w");
+    if (NULL == outfile)
+      error(1, "Could not open file %s\n", filename);
 
-  /* write header */
-  fprintf(outfile, "#F 2 %d\n#E\n", ntypes * ntypes);
+    /* write header */
+    fprintf(outfile, "#F 2 %d\n#E\n", ntypes * ntypes);
 
-  /* write info block */
-  for (i = 0; i < ntypes; i++) {
-    for (j = 0; j < ntypes; j++) {
-      col1 = (ntypes * (ntypes + 1)) / 2 + j;
-      col2 = i * ntypes + j;
+    /* write info block */
+    for (i = 0; i < ntypes; i++) {
+      for (j = 0; j < ntypes; j++) {
+	col1 = (ntypes * (ntypes + 1)) / 2 + j;
+	col2 = i * ntypes + j;
 #ifdef APOT
-      r2begin[col2] = dsquare((plotmin == 0 ? 0.1 : plotmin));
+	r2begin[col2] = dsquare((plotmin == 0 ? 0.1 : plotmin));
 #else
-      /* Extrapolation possible  */
-      r2begin[col2] = dsquare(MAX(pt->begin[col1] - extend * pt->step[col1], 0));
+	/* Extrapolation possible  */
+	r2begin[col2] = dsquare(MAX(pt->begin[col1] - extend * pt->step[col1], 0));
 #endif /* APOT */
-      r2end[col2] = dsquare(pt->end[col1]);
-      r2step[col2] = (r2end[col2] - r2begin[col2]) / imdpotsteps;
-      fprintf(outfile, "%.16e %.16e %.16e\n", r2begin[col2], r2end[col2], r2step[col2]);
+	r2end[col2] = dsquare(pt->end[col1]);
+	r2step[col2] = (r2end[col2] - r2begin[col2]) / imdpotsteps;
+	fprintf(outfile, "%.16e %.16e %.16e\n", r2begin[col2], r2end[col2], r2step[col2]);
+      }
     }
-  }
-  fprintf(outfile, "\n");
+    fprintf(outfile, "\n");
 
-  /* write data */
-  for (i = 0; i < ntypes; i++) {
-    for (j = 0; j < ntypes; j++) {
-      col1 = (ntypes * (ntypes + 1)) / 2 + j;
-      col2 = i * ntypes + j;
-      r2 = r2begin[col2];
-      for (k = 0; k < imdpotsteps; k++) {
+    /* write data */
+    for (i = 0; i < ntypes; i++) {
+      for (j = 0; j < ntypes; j++) {
+	col1 = (ntypes * (ntypes + 1)) / 2 + j;
+	col2 = i * ntypes + j;
+	r2 = r2begin[col2];
+	for (k = 0; k < imdpotsteps; k++) {
 #ifdef APOT
-	apot_table.fvalue[col1] (sqrt(r2), apot_table.values[col1], &temp);
-	temp =
-	  smooth_pot[col1] ? temp * cutoff(sqrt(r2), apot_table.end[col1],
-	  apot_table.values[col1][apot_table.n_par[col1] - 1]) : temp;
-	fprintf(outfile, "%.16e\n", temp);
+	  apot_table.fvalue[col1] (sqrt(r2), apot_table.values[col1], &temp);
+	  temp =
+	    smooth_pot[col1] ? temp * cutoff(sqrt(r2), apot_table.end[col1],
+	    apot_table.values[col1][apot_table.n_par[col1] - 1]) : temp;
+	  fprintf(outfile, "%.16e\n", temp);
 #else
-	fprintf(outfile, "%.16e\n", splint_ne_lin(pt, pt->table, col1, sqrt(r2)));
+	  fprintf(outfile, "%.16e\n", splint_ne_lin(pt, pt->table, col1, sqrt(r2)));
 #endif
-	r2 += r2step[col2];
+	  r2 += r2step[col2];
+	}
+	fprintf(outfile, "%.16e\n", 0.0);
+	fprintf(outfile, "\n");
       }
-      fprintf(outfile, "%.16e\n", 0.0);
-      fprintf(outfile, "\n");
     }
-  }
-  fclose(outfile);
-  printf("IMD transfer function written to \t%s\n", filename);
+    fclose(outfile);
+    printf("IMD transfer function written to \t%s\n", filename);
 
-  /* write embedding function (over r) */
-  sprintf(filename, "%s_F.imd.pt", prefix);
-  outfile = fopen(filename, "w");
-  if (NULL == outfile)
-    error(1, "Could not open file %s\n", filename);
+    /* write embedding function (over r) */
+    sprintf(filename, "%s_F.imd.pt", prefix);
+    outfile = fopen(filename, "w");
+    if (NULL == outfile)
+      error(1, "Could not open file %s\n", filename);
 
-  /* write header */
-  fprintf(outfile, "#F 2 %d\n#E\n", ntypes);
+    /* write header */
+    fprintf(outfile, "#F 2 %d\n#E\n", ntypes);
 
-  /* write info block */
-  for (i = 0; i < ntypes; i++) {
-    col1 = (ntypes * (ntypes + 3)) / 2 + i;
+    /* write info block */
+    for (i = 0; i < ntypes; i++) {
+      col1 = (ntypes * (ntypes + 3)) / 2 + i;
 #ifdef APOT
-    r2begin[i] = 0;
-    r2end[i] = pt->end[col1];
+      r2begin[i] = 0;
+      r2end[i] = pt->end[col1];
 #else
-    /* pad with zeroes */
-    r2begin[i] = pt->begin[col1] - extend * pt->step[col1];
-    /* extrapolation */
-    r2end[i] = pt->end[col1] + extend * pt->step[col1];
+      /* pad with zeroes */
+      r2begin[i] = pt->begin[col1] - extend * pt->step[col1];
+      /* extrapolation */
+      r2end[i] = pt->end[col1] + extend * pt->step[col1];
 #endif /* APOT */
-    r2step[i] = (r2end[i] - r2begin[i]) / imdpotsteps;
-    fprintf(outfile, "%.16e %.16e %.16e\n", r2begin[i], r2end[i], r2step[i]);
-  }
-  fprintf(outfile, "\n");
+      r2step[i] = (r2end[i] - r2begin[i]) / imdpotsteps;
+      fprintf(outfile, "%.16e %.16e %.16e\n", r2begin[i], r2end[i], r2step[i]);
+    }
+    fprintf(outfile, "\n");
 
-  /* write data */
-  for (i = 0; i < ntypes; i++) {
-    r2 = r2begin[i];
-    col1 = (ntypes * (ntypes + 3)) / 2 + i;
-    root = (pt->begin[col1] > 0.0) ? pt->table[pt->first[col1]] / sqrt(pt->begin[col1]) : 0.0;
-    root += (pt->end[col1] < 0.0) ? pt->table[pt->last[col1]] / sqrt(-pt->end[col1]) : 0.0;
-    for (k = 0; k <= imdpotsteps; k++) {
+    /* write data */
+    for (i = 0; i < ntypes; i++) {
+      r2 = r2begin[i];
+      col1 = (ntypes * (ntypes + 3)) / 2 + i;
+      root = (pt->begin[col1] > 0.0) ? pt->table[pt->first[col1]] / sqrt(pt->begin[col1]) : 0.0;
+      root += (pt->end[col1] < 0.0) ? pt->table[pt->last[col1]] / sqrt(-pt->end[col1]) : 0.0;
+      for (k = 0; k <= imdpotsteps; k++) {
 #ifdef APOT
-      apot_table.fvalue[col1] (r2, apot_table.values[col1], &temp);
+	apot_table.fvalue[col1] (r2, apot_table.values[col1], &temp);
 #else
-      temp = splint_ne_lin(pt, pt->table, col1, r2);
-      temp2 = r2 - pt->end[col1];
-      temp += (temp2 > 0.0) ? 5e2 * (temp2 * temp2 * temp2) : 0.0;
+	temp = splint_ne_lin(pt, pt->table, col1, r2);
+	temp2 = r2 - pt->end[col1];
+	temp += (temp2 > 0.0) ? 5e2 * (temp2 * temp2 * temp2) : 0.0;
 #endif /* APOT */
-      fprintf(outfile, "%.16e\n", temp);
-      r2 += r2step[i];
+	fprintf(outfile, "%.16e\n", temp);
+	r2 += r2step[i];
+      }
+      fprintf(outfile, "\n");
     }
-    fprintf(outfile, "\n");
+    fclose(outfile);
+    printf("IMD embedding function written to \t%s\n", filename);
   }
-  fclose(outfile);
-  printf("IMD embedding function written to \t%s\n", filename);
 #endif /* EAM || ADP */
 
 #ifdef ADP
@@ -1115,23 +1233,25 @@ void write_plotpot_pair(pot_table_t *pt, char *filename)
       k++;
     }
 #if defined EAM || defined ADP || defined MEAM
-  for (i = paircol; i < paircol + ntypes; i++) {
-    r = pt->begin[i];
-    r_step = (pt->end[i] - pt->begin[i]) / (NPLOT - 1);
-    for (l = 0; l < NPLOT - 1; l++) {
-      fprintf(outfile, "%e %e\n", r, splint_ne(pt, pt->table, i, r));
-      r += r_step;
+  if (embedding) {
+    for (i = paircol; i < paircol + ntypes; i++) {
+      r = pt->begin[i];
+      r_step = (pt->end[i] - pt->begin[i]) / (NPLOT - 1);
+      for (l = 0; l < NPLOT - 1; l++) {
+	fprintf(outfile, "%e %e\n", r, splint_ne(pt, pt->table, i, r));
+	r += r_step;
+      }
+      fprintf(outfile, "%e %e\n\n\n", r, 0.0);
     }
-    fprintf(outfile, "%e %e\n\n\n", r, 0.0);
-  }
-  for (i = paircol + ntypes; i < paircol + 2 * ntypes; i++) {
-    r = pt->begin[i];
-    r_step = (pt->end[i] - pt->begin[i]) / (NPLOT - 1);
-    for (l = 0; l < NPLOT; l++) {
-      fprintf(outfile, "%e %e\n", r, splint_ne(pt, pt->table, i, r));
-      r += r_step;
+    for (i = paircol + ntypes; i < paircol + 2 * ntypes; i++) {
+      r = pt->begin[i];
+      r_step = (pt->end[i] - pt->begin[i]) / (NPLOT - 1);
+      for (l = 0; l < NPLOT; l++) {
+	fprintf(outfile, "%e %e\n", r, splint_ne(pt, pt->table, i, r));
+	r += r_step;
+      }
+      fprintf(outfile, "\n\n\n");
     }
-    fprintf(outfile, "\n\n\n");
   }
 #endif
 #ifdef MEAM
@@ -1409,6 +1529,13 @@ void write_pot_table_lammps(pot_table_t *pt)
   int   k = 0, l;
   double drho, dr, r, temp;
 
+#ifdef PAIR_KERNEL
+  if (!embedding) {
+    printf("Potential in LAMMPS format is not available for pair potentials in EAM binaries.\n");
+    return;
+  }
+#endif /* PAIR_KERNEL */
+
   /* open file */
   if (strcmp(output_prefix, "") != 0)
     sprintf(filename, "%s.lammps.%s", output_prefix, interaction_name);
@@ -1585,24 +1712,26 @@ void write_altplot_pair(pot_table_t *pt, char *filename)
       k++;
     }
 #if defined EAM || defined MEAM
-  j = k;
-  for (i = j; i < j + ntypes; i++) {
-    r = rmin;
-    for (l = 0; l < NPLOT - 1; l++) {
-      fprintf(outfile, "%e %e\n", r, r <= pt->end[i] ? splint_ne(pt, pt->table, i, r) : 0);
-      r += r_step;
+  if (embedding) {
+    j = k;
+    for (i = j; i < j + ntypes; i++) {
+      r = rmin;
+      for (l = 0; l < NPLOT - 1; l++) {
+	fprintf(outfile, "%e %e\n", r, r <= pt->end[i] ? splint_ne(pt, pt->table, i, r) : 0);
+	r += r_step;
+      }
+      fprintf(outfile, "%e %e\n\n\n", r, 0.0);
     }
-    fprintf(outfile, "%e %e\n\n\n", r, 0.0);
-  }
-  for (i = j + ntypes; i < j + 2 * ntypes; i++) {
-    r = pt->begin[i];
-    r_step = (pt->end[i] - pt->begin[i]) / (NPLOT - 1);
-    for (l = 0; l < NPLOT; l++) {
-      temp = splint_ne(pt, pt->table, i, r);
-      fprintf(outfile, "%e %e\n", r, temp);
-      r += r_step;
+    for (i = j + ntypes; i < j + 2 * ntypes; i++) {
+      r = pt->begin[i];
+      r_step = (pt->end[i] - pt->begin[i]) / (NPLOT - 1);
+      for (l = 0; l < NPLOT; l++) {
+	temp = splint_ne(pt, pt->table, i, r);
+	fprintf(outfile, "%e %e\n", r, temp);
+	r += r_step;
+      }
+      fprintf(outfile, "\n\n\n");
     }
-    fprintf(outfile, "\n\n\n");
   }
 #endif /* EAM || MEAM */
 #ifdef MEAM
@@ -1677,40 +1806,44 @@ void write_pairdist(pot_table_t *pt, char *filename)
 	if (neigh->r < pt->end[col])
 	  freq[neigh->slot[0]]++;
 #ifdef EAM
-	/* transfer function */
-	col = paircol + typ2;
-	if (neigh->r < pt->end[col])
-	  freq[neigh->slot[1]]++;
+	if (embedding) {
+	  /* transfer function */
+	  col = paircol + typ2;
+	  if (neigh->r < pt->end[col])
+	    freq[neigh->slot[1]]++;
+	}
 #endif /* EAM */
       }
 #ifdef EAM
-      /* embedding function - get index first */
-      col = paircol + ntypes + typ1;
-      if (format == 3) {
-	rr = atom->rho - pt->begin[col];
+      if (embedding) {
+	/* embedding function - get index first */
+	col = paircol + ntypes + typ1;
+	if (format == 3) {
+	  rr = atom->rho - pt->begin[col];
 #ifdef RESCALE
-	if (rr < 0.0)
-	  error(1, "short distance");
-	j = (int)(rr * pt->invstep[col]) + pt->first[col];
+	  if (rr < 0.0)
+	    error(1, "short distance");
+	  j = (int)(rr * pt->invstep[col]) + pt->first[col];
 #else
-	if (rr < 0.0)
-	  rr = 0.0;		/* extrapolation */
-	j = MIN((int)(rr * pt->invstep[col]) + pt->first[col], pt->last[col]);
+	  if (rr < 0.0)
+	    rr = 0.0;		/* extrapolation */
+	  j = MIN((int)(rr * pt->invstep[col]) + pt->first[col], pt->last[col]);
 #endif /* RESCALE */
-      } else {			/* format ==4 */
-	rr = atom->rho;
-	k = pt->first[col];
-	l = pt->last[col];
-	while (l - k > 1) {
-	  j = (k + l) >> 1;
-	  if (pt->xcoord[j] > rr)
-	    l = j;
-	  else
-	    k = j;
+	} else {			/* format ==4 */
+	  rr = atom->rho;
+	  k = pt->first[col];
+	  l = pt->last[col];
+	  while (l - k > 1) {
+	    j = (k + l) >> 1;
+	    if (pt->xcoord[j] > rr)
+	      l = j;
+	    else
+	      k = j;
+	  }
+	  j = k;
 	}
-	j = k;
+	freq[j]++;
       }
-      freq[j]++;
 #endif /* EAM */
     }
   }
@@ -1742,3 +1875,119 @@ void write_imd_data_pair(FILE *outfile, char *string, int offset, int y)
 }
 
 #endif /* APOT */
+
+/****************************************************************
+ *
+ *  background writing of the temporary potential file
+ *
+ *  write_pot_temp() formats the potential into memory, which is
+ *  fast and consistent with the current parameters. A separate
+ *  thread writes the buffer to <tempfile>.tmp and renames it to
+ *  tempfile, so the optimizer does not wait for the file system
+ *  and tempfile is always complete. If the previous file is still
+ *  being written, the new snapshot is kept pending and written
+ *  when the running write has finished; a newer snapshot replaces
+ *  a pending one. With tempfile_interval > 0 at most one snapshot
+ *  is taken per interval.
+ *
+ ****************************************************************/
+
+static void *temp_writer(void *arg)
+{
+  char  tmpname[260];
+  int   ok;
+  FILE *outfile;
+
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", tempfile);
+  while (1) {
+    outfile = fopen(tmpname, "w");
+    ok = (NULL != outfile);
+    if (ok) {
+      ok = (fwrite(temp_buf, 1, temp_len, outfile) == temp_len);
+      ok = (0 == fflush(outfile)) && ok;
+      ok = (0 == fsync(fileno(outfile))) && ok;
+      ok = (0 == fclose(outfile)) && ok;
+    }
+    if (ok && 0 != rename(tmpname, tempfile))
+      ok = 0;
+    if (!ok)
+      warning("Could not write temporary potential file %s\n", tempfile);
+
+    free(temp_buf);
+
+    /* continue with the snapshot taken in the meantime */
+    pthread_mutex_lock(&temp_mutex);
+    temp_buf = pend_buf;
+    temp_len = pend_len;
+    pend_buf = NULL;
+    pend_len = 0;
+    if (NULL == temp_buf) {
+      temp_busy = 0;
+      pthread_mutex_unlock(&temp_mutex);
+      break;
+    }
+    pthread_mutex_unlock(&temp_mutex);
+  }
+
+  return NULL;
+}
+
+/* wait for a running background write */
+void finish_pot_temp(void)
+{
+  if (temp_started) {
+    pthread_join(temp_thread, NULL);
+    temp_started = 0;
+  }
+}
+
+/* write the temporary potential, force = 1 waits for a running write
+   and ignores tempfile_interval */
+#ifdef APOT
+void write_pot_temp(apot_table_t *pt, int force)
+#else
+void write_pot_temp(pot_table_t *pt, int force)
+#endif /* APOT */
+{
+  time_t now = time(NULL);
+
+  if (*tempfile == '\0')
+    return;
+  if (!force && tempfile_interval > 0 && difftime(now, temp_last) < tempfile_interval)
+    return;
+
+  pot_capture = 1;
+  write_pot_table(pt, tempfile);
+  pot_capture = 0;
+  temp_last = now;
+
+  pthread_mutex_lock(&temp_mutex);
+  /* this snapshot is newer than a pending one */
+  free(pend_buf);
+  pend_buf = NULL;
+  pend_len = 0;
+  if (temp_busy && !force) {
+    pend_buf = capt_buf;
+    pend_len = capt_len;
+    capt_buf = NULL;
+    capt_len = 0;
+    pthread_mutex_unlock(&temp_mutex);
+    return;
+  }
+  pthread_mutex_unlock(&temp_mutex);
+  finish_pot_temp();
+
+  temp_buf = capt_buf;
+  temp_len = capt_len;
+  capt_buf = NULL;
+  capt_len = 0;
+  temp_busy = 1;
+  if (0 != pthread_create(&temp_thread, NULL, temp_writer, NULL)) {
+    /* write it ourselves */
+    temp_writer(NULL);
+    return;
+  }
+  temp_started = 1;
+
+  return;
+}
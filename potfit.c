@@ -34,6 +34,7 @@
 
 #include <time.h>
 
+#include "checkpoint.h"
 #include "config.h"
 #include "functions.h"
 #include "optimize.h"
@@ -52,6 +53,12 @@ int main(int argc, char **argv)
   int   i;
   double *force, tot;
   time_t t_begin = 0, t_end = 0;
+#ifndef APOT
+  char  binpot[sizeof(endpot) + 4];
+#endif /* !APOT */
+
+  /* default force kernel, the #T line of the potential file may select another one */
+  set_force_kernel(0);
 
 #ifdef MPI
   /* initialize the MPI communication */
@@ -120,6 +127,10 @@ int main(int argc, char **argv)
     }
 #undef R_SIZE
 #undef RAND_MAX
+
+    /* continue an interrupted fit, overwrites potential and RNG state */
+    if (restart)
+      read_checkpoint();
   }
   /* myid == 0 */
 #ifdef MPI
@@ -163,6 +174,9 @@ int main(int argc, char **argv)
   MPI_Bcast(opt_pot.table, ndimtot, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 #endif /* MPI */
   update_calc_table(opt_pot.table, calc_pot.table, 1);
+#ifdef MPI_SHM
+  MPI_Barrier(shm_comm);
+#endif /* MPI_SHM */
 #endif /* APOT */
 
   /* Select correct spline interpolation and other functions */
@@ -210,6 +224,8 @@ int main(int argc, char **argv)
 #endif /* EVO */
       printf("\nStarting powell minimization ...\n");
       powell_lsq(opt_pot.table);
+      /* the last temporary potential has to be complete */
+      finish_pot_temp();
       printf("\nFinished powell minimization, calculating errors ...\n");
     } else if (0 == ndim) {
       printf("\nOptimization disabled due to 0 free parameters. Calculating errors.\n");
@@ -220,6 +236,11 @@ int main(int argc, char **argv)
 
 #ifdef APOT
     tot = calc_forces(opt_pot.table, force, 0);
+#ifdef PAIR
+    /* the tables are not updated while evaluating the potentials directly */
+    if (apot_direct)
+      update_calc_table(opt_pot.table, calc_pot.table, 1);
+#endif /* PAIR */
     write_pot_table(&apot_table, endpot);
 #else /* APOT */
     tot = calc_forces(calc_pot.table, force, 0);
@@ -227,6 +248,13 @@ int main(int argc, char **argv)
 #endif /* APOT */
     printf("\nPotential in format %d written to file \t%s\n", format, endpot);
 #ifndef APOT
+    /* binary copy for fast reading */
+    if (1 == write_binpot) {
+      snprintf(binpot, sizeof(binpot), "%s.bin", endpot);
+      write_pot_table5(&opt_pot, binpot);
+      printf("Potential in format 5 written to file \t%s\n", binpot);
+    }
+
     /* then we can also write format 4 */
     if (format == 3) {
       sprintf(endpot, "%s_4", endpot);
@@ -298,11 +326,18 @@ void error(int done, const char *msg, ...)
   fflush(stderr);
   if (done == 1) {
 #ifdef MPI
+#ifdef MPI_SHM
+    /* other processes of this node might wait for us in a barrier */
+    fprintf(stderr, "\n");
+    fflush(stderr);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+#else
     double *force = NULL;
     /* go wake up other threads */
     calc_forces(calc_pot.table, force, 1);
     fprintf(stderr, "\n");
     shutdown_mpi();
+#endif /* MPI_SHM */
 #endif /* MPI */
     fprintf(stderr, "\n");
     exit(EXIT_FAILURE);
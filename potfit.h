@@ -65,8 +65,14 @@
 #define EAM
 #endif /* TBEAM && !EAM */
 
+/* EAM binaries can also evaluate pair potentials, see forces.c */
+#if defined EAM && !defined TBEAM && !defined COULOMB
+#define PAIR_KERNEL
+#endif /* EAM && !TBEAM && !COULOMB */
+
 #ifdef APOT
 #define APOT_STEPS 500		/* number of sampling points for analytic pot */
+#define APOT_MIN_STEPS 50	/* minimal number of points with apot_tolerance */
 #define APOT_PUNISH 10e6	/* general value for apot punishments */
 #endif /* APOT */
 
@@ -172,10 +178,19 @@ EXTERN MPI_Datatype MPI_ANGL;
 #endif
 EXTERN MPI_Datatype MPI_STENS;
 EXTERN MPI_Datatype MPI_VECTOR;
+#ifdef MPI_SHM
+EXTERN MPI_Comm shm_comm;	/* processes sharing memory on one node */
+EXTERN MPI_Comm head_comm;	/* first process of every node */
+EXTERN int shm_id INIT(0);	/* rank within shm_comm */
+EXTERN int shm_cpus INIT(1);	/* number of processes in shm_comm */
+#endif /* MPI_SHM */
 #endif /* MPI */
 
 /* general settings (from parameter file) */
+EXTERN char checkpointfile[255] INIT("\0");	/* file for optimizer checkpoints */
+EXTERN double checkpoint_interval INIT(60.0);	/* minimal time between checkpoints in seconds */
 EXTERN char config[255] INIT("\0");	/* file with atom configuration */
+EXTERN char config_cache[255] INIT("\0");	/* cache file for neighbor lists */
 EXTERN char distfile[255] INIT("\0");	/* file for distributions */
 EXTERN char endpot[255] INIT("\0");	/* file for end potential */
 EXTERN char flagfile[255] INIT("\0");	/* break if file exists */
@@ -187,9 +202,11 @@ EXTERN char plotfile[255] INIT("\0");	/* file for plotting */
 EXTERN char plotpointfile[255] INIT("\0");	/* write points for plotting */
 EXTERN char startpot[255] INIT("\0");	/* file with start potential */
 EXTERN char tempfile[255] INIT("\0");	/* backup potential file */
+EXTERN double tempfile_interval INIT(0.0);	/* minimal time between backups in seconds */
 EXTERN int imdpotsteps INIT(1000);	/* resolution of IMD potential */
 EXTERN int ntypes INIT(-1);	/* number of atom types */
 EXTERN int opt INIT(0);		/* optimization flag */
+EXTERN int restart INIT(0);	/* restart from checkpointfile */
 EXTERN int seed INIT(4);	/* seed for RNG */
 EXTERN int usemaxch INIT(0);	/* use maximal changes file */
 EXTERN int write_output_files INIT(0);
@@ -197,6 +214,10 @@ EXTERN int write_lammps_files INIT(0);
 EXTERN int write_pair INIT(0);
 EXTERN int writeimd INIT(0);
 EXTERN int write_lammps INIT(0);	/* write output also in LAMMPS format */
+EXTERN int write_csv INIT(0);	/* write error reports also as CSV */
+#ifndef APOT
+EXTERN int write_binpot INIT(0);	/* write output also in binary format */
+#endif /* !APOT */
 #ifdef EVO
 EXTERN double evo_threshold INIT(1.e-6);
 #else /* EVO */
@@ -208,6 +229,8 @@ EXTERN double extend INIT(2.0);	/* how far should one extend imd pot */
 #ifdef APOT
 EXTERN int compnodes INIT(0);	/* how many additional composition nodes */
 EXTERN int enable_cp INIT(0);	/* switch chemical potential on/off */
+EXTERN int apot_direct INIT(0);	/* evaluate pair potentials without tables (0/1/2=auto) */
+EXTERN double apot_tolerance INIT(0.0);	/* choose the sampling points per column (0 = off) */
 EXTERN double apot_punish_value INIT(0.0);
 EXTERN double plotmin INIT(0.0);	/* minimum for plotfile */
 #endif /* APOT */
@@ -330,6 +353,7 @@ EXTERN int init_done INIT(0);
 EXTERN int plot INIT(0);	/* plot output flag */
 #if defined EAM || defined ADP || defined MEAM
 EXTERN double *lambda;		/* embedding energy slope... */
+EXTERN int embedding INIT(1);	/* does the force kernel use rho and F? */
 #endif
 EXTERN double *maxchange;	/* Maximal permissible change */
 EXTERN dsfmt_t dsfmt;		/* random number generator */
@@ -339,10 +363,14 @@ EXTERN char *component[6];	/* componentes of vectors and tensors */
 #ifdef COULOMB
 EXTERN double dp_eps INIT(14.40);	/* this is e^2/(4*pi*epsilon_0) in eV A */
 EXTERN double dp_cut INIT(10.0);	/* cutoff-radius for long-range interactions */
+EXTERN double dp_ewald INIT(0.0);	/* accuracy of the Ewald sum, 0 = real space only */
+EXTERN vector *boxes;		/* box vectors of all configurations */
 #endif /* COULOMB */
 #ifdef DIPOLE
 EXTERN double dp_tol INIT(1.0e-7);	/* dipole iteration precision */
 EXTERN double dp_mix INIT(0.2);	/* mixing parameter (other than that one in IMD) */
+EXTERN int dp_solver INIT(1);	/* 0 = mixing iteration, 1 = conjugate gradients */
+EXTERN double dp_tensor_mem INIT(0.0);	/* MB for stored dipole tensors, 0 = off */
 #endif /* DIPOLE */
 
 /****************************************************************
@@ -351,7 +379,7 @@ EXTERN double dp_mix INIT(0.2);	/* mixing parameter (other than that one in IMD)
  *
  ****************************************************************/
 
-EXTERN double calc_forces(double *, double *, int);
+EXTERN double (*calc_forces) (double *, double *, int);
 EXTERN double (*splint) (pot_table_t *, double *, int, double);
 EXTERN double (*splint_grad) (pot_table_t *, double *, int, double);
 EXTERN double (*splint_comb) (pot_table_t *, double *, int, double, double *);
@@ -384,34 +412,35 @@ void  read_paramfile(FILE *);
 void  set_forces();
 void  init_forces();
 void  set_force_vector_pointers();
+void  set_force_kernel(int);
+void  select_force_kernel(const char *);
 
 /* force routines for different potential models [force_xxx.c] */
-#ifdef PAIR
-EXTERN const char interaction_name[5] INIT("PAIR");
-#elif defined EAM && !defined COULOMB
-#ifndef TBEAM
-EXTERN const char interaction_name[4] INIT("EAM");
-#else
-EXTERN const char interaction_name[6] INIT("TBEAM");
-#endif /* TBEAM */
+EXTERN const char *interaction_name;	/* name of the selected model */
+EXTERN int force_kernel INIT(0);	/* index of the selected model */
+#if defined PAIR || defined PAIR_KERNEL
+double calc_forces_pair(double *, double *, int);
+#endif /* PAIR || PAIR_KERNEL */
+#if defined EAM && !defined COULOMB
+double calc_forces_eam(double *, double *, int);
 #elif defined ADP
-EXTERN const char interaction_name[4] INIT("ADP");
+double calc_forces_adp(double *, double *, int);
 #elif defined COULOMB && !defined EAM
-EXTERN const char interaction_name[7] INIT("ELSTAT");
+double calc_forces_elstat(double *, double *, int);
 #elif defined COULOMB && defined EAM
-EXTERN const char interaction_name[11] INIT("EAM_ELSTAT");
+double calc_forces_eam_elstat(double *, double *, int);
 #elif defined MEAM
-EXTERN const char interaction_name[5] INIT("MEAM");
+double calc_forces_meam(double *, double *, int);
 #elif defined STIWEB
-EXTERN const char interaction_name[7] INIT("STIWEB");
+double calc_forces_stiweb(double *, double *, int);
 void  update_stiweb_pointers(double *);
+void  init_stiweb_angles(void);
+int   stiweb_angle(int, neigh_t *, neigh_t *);
 #elif defined TERSOFF
-#ifdef TERSOFFMOD
-EXTERN const char interaction_name[11] INIT("TERSOFFMOD");
-#else
-EXTERN const char interaction_name[8] INIT("TERSOFF");
-#endif /* TERSOFFMOD */
+double calc_forces_tersoff(double *, double *, int);
 void  update_tersoff_pointers(double *);
+void  init_tersoff_angles(void);
+int   tersoff_angle(neigh_t *, neigh_t *);
 #endif /* interaction type */
 
 /* rescaling functions for EAM [rescale.c] */
@@ -428,6 +457,9 @@ void  broadcast_params(void);
 void  broadcast_neighbors(void);
 void  broadcast_angles(void);
 void  potsync(void);
+#ifdef MPI_SHM
+void *shm_alloc(int, int);
+#endif /* MPI_SHM */
 #endif /* MPI */
 
 #endif /* POTFIT_H */
@@ -47,6 +47,7 @@
 #endif /* ACML */
 
 #include "bracket.h"
+#include "checkpoint.h"
 #include "optimize.h"
 #include "potential.h"
 #include "utils.h"
@@ -57,6 +58,26 @@
 #define INNERLOOPS 801
 #define TOOBIG 10000
 
+/****************************************************************
+ *
+ *  read or write the state of the inner loop from/to a checkpoint
+ *
+ ****************************************************************/
+
+static void powell_checkpoint(FILE *ckpt, double *F, double *F3, int *m, int *n, double *fxi1,
+  double **d, double **gamma, double **lineqsys, double *p)
+{
+  checkpoint_data(ckpt, F, sizeof(double), 1);
+  checkpoint_data(ckpt, F3, sizeof(double), 1);
+  checkpoint_data(ckpt, m, sizeof(int), 1);
+  checkpoint_data(ckpt, n, sizeof(int), 1);
+  checkpoint_data(ckpt, fxi1, sizeof(double), mdim);
+  checkpoint_data(ckpt, &d[0][0], sizeof(double), ndim * ndim);
+  checkpoint_data(ckpt, &gamma[0][0], sizeof(double), mdim * ndim);
+  checkpoint_data(ckpt, &lineqsys[0][0], sizeof(double), ndim * ndim);
+  checkpoint_data(ckpt, p, sizeof(double), ndim);
+}
+
 void powell_lsq(double *xi)
 {
 #ifndef ACML
@@ -79,6 +100,7 @@ void powell_lsq(double *xi)
 #endif /* ACML */
   int  *perm_indx;		/* Keeps track of LU pivoting */
   int   breakflag;		/* Breakflag */
+  int   resume = 0;		/* resumed from checkpoint */
   double cond = 0.0;		/* Condition number dsysvx */
   double *p, *q;		/* Vectors needed in Powell's algorithm */
   double F, F2, F3 = 0, df, xi1, xi2;	/* Fn values, changes, steps ... */
@@ -89,6 +111,7 @@ void powell_lsq(double *xi)
   double ferror = 0.0;
   double berror = 0.0;		/* forward/backward error estimates */
   FILE *ff;			/* Exit flagfile */
+  FILE *ckpt;			/* checkpoint file */
 
   d = mat_double(ndim, ndim);
   gamma = mat_double(mdim, ndim);
@@ -113,17 +136,24 @@ void powell_lsq(double *xi)
   for (i = 0; i < ndimtot; i++)
     delta[i] = 0.0;
 
-  /* calculate the first force */
-  F = calc_forces(xi, fxi1, 0);
+  ckpt = checkpoint_resume(CKPT_POWELL);
+  if (NULL != ckpt) {
+    powell_checkpoint(ckpt, &F, &F3, &m, &n, fxi1, d, gamma, lineqsys, p);
+    checkpoint_end(ckpt);
+    resume = 1;
+  } else {
+    /* calculate the first force */
+    F = calc_forces(xi, fxi1, 0);
 #ifndef APOT
-  printf("%d %f %f %f %f %f %f %d\n", m, F, xi[0], xi[1], xi[2], xi[3], xi[4], fcalls);
-  fflush(stdout);
+    printf("%d %f %f %f %f %f %f %d\n", m, F, xi[0], xi[1], xi[2], xi[3], xi[4], fcalls);
+    fflush(stdout);
 #endif /* APOT */
 
-  if (F < NOTHING) {
-    printf("Error already too small to optimize, aborting ...\n");
-    return;			/* If F is less than nothing, */
-    /* what is there to do? */
+    if (F < NOTHING) {
+      printf("Error already too small to optimize, aborting ...\n");
+      return;			/* If F is less than nothing, */
+      /* what is there to do? */
+    }
   }
 
   (void)copy_vector(fxi1, force_xi, mdim);
@@ -133,46 +163,57 @@ void powell_lsq(double *xi)
 #endif /* APOT */
 
   do {				/*outer loop, includes recalculating gamma */
-    m = 0;
+    /* a resumed inner loop keeps its directions and gamma */
+    if (!resume) {
+      m = 0;
 
-    /* Init gamma */
-    i = gamma_init(gamma, d, xi, fxi1);
-    if (0 != i) {
+      /* Init gamma */
+      i = gamma_init(gamma, d, xi, fxi1);
+      if (0 != i) {
 #ifdef RESCALE
 #if defined EAM || defined ADP || defined MEAM
-      /* perhaps rescaling helps? - Last resort... */
-      warning("F does not depend on xi[%d], trying to rescale!\n", idx[i - 1]);
-      rescale(&opt_pot, 1.0, 1);
-      /* wake other threads and sync potentials */
-      F = calc_forces(xi, fxi1, 2);
-      i = gamma_init(gamma, d, xi, fxi1);
+	/* perhaps rescaling helps? - Last resort... */
+	warning("F does not depend on xi[%d], trying to rescale!\n", idx[i - 1]);
+	rescale(&opt_pot, 1.0, 1);
+	/* wake other threads and sync potentials */
+	F = calc_forces(xi, fxi1, 2);
+	i = gamma_init(gamma, d, xi, fxi1);
 #endif /* EAM */
 #endif /* RESCALE */
 
-      /* try again */
-      if (0 != i) {
-	/* ok, now this is serious, better exit cleanly */
+	/* try again */
+	if (0 != i) {
+	  /* ok, now this is serious, better exit cleanly */
 #ifndef APOT
-	write_pot_table(&opt_pot, tempfile);	/*emergency writeout */
-	warning("F does not depend on xi[%d], fit impossible!\n", idx[i - 1]);
+	  write_pot_temp(&opt_pot, 1);	/*emergency writeout */
+	  warning("F does not depend on xi[%d], fit impossible!\n", idx[i - 1]);
 #else
-	update_apot_table(xi);
-	write_pot_table(&apot_table, tempfile);
-	itemp = apot_table.idxpot[i - 1];
-	itemp2 = apot_table.idxparam[i - 1];
-	warning("F does not depend on the %d. parameter (%s) of the %d. potential.\n",
-	  itemp2 + 1, apot_table.param_name[itemp][itemp2], itemp + 1);
-	warning("Fit impossible!\n");
+	  update_apot_table(xi);
+	  write_pot_temp(&apot_table, 1);
+	  itemp = apot_table.idxpot[i - 1];
+	  itemp2 = apot_table.idxparam[i - 1];
+	  warning("F does not depend on the %d. parameter (%s) of the %d. potential.\n",
+	    itemp2 + 1, apot_table.param_name[itemp][itemp2], itemp + 1);
+	  warning("Fit impossible!\n");
 #endif /* APOT */
-	break;
+	  break;
+	}
       }
+      (void)lineqsys_init(gamma, lineqsys, fxi1, p, ndim, mdim);	/*init LES */
+      F3 = F;
     }
-    (void)lineqsys_init(gamma, lineqsys, fxi1, p, ndim, mdim);	/*init LES */
-    F3 = F;
+    resume = 0;
     breakflag = 0;
 
     /*inner loop - only calculate changed rows/lines in gamma */
     do {
+      /* save the state of the inner loop for a restart */
+      if (checkpoint_due()) {
+	ckpt = checkpoint_begin(CKPT_POWELL);
+	powell_checkpoint(ckpt, &F, &F3, &m, &n, fxi1, d, gamma, lineqsys, p);
+	checkpoint_end(ckpt);
+      }
+
       /* (a) solve linear equation */
 
       /* All in one driver routine */
@@ -308,10 +349,10 @@ void powell_lsq(double *xi)
     /* write temp file  */
     if (*tempfile != '\0') {
 #ifndef APOT
-      write_pot_table(&opt_pot, tempfile);	/*emergency writeout */
+      write_pot_temp(&opt_pot, 0);	/*emergency writeout */
 #else
       update_apot_table(xi);
-      write_pot_table(&apot_table, tempfile);
+      write_pot_temp(&apot_table, 0);
 #endif /* APOT */
     }
 
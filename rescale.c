@@ -56,6 +56,10 @@ double rescale(pot_table_t *pt, double upper, int flag)
   double fnval, pos, grad, a;
   double min = 1e100, max = -1e100;
 
+  /* nothing to rescale for pair potentials */
+  if (!embedding)
+    return 0.0;
+
   xi = pt->table;
   dimneuxi = pt->last[paircol + 2 * ntypes - 1] - pt->last[paircol + ntypes - 1];
   neuxi = (double *)malloc(dimneuxi * sizeof(double));
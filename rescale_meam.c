@@ -55,7 +55,7 @@ double rescale(pot_table_t *pt, double upper, int flag)
   atom_t *atom;
   neigh_t *neigh;
 
-  int   jj, kk, ijk;
+  int   ijk;
   angle_t *angle;
   neigh_t *neigh_j, *neigh_k;
 
@@ -162,31 +162,26 @@ double rescale(pot_table_t *pt, double upper, int flag)
       }				// END OF LOOP OVER NEIGHBORS
 
       // Loop over every angle formed by neighbors
-      // N(N-1)/2 possible combinations
+      // at most N(N-1)/2 possible combinations
       // Used in computing angular part g_ijk
-      ijk = 0;			// count number of angles
-      for (jj = 0; jj < atom->num_neigh - 1; ++jj) {
+      // Only angles inside the range of f are stored
+      for (ijk = 0; ijk < atom->num_angles; ++ijk) {
 
-	// Get pointer to neighbor jj
-	neigh_j = atom->neigh + jj;
-	for (kk = jj + 1; kk < atom->num_neigh; ++kk) {
+	// Store pointer to angular part (g)
+	angle = atom->angle_part + ijk;
 
-	  // Store pointer to angular part (g)
-	  angle = atom->angle_part + ijk;
+	// Get pointers to neighbors j and k
+	neigh_j = atom->neigh + angle->j;
+	neigh_k = atom->neigh + angle->k;
 
-	  // Get pointer to neighbor kk
-	  neigh_k = atom->neigh + kk;
+	// The cos(theta) should always lie inside -1 ... 1
+	// So store the g and g' without checking bounds
+	angle->g = splint_dir(pt, xi, angle->slot, angle->shift, angle->step);
 
-	  // The cos(theta) should always lie inside -1 ... 1
-	  // So store the g and g' without checking bounds
-	  angle->g = splint_dir(pt, xi, angle->slot, angle->shift, angle->step);
-
-	  // Sum up rho piece for atom i caused by j and k
-	  // f_ij * f_ik * m_ijk
-	  atom->rho += neigh_j->f * neigh_k->f * angle->g;
-	  ++ijk;
-	}			// END OF INNER LOOP OVER TRIPLETS
-      }				// END OF OUTER LOOP OVER TRIPLETS
+	// Sum up rho piece for atom i caused by j and k
+	// f_ij * f_ik * m_ijk
+	atom->rho += neigh_j->f * neigh_k->f * angle->g;
+      }				// END OF LOOP OVER TRIPLETS
     }				// END OF LOOP OVER ATOM i
 
     // BEGIN LOOP OVER EACH ATOM i FINDING MAX/MIN RHO
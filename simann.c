@@ -34,6 +34,7 @@
 
 #include <ctype.h>
 
+#include "checkpoint.h"
 #include "optimize.h"
 #include "potential.h"
 #include "utils.h"
@@ -123,6 +124,42 @@ void makebump(double *x, double width, double height, int center)
 
 #endif /* APOT */
 
+/****************************************************************
+ *
+ * void anneal_checkpoint(FILE *ckpt, ...);
+ *
+ * Reads or writes the annealing state from/to a checkpoint.
+ *
+ ****************************************************************/
+
+#ifdef APOT
+static void anneal_checkpoint(FILE *ckpt, int *k, int *m, double *T, double *F, double *Fopt,
+  double *Fvar, double *v, int *naccept, double *xopt)
+#else
+static void anneal_checkpoint(FILE *ckpt, int *k, int *m, double *T, double *F, double *Fopt,
+  double *Fvar, double *v, int *naccept, double *xopt, double *optbegin, double *optend,
+  double *optstep, double *optinvstep, double *optxcoord, int *rescaleMe)
+#endif /* APOT */
+{
+  checkpoint_data(ckpt, k, sizeof(int), 1);
+  checkpoint_data(ckpt, m, sizeof(int), 1);
+  checkpoint_data(ckpt, T, sizeof(double), 1);
+  checkpoint_data(ckpt, F, sizeof(double), 1);
+  checkpoint_data(ckpt, Fopt, sizeof(double), 1);
+  checkpoint_data(ckpt, Fvar, sizeof(double), KMAX + 5 + NEPS);
+  checkpoint_data(ckpt, v, sizeof(double), ndim);
+  checkpoint_data(ckpt, naccept, sizeof(int), ndim);
+  checkpoint_data(ckpt, xopt, sizeof(double), ndimtot);
+#ifndef APOT
+  checkpoint_data(ckpt, optbegin, sizeof(double), ntypes);
+  checkpoint_data(ckpt, optend, sizeof(double), ntypes);
+  checkpoint_data(ckpt, optstep, sizeof(double), ntypes);
+  checkpoint_data(ckpt, optinvstep, sizeof(double), ntypes);
+  checkpoint_data(ckpt, optxcoord, sizeof(double), ndimtot);
+  checkpoint_data(ckpt, rescaleMe, sizeof(int), 1);
+#endif /* !APOT */
+}
+
 /****************************************************************
  *
  * void anneal(double *x);
@@ -138,7 +175,9 @@ void anneal(double *xi)
   int   h = 0, j = 0, k = 0, n, m = 0;	/* counters */
   int   auto_T = 0;
   int   loopagain;		/* loop flag */
-#if defined(RESCALE) && !defined(APOT) && ( defined(EAM) || defined(ADP) ) || defined(MEAM)
+  int   m_start = 0;		/* first m of a resumed run */
+  int   resume = 0;		/* resumed from checkpoint */
+#ifndef APOT
   int   rescaleMe = 1;		/* rescaling flag */
 #endif /* APOT */
   double T = -1.0;		/* Temperature */
@@ -151,8 +190,13 @@ void anneal(double *xi)
   double width, height;		/* gaussian bump size */
 #endif /* APOT */
   FILE *ff;			/* exit flagfile */
+  FILE *ckpt;			/* checkpoint file */
   int  *naccept;		/* number of accepted changes in dir */
 
+  /* a restart in the powell stage skips annealing */
+  if (checkpoint_pending(CKPT_POWELL))
+    return;
+
   /* check for automatic temperature */
   if (tolower(anneal_temp[0]) == 'a') {
     auto_T = 1;
@@ -191,23 +235,38 @@ void anneal(double *xi)
     xi2[n] = xi[n];
     xopt[n] = xi[n];
   }
-  F = calc_forces(xi, fxi1, 0);
-  Fopt = F;
+  ckpt = checkpoint_resume(CKPT_ANNEAL);
+  if (NULL != ckpt) {
+#ifdef APOT
+    anneal_checkpoint(ckpt, &k, &m_start, &T, &F, &Fopt, Fvar, v, naccept, xopt);
+#else
+    anneal_checkpoint(ckpt, &k, &m_start, &T, &F, &Fopt, Fvar, v, naccept, xopt, optbegin,
+      optend, optstep, optinvstep, optxcoord, &rescaleMe);
+#endif /* APOT */
+    checkpoint_end(ckpt);
+    resume = 1;
+    auto_T = 0;
+  } else {
+    F = calc_forces(xi, fxi1, 0);
+    Fopt = F;
+  }
 #ifndef APOT
   // Need to save xcoord of this F potential because we use the
   // optimum potential in the future, and the current potential
   // could be rescaled differently from the optimum
-  col2 = 0;
-  for (col = paircol + ntypes; col < paircol + 2 * ntypes; ++col) {
-    optbegin[col2] = opt_pot.begin[col];
-    optend[col2] = opt_pot.end[col];
-    optstep[col2] = opt_pot.step[col];
-    optinvstep[col2] = opt_pot.invstep[col];
-
-    // Loop through each spline knot of F
-    for (n = opt_pot.first[col]; n <= opt_pot.last[col]; ++n)
-      optxcoord[n] = opt_pot.xcoord[n];
-    ++col2;
+  if (!resume) {
+    col2 = 0;
+    for (col = paircol + ntypes; col < paircol + 2 * ntypes; ++col) {
+      optbegin[col2] = opt_pot.begin[col];
+      optend[col2] = opt_pot.end[col];
+      optstep[col2] = opt_pot.step[col];
+      optinvstep[col2] = opt_pot.invstep[col];
+
+      // Loop through each spline knot of F
+      for (n = opt_pot.first[col]; n <= opt_pot.last[col]; ++n)
+	optxcoord[n] = opt_pot.xcoord[n];
+      ++col2;
+    }
   }
 #endif /* APOT */
   /* determine optimum temperature for annealing */
@@ -251,14 +310,16 @@ void anneal(double *xi)
   }
 
   printf("  k\tT        \t  m\tF          \tFopt\n");
-  printf("%3d\t%f\t%3d\t%f\t%f\n", 0, T, 0, F, Fopt);
+  printf("%3d\t%f\t%3d\t%f\t%f\n", k, T, m_start, F, Fopt);
   fflush(stdout);
-  for (n = 0; n <= NEPS; n++)
-    Fvar[n] = F;
+  if (!resume) {
+    for (n = 0; n <= NEPS; n++)
+      Fvar[n] = F;
+  }
 
   /* annealing loop */
   do {
-    for (m = 0; m < NTEMP; m++) {
+    for (m = m_start; m < NTEMP; m++) {
       for (j = 0; j < NSTEP; j++) {
 	for (h = 0; h < ndim; h++) {
 	  /* Step #1 */
@@ -309,10 +370,10 @@ void anneal(double *xi)
 	      Fopt = F2;
 	      if (*tempfile != '\0') {
 #ifndef APOT
-		write_pot_table(&opt_pot, tempfile);
+		write_pot_temp(&opt_pot, 0);
 #else
 		update_apot_table(xi);
-		write_pot_table(&apot_table, tempfile);
+		write_pot_temp(&apot_table, 0);
 #endif /* APOT */
 	      }
 	    }
@@ -366,7 +427,21 @@ void anneal(double *xi)
       }
 #endif /* !APOT && ( EAM || ADP || MEAM ) */
 #endif /* RESCALE */
+
+      /* save the annealing state for a restart */
+      if (checkpoint_due()) {
+	ckpt = checkpoint_begin(CKPT_ANNEAL);
+	n = m + 1;
+#ifdef APOT
+	anneal_checkpoint(ckpt, &k, &n, &T, &F, &Fopt, Fvar, v, naccept, xopt);
+#else
+	anneal_checkpoint(ckpt, &k, &n, &T, &F, &Fopt, Fvar, v, naccept, xopt, optbegin, optend,
+	  optstep, optinvstep, optxcoord, &rescaleMe);
+#endif /* APOT */
+	checkpoint_end(ckpt);
+      }
     }
+    m_start = 0;
 
     /*Temp adjustment */
     T *= TEMPVAR;
@@ -434,10 +509,10 @@ void anneal(double *xi)
 
   if (*tempfile != '\0') {
 #ifndef APOT
-    write_pot_table(&opt_pot, tempfile);
+    write_pot_temp(&opt_pot, 1);
 #else
     update_apot_table(xopt);
-    write_pot_table(&apot_table, tempfile);
+    write_pot_temp(&apot_table, 1);
 #endif /* APOT */
   }
 
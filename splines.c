@@ -249,6 +249,37 @@ double splint_grad_dir(pot_table_t *pt, double *xi, int k, double b, double step
   return (p2 - p1) / step + ((3 * (b * b) - 1) * d22 - (3 * (a * a) - 1) * d21) * step / 6.0;
 }
 
+/****************************************************************
+ *
+ * splint_comb_dir_v: spline interpolation of n values at once
+ *            (and of their gradients if grad is not NULL),
+ *            equidistant and non-eqd x[i], with known index positions
+ *
+ ****************************************************************/
+
+void splint_comb_dir_v(pot_table_t *pt, double *xi, int n, const int *k, const double *b,
+  const double *step, double *val, double *grad)
+{
+  int   i;
+  double a, p1, p2, d21, d22;
+
+  for (i = 0; i < n; i++) {
+    a = 1.0 - b[i];
+    p1 = xi[k[i]];
+    d21 = pt->d2tab[k[i]];
+    p2 = xi[k[i] + 1];
+    d22 = pt->d2tab[k[i] + 1];
+    if (NULL != grad)
+      grad[i] =
+	(p2 - p1) / step[i] + ((3 * (b[i] * b[i]) - 1) * d22 - (3 * (a * a) - 1) * d21) * step[i] / 6.0;
+    val[i] =
+      a * p1 + b[i] * p2 + ((a * a * a - a) * d21 + (b[i] * b[i] * b[i] - b[i]) * d22) * (step[i] *
+      step[i]) / 6.0;
+  }
+
+  return;
+}
+
 /****************************************************************
  *
  * spline_ne  : initializes second derivatives used for spline interpolation
@@ -38,6 +38,8 @@ double splint_comb_ed(pot_table_t *, double *, int, double, double *);
 double splint_dir(pot_table_t *, double *, int, double, double);
 double splint_comb_dir(pot_table_t *, double *, int, double, double, double *);
 double splint_grad_dir(pot_table_t *, double *, int, double, double);
+void  splint_comb_dir_v(pot_table_t *, double *, int, const int *, const double *, const double *,
+  double *, double *);
 void  spline_ne(double *, double *, int, double, double, double *);
 double splint_ne(pot_table_t *, double *, int, double);
 double splint_ne_lin(pot_table_t *, double *, int, double);
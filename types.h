@@ -96,6 +96,8 @@ typedef struct {
 #ifdef THREEBODY
 typedef struct {
   double cos;
+  int   j;			/* first neighbor of the angle */
+  int   k;			/* second neighbor of the angle */
 #ifdef MEAM
   int   slot;
   double shift;
@@ -119,6 +121,8 @@ typedef struct {
   double **gamma;
   double **a2;
   double ****lambda;
+  double *cut_3;		/* fixed threebody cutoff a2, 0 if fitted */
+  int  *skip_3;			/* triplets with a fixed zero lambda */
 } sw_t;
 #endif
 
@@ -143,6 +147,7 @@ typedef struct {
   double *c2;
   double *d2;
   double one;
+  double *cut_3;		/* fixed threebody cutoff S, 0 if fitted */
 } tersoff_t;
 #else
 /* pointers to access Tersoff parameters directly */
@@ -164,6 +169,7 @@ typedef struct {
   double **h;
   double **R1;
   double **R2;
+  double *cut_3;		/* fixed threebody cutoff R2, 0 if fitted */
 } tersoff_t;
 #endif /* !TERSOFFMOD */
 #endif /* TERSOFF */
@@ -233,10 +239,27 @@ typedef struct {
   int  *idx;			/* indirect indexing */
 } pot_table_t;
 
+/* force routine of an interaction model, see set_force_kernel() */
+typedef struct {
+  const char *name;		/* model name in the #T line of the potential file */
+  double (*calc_forces) (double *, double *, int);
+  int   embedding;		/* are there transfer and embedding functions? */
+} force_kernel_t;
+
 #ifdef APOT
 /* function pointer for analytic potential evaluation */
 typedef void (*fvalue_pointer) (double, double *, double *);
 
+/* function pointer for evaluating an analytic potential at many points */
+typedef void (*fvalue_batch_pointer) (const double *, int, const double *, double *);
+
+/* function pointer for evaluating an analytic potential and its derivative */
+typedef void (*fgrad_pointer) (double, double *, double *, double *);
+
+/* function pointers for the parameter constraints and punishments of a potential */
+typedef void (*fcheck_pointer) (double *);
+typedef double (*fpunish_pointer) (double *);
+
 typedef struct {
   /* potentials */
   int   number;			/* number of analytic potentials */
@@ -289,13 +312,20 @@ typedef struct {
   tersoff_t tersoff;
 #endif
 
+  int  *fid;			/* index of the function in function_table */
   fvalue_pointer *fvalue;	/* function pointers for analytic potentials */
+  fvalue_batch_pointer *fbatch;	/* batch versions of fvalue, NULL if there is none */
+  fgrad_pointer *fgrad;		/* fvalue with analytic derivative, NULL if there is none */
 } apot_table_t;
 
 typedef struct {
   char **name;			/* identifier of the potential */
   int  *n_par;			/* number of parameters */
   fvalue_pointer *fvalue;	/* function pointer */
+  fvalue_batch_pointer *fbatch;	/* batch function pointer, may be NULL */
+  fgrad_pointer *fgrad;		/* value and derivative function pointer, may be NULL */
+  fcheck_pointer *fcheck;	/* constraints for the parameters, may be NULL */
+  fpunish_pointer *fpunish;	/* punishment for bad parameters, may be NULL */
 } function_table_t;
 
 #endif /* APOT */
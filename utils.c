@@ -30,6 +30,8 @@
 
 #include "potfit.h"
 
+#include <ctype.h>
+#include <float.h>
 #include <stdint.h>
 
 /* 32-bit */
@@ -260,6 +262,8 @@ void init_neigh(neigh_t *neigh)
 void init_angle(angle_t * angle)
 {
   angle->cos = 0.0;
+  angle->j = 0;
+  angle->k = 0;
 
 #ifdef MEAM
   angle->slot = 0;
@@ -309,19 +313,127 @@ vector vec_prod(vector u, vector v)
   return w;
 }
 
+/****************************************************************
+ *
+ *  parse_double: fast replacement for strtod()
+ *
+ *  parse_double() gives the same result as strtod(). The decimal
+ *  mantissa and the power of ten are exact in double precision for
+ *  short numbers, then a single correctly rounded multiplication or
+ *  division gives the result. The 17 digits written by potfit are
+ *  converted the same way in x87 extended precision, unless the
+ *  result is too close to the midpoint of two doubles. All other
+ *  numbers are passed to strtod().
+ *
+ ****************************************************************/
+
+static const double pow10_tab[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* without SSE, double operations on x86 are rounded twice */
+#if FLT_EVAL_METHOD == 0
+#define PARSE_DOUBLE 1
+#else
+#define PARSE_DOUBLE 0
+#endif /* FLT_EVAL_METHOD == 0 */
+
+/* the x87 extended format stores the 64-bit mantissa in the first 8 bytes */
+#if LDBL_MANT_DIG == 64 && (defined __i386__ || defined __x86_64__)
+#define PARSE_X87
+#endif /* LDBL_MANT_DIG == 64 && x86 */
+
+#ifdef PARSE_X87
+static const long double pow10_tabl[] = {
+  1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L, 1e12L, 1e13L,
+  1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L,
+  1e26L, 1e27L
+};
+#endif /* PARSE_X87 */
+
+double parse_double(const char *str, char **end)
+{
+  int   neg = 0, ndig = 0, nexp = 0, e = 0, eneg = 0;
+  unsigned long long m = 0;
+  const char *p = str;
+  double x;
+#ifdef PARSE_X87
+  long double y;
+  unsigned long long low;
+#endif /* PARSE_X87 */
+
+  while (isspace((unsigned char)*p))
+    p++;
+  if ('-' == *p || '+' == *p)
+    neg = ('-' == *p++);
+  if (!isdigit((unsigned char)*p) && !('.' == *p && isdigit((unsigned char)p[1])))
+    return strtod(str, end);
+
+  while (isdigit((unsigned char)*p) && ndig < 20) {
+    if (m > 0 || '0' != *p)
+      ndig++;
+    m = 10 * m + (*p++ - '0');
+  }
+  if ('.' == *p) {
+    p++;
+    while (isdigit((unsigned char)*p) && ndig < 20) {
+      if (m > 0 || '0' != *p)
+	ndig++;
+      m = 10 * m + (*p++ - '0');
+      nexp--;
+    }
+  }
+  if (ndig > 19 || isdigit((unsigned char)*p))
+    return strtod(str, end);
+  if ('e' == *p || 'E' == *p) {
+    p++;
+    if ('-' == *p || '+' == *p)
+      eneg = ('-' == *p++);
+    if (!isdigit((unsigned char)*p))
+      return strtod(str, end);
+    while (isdigit((unsigned char)*p) && e < 1000)
+      e = 10 * e + (*p++ - '0');
+    nexp += eneg ? -e : e;
+  }
+  if (isalnum((unsigned char)*p) || '.' == *p)
+    return strtod(str, end);
+
+  if (PARSE_DOUBLE && m <= (1ULL << 53) && nexp >= -22 && nexp <= 22) {
+    x = (nexp < 0) ? (double)m / pow10_tab[-nexp] : (double)m * pow10_tab[nexp];
+#ifdef PARSE_X87
+  } else if (nexp >= -27 && nexp <= 27) {
+    y = (nexp < 0) ? (long double)m / pow10_tabl[-nexp] : (long double)m * pow10_tabl[nexp];
+    /* the lowest 11 of 64 bits decide the rounding to 53 bits */
+    memcpy(&low, &y, sizeof(low));
+    low &= 0x7ff;
+    if (low >= 0x3ff && low <= 0x401)
+      return strtod(str, end);
+    x = (double)y;
+#endif /* PARSE_X87 */
+  } else
+    return strtod(str, end);
+
+  *end = (char *)p;
+
+  return neg ? -x : x;
+}
+
 /****************************************************************
  *
  *  double normdist(): Returns a normally distributed random variable
  *
  ****************************************************************/
 
+/* second value of the last Box Muller transformation */
+static int nd_have = 0;
+static double nd2;
+
 double normdist()
 {
-  static int have = 0;
-  static double nd2;
   double x1, x2, sqr, cnst;
 
-  if (!(have)) {
+  if (!(nd_have)) {
     do {
       x1 = 2.0 * eqdist() - 1.0;
       x2 = 2.0 * eqdist() - 1.0;
@@ -330,14 +442,32 @@ double normdist()
     /* Box Muller Transformation */
     cnst = sqrt(-2.0 * log(sqr) / sqr);
     nd2 = x2 * cnst;
-    have = 1;
+    nd_have = 1;
     return x1 * cnst;
   } else {
-    have = 0;
+    nd_have = 0;
     return nd2;
   }
 }
 
+/****************************************************************
+ *
+ *  get/set the cached value of normdist() for checkpoints
+ *
+ ****************************************************************/
+
+void get_normdist_state(int *have, double *val)
+{
+  *have = nd_have;
+  *val = nd2;
+}
+
+void set_normdist_state(int have, double val)
+{
+  nd_have = have;
+  nd2 = val;
+}
+
 /****************************************************************
  *
  *  higher powers in one and more dimensions
@@ -380,6 +510,33 @@ void power_m(int dim, double *result, double *x, double *y)
 #endif /* _32BIT */
 }
 
+/****************************************************************
+ *
+ *  exponential function in more dimensions
+ *
+ ****************************************************************/
+
+void exp_m(int dim, double *result, double *x)
+{
+#ifdef _32BIT
+  int   i = 0;
+  for (i = 0; i < dim; i++)
+    result[i] = exp(x[i]);
+#else
+#ifndef ACML
+  vdExp(dim, x, result);
+#elif defined ACML4
+  int   i;
+  for (i = 0; i < dim; i++)
+    *(result + i) = fastexp(*(x + i));
+#elif defined ACML5
+  int   i;
+  for (i = 0; i < dim; i++)
+    *(result + i) = exp(*(x + i));
+#endif /* ACML */
+#endif /* _32BIT */
+}
+
 #if defined APOT && defined EVO
 
 /****************************************************************
@@ -53,15 +53,21 @@ void  free_all_pointers();
 /* vector procuct */
 vector vec_prod(vector, vector);
 
+/* strtod() with a fast path for short numbers */
+double parse_double(const char *, char **);
+
 /* pRNG with equal or normal distribution */
 static inline double eqdist() { return dsfmt_genrand_close_open(&dsfmt); }
 double normdist();
+void  get_normdist_state(int *, double *);
+void  set_normdist_state(int, double);
 
 /* different power functions */
 static inline int isquare(int a) { return a*a; }
 static inline double dsquare(double a) { return a*a; }
 void  power_1(double *, double *, double *);
 void  power_m(int, double *, double *, double *);
+void  exp_m(int, double *, double *);
 
 #if defined APOT && defined EVO
 /* quicksort for ODE */